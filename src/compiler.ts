@@ -1,15 +1,15 @@
-import { SystemOp } from './types';
-import iconv from 'iconv-lite';
+import { Op, SystemOp } from './types';
+import { decodeGbk, encodeGbk, normalizeToGbk } from './lav/gbk';
 import { LavaXAssembler } from './compiler/LavaXAssembler';
+import { LavaXTokenStream, lineIndexAt, lineStartOffsets } from './compiler/LavaXLexer';
+import { evalConstExpr, expandMacros } from './compiler/LavaXConstExpr';
+import { encodeIr, formatIr, GENERATED_LABEL, irOp, irRef, type IrNode } from './compiler/LavaXIR';
+import { defaultOptimizerRules, emptyOptimizerStats, optimizeIr, type OptimizerRules, type OptimizerStats } from './compiler/LavaXOptimizer';
+import { LavLineMapBuilder, type LavLineMap } from './lav/lineMap';
 import { SYSCALL_MAP } from './vm/SyscallMetadata';
 
 function encodeToGBK(str: string): number[] {
-  try {
-    const buf = iconv.encode(str, 'gbk');
-    return Array.from(buf);
-  } catch (e) {
-    return Array.from(str).map(c => c.charCodeAt(0) & 0xFF);
-  }
+  return Array.from(encodeGbk(str));
 }
 function unescapeString(str: string): string {
   return str.replace(/\\n/g, '\n')
@@ -20,6 +20,23 @@ function unescapeString(str: string): string {
 }
 
 
+export interface CompileToLavOptions {
+  strictOfficial?: boolean;
+  /** Also return the textual assembly listing. */
+  listing?: boolean;
+  /** Also return a PC-to-source-line map. */
+  lineMap?: boolean;
+}
+
+export interface CompileToLavResult {
+  /** The encoded program; absent when compilation failed. */
+  lav?: Uint8Array;
+  listing?: string;
+  lineMap?: LavLineMap;
+  /** `ERROR: ...` message, as compile() would return it. */
+  error?: string;
+}
+
 interface Variable {
   offset: number;
   type: string; // 'int', 'char', 'long', 'void', 'addr'
@@ -42,9 +59,60 @@ interface StructDef {
   totalSize: number;
 }
 
+/** Generated code for one function definition, reusable while its text and the symbols it sees are unchanged. */
+interface CachedFunction {
+  /** Definition text, from the return type through the closing brace. */
+  text: string;
+  /** Symbol-table fingerprint the body was generated against. */
+  symbols: string;
+  /** Source offset of the definition when `nodes` was generated. */
+  start: number;
+  /** First generated label number, and how many the function used. */
+  labelBase: number;
+  labelCount: number;
+  /** IR before the peephole pass. */
+  nodes: IrNode[];
+}
+
+/** Preprocessor output for one #include, reusable while its inputs are unchanged. */
+interface CachedInclude {
+  content: string;
+  /** Macro set on entry and the include stack, serialized. */
+  definesIn: string;
+  visited: string;
+  /** Nested includes read while expanding, with what the resolver returned. */
+  deps: Array<[string, string | null]>;
+  lines: string[];
+  map: Array<{file: string; line: number}>;
+  /** Macro set on exit. */
+  definesOut: Array<[string, string]>;
+}
+
+// Expansions kept per include file name (different macro sets or contents).
+const INCLUDE_CACHE_VARIANTS = 4;
+
+// Switches with at least this many distinct cases bisect; search leaves
+// compare up to SWITCH_TREE_LEAF_CASES values in turn.
+const SWITCH_TREE_MIN_CASES = 6;
+const SWITCH_TREE_LEAF_CASES = 3;
+
 export class LavaXCompiler {
   /** Optional resolver for #include directives. Return file content as string, or null if not found. */
   public includeResolver: ((filename: string) => string | null) | null = null;
+  /**
+   * Keep generated code per function between compiles (for the editor, which
+   * recompiles the same buffer on every change). Functions whose text and
+   * visible symbols are unchanged are relinked instead of re-parsed.
+   */
+  public incremental = false;
+  /** Optimizer rules to run; all on by default (see LavaXOptimizer). */
+  public optimizations: OptimizerRules = defaultOptimizerRules();
+  /** Dispatch larger switches through a binary search over the case values (off: compare each case in turn). */
+  public switchTrees = true;
+  /** Functions generated and reused by the last compile (reuse only counts when `incremental`). */
+  public lastCompileStats = { functions: 0, reused: 0 };
+  /** How often each optimizer rule fired in the last compile. */
+  public lastOptimizerStats: OptimizerStats = emptyOptimizerStats();
 
   /**
    * Full C preprocessor: handles #define, #undef, #include, #ifdef, #ifndef,
@@ -65,19 +133,12 @@ export class LavaXCompiler {
     let emitting = true;
 
     const evalBool = (expr: string): boolean => {
-      let expanded = expr
+      const resolved = expr
         .replace(/\bdefined\s*\(\s*(\w+)\s*\)/g, (_, n: string) => defines.has(n) ? '1' : '0')
         .replace(/\bdefined\s+(\w+)/g, (_, n: string) => defines.has(n) ? '1' : '0');
-      let limit = 20;
-      while (limit-- > 0) {
-        let changed = false;
-        expanded = expanded.replace(/\b([a-zA-Z_]\w*)\b/g, (m) => {
-          if (defines.has(m)) { changed = true; return defines.get(m)!; }
-          return m;
-        });
-        if (!changed) break;
-      }
-      try { return !!new Function(`return (${expanded});`)(); } catch { return false; }
+      // Names still undefined after expansion count as 0, as in C.
+      const value = evalConstExpr(expandMacros(resolved, defines, 20), true);
+      return !Number.isNaN(value) && value !== 0;
     };
 
     // Push one output line and its source-map entry together
@@ -150,17 +211,12 @@ export class LavaXCompiler {
             } else if (visited.has(incFilename)) {
               pushLine(`// #include "${incFilename}" (circular, skipped)`, origLine);
             } else {
-              const content = this.includeResolver(incFilename);
+              const content = this.resolveInclude(incFilename);
               if (content === null) {
                 pushLine(`// #include "${incFilename}" (not found)`, origLine);
               } else {
-                visited.add(incFilename);
-                // Recursive call appends to this.preprocessorMap directly as a side effect.
-                // We spread the expanded lines individually so outputLines and preprocessorMap stay 1:1.
-                const expanded = this.runPreprocessor(content, incFilename, visited, defines);
-                outputLines.push(...expanded.split('\n'));
-                // Note: map entries for included lines were already appended by the recursive call
-                visited.delete(incFilename);
+                // Included lines and their map entries are appended together, so outputLines and preprocessorMap stay 1:1.
+                outputLines.push(...this.expandInclude(content, incFilename, visited, defines));
               }
             }
           } else {
@@ -177,18 +233,64 @@ export class LavaXCompiler {
     return outputLines.join('\n');
   }
 
-  // Ensure source is interpreted as GBK: encode -> decode via GBK to coerce codepoints
-  private normalizeSourceToGBK(source: string): string {
+  /** includeResolver, recording the lookup for every include being expanded. */
+  private resolveInclude(filename: string): string | null {
+    const content = this.includeResolver!(filename);
+    for (const deps of this.includeDeps) deps.push([filename, content]);
+    return content;
+  }
+
+  /**
+   * Preprocesses an included file into lines, appending its preprocessorMap
+   * entries and updating `defines`. The result depends only on the file's
+   * text, the macros defined on entry, the include stack and what nested
+   * includes resolve to, so it is cached on exactly those.
+   */
+  private expandInclude(content: string, filename: string, visited: Set<string>, defines: Map<string, string>): string[] {
+    const definesIn = JSON.stringify([...defines]);
+    const visitedKey = [...visited].join('\0');
+    const variants = this.includeCache.get(filename) ?? [];
+    const hit = variants.find(entry => entry.content === content && entry.definesIn === definesIn && entry.visited === visitedKey
+      && entry.deps.every(([name, text]) => this.includeResolver!(name) === text));
+    if (hit) {
+      for (const deps of this.includeDeps) deps.push(...hit.deps);
+      for (const entry of hit.map) this.preprocessorMap.push(entry);
+      defines.clear();
+      for (const [name, value] of hit.definesOut) defines.set(name, value);
+      return hit.lines;
+    }
+
+    const mapStart = this.preprocessorMap.length;
+    const deps: Array<[string, string | null]> = [];
+    this.includeDeps.push(deps);
+    visited.add(filename);
+    let lines: string[];
     try {
-      const buf = iconv.encode(source, 'gbk');
-      return iconv.decode(buf, 'gbk');
-    } catch (e) {
-      return source;
+      lines = this.runPreprocessor(content, filename, visited, defines).split('\n');
+    } finally {
+      visited.delete(filename);
+      this.includeDeps.pop();
     }
+    variants.unshift({
+      content, definesIn, visited: visitedKey, deps, lines,
+      map: this.preprocessorMap.slice(mapStart),
+      definesOut: [...defines],
+    });
+    if (variants.length > INCLUDE_CACHE_VARIANTS) variants.pop();
+    this.includeCache.set(filename, variants);
+    return lines;
+  }
+
+  // Ensure source is interpreted as GBK: encode -> decode via GBK to coerce codepoints
+  private normalizeSourceToGBK(source: string): string {
+    return normalizeToGbk(source);
   }
   private src: string = "";
   private pos: number = 0;
-  private asm: string[] = [];
+  private tokens: LavaXTokenStream = new LavaXTokenStream('');
+  /** Start offset of each line of the preprocessed source. */
+  private lineStarts: Int32Array = new Int32Array(1);
+  private asm: IrNode[] = [];
   private labelCount = 0;
   private globals: Map<string, Variable> = new Map();
   private locals: Map<string, Variable> = new Map();
@@ -198,10 +300,18 @@ export class LavaXCompiler {
   private breakLabels: string[] = [];
   private continueLabels: string[] = [];
   private defines: Map<string, string> = new Map();
-  private initializers: string[] = [];
+  private initializers: IrNode[] = [];
   private structs: Map<string, StructDef> = new Map();
   /** Maps each line (0-based) in the preprocessed source to its original file/line. */
   private preprocessorMap: Array<{file: string; line: number}> = [];
+  private functionCache = new Map<string, CachedFunction>();
+  private includeCache = new Map<string, CachedInclude[]>();
+  /** Lookup logs of the includes currently being expanded, outermost first. */
+  private includeDeps: Array<Array<[string, string | null]>> = [];
+  private cacheSeen = new Set<string>();
+  /** Fingerprint of everything a function body can see besides its own text. */
+  private symbolKey = '';
+  private prescanKey = '';
 
   private getTypeSize(type: string): number {
     if (type === 'char') return 1;
@@ -224,10 +334,10 @@ export class LavaXCompiler {
     for (let index = 0; index < values.length; index++) {
       this.pushLiteral(values[index] & 0xFF);
       // Pre-computed handle: (offset + index) | HANDLE_TYPE_BYTE | HANDLE_BASE_EBP
-      this.asm.push(`PUSH_D ${(offset + index) | 0x10000 | 0x800000}`);
-      this.asm.push('SWAP');
-      this.asm.push('STORE');
-      this.asm.push('POP');
+      this.emit(Op.PUSH_D, (offset + index) | 0x10000 | 0x800000);
+      this.emit(Op.SWAP);
+      this.emit(Op.STORE);
+      this.emit(Op.POP);
     }
   }
 
@@ -326,40 +436,15 @@ export class LavaXCompiler {
     return { bytes, topLevelCount };
   }
 
+  /** Value of a constant expression after macro expansion; NaN if it is not constant. */
   private evalConstant(expr: string): number {
-    // 1. Recursive macro expansion
-    let expanded = expr;
-    let limit = 100;
-    while (limit-- > 0) {
-      let changed = false;
-      // Find identifiers
-      expanded = expanded.replace(/[a-zA-Z_]\w*/g, (match) => {
-        if (this.defines.has(match)) {
-          changed = true;
-          return this.defines.get(match)!;
-        }
-        return match;
-      });
-      if (!changed) break;
-    }
-
-    // 2. Evaluate
-    try {
-      // Safety check: only allow digits, operators, parens, spaces, hex
-      // We allow \w for hex (0x...) and identifiers that might be valid (e.g. true/false if supported, or unexpanded)
-      // But strictly we should probably limit it.
-      // For now, let's try to eval.
-      return new Function(`return (${expanded});`)();
-    } catch (e) {
-      return NaN;
-    }
+    return evalConstExpr(expandMacros(expr, this.defines, 100));
   }
 
   private getLineInfo(pos: number): {file: string; line: number; col: number} {
-    const before = this.src.substring(0, pos);
-    const linesBefore = before.split('\n');
-    const lineIdx = linesBefore.length - 1; // 0-based index into expanded source
-    const col = linesBefore[lineIdx].length + 1;
+    pos = Math.min(pos, this.src.length);
+    const lineIdx = lineIndexAt(this.lineStarts, pos); // 0-based index into expanded source
+    const col = pos - this.lineStarts[lineIdx] + 1;
     if (lineIdx < this.preprocessorMap.length) {
       const entry = this.preprocessorMap[lineIdx];
       return {file: entry.file, line: entry.line, col};
@@ -369,7 +454,34 @@ export class LavaXCompiler {
 
   private _compileFilename: string = '';
 
+  /** Compiles to textual assembly, or returns an `ERROR: ...` message. */
   compile(source: string | Buffer, filename: string = ''): string {
+    return this.generate(source, filename) ?? formatIr(this.asm);
+  }
+
+  /**
+   * Compiles straight to a .lav image without going through assembly text.
+   * The listing (same text compile() returns) is only built when asked for.
+   */
+  compileToLav(source: string | Buffer, filename: string = '', options: CompileToLavOptions = {}): CompileToLavResult {
+    const error = this.generate(source, filename);
+    if (error !== null) return { error };
+    const listing = options.listing ? formatIr(this.asm) : undefined;
+    const lineMap = options.lineMap ? new LavLineMapBuilder() : undefined;
+    const onLocation = lineMap && ((pc: number, pos: number) => {
+      const { file, line } = this.getLineInfo(pos);
+      lineMap.add(pc, file, line);
+    });
+    try {
+      const lav = encodeIr(this.asm, { strictOfficial: options.strictOfficial, onLocation });
+      return { lav, listing, lineMap: lineMap?.build() };
+    } catch (e: any) {
+      return { error: `ERROR: ${e.message}`, listing };
+    }
+  }
+
+  /** Parses and generates code into `this.asm`; returns an error message or null. */
+  private generate(source: string | Buffer, filename: string): string | null {
     this._compileFilename = filename;
     // Accept either a string or a Buffer. If Buffer, detect encoding.
     if (Buffer.isBuffer(source)) {
@@ -381,10 +493,10 @@ export class LavaXCompiler {
           this.src = this.normalizeSourceToGBK(tryUtf8);
         } else {
           // Treat as GBK
-          this.src = iconv.decode(buf, 'gbk');
+          this.src = decodeGbk(buf);
         }
       } catch (e) {
-        this.src = iconv.decode(buf, 'gbk');
+        this.src = decodeGbk(buf);
       }
     } else {
       // source is string
@@ -393,6 +505,9 @@ export class LavaXCompiler {
     // Expand preprocessor directives (#include, #ifdef, #define, etc.)
     this.preprocessorMap = [];
     this.src = this.runPreprocessor(this.src, this._compileFilename);
+    // Incremental compiles skip unchanged function bodies, so only lex what the parser visits.
+    this.tokens = new LavaXTokenStream(this.src, !this.incremental);
+    this.lineStarts = lineStartOffsets(this.src);
     this.pos = 0;
     this.asm = [];
     this.labelCount = 0;
@@ -596,7 +711,7 @@ export class LavaXCompiler {
                 const bytes = encodeToGBK(strRaw);
                 if (size === 0) size = bytes.length + 1;
                 // Save INIT for global string
-                this.initializers.push(`INIT ${this.globalOffset} ${bytes.length + 1} ${bytes.join(' ')} 0`);
+                this.initializers.push({ kind: 'init', addr: this.globalOffset, data: Uint8Array.from([...bytes, 0]) });
                 this.parseToken(); // consume string
               } else if (initializer === '{') {
                 let values: number[] = [];
@@ -627,7 +742,7 @@ export class LavaXCompiler {
                       byteValues.push(v & 0xFF, (v >> 8) & 0xFF, (v >> 16) & 0xFF, (v >> 24) & 0xFF);
                     }
                   }
-                  this.initializers.push(`INIT ${this.globalOffset} ${byteValues.length} ${byteValues.join(' ')}`);
+                  this.initializers.push({ kind: 'init', addr: this.globalOffset, data: Uint8Array.from(byteValues) });
                 }
               } else {
                 const firstTok = this.parseToken();
@@ -641,9 +756,8 @@ export class LavaXCompiler {
                   val = this.evalConstant(firstTok);
                 }
                 if (!isNaN(val)) {
-                  if (elementSize === 1) this.initializers.push(`INIT ${this.globalOffset} 1 ${val & 0xFF}`);
-                  else if (elementSize === 2) this.initializers.push(`INIT ${this.globalOffset} 2 ${val & 0xFF} ${(val >> 8) & 0xFF}`);
-                  else this.initializers.push(`INIT ${this.globalOffset} 4 ${val & 0xFF} ${(val >> 8) & 0xFF} ${(val >> 16) & 0xFF} ${(val >> 24) & 0xFF}`);
+                  const data = elementSize === 1 ? [val] : elementSize === 2 ? [val, val >> 8] : [val, val >> 8, val >> 16, val >> 24];
+                  this.initializers.push({ kind: 'init', addr: this.globalOffset, data: Uint8Array.from(data) });
                 }
               }
             }
@@ -657,18 +771,28 @@ export class LavaXCompiler {
         this.match(';');
       }
       this.pos = tempPos;
+      if (this.incremental) {
+        this.updateSymbolKey();
+        this.cacheSeen.clear();
+      }
+      this.lastCompileStats = { functions: 0, reused: 0 };
 
-      this.asm.push(`SPACE ${this.globalOffset}`);
+      this.emit(Op.SPACE, this.globalOffset);
       this.asm.push(...this.initializers);
       // Main function is the entry point - use JMP not CALL
       // because main should not return, it should exit directly
-      this.asm.push('JMP main');
+      this.emitJump(Op.JMP, 'main');
 
       while (this.pos < this.src.length) {
         this.skipWhitespace();
         if (this.pos >= this.src.length) break;
         this.parseTopLevel();
       }
+      if (this.incremental) {
+        for (const name of this.functionCache.keys()) {
+          if (!this.cacheSeen.has(name)) this.functionCache.delete(name);
+        }
+      }
     } catch (e: any) {
       const info = this.getLineInfo(this.pos);
       const locationStr = `${info.file || 'source'}:${info.line}:${info.col}`;
@@ -683,44 +807,26 @@ export class LavaXCompiler {
       return `ERROR: ${e.message} at ${locationStr}\nContext: ${context}\n         ${pointer}`;
     }
     this.peepholeOptimize();
-    return this.asm.join('\n');
+    return null;
   }
 
-  // Peephole optimizer: combine PUSH_B/W + OP → OP_C patterns
+  // Runs after the function cache took its copy of the unoptimized code.
   private peepholeOptimize() {
-    const comboOps = new Set(['ADD', 'SUB', 'MUL', 'DIV', 'MOD', 'SHL', 'SHR', 'EQ', 'NEQ', 'GT', 'LT', 'GE', 'LE']);
-    const result: string[] = [];
-    for (let i = 0; i < this.asm.length; i++) {
-      const line = this.asm[i];
-      if (i + 1 < this.asm.length && (line.startsWith('PUSH_B ') || line.startsWith('PUSH_W '))) {
-        const nextLine = this.asm[i + 1];
-        if (comboOps.has(nextLine)) {
-          const val = parseInt(line.split(' ')[1], 10);
-          if (val >= -32768 && val <= 32767) {
-            result.push(`${nextLine}_C ${val}`);
-            i++; // skip the OP
-            continue;
-          }
-        }
-      }
-      result.push(line);
-    }
-    this.asm = result;
+    this.lastOptimizerStats = emptyOptimizerStats();
+    this.asm = optimizeIr(this.asm, this.optimizations, this.lastOptimizerStats);
   }
 
   private peekToken(): string {
-    const oldPos = this.pos;
-    const token = this.parseToken();
-    this.pos = oldPos;
-    return token;
+    return this.tokens.texts[this.tokens.at(this.pos)];
   }
 
   private match(str: string) {
-    this.skipWhitespace();
-    if (this.peekToken() === str) {
-      this.parseToken();
+    const token = this.tokens.at(this.pos);
+    if (this.tokens.texts[token] === str) {
+      this.pos = this.tokens.ends[token];
       return true;
     }
+    this.pos = this.tokens.starts[token];
     return false;
   }
 
@@ -729,78 +835,17 @@ export class LavaXCompiler {
   }
 
   private skipWhitespace() {
-    while (this.pos < this.src.length) {
-      const c = this.src[this.pos];
-      if (/\s/.test(c)) { this.pos++; continue; }
-      if (this.src.startsWith('//', this.pos)) {
-        while (this.pos < this.src.length && this.src[this.pos] !== '\n') this.pos++;
-        continue;
-      }
-      if (this.src.startsWith('/*', this.pos)) {
-        this.pos += 2;
-        while (this.pos < this.src.length && !this.src.startsWith('*/', this.pos)) this.pos++;
-        this.pos += 2;
-        continue;
-      }
-      break;
-    }
+    this.pos = this.tokens.starts[this.tokens.at(this.pos)];
   }
 
   private parseToken(): string {
-    this.skipWhitespace();
-    const start = this.pos;
-    if (this.pos >= this.src.length) return "";
-
-    if (this.src[this.pos] === '"') {
-      this.pos++;
-      while (this.pos < this.src.length && this.src[this.pos] !== '"') {
-        if (this.src[this.pos] === '\\') this.pos++;
-        this.pos++;
-      }
-      this.pos++;
-      return this.src.substring(start, this.pos);
-    }
-
-    // Handle character literals (single quotes)
-    if (this.src[this.pos] === "'") {
-      this.pos++;
-      while (this.pos < this.src.length && this.src[this.pos] !== "'") {
-        if (this.src[this.pos] === '\\') this.pos++;
-        this.pos++;
-      }
-      this.pos++;
-      return this.src.substring(start, this.pos);
-    }
-
-    const special = "(){}[],;=+-*/%><!&|^~#.";
-    if (special.includes(this.src[this.pos])) {
-      let op = this.src[this.pos++];
-      if (op === '<' && this.src[this.pos] === '<') {
-        op += this.src[this.pos++];
-        if (this.src[this.pos] === '=') op += this.src[this.pos++];
-      }
-      else if (op === '>' && this.src[this.pos] === '>') {
-        op += this.src[this.pos++];
-        if (this.src[this.pos] === '=') op += this.src[this.pos++];
-      }
-      else if ((op === '=' || op === '!' || op === '<' || op === '>') && this.src[this.pos] === '=') op += this.src[this.pos++];
-      else if ((op === '&' || op === '|') && this.src[this.pos] === op) {
-        op += this.src[this.pos++];
-        if (this.src[this.pos] === '=') op += this.src[this.pos++];
-      }
-      else if ((op === '+' || op === '-') && this.src[this.pos] === op) op += this.src[this.pos++];
-      else if (op === '-' && this.src[this.pos] === '>') op += this.src[this.pos++];
-      else if ("+-*/%&|^!".includes(op) && this.src[this.pos] === '=') op += this.src[this.pos++];
-      return op;
-    }
-
-    while (this.pos < this.src.length && !/\s/.test(this.src[this.pos]) && !special.includes(this.src[this.pos])) {
-      this.pos++;
-    }
-    return this.src.substring(start, this.pos);
+    const token = this.tokens.at(this.pos);
+    this.pos = this.tokens.ends[token];
+    return this.tokens.texts[token];
   }
 
   private parseTopLevel() {
+    const defStart = this.pos;
     let type = this.parseToken();
     if (!type) return;
 
@@ -840,6 +885,8 @@ export class LavaXCompiler {
             pointerDepth: 0
           });
           this.globalOffset += structDef.totalSize;
+          // Later functions see this global; key their cached code on it.
+          if (this.incremental) this.symbolKey += `|${varName}:${structName}@${this.globals.get(varName)!.offset}`;
         }
         this.match(';');
       }
@@ -883,8 +930,19 @@ export class LavaXCompiler {
       if (this.match(';')) return;
 
       this.expect('{');
-      this.asm.push('F_FLAG');
-      this.asm.push(`${name}:`);
+      this.lastCompileStats.functions++;
+      if (this.incremental) {
+        this.cacheSeen.add(name);
+        if (this.relinkCachedFunction(name, defStart)) {
+          this.lastCompileStats.reused++;
+          return;
+        }
+      }
+      const asmStart = this.asm.length;
+      const labelBase = this.labelCount;
+      this.asm.push({ kind: 'loc', pos: this.pos });
+      this.emit('F_FLAG');
+      this.emitLabel(name);
       this.localOffset = 5;
       this.locals.clear();
       params.forEach((p, i) => {
@@ -897,8 +955,8 @@ export class LavaXCompiler {
         this.locals.set(p.name, { offset: 5 + i * 4, type: p.type, size: 1, pointerDepth: (p as any).pointerDepth || 0 });
         this.localOffset += 4;
       });
-      const localSizePos = this.asm.length;
-      this.asm.push('REPLACE_ME_FUNC');
+      const funcInsn = { kind: 'func' as const, frameSize: 0, argCount: params.length };
+      this.asm.push(funcInsn);
       const prevLocalOffset = this.localOffset;
       this.parseBlock();
       const localVarsSize = this.localOffset - prevLocalOffset;
@@ -906,25 +964,37 @@ export class LavaXCompiler {
       // Frame layout: [0-2] saved PC, [3-4] saved BASE, [5+] params, [5+params*4+] locals
       // frameSize must cover: 5 (header) + params*4 (arguments) + localVarsSize
       const frameSize = 5 + (params.length * 4) + localVarsSize;
-      this.asm[localSizePos] = `FUNC ${frameSize} ${params.length}`;
+      funcInsn.frameSize = frameSize;
 
       // For main function (void main), we should use EXIT not RET
       // because there's nowhere to return to
       if (name === 'main') {
         // Main should exit directly, not return
         // If there's no explicit return, add EXIT
-        const lastInsn = this.asm[this.asm.length - 1].trim();
-        if (!lastInsn.startsWith('RET') && !lastInsn.startsWith('EXIT')) {
-          this.asm.push('EXIT');
+        let last = this.asm.length - 1;
+        while (this.asm[last].kind === 'loc') last--;
+        const lastInsn = this.asm[last];
+        if (lastInsn.kind !== 'op' || (lastInsn.def.opcode !== Op.RET && lastInsn.def.opcode !== Op.EXIT)) {
+          this.emit(Op.EXIT);
         }
       } else {
         if (type !== 'void') {
-          this.asm.push('PUSH_B 0');
+          this.emit(Op.PUSH_B, 0);
         }
-        this.asm.push('RET');
+        this.emit(Op.RET);
       }
       this.locals = new Map();
       this.localOffset = 0;
+      if (this.incremental) {
+        this.functionCache.set(name, {
+          text: this.src.substring(defStart, this.pos),
+          symbols: this.symbolKey,
+          start: defStart,
+          labelBase,
+          labelCount: this.labelCount - labelBase,
+          nodes: this.asm.slice(asmStart),
+        });
+      }
     } else {
       // Global already handled in pre-scan, but let's skip it and its initializer
       let depth = 0;
@@ -940,6 +1010,54 @@ export class LavaXCompiler {
       }
     }
   }
+  private updateSymbolKey() {
+    const key = JSON.stringify([
+      [...this.globals],
+      [...this.functions],
+      [...this.structs].map(([name, def]) => [name, def.totalSize, [...def.members]]),
+      [...this.defines],
+    ]);
+    // Keep the previous string when nothing changed so cache checks compare by identity.
+    if (key !== this.prescanKey) this.prescanKey = key;
+    this.symbolKey = this.prescanKey;
+  }
+
+  /**
+   * Appends the cached code for a function if its definition text at `defStart`
+   * and the symbols it sees match; generated labels and source offsets are
+   * shifted to where the function now sits. Leaves `pos` after the body.
+   */
+  private relinkCachedFunction(name: string, defStart: number): boolean {
+    const cached = this.functionCache.get(name);
+    if (!cached || cached.symbols !== this.symbolKey || !this.src.startsWith(cached.text, defStart)) return false;
+    const labelShift = this.labelCount - cached.labelBase;
+    const posShift = defStart - cached.start;
+    if (labelShift !== 0 || posShift !== 0) {
+      const { labelBase, labelCount } = cached;
+      const relabel = (label: string) => {
+        const match = GENERATED_LABEL.exec(label);
+        if (!match) return label;
+        const n = Number(match[1]);
+        if (n < labelBase || n >= labelBase + labelCount) return label;
+        return label.slice(0, label.length - match[1].length) + (n + labelShift);
+      };
+      cached.nodes = cached.nodes.map(node => {
+        switch (node.kind) {
+          case 'label': return labelShift ? { kind: 'label', name: relabel(node.name) } : node;
+          case 'ref': return labelShift ? { kind: 'ref', def: node.def, label: relabel(node.label) } : node;
+          case 'loc': return posShift ? { kind: 'loc', pos: node.pos + posShift } : node;
+          default: return node;
+        }
+      });
+      cached.start = defStart;
+      cached.labelBase = this.labelCount;
+    }
+    for (const node of cached.nodes) this.asm.push(node);
+    this.labelCount += cached.labelCount;
+    this.pos = defStart + cached.text.length;
+    return true;
+  }
+
   private parseBlock() {
     while (this.pos < this.src.length) {
       this.skipWhitespace();
@@ -961,10 +1079,11 @@ export class LavaXCompiler {
       this.parseToken();
       return;
     }
+    this.asm.push({ kind: 'loc', pos: this.pos });
 
     if (token.endsWith(':')) {
       this.parseToken();
-      this.asm.push(token);
+      this.emitLabel(token.slice(0, -1));
       return;
     }
 
@@ -1099,13 +1218,13 @@ export class LavaXCompiler {
               if (pointerDepth > 0) handleType = 0x40000;
               else if (token === 'int') handleType = 0x20000;
               else if (token === 'long' || token === 'addr') handleType = 0x40000;
-              this.asm.push(`PUSH_D ${offset | handleType | 0x800000}`);
-              this.asm.push('SWAP');
+              this.emit(Op.PUSH_D, offset | handleType | 0x800000);
+              this.emit(Op.SWAP);
 
               // 3. Store
-              this.asm.push('STORE');
+              this.emit(Op.STORE);
               // 4. Pop result of store (which is the value)
-              this.asm.push('POP');
+              this.emit(Op.POP);
             }
 
             // We have handled initialization, so we don't need the generic assignment parsing below
@@ -1126,21 +1245,21 @@ export class LavaXCompiler {
           // We use PUSH_W + PUSH_D 0x800000 + OR to avoid pre-baked type bits from LEA.
           if (pointerDepth > 0) {
             // Pointer variable: store as DWORD (handle is 24-bit)
-            this.asm.push(`PUSH_W ${addr}`);
-            this.asm.push('PUSH_D 0x800000');
-            this.asm.push('OR');
-            this.asm.push('PUSH_D 0x40000');
-            this.asm.push('OR');
+            this.emit(Op.PUSH_W, addr);
+            this.emit(Op.PUSH_D, 0x800000);
+            this.emit(Op.OR);
+            this.emit(Op.PUSH_D, 0x40000);
+            this.emit(Op.OR);
           } else {
             // Normal variable: use pre-computed handle
             let handleType = 0x10000;
             if (token === 'int') handleType = 0x20000;
             else if (token === 'long' || token === 'addr') handleType = 0x40000;
-            this.asm.push(`PUSH_D ${addr | handleType | 0x800000}`);
+            this.emit(Op.PUSH_D, addr | handleType | 0x800000);
           }
-          this.asm.push('SWAP');
-          this.asm.push('STORE');
-          this.asm.push('POP');
+          this.emit(Op.SWAP);
+          this.emit(Op.STORE);
+          this.emit(Op.POP);
         } else {
           if (size === 0) throw new Error(`Array size required for ${name}`);
           this.locals.set(name, { offset: this.localOffset, type: token, size, pointerDepth });
@@ -1155,54 +1274,54 @@ export class LavaXCompiler {
       this.expect(')');
       const labelElse = `L_ELSE_${this.labelCount++}`;
       const labelEnd = `L_END_${this.labelCount++}`;
-      this.asm.push('POP');
-      this.asm.push(`JZ ${labelElse}`);
+      this.emit(Op.POP);
+      this.emitJump(Op.JZ, labelElse);
       this.parseInnerStatement();
       if (this.match('else')) {
-        this.asm.push(`JMP ${labelEnd}`);
-        this.asm.push(`${labelElse}:`);
+        this.emitJump(Op.JMP, labelEnd);
+        this.emitLabel(labelElse);
         this.parseInnerStatement();
-        this.asm.push(`${labelEnd}:`);
+        this.emitLabel(labelEnd);
       } else {
-        this.asm.push(`${labelElse}:`);
+        this.emitLabel(labelElse);
       }
     } else if (token === 'while') {
       this.parseToken();
       const labelStart = `L_WHILE_${this.labelCount++}`;
       const labelEnd = `L_WEND_${this.labelCount++}`;
-      this.asm.push(`${labelStart}:`);
+      this.emitLabel(labelStart);
       this.expect('(');
       this.parseExpression();
       this.expect(')');
-      this.asm.push('POP');
-      this.asm.push(`JZ ${labelEnd}`);
+      this.emit(Op.POP);
+      this.emitJump(Op.JZ, labelEnd);
       this.breakLabels.push(labelEnd);
       this.continueLabels.push(labelStart);
       this.parseInnerStatement();
       this.breakLabels.pop();
       this.continueLabels.pop();
-      this.asm.push(`JMP ${labelStart}`);
-      this.asm.push(`${labelEnd}:`);
+      this.emitJump(Op.JMP, labelStart);
+      this.emitLabel(labelEnd);
     } else if (token === 'do') {
       this.parseToken();
       const labelStart = `L_DO_${this.labelCount++}`;
       const labelContinue = `L_DOCONT_${this.labelCount++}`;
       const labelEnd = `L_DOEND_${this.labelCount++}`;
-      this.asm.push(`${labelStart}:`);
+      this.emitLabel(labelStart);
       this.breakLabels.push(labelEnd);
       this.continueLabels.push(labelContinue);
       this.parseInnerStatement();
       this.breakLabels.pop();
       this.continueLabels.pop();
-      this.asm.push(`${labelContinue}:`);
+      this.emitLabel(labelContinue);
       this.expect('while');
       this.expect('(');
       this.parseExpression();
       this.expect(')');
       this.expect(';');
-      this.asm.push('POP');
-      this.asm.push(`JNZ ${labelStart}`);
-      this.asm.push(`${labelEnd}:`);
+      this.emit(Op.POP);
+      this.emitJump(Op.JNZ, labelStart);
+      this.emitLabel(labelEnd);
     } else if (token === 'switch') {
       this.parseToken();
       this.expect('(');
@@ -1214,10 +1333,9 @@ export class LavaXCompiler {
       this.breakLabels.push(labelEnd);
       // Parse case labels and body
       // Strategy: collect all case values and generate dispatch code
-      // Each case: DUP, PUSH_B caseVal, EQ, JNZ caseLabel
-      // After all cases: JMP default/end
+      // (see emitSwitchDispatch), then the case bodies in source order
       const caseLabels: { val: number | null, label: string }[] = [];
-      const caseStmts: { label: string, stmts: string[] }[] = [];
+      const caseStmts: { label: string, stmts: IrNode[] }[] = [];
       // Parse all case/default blocks
       while (true) {
         this.skipWhitespace();
@@ -1273,30 +1391,17 @@ export class LavaXCompiler {
       this.breakLabels.pop();
       // Emit dispatch code
       // switch value is on stack, we'll DUP for each comparison
-      for (const c of caseLabels) {
-        if (c.val !== null) {
-          this.asm.push('DUP');
-          this.pushLiteral(c.val);
-          this.asm.push('EQ');
-          this.asm.push('POP');
-          this.asm.push(`JNZ ${c.label}`);
-        }
-      }
-      // Check for default case
       const defaultCase = caseLabels.find(c => c.val === null);
-      if (defaultCase) {
-        this.asm.push(`JMP ${defaultCase.label}`);
-      } else {
-        this.asm.push(`JMP ${labelEnd}`);
-      }
+      this.emitSwitchDispatch(caseLabels.filter(c => c.val !== null) as { val: number, label: string }[],
+        defaultCase ? defaultCase.label : labelEnd);
       // Emit case bodies
       for (const cs of caseStmts) {
-        this.asm.push(`${cs.label}:`);
+        this.emitLabel(cs.label);
         this.asm.push(...cs.stmts);
       }
       // Pop the switch expression value
-      this.asm.push(`${labelEnd}:`);
-      this.asm.push('POP'); // pop the original switch expression value
+      this.emitLabel(labelEnd);
+      this.emit(Op.POP); // pop the original switch expression value
     } else if (token === 'for') {
       this.parseToken();
       this.expect('(');
@@ -1304,8 +1409,8 @@ export class LavaXCompiler {
       const labelStart = `L_FOR_${this.labelCount++}`;
       const labelEnd = `L_FEND_${this.labelCount++}`;
       const labelStep = `L_FSTEP_${this.labelCount++}`;
-      this.asm.push(`${labelStart}:`);
-      if (!this.match(';')) { this.parseExpression(); this.asm.push('POP'); this.asm.push(`JZ ${labelEnd}`); this.expect(';'); }
+      this.emitLabel(labelStart);
+      if (!this.match(';')) { this.parseExpression(); this.emit(Op.POP); this.emitJump(Op.JZ, labelEnd); this.expect(';'); }
       let stepExprStart = this.pos;
       let parenDepth = 0;
       while (true) {
@@ -1323,27 +1428,27 @@ export class LavaXCompiler {
       this.parseInnerStatement();
       this.breakLabels.pop();
       this.continueLabels.pop();
-      this.asm.push(`${labelStep}:`);
+      this.emitLabel(labelStep);
       const savedPos = this.pos;
       this.pos = stepExprStart;
       if (this.pos < stepExprEnd) { this.parseExprStmt(); }
       this.pos = savedPos;
-      this.asm.push(`JMP ${labelStart}`);
-      this.asm.push(`${labelEnd}:`);
+      this.emitJump(Op.JMP, labelStart);
+      this.emitLabel(labelEnd);
     } else if (token === 'goto') {
       this.parseToken();
       const label = this.parseToken();
-      this.asm.push(`JMP ${label}`);
+      this.emitJump(Op.JMP, label);
       this.expect(';');
     } else if (token === 'break') {
       this.parseToken();
       if (this.breakLabels.length === 0) throw new Error("break outside of loop");
-      this.asm.push(`JMP ${this.breakLabels[this.breakLabels.length - 1]}`);
+      this.emitJump(Op.JMP, this.breakLabels[this.breakLabels.length - 1]);
       this.expect(';');
     } else if (token === 'continue') {
       this.parseToken();
       if (this.continueLabels.length === 0) throw new Error("continue outside of loop");
-      this.asm.push(`JMP ${this.continueLabels[this.continueLabels.length - 1]}`);
+      this.emitJump(Op.JMP, this.continueLabels[this.continueLabels.length - 1]);
       this.expect(';');
     } else if (token === 'return') {
       this.parseToken();
@@ -1351,7 +1456,7 @@ export class LavaXCompiler {
         this.parseExpression();
         this.expect(';');
       }
-      this.asm.push('RET');
+      this.emit(Op.RET);
     } else {
       this.parseExprStmt();
       this.expect(';');
@@ -1366,7 +1471,7 @@ export class LavaXCompiler {
   private parseExprStmt() {
     const hasValue = this.parseExpression();
     if (hasValue) {
-      this.asm.push('POP');
+      this.emit(Op.POP);
     }
   }
 
@@ -1400,18 +1505,18 @@ export class LavaXCompiler {
           if (castOp === '=' || isCastCompound) {
             this.parseToken(); // consume =
             // CPTR/CIPTR/CLPTR strips upper bits and sets the cast type.
-            if (castType === 'char') this.asm.push('CPTR');
-            else if (castType === 'int') this.asm.push('CIPTR');
-            else this.asm.push('CLPTR'); // long, addr, float
+            if (castType === 'char') this.emit(Op.CPTR);
+            else if (castType === 'int') this.emit(Op.CIPTR);
+            else this.emit(Op.CLPTR); // long, addr, float
             if (isCastCompound) {
-              this.asm.push('DUP');
-              this.asm.push('LD_IND');
+              this.emit(Op.DUP);
+              this.emit(Op.LD_IND);
               this.parseExpression();
               this.emitCompoundOp(castOp);
             } else {
               this.parseExpression();
             }
-            this.asm.push('STORE');
+            this.emit(Op.STORE);
             return true;
           }
         }
@@ -1441,18 +1546,18 @@ export class LavaXCompiler {
         if (op === '=' || isCompound) {
           this.parseToken(); // consume op
           // Apply type via CPTR/CIPTR/CLPTR (strips upper bits, sets type).
-          if (handleType === '0x10000') this.asm.push('CPTR');
-          else if (handleType === '0x20000') this.asm.push('CIPTR');
-          else this.asm.push('CLPTR');
+          if (handleType === '0x10000') this.emit(Op.CPTR);
+          else if (handleType === '0x20000') this.emit(Op.CIPTR);
+          else this.emit(Op.CLPTR);
           if (isCompound) {
-            this.asm.push('DUP');
-            this.asm.push('LD_IND');
+            this.emit(Op.DUP);
+            this.emit(Op.LD_IND);
             this.parseExpression();
             this.emitCompoundOp(op);
           } else {
             this.parseExpression();
           }
-          this.asm.push('STORE');
+          this.emit(Op.STORE);
           // Result of assignment is the value, so it leaves 1 value on stack
           return true;
         }
@@ -1482,15 +1587,15 @@ export class LavaXCompiler {
           const opSuffix = member.type === 'char' ? 'B' : (member.type === 'int' ? 'W' : 'D');
           if (isCompound) {
             const ldPrefix = isLocal ? 'LD_L' : 'LD_G';
-            this.asm.push(`${ldPrefix}_${opSuffix} ${member.offset}`);
+            this.emit(`${ldPrefix}_${opSuffix}`, member.offset);
             this.parseAssignment();
             this.emitCompoundOp(op);
           } else {
             this.parseAssignment();
           }
           this.emitVarHandle(member, isLocal);
-          this.asm.push('SWAP');
-          this.asm.push('STORE');
+          this.emit(Op.SWAP);
+          this.emit(Op.STORE);
           return true;
         }
         // Not an assignment - rollback
@@ -1507,13 +1612,13 @@ export class LavaXCompiler {
           if (variable.dimensions && dimIdx < variable.dimensions.length) {
             const nextDim = variable.dimensions[dimIdx];
             this.pushLiteral(nextDim);
-            this.asm.push('MUL');
+            this.emit(Op.MUL);
             this.parseExpression();
-            this.asm.push('ADD');
+            this.emit(Op.ADD);
             dimIdx++;
           } else {
             this.parseExpression();
-            this.asm.push('ADD');
+            this.emit(Op.ADD);
           }
           this.expect(']');
         }
@@ -1524,49 +1629,49 @@ export class LavaXCompiler {
           const elementSize = this.getVariableElementSize(variable);
           if (elementSize > 1) {
             this.pushLiteral(elementSize);
-            this.asm.push('MUL');
+            this.emit(Op.MUL);
           }
           let usedLea = false;
           if (variable.pointerDepth > 0 && variable.size === 1) {
             // Pointer subscript assignment: load pointer value and add byte offset
-            const ptrLoadOp = isLocal ? 'LD_L_D' : 'LD_G_D';
-            this.asm.push(`${ptrLoadOp} ${variable.offset}`);
-            this.asm.push('SWAP');
-            this.asm.push('ADD');
+            const ptrLoadOp = isLocal ? Op.LD_L_D : Op.LD_G_D;
+            this.emit(ptrLoadOp, variable.offset);
+            this.emit(Op.SWAP);
+            this.emit(Op.ADD);
           } else if (isLocal) {
             if (variable.type === 'char' && !variable.pointerDepth) {
-              this.asm.push(`LEA_L_B ${variable.offset}`);
+              this.emit(Op.LEA_L_B, variable.offset);
               usedLea = true;
             } else {
               this.pushLiteral(variable.offset);
-              this.asm.push('ADD');
-              this.asm.push('PUSH_D 0x800000');
-              this.asm.push('OR');
+              this.emit(Op.ADD);
+              this.emit(Op.PUSH_D, 0x800000);
+              this.emit(Op.OR);
             }
           } else {
             if (variable.type === 'char' && !variable.pointerDepth) {
-              this.asm.push(`LEA_G_B ${variable.offset}`);
+              this.emit(Op.LEA_G_B, variable.offset);
               usedLea = true;
             } else {
               this.pushLiteral(variable.offset);
-              this.asm.push('ADD');
+              this.emit(Op.ADD);
             }
           }
           if (!usedLea) {
-            const handleType = variable.pointerDepth > 1 ? '0x40000'
-              : (variable.type === 'char' ? '0x10000' : (variable.type === 'int' ? '0x20000' : '0x40000'));
-            this.asm.push(`PUSH_D ${handleType}`);
-            this.asm.push('OR');
+            const handleType = variable.pointerDepth > 1 ? 0x40000
+              : (variable.type === 'char' ? 0x10000 : (variable.type === 'int' ? 0x20000 : 0x40000));
+            this.emit(Op.PUSH_D, handleType);
+            this.emit(Op.OR);
           }
           if (isCompound) {
-            this.asm.push('DUP');
-            this.asm.push('LD_IND');
+            this.emit(Op.DUP);
+            this.emit(Op.LD_IND);
             this.parseAssignment();
             this.emitCompoundOp(op);
           } else {
             this.parseAssignment();
           }
-          this.asm.push('STORE');
+          this.emit(Op.STORE);
           return true;
         }
         // Not an assignment - rollback both pos and asm
@@ -1592,7 +1697,7 @@ export class LavaXCompiler {
             (variable.type === 'char' ? 'B' : (variable.type === 'int' ? 'W' : 'D'));
           if (isCompound) {
             const ldPrefix = isLocal ? 'LD_L' : 'LD_G';
-            this.asm.push(`${ldPrefix}_${opSuffix} ${variable.offset}`);
+            this.emit(`${ldPrefix}_${opSuffix}`, variable.offset);
             this.parseAssignment();
             this.emitCompoundOp(op);
           } else {
@@ -1602,8 +1707,8 @@ export class LavaXCompiler {
           // Now get the address and prepare for store
           // Use pre-computed handle (offset | type | baseFlags)
           this.emitVarHandle(variable, isLocal);
-          this.asm.push('SWAP');
-          this.asm.push('STORE');
+          this.emit(Op.SWAP);
+          this.emit(Op.STORE);
           return true;
         }
         this.pos = oldPos;
@@ -1617,7 +1722,7 @@ export class LavaXCompiler {
     while (true) {
       if (this.match('||')) {
         this.parseLogicalAnd();
-        this.asm.push('L_OR');
+        this.emit(Op.L_OR);
         hasValue = true;
       } else break;
     }
@@ -1629,7 +1734,7 @@ export class LavaXCompiler {
     while (true) {
       if (this.match('&&')) {
         this.parseBitwiseOr();
-        this.asm.push('L_AND');
+        this.emit(Op.L_AND);
         hasValue = true;
       } else break;
     }
@@ -1641,7 +1746,7 @@ export class LavaXCompiler {
     while (true) {
       if (this.match('|')) {
         this.parseBitwiseXor();
-        this.asm.push('OR');
+        this.emit(Op.OR);
         hasValue = true;
       } else break;
     }
@@ -1653,7 +1758,7 @@ export class LavaXCompiler {
     while (true) {
       if (this.match('^')) {
         this.parseBitwiseAnd();
-        this.asm.push('XOR');
+        this.emit(Op.XOR);
         hasValue = true;
       } else break;
     }
@@ -1665,7 +1770,7 @@ export class LavaXCompiler {
     while (true) {
       if (this.match('&')) {
         this.parseEquality();
-        this.asm.push('AND');
+        this.emit(Op.AND);
         hasValue = true;
       } else break;
     }
@@ -1675,8 +1780,8 @@ export class LavaXCompiler {
   private parseEquality(): boolean {
     let hasValue = this.parseRelational();
     while (true) {
-      if (this.match('==')) { this.parseRelational(); this.asm.push('EQ'); hasValue = true; }
-      else if (this.match('!=')) { this.parseRelational(); this.asm.push('NEQ'); hasValue = true; }
+      if (this.match('==')) { this.parseRelational(); this.emit(Op.EQ); hasValue = true; }
+      else if (this.match('!=')) { this.parseRelational(); this.emit(Op.NEQ); hasValue = true; }
       else break;
     }
     return hasValue;
@@ -1685,10 +1790,10 @@ export class LavaXCompiler {
   private parseRelational(): boolean {
     let hasValue = this.parseShift();
     while (true) {
-      if (this.match('<')) { this.parseShift(); this.asm.push('LT'); hasValue = true; }
-      else if (this.match('>')) { this.parseShift(); this.asm.push('GT'); hasValue = true; }
-      else if (this.match('<=')) { this.parseShift(); this.asm.push('LE'); hasValue = true; }
-      else if (this.match('>=')) { this.parseShift(); this.asm.push('GE'); hasValue = true; }
+      if (this.match('<')) { this.parseShift(); this.emit(Op.LT); hasValue = true; }
+      else if (this.match('>')) { this.parseShift(); this.emit(Op.GT); hasValue = true; }
+      else if (this.match('<=')) { this.parseShift(); this.emit(Op.LE); hasValue = true; }
+      else if (this.match('>=')) { this.parseShift(); this.emit(Op.GE); hasValue = true; }
       else break;
     }
     return hasValue;
@@ -1697,8 +1802,8 @@ export class LavaXCompiler {
   private parseShift(): boolean {
     let hasValue = this.parseAdditive();
     while (true) {
-      if (this.match('<<')) { this.parseAdditive(); this.asm.push('SHL'); hasValue = true; }
-      else if (this.match('>>')) { this.parseAdditive(); this.asm.push('SHR'); hasValue = true; }
+      if (this.match('<<')) { this.parseAdditive(); this.emit(Op.SHL); hasValue = true; }
+      else if (this.match('>>')) { this.parseAdditive(); this.emit(Op.SHR); hasValue = true; }
       else break;
     }
     return hasValue;
@@ -1707,8 +1812,8 @@ export class LavaXCompiler {
   private parseAdditive(): boolean {
     let hasValue = this.parseTerm();
     while (true) {
-      if (this.match('+')) { this.parseTerm(); this.asm.push('ADD'); hasValue = true; }
-      else if (this.match('-')) { this.parseTerm(); this.asm.push('SUB'); hasValue = true; }
+      if (this.match('+')) { this.parseTerm(); this.emit(Op.ADD); hasValue = true; }
+      else if (this.match('-')) { this.parseTerm(); this.emit(Op.SUB); hasValue = true; }
       else break;
     }
     return hasValue;
@@ -1717,9 +1822,9 @@ export class LavaXCompiler {
   private parseTerm(): boolean {
     let hasValue = this.parseUnary();
     while (true) {
-      if (this.match('*')) { this.parseUnary(); this.asm.push('MUL'); hasValue = true; }
-      else if (this.match('/')) { this.parseUnary(); this.asm.push('DIV'); hasValue = true; }
-      else if (this.match('%')) { this.parseUnary(); this.asm.push('MOD'); hasValue = true; }
+      if (this.match('*')) { this.parseUnary(); this.emit(Op.MUL); hasValue = true; }
+      else if (this.match('/')) { this.parseUnary(); this.emit(Op.DIV); hasValue = true; }
+      else if (this.match('%')) { this.parseUnary(); this.emit(Op.MOD); hasValue = true; }
       else break;
     }
     return hasValue;
@@ -1732,7 +1837,7 @@ export class LavaXCompiler {
       const isLocal = this.locals.has(token);
       if (variable) {
         this.emitVarHandle(variable, isLocal);
-        this.asm.push('INC_PRE');
+        this.emit(Op.INC_PRE);
         return true;
       } else {
         throw new Error(`++ requires lvalue, got ${token} `);
@@ -1743,7 +1848,7 @@ export class LavaXCompiler {
       const isLocal = this.locals.has(token);
       if (variable) {
         this.emitVarHandle(variable, isLocal);
-        this.asm.push('DEC_PRE');
+        this.emit(Op.DEC_PRE);
         return true;
       } else {
         throw new Error(`-- requires lvalue, got ${token} `);
@@ -1763,10 +1868,10 @@ export class LavaXCompiler {
         if (pointerDepth > 0) {
           // LavaX (type *) reads from the address stored in the expression.
           // CPTR/CIPTR/CLPTR strips upper bits and sets correct type, then LD_IND reads.
-          if (token === 'char') this.asm.push('CPTR');
-          else if (token === 'int') this.asm.push('CIPTR');
-          else this.asm.push('CLPTR'); // long, addr, float
-          this.asm.push('LD_IND');
+          if (token === 'char') this.emit(Op.CPTR);
+          else if (token === 'int') this.emit(Op.CIPTR);
+          else this.emit(Op.CLPTR); // long, addr, float
+          this.emit(Op.LD_IND);
           return true;
         }
         return true;
@@ -1787,14 +1892,14 @@ export class LavaXCompiler {
       // If the pointer came from an expression (not a direct variable), we may need type bits.
       if (variable && (variable as any).pointerDepth > 0) {
         // C-style typed pointer: apply the declared element type, then LD_IND.
-        if (variable.type === 'int') this.asm.push('CIPTR');
-        else if (variable.type === 'long' || variable.type === 'addr') this.asm.push('CLPTR');
-        else this.asm.push('CPTR'); // char
+        if (variable.type === 'int') this.emit(Op.CIPTR);
+        else if (variable.type === 'long' || variable.type === 'addr') this.emit(Op.CLPTR);
+        else this.emit(Op.CPTR); // char
       } else {
         // LavaX-style: * is shorthand for (char *) - always read 1 byte.
-        this.asm.push('CPTR');
+        this.emit(Op.CPTR);
       }
-      this.asm.push('LD_IND');
+      this.emit(Op.LD_IND);
       return true;
     } else if (this.match('&')) {
       const token = this.peekToken();
@@ -1804,33 +1909,33 @@ export class LavaXCompiler {
         this.parseToken();
         // Determine the type bits for the element the pointer points to
         const ptrElemDepth = (variable as any).pointerDepth > 0 ? 1 : 0;
-        const ptrHandleType = ptrElemDepth > 0 ? '0x40000'
-          : (variable.type === 'char' ? '0x10000' : (variable.type === 'int' ? '0x20000' : '0x40000'));
+        const ptrHandleType = ptrElemDepth > 0 ? 0x40000
+          : (variable.type === 'char' ? 0x10000 : (variable.type === 'int' ? 0x20000 : 0x40000));
         if (this.match('[')) {
           this.parseExpression();
           this.expect(']');
           const elementSize = this.getVariableElementSize(variable);
-          this.asm.push(`PUSH_B ${elementSize}`);
-          this.asm.push('MUL');
+          this.emit(Op.PUSH_B, elementSize);
+          this.emit(Op.MUL);
           if (isLocal) {
-            this.asm.push(`PUSH_W ${variable.offset}`);
-            this.asm.push('ADD');
-            this.asm.push('LEA_L_PH 0');
+            this.emit(Op.PUSH_W, variable.offset);
+            this.emit(Op.ADD);
+            this.emit(Op.LEA_L_PH, 0);
           } else {
-            this.asm.push(`PUSH_W ${variable.offset}`);
-            this.asm.push('ADD');
+            this.emit(Op.PUSH_W, variable.offset);
+            this.emit(Op.ADD);
           }
           // Add type bits so LD_IND knows how many bytes to read/write
-          this.asm.push(`PUSH_D ${ptrHandleType}`);
-          this.asm.push('OR');
+          this.emit(Op.PUSH_D, ptrHandleType);
+          this.emit(Op.OR);
         } else {
           // For &variable, produce an absolute (not EBP-relative) raw address.
           // Type bits are applied at the dereference site (CPTR/CIPTR/CLPTR), so no
           // need to embed them here. This also avoids spurious globals in the decompiler.
           if (isLocal) {
-            this.asm.push(`LEA_ABS ${variable.offset}`);
+            this.emit(Op.LEA_ABS, variable.offset);
           } else {
-            this.asm.push(`PUSH_W ${variable.offset}`);
+            this.emit(Op.PUSH_W, variable.offset);
           }
         }
         return true;
@@ -1839,15 +1944,15 @@ export class LavaXCompiler {
       }
     } else if (this.match('-')) {
       this.parseUnary();
-      this.asm.push('NEG');
+      this.emit(Op.NEG);
       return true;
     } else if (this.match('!')) {
       this.parseUnary();
-      this.asm.push('L_NOT');
+      this.emit(Op.L_NOT);
       return true;
     } else if (this.match('~')) {
       this.parseUnary();
-      this.asm.push('NOT');
+      this.emit(Op.NOT);
       return true;
     } else {
       return this.parseFactor();
@@ -1873,7 +1978,7 @@ export class LavaXCompiler {
       return true;
     } else if (token.startsWith('"')) {
       this.parseToken();
-      this.asm.push(`PUSH_STR ${token}`);
+      this.asm.push({ kind: 'str', literal: token });
       return true;
     } else if (token.startsWith("'")) {
       this.parseToken();
@@ -1881,22 +1986,22 @@ export class LavaXCompiler {
       return true;
     } else if (token === '_TEXT') {
       this.parseToken();
-      this.asm.push('LD_TEXT');
+      this.emit(Op.LD_TEXT);
       return true;
     } else if (token === '_GRAPH') {
       this.parseToken();
-      this.asm.push('LD_GRAP');
+      this.emit(Op.LD_GRAP);
       return true;
     } else if (token === '_GBUF') {
       this.parseToken();
-      this.asm.push('LD_GBUF');
+      this.emit(Op.LD_GBUF);
       return true;
-    } else if (this.functions.has(token) || SystemOp[token as keyof typeof SystemOp] !== undefined) {
+    } else if (this.functions.has(token) || SYSCALL_MAP[token] || SystemOp[token as keyof typeof SystemOp] !== undefined) {
       this.parseToken();
       const func = this.functions.get(token);
       this.expect('(');
       const isVariadic = token === 'printf' || token === 'sprintf';
-      const args: string[][] = [];
+      const args: IrNode[][] = [];
       if (!this.match(')')) {
         do {
           const currentAsm = this.asm;
@@ -1913,7 +2018,7 @@ export class LavaXCompiler {
       }
 
       if (isVariadic) {
-        this.asm.push(`PUSH_B ${args.length}`);
+        this.emit(Op.PUSH_B, args.length);
       }
 
       if (SYSCALL_MAP[token]) {
@@ -1928,17 +2033,22 @@ export class LavaXCompiler {
         if (token === 'sprintf' && args.length < 2) {
           throw new Error(`sprintf expects at least 2 arguments`);
         }
-        this.asm.push(`${token}`);
+        if (sys.subOp !== undefined) {
+          this.emit(Op.PUSH_B, sys.subOp);
+          this.emit(sys.op);
+          return sys.hasReturn;
+        }
+        this.emit(token);
         return sys.hasReturn;
       } else if (SystemOp[token as keyof typeof SystemOp] !== undefined) {
         // Fallback for syscalls not in map
-        this.asm.push(`${token}`);
+        this.emit(token);
         return true;
       } else {
         if (func && args.length !== func.params) {
           throw new Error(`Function ${token} expects ${func.params} arguments, but got ${args.length}`);
         }
-        this.asm.push(`CALL ${token}`);
+        this.emitJump(Op.CALL, token);
         return func?.returnType !== 'void';
       }
     } else if (this.defines.has(token)) {
@@ -1959,7 +2069,7 @@ export class LavaXCompiler {
         if (!member) throw new Error(`Unknown member '${memberName}' in struct`);
         const opPrefix = isLocal ? 'LD_L' : 'LD_G';
         const opSuffix = member.type === 'char' ? 'B' : (member.type === 'int' ? 'W' : 'D');
-        this.asm.push(`${opPrefix}_${opSuffix} ${member.offset}`);
+        this.emit(`${opPrefix}_${opSuffix}`, member.offset);
         return true;
       }
 
@@ -1971,57 +2081,57 @@ export class LavaXCompiler {
           if (variable.dimensions && dimIdx < variable.dimensions.length) {
             const nextDim = variable.dimensions[dimIdx];
             this.pushLiteral(nextDim);
-            this.asm.push('MUL');
+            this.emit(Op.MUL);
             this.parseExpression();
-            this.asm.push('ADD');
+            this.emit(Op.ADD);
             dimIdx++;
           } else {
             this.parseExpression();
-            this.asm.push('ADD');
+            this.emit(Op.ADD);
           }
           this.expect(']');
         }
         const elementSize = this.getVariableElementSize(variable);
         if (elementSize > 1) {
           this.pushLiteral(elementSize);
-          this.asm.push('MUL');
+          this.emit(Op.MUL);
         }
         // For pointer variables (e.g., int* arr passed as parameter), the variable stores
         // an absolute address to the array data — load the pointer and use LD_IND.
         if (variable.pointerDepth > 0 && variable.size === 1) {
-          const ptrLoadOp = isLocal ? 'LD_L_D' : 'LD_G_D';
-          this.asm.push(`${ptrLoadOp} ${variable.offset}`);  // load pointer (absolute addr)
-          this.asm.push('SWAP'); // swap so byte_offset is on top
-          this.asm.push('ADD');  // absolute element address
-          const typeFlag = variable.pointerDepth > 1 ? '0x40000'
-            : (variable.type === 'char' ? '0x10000' : (variable.type === 'int' ? '0x20000' : '0x40000'));
-          this.asm.push(`PUSH_D ${typeFlag}`);
-          this.asm.push('OR');
-          this.asm.push('LD_IND');
+          const ptrLoadOp = isLocal ? Op.LD_L_D : Op.LD_G_D;
+          this.emit(ptrLoadOp, variable.offset);  // load pointer (absolute addr)
+          this.emit(Op.SWAP); // swap so byte_offset is on top
+          this.emit(Op.ADD);  // absolute element address
+          const typeFlag = variable.pointerDepth > 1 ? 0x40000
+            : (variable.type === 'char' ? 0x10000 : (variable.type === 'int' ? 0x20000 : 0x40000));
+          this.emit(Op.PUSH_D, typeFlag);
+          this.emit(Op.OR);
+          this.emit(Op.LD_IND);
         } else if (isLocal) {
           if (variable.type === 'char' && !variable.pointerDepth) {
-            this.asm.push(`LD_L_O_B ${variable.offset}`);
+            this.emit(Op.LD_L_O_B, variable.offset);
           } else {
             this.pushLiteral(variable.offset);
-            this.asm.push('ADD');
+            this.emit(Op.ADD);
             const opSuffix = variable.type === 'char' ? 'B' : (variable.type === 'int' ? 'W' : 'D');
-            this.asm.push(`LD_L_O_${opSuffix} 0`);
+            this.emit(`LD_L_O_${opSuffix}`, 0);
           }
         } else {
           if (variable.type === 'char' && !variable.pointerDepth) {
-            this.asm.push(`LD_G_O_B ${variable.offset}`);
+            this.emit(Op.LD_G_O_B, variable.offset);
           } else {
             this.pushLiteral(variable.offset);
-            this.asm.push('ADD');
+            this.emit(Op.ADD);
             const opSuffix = variable.type === 'char' ? 'B' : (variable.type === 'int' ? 'W' : 'D');
-            this.asm.push(`LD_G_O_${opSuffix} 0`);
+            this.emit(`LD_G_O_${opSuffix}`, 0);
           }
         }
       } else if (variable.size > 1) {
         // Local array referenced without subscript: push absolute address so it can be
         // passed to functions that expect a pointer (e.g., sum(arr, n)).
         if (isLocal) {
-          this.asm.push(`LEA_ABS ${variable.offset}`);
+          this.emit(Op.LEA_ABS, variable.offset);
         } else {
           // Global arrays: push the global offset directly (it's already absolute)
           this.pushLiteral(variable.offset);
@@ -2032,17 +2142,17 @@ export class LavaXCompiler {
         // regardless of the base type (e.g. int* still uses LD_L_D)
         const opSuffix = (variable as any).pointerDepth > 0 ? 'D' :
           (variable.type === 'char' ? 'B' : (variable.type === 'int' ? 'W' : 'D'));
-        this.asm.push(`${opPrefix}_${opSuffix} ${variable.offset}`);
+        this.emit(`${opPrefix}_${opSuffix}`, variable.offset);
       }
 
       if (this.match('++')) {
         this.asm.pop();
         this.emitVarHandle(variable, isLocal);
-        this.asm.push('INC_POS');
+        this.emit(Op.INC_POS);
       } else if (this.match('--')) {
         this.asm.pop();
         this.emitVarHandle(variable, isLocal);
-        this.asm.push('DEC_POS');
+        this.emit(Op.DEC_POS);
       }
       return true;
     } else {
@@ -2050,10 +2160,81 @@ export class LavaXCompiler {
     }
   }
 
+  private emit(op: Op | string, operand = 0) {
+    this.asm.push(irOp(op, operand));
+  }
+
+  private emitJump(op: Op, label: string) {
+    this.asm.push(irRef(op, label));
+  }
+
+  private emitLabel(name: string) {
+    this.asm.push({ kind: 'label', name });
+  }
+
+  /**
+   * Jumps to the label of the case matching the value on top of the stack,
+   * or to `defaultLabel`; the value stays on the stack. The ISA has no
+   * indirect jump, so there is no jump table: a few cases are compared in
+   * order (DUP, EQ_C v, POP, JNZ), and larger switches bisect the sorted case
+   * values with LT_C, which takes about log2(n) compares instead of n.
+   */
+  private emitSwitchDispatch(cases: { val: number, label: string }[], defaultLabel: string) {
+    // The VM compares 32-bit values, so 0xFFFFFFFF is the case -1.
+    const distinct = new Map<number, string>();
+    for (const c of cases) {
+      const val = c.val | 0;
+      if (!distinct.has(val)) distinct.set(val, c.label); // first duplicate wins, as in the linear chain
+    }
+    const values = [...distinct.keys()];
+    if (!this.switchTrees || values.length < SWITCH_TREE_MIN_CASES || !cases.every(c => Number.isInteger(c.val))) {
+      for (const c of cases) this.emitCaseTest(c.val, c.label);
+      this.emitJump(Op.JMP, defaultLabel);
+      return;
+    }
+    values.sort((a, b) => a - b);
+    // [lo, hi] bounds what the value can be on this path; a leaf whose cases
+    // fill it needs no test for the last one.
+    const bisect = (first: number, end: number, lo: number, hi: number) => {
+      if (end - first <= SWITCH_TREE_LEAF_CASES) {
+        const exhaustive = hi - lo + 1 === end - first;
+        for (let i = first; i < end; i++) {
+          if (exhaustive && i === end - 1) {
+            this.emitJump(Op.JMP, distinct.get(values[i])!);
+            return;
+          }
+          this.emitCaseTest(values[i], distinct.get(values[i])!);
+        }
+        this.emitJump(Op.JMP, defaultLabel);
+        return;
+      }
+      const mid = (first + end) >> 1;
+      const pivot = values[mid];
+      const lower = `L_SWLT_${this.labelCount++}`;
+      this.emit(Op.DUP);
+      this.pushLiteral(pivot);
+      this.emit(Op.LT);
+      this.emit(Op.POP);
+      this.emitJump(Op.JNZ, lower);
+      bisect(mid, end, pivot, hi);
+      this.emitLabel(lower);
+      bisect(first, mid, lo, pivot - 1);
+    };
+    bisect(0, values.length, -Infinity, Infinity);
+  }
+
+  private emitCaseTest(val: number, label: string) {
+    this.emit(Op.DUP);
+    this.pushLiteral(val);
+    this.emit(Op.EQ);
+    this.emit(Op.POP);
+    this.emitJump(Op.JNZ, label);
+  }
+
   private pushLiteral(val: number) {
-    if (val >= 0 && val <= 255) this.asm.push(`PUSH_B ${val}`);
-    else if (val >= -32768 && val <= 32767) this.asm.push(`PUSH_W ${val}`);
-    else this.asm.push(`PUSH_D ${val}`);
+    if (val >= 0 && val <= 255) this.emit(Op.PUSH_B, val);
+    else if (val >= -32768 && val <= 32767) this.emit(Op.PUSH_W, val);
+    else this.emit(Op.PUSH_D, val);
   }
 
   // Emit a pre-computed handle for a simple (non-array) variable.
@@ -2066,7 +2247,7 @@ export class LavaXCompiler {
     else if (variable.type === 'long' || variable.type === 'addr') handleType = 0x40000;
     let handle = variable.offset | handleType;
     if (isLocal) handle |= 0x800000; // HANDLE_BASE_EBP
-    this.asm.push(`PUSH_D ${handle}`);
+    this.emit(Op.PUSH_D, handle);
   }
 
   private parseCharLiteral(token: string): number {
@@ -2142,12 +2323,12 @@ export class LavaXCompiler {
 
   private emitCompoundOp(op: string) {
     const baseOp = op.substring(0, op.length - 1);
-    const opMap: { [key: string]: string } = {
-      '+': 'ADD', '-': 'SUB', '*': 'MUL', '/': 'DIV', '%': 'MOD',
-      '&': 'AND', '|': 'OR', '^': 'XOR', '<<': 'SHL', '>>': 'SHR'
+    const opMap: { [key: string]: Op } = {
+      '+': Op.ADD, '-': Op.SUB, '*': Op.MUL, '/': Op.DIV, '%': Op.MOD,
+      '&': Op.AND, '|': Op.OR, '^': Op.XOR, '<<': Op.SHL, '>>': Op.SHR
     };
-    if (opMap[baseOp]) {
-      this.asm.push(opMap[baseOp]);
+    if (opMap[baseOp] !== undefined) {
+      this.emit(opMap[baseOp]);
     } else {
       throw new Error(`Unsupported compound operator: ${op} `);
     }
@@ -1,4 +1,3 @@
-import iconv from 'iconv-lite';
 import {
   createOfficialLavHeader,
   encodeLavHeader,
@@ -11,13 +10,10 @@ import {
   type LavInstructionNode,
   type LavProgram,
 } from '../lav/format';
+import { encodeGbk } from '../lav/gbk';
 
 function encodeToGBK(str: string): number[] {
-  try {
-    return Array.from(iconv.encode(str, 'gbk'));
-  } catch {
-    return Array.from(str).map(c => c.charCodeAt(0) & 0xff);
-  }
+  return Array.from(encodeGbk(str));
 }
 
 function unescapeString(str: string): string {
@@ -0,0 +1,272 @@
+/**
+ * Constant expressions for the compiler: #if conditions, array dimensions,
+ * case labels and initializers.
+ *
+ * Each distinct text is parsed and evaluated once and the value kept, so the
+ * same `#if` or dimension seen on every compile costs a map lookup. No code
+ * is generated at run time (no `Function`/`eval`), which also keeps the
+ * compiler usable under a strict Content-Security-Policy.
+ *
+ * Arithmetic is C's: integer division truncates, comparisons and logical
+ * operators yield 0 or 1, and character literals are their codes.
+ */
+
+interface ConstValue {
+  value: number;
+  /** Whether identifiers remain; they were taken as 0, as in #if. */
+  hasIdentifiers: boolean;
+}
+
+const MAX_CACHED = 4096;
+// Expression text -> value, or null if the text is not a constant expression.
+const evaluated = new Map<string, ConstValue | null>();
+
+function isIdentStart(code: number): boolean {
+  return (code >= 0x61 && code <= 0x7a) || (code >= 0x41 && code <= 0x5a) || code === 0x5f;
+}
+
+function isIdentPart(code: number): boolean {
+  return isIdentStart(code) || (code >= 0x30 && code <= 0x39);
+}
+
+function isDigit(code: number): boolean {
+  return code >= 0x30 && code <= 0x39;
+}
+
+/**
+ * Replaces object-like macros in `text` until none are left or `maxPasses`
+ * rounds have run. Numbers and character/string literals are left alone.
+ */
+export function expandMacros(text: string, defines: Map<string, string>, maxPasses: number): string {
+  for (let pass = 0; pass < maxPasses; pass++) {
+    let out = '';
+    let copied = 0;
+    let pos = 0;
+    const len = text.length;
+    while (pos < len) {
+      const code = text.charCodeAt(pos);
+      if (isIdentStart(code)) {
+        const start = pos;
+        while (pos < len && isIdentPart(text.charCodeAt(pos))) pos++;
+        const value = defines.get(text.slice(start, pos));
+        if (value !== undefined) {
+          out += text.slice(copied, start) + value;
+          copied = pos;
+        }
+      } else if (isDigit(code)) {
+        while (pos < len && (isIdentPart(text.charCodeAt(pos)) || text[pos] === '.')) pos++;
+      } else if (code === 0x27 || code === 0x22) { // ' "
+        pos++;
+        while (pos < len && text.charCodeAt(pos) !== code) pos += text[pos] === '\\' ? 2 : 1;
+        pos++;
+      } else {
+        pos++;
+      }
+    }
+    if (copied === 0) return text;
+    text = out + text.slice(copied);
+  }
+  return text;
+}
+
+/**
+ * Value of the constant expression `text`, or NaN when it is not one
+ * (syntax error, division by zero, or an identifier, unless
+ * `identifiersAsZero`, which is the #if rule for undefined names).
+ */
+export function evalConstExpr(text: string, identifiersAsZero = false): number {
+  let result = evaluated.get(text);
+  if (result === undefined) {
+    result = parseConstExpr(text);
+    if (evaluated.size >= MAX_CACHED) evaluated.clear();
+    evaluated.set(text, result);
+  }
+  if (!result || (result.hasIdentifiers && !identifiersAsZero)) return NaN;
+  return result.value;
+}
+
+// Binary operators by precedence level, lowest first (C's table below ?:).
+const BINARY_LEVELS: string[][] = [
+  ['||'], ['&&'], ['|'], ['^'], ['&'], ['==', '!='], ['<', '>', '<=', '>='], ['<<', '>>'], ['+', '-'], ['*', '/', '%'],
+];
+const PUNCTUATORS = ['<<', '>>', '<=', '>=', '==', '!=', '&&', '||', '+', '-', '*', '/', '%', '<', '>', '&', '^', '|', '!', '~', '?', ':', '(', ')'];
+const CHAR_ESCAPES: Record<string, number> = { n: 10, t: 9, r: 13, a: 7, b: 8, f: 12, v: 11, '\\': 92, "'": 39, '"': 34, '?': 63 };
+
+function binary(op: string, a: number, b: number): number {
+  switch (op) {
+    case '||': return a || b ? 1 : 0;
+    case '&&': return a && b ? 1 : 0;
+    case '|': return a | b;
+    case '^': return a ^ b;
+    case '&': return a & b;
+    case '==': return a === b ? 1 : 0;
+    case '!=': return a !== b ? 1 : 0;
+    case '<': return a < b ? 1 : 0;
+    case '>': return a > b ? 1 : 0;
+    case '<=': return a <= b ? 1 : 0;
+    case '>=': return a >= b ? 1 : 0;
+    case '<<': return a << b;
+    case '>>': return a >> b;
+    case '+': return a + b;
+    case '-': return a - b;
+    case '*': return a * b;
+    case '/':
+      if (b === 0) return NaN;
+      return Number.isInteger(a) && Number.isInteger(b) ? Math.trunc(a / b) : a / b;
+    default:
+      return b === 0 ? NaN : a % b;
+  }
+}
+
+function parseConstExpr(text: string): ConstValue | null {
+  let pos = 0;
+  let hasIdentifiers = false;
+
+  const skipSpace = () => {
+    while (pos < text.length) {
+      if (text.charCodeAt(pos) <= 0x20) {
+        pos++;
+      } else if (text.startsWith('//', pos)) {
+        const end = text.indexOf('\n', pos);
+        pos = end === -1 ? text.length : end + 1;
+      } else if (text.startsWith('/*', pos)) {
+        const end = text.indexOf('*/', pos + 2);
+        if (end === -1) fail();
+        pos = end + 2;
+      } else {
+        break;
+      }
+    }
+  };
+  const peekPunct = (): string | null => {
+    skipSpace();
+    for (const p of PUNCTUATORS) {
+      if (text.startsWith(p, pos)) return p;
+    }
+    return null;
+  };
+  const fail = (): never => {
+    throw new SyntaxError(text);
+  };
+
+  const number = (): number => {
+    const start = pos;
+    let value: number;
+    if (text[pos] === '0' && (text[pos + 1] === 'x' || text[pos + 1] === 'X')) {
+      pos += 2;
+      while (pos < text.length && /[0-9a-fA-F]/.test(text[pos])) pos++;
+      value = parseInt(text.slice(start + 2, pos), 16);
+    } else if (text[pos] === '0' && (text[pos + 1] === 'b' || text[pos + 1] === 'B')) {
+      pos += 2;
+      while (text[pos] === '0' || text[pos] === '1') pos++;
+      value = parseInt(text.slice(start + 2, pos), 2);
+    } else {
+      while (isDigit(text.charCodeAt(pos))) pos++;
+      let integral = true;
+      if (text[pos] === '.') {
+        integral = false;
+        pos++;
+        while (isDigit(text.charCodeAt(pos))) pos++;
+      }
+      if ((text[pos] === 'e' || text[pos] === 'E') && (isDigit(text.charCodeAt(pos + 1))
+        || ((text[pos + 1] === '+' || text[pos + 1] === '-') && isDigit(text.charCodeAt(pos + 2))))) {
+        integral = false;
+        pos += 2;
+        while (isDigit(text.charCodeAt(pos))) pos++;
+      }
+      const digits = text.slice(start, pos);
+      value = integral && digits.length > 1 && digits[0] === '0' && /^[0-7]+$/.test(digits) ? parseInt(digits, 8) : Number(digits);
+    }
+    while (pos < text.length && 'uUlL'.includes(text[pos])) pos++;
+    if (Number.isNaN(value) || (pos < text.length && isIdentPart(text.charCodeAt(pos)))) fail();
+    return value;
+  };
+
+  const char = (): number => {
+    pos++; // opening quote
+    let value: number;
+    if (text[pos] === '\\') {
+      const esc = text[pos + 1];
+      pos += 2;
+      if (esc === 'x') {
+        const start = pos;
+        while (pos < text.length && /[0-9a-fA-F]/.test(text[pos])) pos++;
+        value = parseInt(text.slice(start, pos), 16);
+      } else if (esc >= '0' && esc <= '7') {
+        const start = pos - 1;
+        while (pos < start + 3 && text[pos] >= '0' && text[pos] <= '7') pos++;
+        value = parseInt(text.slice(start, pos), 8);
+      } else {
+        value = CHAR_ESCAPES[esc] ?? fail();
+      }
+    } else {
+      value = text.charCodeAt(pos++);
+    }
+    if (text[pos] !== "'" || Number.isNaN(value)) fail();
+    pos++;
+    return value;
+  };
+
+  const primary = (): number => {
+    const op = peekPunct();
+    if (op === '(') {
+      pos++;
+      const inner = conditional();
+      if (peekPunct() !== ')') fail();
+      pos++;
+      return inner;
+    }
+    if (op === '-' || op === '+' || op === '!' || op === '~') {
+      pos++;
+      const operand = primary();
+      switch (op) {
+        case '-': return -operand;
+        case '+': return operand;
+        case '!': return operand ? 0 : 1;
+        default: return ~operand;
+      }
+    }
+    if (op !== null || pos >= text.length) fail();
+    const code = text.charCodeAt(pos);
+    if (isDigit(code) || (code === 0x2e && isDigit(text.charCodeAt(pos + 1)))) return number();
+    if (code === 0x27) return char();
+    if (!isIdentStart(code)) return fail();
+    const start = pos;
+    while (pos < text.length && isIdentPart(text.charCodeAt(pos))) pos++;
+    const name = text.slice(start, pos);
+    if (name === 'true') return 1;
+    if (name === 'false') return 0;
+    hasIdentifiers = true;
+    return 0;
+  };
+
+  const binaryLevel = (level: number): number => {
+    if (level === BINARY_LEVELS.length) return primary();
+    let left = binaryLevel(level + 1);
+    for (;;) {
+      const op = peekPunct();
+      if (op === null || !BINARY_LEVELS[level].includes(op)) return left;
+      pos += op.length;
+      left = binary(op, left, binaryLevel(level + 1));
+    }
+  };
+
+  const conditional = (): number => {
+    const test = binaryLevel(0);
+    if (peekPunct() !== '?') return test;
+    pos++;
+    const then = conditional();
+    if (peekPunct() !== ':') fail();
+    pos++;
+    const otherwise = conditional();
+    return test ? then : otherwise;
+  };
+
+  try {
+    const value = conditional();
+    skipSpace();
+    return pos < text.length ? null : { value, hasIdentifiers };
+  } catch {
+    return null;
+  }
+}
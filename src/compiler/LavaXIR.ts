@@ -0,0 +1,243 @@
+import {
+  createOfficialLavHeader,
+  encodeLavHeader,
+  LAV_HEADER_SIZE,
+  LAV_OPCODE_BY_MNEMONIC,
+  LAV_OPCODE_BY_UPPERCASE_MNEMONIC,
+  LAV_OPCODE_BY_VALUE,
+  OperandType,
+  type LavInstructionDef,
+} from '../lav/format';
+import { encodeGbk } from '../lav/gbk';
+
+/**
+ * Structured compiler output: one node per instruction or label, with
+ * numeric operands and symbolic jump targets. encodeIr() writes it straight
+ * into a .lav image; formatIr() renders the same program as the textual
+ * assembly LavaXAssembler accepts, for listings.
+ */
+export type IrNode =
+  /** Instruction with no operand or a numeric one (u8/i16/u16/i32). */
+  | { kind: 'op'; def: LavInstructionDef; operand: number }
+  | { kind: 'label'; name: string }
+  /** Instruction whose u24 operand is a label address (jumps, CALL). */
+  | { kind: 'ref'; def: LavInstructionDef; label: string }
+  /** PUSH_STR; `literal` is the C string literal, quotes and escapes included. */
+  | { kind: 'str'; literal: string }
+  | { kind: 'init'; addr: number; data: Uint8Array }
+  | { kind: 'func'; frameSize: number; argCount: number }
+  /** A mnemonic with no opcode; encoding reports it like the assembler would. */
+  | { kind: 'unknown'; name: string }
+  /** Marks where code for the source at offset `pos` starts; encodes to nothing. */
+  | { kind: 'loc'; pos: number };
+
+export interface IrEncodeOptions {
+  strictOfficial?: boolean;
+  /** Called for each `loc` node, in order, with its code address (header included). */
+  onLocation?: (pc: number, pos: number) => void;
+}
+
+// Labels made by the compiler: L_<KIND>_<labelCount>.
+export const GENERATED_LABEL = /^L_[A-Z]+_(\d+)$/;
+
+// Pseudo-instruction marking a function start for function pointers.
+const F_FLAG_DEF: LavInstructionDef = { opcode: 0xad, mnemonic: 'F_FLAG', operandType: OperandType.NONE, official: false };
+const PUSH_STR_DEF = LAV_OPCODE_BY_MNEMONIC.get('PUSH_STR')!;
+const INIT_DEF = LAV_OPCODE_BY_MNEMONIC.get('INIT')!;
+const FUNC_DEF = LAV_OPCODE_BY_MNEMONIC.get('FUNC')!;
+
+/** Same lookup as the assembler: exact mnemonic, then upper case. */
+export function resolveMnemonic(mnemonic: string): LavInstructionDef | undefined {
+  const upper = mnemonic.toUpperCase();
+  if (upper === 'F_FLAG') return F_FLAG_DEF;
+  return LAV_OPCODE_BY_MNEMONIC.get(mnemonic) || LAV_OPCODE_BY_UPPERCASE_MNEMONIC.get(upper);
+}
+
+export function irOp(op: number | string, operand = 0): IrNode {
+  const def = typeof op === 'number' ? LAV_OPCODE_BY_VALUE.get(op) : resolveMnemonic(op);
+  if (!def) return { kind: 'unknown', name: String(op) };
+  if (def.operandType === OperandType.U24) throw new Error(`${def.mnemonic} takes a label operand`);
+  return { kind: 'op', def, operand };
+}
+
+export function irRef(op: number, label: string): IrNode {
+  return { kind: 'ref', def: LAV_OPCODE_BY_VALUE.get(op)!, label };
+}
+
+function unescapeString(str: string): string {
+  return str
+    .replace(/\\n/g, '\n')
+    .replace(/\\r/g, '\r')
+    .replace(/\\t/g, '\t')
+    .replace(/\\"/g, '"')
+    .replace(/\\\\/g, '\\');
+}
+
+function stringBytes(literal: string): Uint8Array {
+  const start = literal.indexOf('"');
+  const end = literal.lastIndexOf('"');
+  return encodeGbk(unescapeString(start === -1 || end <= start ? '' : literal.slice(start + 1, end)));
+}
+
+function operandSize(type: OperandType): number {
+  switch (type) {
+    case OperandType.NONE: return 0;
+    case OperandType.U8: return 1;
+    case OperandType.I16:
+    case OperandType.U16: return 2;
+    case OperandType.U24:
+    case OperandType.FUNC_META: return 3;
+    case OperandType.I32: return 4;
+    default: throw new Error(`Operand type ${type} needs its own IR node`);
+  }
+}
+
+/** Bytes `node` takes in the encoded image (0 for labels and markers). */
+export function irNodeSize(node: IrNode): number {
+  switch (node.kind) {
+    case 'op':
+    case 'ref': return 1 + operandSize(node.def.operandType);
+    case 'str': return 1 + stringBytes(node.literal).length + 1;
+    case 'init': return 1 + 2 + 2 + node.data.length;
+    case 'func': return 4;
+    default: return 0;
+  }
+}
+
+/** Encodes IR into a complete .lav image (header included). */
+export function encodeIr(nodes: IrNode[], options: IrEncodeOptions = {}): Uint8Array {
+  // Pass 1: sizes and label addresses. String bytes are kept for pass 2.
+  const labels = new Map<string, number>();
+  const strings: Uint8Array[] = [];
+  let size = 0;
+  const onLocation = options.onLocation;
+  for (const node of nodes) {
+    switch (node.kind) {
+      case 'label':
+        labels.set(node.name, size);
+        break;
+      case 'loc':
+        onLocation?.(LAV_HEADER_SIZE + size, node.pos);
+        break;
+      case 'op':
+      case 'ref':
+        if (options.strictOfficial && !node.def.official) {
+          throw new Error(`Opcode ${node.def.mnemonic} is not part of official-compatible mode`);
+        }
+        size += 1 + operandSize(node.def.operandType);
+        break;
+      case 'str': {
+        const bytes = stringBytes(node.literal);
+        strings.push(bytes);
+        size += 1 + bytes.length + 1;
+        break;
+      }
+      case 'init':
+        size += 1 + 2 + 2 + node.data.length;
+        break;
+      case 'func':
+        size += 4;
+        break;
+      case 'unknown':
+        throw new Error(`Unknown opcode: ${node.name.toUpperCase()}`);
+    }
+  }
+
+  const out = new Uint8Array(LAV_HEADER_SIZE + size);
+  out.set(encodeLavHeader(createOfficialLavHeader({ strMask: 0, entryPointField: 0 })), 0);
+  let p = LAV_HEADER_SIZE;
+  let s = 0;
+  const i16 = (value: number) => {
+    out[p++] = value & 0xff;
+    out[p++] = (value >> 8) & 0xff;
+  };
+  for (const node of nodes) {
+    switch (node.kind) {
+      case 'label':
+      case 'loc':
+        break;
+      case 'op': {
+        out[p++] = node.def.opcode;
+        const value = node.operand;
+        switch (node.def.operandType) {
+          case OperandType.U8:
+            out[p++] = value & 0xff;
+            break;
+          case OperandType.I16:
+          case OperandType.U16:
+            i16(value);
+            break;
+          case OperandType.I32:
+            i16(value);
+            out[p++] = (value >> 16) & 0xff;
+            out[p++] = (value >> 24) & 0xff;
+            break;
+          case OperandType.FUNC_META:
+            i16(value);
+            out[p++] = 0;
+            break;
+        }
+        break;
+      }
+      case 'ref': {
+        const target = labels.get(node.label);
+        if (target === undefined) throw new Error(`Unknown label: ${node.label}`);
+        const address = target + LAV_HEADER_SIZE;
+        out[p++] = node.def.opcode;
+        i16(address);
+        out[p++] = (address >> 16) & 0xff;
+        break;
+      }
+      case 'str': {
+        const bytes = strings[s++];
+        out[p++] = PUSH_STR_DEF.opcode;
+        out.set(bytes, p);
+        p += bytes.length;
+        out[p++] = 0;
+        break;
+      }
+      case 'init':
+        out[p++] = INIT_DEF.opcode;
+        i16(node.addr);
+        i16(node.data.length);
+        out.set(node.data, p);
+        p += node.data.length;
+        break;
+      case 'func':
+        out[p++] = FUNC_DEF.opcode;
+        i16(node.frameSize);
+        out[p++] = node.argCount & 0xff;
+        break;
+    }
+  }
+  return out;
+}
+
+/** One line of the textual listing for a node. */
+export function formatIrNode(node: Exclude<IrNode, { kind: 'loc' }>): string {
+  switch (node.kind) {
+    case 'op':
+      return node.def.operandType === OperandType.NONE ? node.def.mnemonic : `${node.def.mnemonic} ${node.operand}`;
+    case 'label':
+      return `${node.name}:`;
+    case 'ref':
+      return `${node.def.mnemonic} ${node.label}`;
+    case 'str':
+      return `PUSH_STR ${node.literal}`;
+    case 'init':
+      return `INIT ${node.addr} ${node.data.length} ${node.data.join(' ')}`;
+    case 'func':
+      return `FUNC ${node.frameSize} ${node.argCount}`;
+    case 'unknown':
+      return node.name;
+  }
+}
+
+/** Textual assembly for the whole program, accepted by LavaXAssembler. */
+export function formatIr(nodes: IrNode[]): string {
+  const lines: string[] = [];
+  for (const node of nodes) {
+    if (node.kind !== 'loc') lines.push(formatIrNode(node));
+  }
+  return lines.join('\n');
+}
@@ -0,0 +1,178 @@
+/**
+ * One-pass tokenizer for LavaXCompiler.
+ *
+ * The parser addresses the source by character offset (it also does raw
+ * character scans, e.g. for array dimensions and skipped function bodies),
+ * so the token stream is indexed by offset: `at(pos)` returns the token the
+ * compiler's old lex-from-here logic would produce at `pos`, whitespace and
+ * comments included. Lexing only ever depends on the text after `pos`, so a
+ * token found once is valid for every later visit. Offsets the linear pass
+ * never reached (a raw scan that stopped mid-token) are lexed on demand and
+ * then kept as well.
+ */
+
+export enum TokenKind {
+  End,
+  Identifier, // also numbers and any other run of non-special characters
+  String,
+  Char,
+  Punct,
+}
+
+const CH_SPACE = 1;
+const CH_SPECIAL = 2;
+
+// ASCII classes; non-ASCII characters fall back to /\s/ for whitespace.
+const CHAR_CLASS = new Uint8Array(128);
+for (const ch of ' \t\n\r\v\f') CHAR_CLASS[ch.charCodeAt(0)] = CH_SPACE;
+for (const ch of '(){}[],;=+-*/%><!&|^~#.') CHAR_CLASS[ch.charCodeAt(0)] = CH_SPECIAL;
+const COMPOUND_ASSIGN = new Set(['+', '-', '*', '/', '%', '&', '|', '^', '!']);
+
+function isSpace(code: number): boolean {
+  return code < 128 ? CHAR_CLASS[code] === CH_SPACE : /\s/.test(String.fromCharCode(code));
+}
+
+function isSpecial(code: number): boolean {
+  return code < 128 && CHAR_CLASS[code] === CH_SPECIAL;
+}
+
+/** Offset after the whitespace and comments starting at `pos`. */
+export function skipSpace(src: string, pos: number): number {
+  const len = src.length;
+  while (pos < len) {
+    const c = src.charCodeAt(pos);
+    if (isSpace(c)) { pos++; continue; }
+    if (c === 0x2f) { // '/'
+      const next = src.charCodeAt(pos + 1);
+      if (next === 0x2f) {
+        while (pos < len && src.charCodeAt(pos) !== 0x0a) pos++;
+        continue;
+      }
+      if (next === 0x2a) {
+        pos += 2;
+        while (pos < len && !(src.charCodeAt(pos) === 0x2a && src.charCodeAt(pos + 1) === 0x2f)) pos++;
+        pos += 2;
+        continue;
+      }
+    }
+    break;
+  }
+  return pos;
+}
+
+/** Kind and end offset of the token starting exactly at `start` (no leading whitespace). */
+function scanToken(src: string, start: number): { kind: TokenKind; end: number } {
+  const len = src.length;
+  let pos = start;
+  if (pos >= len) return { kind: TokenKind.End, end: pos };
+  const c = src[pos];
+
+  if (c === '"' || c === "'") {
+    pos++;
+    while (pos < len && src[pos] !== c) {
+      if (src[pos] === '\\') pos++;
+      pos++;
+    }
+    pos++;
+    return { kind: c === '"' ? TokenKind.String : TokenKind.Char, end: pos };
+  }
+
+  if (isSpecial(src.charCodeAt(pos))) {
+    const op = src[pos++];
+    const next = src[pos];
+    if ((op === '<' || op === '>') && next === op) {
+      pos++;
+      if (src[pos] === '=') pos++;
+    } else if ((op === '=' || op === '!' || op === '<' || op === '>') && next === '=') pos++;
+    else if ((op === '&' || op === '|') && next === op) {
+      pos++;
+      if (src[pos] === '=') pos++;
+    } else if ((op === '+' || op === '-') && next === op) pos++;
+    else if (op === '-' && next === '>') pos++;
+    else if (COMPOUND_ASSIGN.has(op) && next === '=') pos++;
+    return { kind: TokenKind.Punct, end: pos };
+  }
+
+  while (pos < len) {
+    const code = src.charCodeAt(pos);
+    if (isSpace(code) || isSpecial(code)) break;
+    pos++;
+  }
+  return { kind: TokenKind.Identifier, end: pos };
+}
+
+export class LavaXTokenStream {
+  /** Token fields, indexed by token number. */
+  public readonly kinds: TokenKind[] = [];
+  public readonly starts: number[] = [];
+  public readonly ends: number[] = [];
+  public readonly texts: string[] = [];
+  // Source offset -> token number + 1 (0 = not lexed from here yet). Set at
+  // each token's start and at the offset where its leading whitespace begins.
+  // Unterminated comments and literals end up to two characters past the end.
+  private readonly index: Int32Array;
+  private readonly interned = new Map<string, string>();
+
+  /** `eager` lexes the whole source up front; otherwise tokens are lexed as they are first asked for. */
+  constructor(private readonly src: string, eager = true) {
+    this.index = new Int32Array(src.length + 3);
+    if (!eager) return;
+    let pos = 0;
+    for (;;) {
+      const token = this.lexFrom(pos);
+      if (this.kinds[token] === TokenKind.End) break;
+      pos = this.ends[token];
+    }
+  }
+
+  /** Number of the token produced by lexing from `pos` (after skipping whitespace). */
+  public at(pos: number): number {
+    const cached = this.index[pos]; // undefined past the table
+    return cached > 0 ? cached - 1 : this.lexFrom(pos);
+  }
+
+  private lexFrom(pos: number): number {
+    const start = skipSpace(this.src, pos);
+    const known = this.index[start];
+    if (known > 0) {
+      this.index[pos] = known;
+      return known - 1;
+    }
+    const { kind, end } = scanToken(this.src, start);
+    let text = this.src.substring(start, end);
+    const interned = this.interned.get(text);
+    if (interned !== undefined) text = interned;
+    else this.interned.set(text, text);
+
+    const token = this.kinds.length;
+    this.kinds.push(kind);
+    this.starts.push(start);
+    this.ends.push(end);
+    this.texts.push(text);
+    this.index[start] = token + 1;
+    this.index[pos] = token + 1;
+    return token;
+  }
+}
+
+/** Offsets where each line of `src` starts; entry 0 is always 0. */
+export function lineStartOffsets(src: string): Int32Array {
+  let count = 1;
+  for (let pos = src.indexOf('\n'); pos !== -1; pos = src.indexOf('\n', pos + 1)) count++;
+  const starts = new Int32Array(count);
+  let line = 1;
+  for (let pos = src.indexOf('\n'); pos !== -1; pos = src.indexOf('\n', pos + 1)) starts[line++] = pos + 1;
+  return starts;
+}
+
+/** 0-based line containing `pos`, by binary search over lineStartOffsets(). */
+export function lineIndexAt(lineStarts: Int32Array, pos: number): number {
+  let lo = 0;
+  let hi = lineStarts.length - 1;
+  while (lo < hi) {
+    const mid = (lo + hi + 1) >>> 1;
+    if (lineStarts[mid] <= pos) lo = mid;
+    else hi = mid - 1;
+  }
+  return lo;
+}
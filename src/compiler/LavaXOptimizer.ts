@@ -0,0 +1,828 @@
+import { isSystemOpcode } from '../lav/format';
+import { Op } from '../types';
+import { SYSCALL_MAP } from '../vm/SyscallMetadata';
+import { GENERATED_LABEL, irNodeSize, irOp, irRef, type IrNode } from './LavaXIR';
+
+/**
+ * Optimizer for generated IR, run once per compile after the function cache
+ * has taken its copy (nodes are never modified in place; rewritten
+ * instructions are new nodes).
+ *
+ * An expression pass folds constants and picks immediate forms; a control
+ * flow pass then works on basic blocks (runs of instructions between labels
+ * and jumps) until nothing changes. Every rule can be switched off and counts
+ * its rewrites, so each one's effect on size and speed can be measured.
+ *
+ * Values follow the VM exactly: 32-bit wrap-around, MUL is Math.imul, DIV by
+ * zero is -1, MOD by zero is 0, SHR is a logical shift and comparisons
+ * yield -1 or 0. Expression rewrites only combine adjacent instructions, so
+ * nothing moves across a label or a source-location marker.
+ *
+ * JZ/JNZ test the value last removed by POP, and the code generator always
+ * emits them right after a POP; rules that drop a POP keep that pairing.
+ *
+ * Inlining runs between the two passes, on whole functions: sizes are
+ * measured on folded code, and the control flow rules see each copied body
+ * together with the code around its call.
+ */
+
+export const OPTIMIZER_RULES = [
+  /** PUSH 3; ADD -> ADD_C 3. */
+  'immediates',
+  /** Constant folding and strength reduction (see optimizeExpressions), and constant branch conditions. */
+  'foldConstants',
+  /** PUSH_W/PUSH_D of a value that fits a shorter push. */
+  'shortPush',
+  /** A jump to a JMP goes straight to its target; a JMP to RET/EXIT becomes it. */
+  'jumpThreading',
+  /** Jumps to the instruction that follows anyway; JZ over a JMP becomes JNZ. */
+  'branchToNext',
+  /** Instructions after JMP/RET/EXIT that no label leads to. */
+  'deadCode',
+  /** DUP, a constant or a plain load (and operators on it) whose value is popped right away. */
+  'dupPop',
+  /** POP; LD of a variable right after a STORE to it keeps the stored value instead. */
+  'storeLoad',
+  /** CALL of a small leaf function replaced by a copy of its body (see inlineCalls). */
+  'inlining',
+] as const;
+
+export type OptimizerRule = typeof OPTIMIZER_RULES[number];
+export type OptimizerRules = Record<OptimizerRule, boolean>;
+/** Rewrites made by each rule (instructions removed, replaced or retargeted). */
+export type OptimizerStats = Record<OptimizerRule, number>;
+
+export function defaultOptimizerRules(): OptimizerRules {
+  return Object.fromEntries(OPTIMIZER_RULES.map((rule) => [rule, true])) as OptimizerRules;
+}
+
+export function emptyOptimizerStats(): OptimizerStats {
+  return Object.fromEntries(OPTIMIZER_RULES.map((rule) => [rule, 0])) as OptimizerStats;
+}
+
+// Inlining limits: instructions in a function body (the final RET aside),
+// and bytes of parameters and locals it adds to a caller's frame. Frames
+// are stacked above the globals on every call, so each one inlined into
+// grows the memory a deep call chain needs; the growth is kept small.
+const INLINE_MAX_INSTRUCTIONS = 16;
+const INLINE_MAX_FRAME_GROWTH = 32;
+// Arguments a call may have that must be stored rather than used in place.
+const INLINE_MAX_STORED_ARGS = 1;
+// Frame header written by CALL: return address and saved base.
+const FRAME_HEADER = 5;
+
+// Rounds of the control flow pass; each can expose more (a removed jump
+// leaves a label unreferenced, which lets the code behind it die).
+const MAX_CONTROL_FLOW_ROUNDS = 8;
+
+// Binary ops with an immediate-operand form.
+const COMBO_OPS = new Map<number, Op>([
+  [Op.ADD, Op.ADD_C], [Op.SUB, Op.SUB_C], [Op.MUL, Op.MUL_C], [Op.DIV, Op.DIV_C], [Op.MOD, Op.MOD_C],
+  [Op.SHL, Op.SHL_C], [Op.SHR, Op.SHR_C], [Op.EQ, Op.EQ_C], [Op.NEQ, Op.NEQ_C], [Op.GT, Op.GT_C],
+  [Op.LT, Op.LT_C], [Op.GE, Op.GE_C], [Op.LE, Op.LE_C],
+]);
+
+const BINARY_OPS = new Map<number, (a: number, b: number) => number>([
+  [Op.ADD, (a, b) => (a + b) | 0],
+  [Op.SUB, (a, b) => (a - b) | 0],
+  [Op.AND, (a, b) => a & b],
+  [Op.OR, (a, b) => a | b],
+  [Op.XOR, (a, b) => a ^ b],
+  [Op.MUL, (a, b) => Math.imul(a, b)],
+  [Op.DIV, (a, b) => b === 0 ? -1 : (a / b) | 0],
+  [Op.MOD, (a, b) => b === 0 ? 0 : a % b],
+  [Op.SHL, (a, b) => b < 0 ? 0 : a << b],
+  [Op.SHR, (a, b) => b < 0 ? 0 : (a >>> b) | 0],
+  [Op.L_AND, (a, b) => a !== 0 && b !== 0 ? -1 : 0],
+  [Op.L_OR, (a, b) => a !== 0 || b !== 0 ? -1 : 0],
+  [Op.EQ, (a, b) => a === b ? -1 : 0],
+  [Op.NEQ, (a, b) => a !== b ? -1 : 0],
+  [Op.GT, (a, b) => a > b ? -1 : 0],
+  [Op.LT, (a, b) => a < b ? -1 : 0],
+  [Op.GE, (a, b) => a >= b ? -1 : 0],
+  [Op.LE, (a, b) => a <= b ? -1 : 0],
+]);
+
+// Immediate forms compute like their binary op, except that the VM's SHL_C
+// and SHR_C shift by the immediate without the negative-count check.
+const COMBO_FOLDS = new Map<number, (a: number, b: number) => number>();
+for (const [op, comboOp] of COMBO_OPS) COMBO_FOLDS.set(comboOp, BINARY_OPS.get(op)!);
+COMBO_FOLDS.set(Op.SHL_C, (a, b) => a << b);
+COMBO_FOLDS.set(Op.SHR_C, (a, b) => (a >>> b) | 0);
+
+const UNARY_OPS = new Map<number, (a: number) => number>([
+  [Op.NEG, (a) => -a | 0],
+  [Op.NOT, (a) => ~a],
+  [Op.L_NOT, (a) => a ? 0 : -1],
+]);
+
+// `c OP x` as `x OP' c`.
+const SWAPPED_OPS = new Map<number, Op>([
+  [Op.ADD, Op.ADD], [Op.MUL, Op.MUL], [Op.EQ, Op.EQ], [Op.NEQ, Op.NEQ],
+  [Op.GT, Op.LT], [Op.LT, Op.GT], [Op.GE, Op.LE], [Op.LE, Op.GE],
+]);
+
+// Comparison followed by L_NOT as the opposite comparison.
+const NEGATED_COMPARISONS = new Map<number, Op>([
+  [Op.EQ, Op.NEQ], [Op.NEQ, Op.EQ], [Op.GT, Op.LE], [Op.LE, Op.GT], [Op.LT, Op.GE], [Op.GE, Op.LT],
+  [Op.EQ_C, Op.NEQ_C], [Op.NEQ_C, Op.EQ_C], [Op.GT_C, Op.LE_C], [Op.LE_C, Op.GT_C], [Op.LT_C, Op.GE_C], [Op.GE_C, Op.LT_C],
+]);
+
+// Loads that only push a value: free to reorder with a constant push.
+const PLAIN_LOADS = new Set<number>([Op.LD_G_B, Op.LD_G_W, Op.LD_G_D, Op.LD_L_B, Op.LD_L_W, Op.LD_L_D]);
+// Loads whose value is never negative (bytes are unsigned).
+const BYTE_LOADS = new Set<number>([Op.LD_G_B, Op.LD_L_B]);
+
+// Handle type bits of a STORE target, by the load that reads the variable
+// back; local handles also carry HANDLE_BASE_EBP.
+const LOAD_HANDLES = new Map<number, number>([
+  [Op.LD_G_B, 0x10000], [Op.LD_G_W, 0x20000], [Op.LD_G_D, 0x40000],
+  [Op.LD_L_B, 0x810000], [Op.LD_L_W, 0x820000], [Op.LD_L_D, 0x840000],
+]);
+// STORE leaves the value it was given, not what the variable reads back:
+// for int and char variables the value must already be in range.
+const INT16_RESULTS = new Set<number>([
+  Op.PUSH_B, Op.PUSH_W, Op.LD_G_B, Op.LD_G_W, Op.LD_L_B, Op.LD_L_W, Op.LD_G_O_B, Op.LD_G_O_W, Op.LD_L_O_B, Op.LD_L_O_W,
+  Op.L_AND, Op.L_OR, Op.L_NOT, Op.EQ, Op.NEQ, Op.GT, Op.LT, Op.GE, Op.LE, Op.EQ_C, Op.NEQ_C, Op.GT_C, Op.LT_C, Op.GE_C, Op.LE_C,
+]);
+const BYTE_RESULTS = new Set<number>([Op.PUSH_B, Op.LD_G_B, Op.LD_L_B, Op.LD_G_O_B, Op.LD_L_O_B]);
+
+function isInt16(value: number): boolean {
+  return value >= -32768 && value <= 32767;
+}
+
+/** Exponent if `value` is a power of two, else -1. */
+function log2Exact(value: number): number {
+  return value > 0 && (value & (value - 1)) === 0 ? 31 - Math.clz32(value) : -1;
+}
+
+/** The shortest push of `value`, as the code generator picks it. */
+export function irPush(value: number): IrNode {
+  value |= 0;
+  if (value >= 0 && value <= 255) return irOp(Op.PUSH_B, value);
+  if (isInt16(value)) return irOp(Op.PUSH_W, value);
+  return irOp(Op.PUSH_D, value);
+}
+
+/** Value pushed by a PUSH_B/W/D node, or null for anything else. */
+function pushedValue(node: IrNode | undefined): number | null {
+  if (!node || node.kind !== 'op') return null;
+  switch (node.def.opcode) {
+    case Op.PUSH_B: return node.operand & 0xff;
+    case Op.PUSH_W: return (node.operand << 16) >> 16;
+    case Op.PUSH_D: return node.operand | 0;
+    default: return null;
+  }
+}
+
+function opcodeOf(node: IrNode | undefined): number {
+  return node && node.kind === 'op' ? node.def.opcode : -1;
+}
+
+/** Runs every enabled rule over `nodes`, adding to `stats`. */
+export function optimizeIr(nodes: IrNode[], rules: OptimizerRules, stats: OptimizerStats): IrNode[] {
+  let out = optimizeExpressions(nodes, rules, stats);
+  if (rules.inlining) out = inlineCalls(out, stats);
+  for (let round = 0; round < MAX_CONTROL_FLOW_ROUNDS; round++) {
+    const before = out.length;
+    const rewrites = OPTIMIZER_RULES.reduce((sum, rule) => sum + stats[rule], 0);
+    out = optimizeControlFlow(out, rules, stats);
+    if (out.length === before && OPTIMIZER_RULES.reduce((sum, rule) => sum + stats[rule], 0) === rewrites) break;
+  }
+  return out;
+}
+
+/**
+ * Fuses a small constant push with the binary op after it (PUSH 3; ADD ->
+ * ADD_C 3) and shortens pushes. With `foldConstants`, also:
+ *
+ * - evaluates operators whose operands are all constants;
+ * - moves a constant left operand past a plain load (3 < x -> x > 3) so it
+ *   can become an immediate;
+ * - drops identities (x + 0, x * 1, x / 1, shifts by 0) and merges ADD_C /
+ *   SUB_C chains;
+ * - turns multiplication by 2^k into SHL_C k, and division of an unsigned
+ *   byte by 2^k into SHR_C k (other values may be negative, where division
+ *   truncates and the logical shift would not);
+ * - absorbs a logical NOT into the comparison before it.
+ */
+export function optimizeExpressions(nodes: IrNode[], rules: OptimizerRules, stats: OptimizerStats): IrNode[] {
+  const out: IrNode[] = [];
+  const fold = rules.foldConstants;
+
+  const emitImmediate = (comboOp: number, imm: number) => {
+    if (fold) {
+      const value = pushedValue(out[out.length - 1]);
+      if (value !== null) {
+        out[out.length - 1] = irPush(COMBO_FOLDS.get(comboOp)!(value, imm));
+        stats.foldConstants++;
+        return;
+      }
+      if ((imm === 0 && (comboOp === Op.ADD_C || comboOp === Op.SUB_C || comboOp === Op.SHL_C || comboOp === Op.SHR_C))
+        || (imm === 1 && (comboOp === Op.MUL_C || comboOp === Op.DIV_C))) {
+        stats.foldConstants++;
+        return;
+      }
+      if (comboOp === Op.MUL_C && imm === -1) {
+        stats.foldConstants++;
+        emit(irOp(Op.NEG));
+        return;
+      }
+      const shift = log2Exact(imm);
+      if (shift > 0 && (comboOp === Op.MUL_C || (comboOp === Op.DIV_C && BYTE_LOADS.has(opcodeOf(out[out.length - 1]))))) {
+        out.push(irOp(comboOp === Op.MUL_C ? Op.SHL_C : Op.SHR_C, shift));
+        stats.foldConstants++;
+        return;
+      }
+      const prev = out[out.length - 1];
+      if ((comboOp === Op.ADD_C || comboOp === Op.SUB_C) && prev?.kind === 'op'
+        && (prev.def.opcode === Op.ADD_C || prev.def.opcode === Op.SUB_C)) {
+        const sum = (prev.def.opcode === Op.ADD_C ? prev.operand : -prev.operand) + (comboOp === Op.ADD_C ? imm : -imm);
+        if (isInt16(sum)) {
+          out.pop();
+          stats.foldConstants++;
+          emitImmediate(Op.ADD_C, sum);
+          return;
+        }
+      }
+    }
+    out.push(irOp(comboOp, imm));
+  };
+
+  const emitBinary = (opcode: number): boolean => {
+    const right = pushedValue(out[out.length - 1]);
+    if (fold && right !== null) {
+      const left = pushedValue(out[out.length - 2]);
+      const evaluate = BINARY_OPS.get(opcode);
+      if (left !== null && evaluate) {
+        out.length -= 2;
+        stats.foldConstants++;
+        emit(irPush(evaluate(left, right)));
+        return true;
+      }
+      if (opcode === Op.MUL && log2Exact(right) > 0) {
+        out.pop();
+        out.push(irOp(Op.SHL_C, log2Exact(right)));
+        stats.foldConstants++;
+        return true;
+      }
+    }
+    if (!rules.immediates) return false;
+    const comboOp = COMBO_OPS.get(opcode);
+    const prev = out[out.length - 1];
+    if (comboOp !== undefined && prev?.kind === 'op' && (prev.def.opcode === Op.PUSH_B || prev.def.opcode === Op.PUSH_W)
+      && isInt16(prev.operand)) {
+      out.pop();
+      stats.immediates++;
+      emitImmediate(comboOp, prev.operand);
+      return true;
+    }
+    if (fold && PLAIN_LOADS.has(opcodeOf(prev)) && SWAPPED_OPS.has(opcode)) {
+      const left = pushedValue(out[out.length - 2]);
+      if (left !== null && isInt16(left)) {
+        out.length -= 2;
+        out.push(prev);
+        stats.foldConstants++;
+        emitImmediate(COMBO_OPS.get(SWAPPED_OPS.get(opcode)!)!, left);
+        return true;
+      }
+    }
+    return false;
+  };
+
+  const emit = (node: IrNode) => {
+    if (node.kind === 'op') {
+      const opcode = node.def.opcode;
+      if (rules.shortPush && (opcode === Op.PUSH_W || opcode === Op.PUSH_D)) {
+        const shortest = irPush(pushedValue(node)!);
+        if (shortest.kind === 'op' && shortest.def !== node.def) {
+          node = shortest;
+          stats.shortPush++;
+        }
+      }
+      if (BINARY_OPS.has(opcode) && emitBinary(opcode)) return;
+      if (fold) {
+        if (COMBO_FOLDS.has(opcode)) {
+          emitImmediate(opcode, node.operand);
+          return;
+        }
+        const unary = UNARY_OPS.get(opcode);
+        const value = pushedValue(out[out.length - 1]);
+        if (unary && value !== null) {
+          out[out.length - 1] = irPush(unary(value));
+          stats.foldConstants++;
+          return;
+        }
+        const prev = out[out.length - 1];
+        const negated = NEGATED_COMPARISONS.get(opcodeOf(prev));
+        if (opcode === Op.L_NOT && negated !== undefined && prev.kind === 'op') {
+          out[out.length - 1] = irOp(negated, prev.operand);
+          stats.foldConstants++;
+          return;
+        }
+      }
+    }
+    out.push(node);
+  };
+
+  for (const node of nodes) emit(node);
+  return out;
+}
+
+const BRANCHES = new Set<number>([Op.JMP, Op.JZ, Op.JNZ]);
+// Values that can be dropped with the POP after them: no side effects.
+const DISCARDABLE = new Set<number>([Op.DUP, Op.PUSH_B, Op.PUSH_W, Op.PUSH_D, ...PLAIN_LOADS]);
+
+function isInstruction(node: IrNode): boolean {
+  return node.kind === 'op' || node.kind === 'ref' || node.kind === 'str';
+}
+
+function isTerminator(node: IrNode): boolean {
+  return node.kind === 'ref' ? node.def.opcode === Op.JMP
+    : node.kind === 'op' && (node.def.opcode === Op.RET || node.def.opcode === Op.EXIT);
+}
+
+/** Index of the last instruction in `out` (skipping location markers), or -1. */
+function lastInstruction(out: IrNode[], before = out.length): number {
+  let index = before - 1;
+  while (index >= 0 && out[index].kind === 'loc') index--;
+  return index >= 0 && isInstruction(out[index]) ? index : -1;
+}
+
+/**
+ * One round of the block-level rules: jump threading, branch-to-next and
+ * dead-code removal at block ends, and the dupPop and storeLoad patterns
+ * inside blocks (which may span statements, but never a label).
+ */
+export function optimizeControlFlow(nodes: IrNode[], rules: OptimizerRules, stats: OptimizerStats): IrNode[] {
+  const labelIndex = new Map<string, number>();
+  const referenced = new Set<string>();
+  nodes.forEach((node, index) => {
+    if (node.kind === 'label') labelIndex.set(node.name, index);
+    else if (node.kind === 'ref') referenced.add(node.label);
+  });
+  // Compiler-made labels nothing jumps to do not start a block.
+  const isDeadLabel = (node: IrNode) => node.kind === 'label' && !referenced.has(node.name) && GENERATED_LABEL.test(node.name);
+
+  // First instruction at or after `index`: where control goes from there.
+  const instructionAt = (index: number): IrNode | undefined => {
+    while (index < nodes.length && (nodes[index].kind === 'label' || nodes[index].kind === 'loc')) index++;
+    return nodes[index];
+  };
+  const finalTarget = (label: string): string => {
+    const seen = new Set<string>();
+    while (!seen.has(label)) {
+      seen.add(label);
+      const index = labelIndex.get(label);
+      const next = index === undefined ? undefined : instructionAt(index + 1);
+      if (next?.kind !== 'ref' || next.def.opcode !== Op.JMP) break;
+      label = next.label;
+    }
+    return label;
+  };
+  const fallsTo = (index: number, label: string): boolean => {
+    for (let i = index + 1; i < nodes.length && (nodes[i].kind === 'label' || nodes[i].kind === 'loc'); i++) {
+      if (nodes[i].kind === 'label' && (nodes[i] as { name: string }).name === label) return true;
+    }
+    return false;
+  };
+
+  const out: IrNode[] = [];
+  for (let i = 0; i < nodes.length; i++) {
+    let node = nodes[i];
+    if (node.kind === 'ref' && BRANCHES.has(node.def.opcode)) {
+      if (rules.jumpThreading) {
+        const target = finalTarget(node.label);
+        if (target !== node.label) {
+          node = { kind: 'ref', def: node.def, label: target };
+          stats.jumpThreading++;
+        }
+        const index = labelIndex.get(node.label);
+        const landing = node.def.opcode === Op.JMP && index !== undefined ? instructionAt(index + 1) : undefined;
+        if (landing?.kind === 'op' && (landing.def.opcode === Op.RET || landing.def.opcode === Op.EXIT)) {
+          node = landing;
+          stats.jumpThreading++;
+        }
+      }
+      if (node.kind === 'ref' && rules.branchToNext && fallsTo(i, node.label)) {
+        stats.branchToNext++;
+        continue;
+      }
+      let after = i + 1;
+      while (after < nodes.length && nodes[after].kind === 'loc') after++;
+      const next = nodes[after];
+      if (node.kind === 'ref' && rules.branchToNext && node.def.opcode !== Op.JMP
+        && next?.kind === 'ref' && next.def.opcode === Op.JMP && fallsTo(after, node.label)) {
+        // JZ over a JMP: JNZ to where the JMP goes.
+        node = irRef(node.def.opcode === Op.JZ ? Op.JNZ : Op.JZ, next.label);
+        stats.branchToNext++;
+        i = after;
+      }
+      const pop = lastInstruction(out);
+      if (node.kind === 'ref' && rules.foldConstants && node.def.opcode !== Op.JMP && pop > 0
+        && opcodeOf(out[pop]) === Op.POP && lastInstruction(out, pop) === pop - 1) {
+        // Constant condition (while (1)): the branch always or never goes.
+        const value = pushedValue(out[pop - 1]);
+        if (value !== null) {
+          out.splice(pop - 1, 2);
+          stats.foldConstants++;
+          if ((value === 0) !== (node.def.opcode === Op.JZ)) continue;
+          node = irRef(Op.JMP, node.label);
+        }
+      }
+    }
+    if (rules.deadCode && isDeadLabel(node)) continue;
+
+    if (rules.dupPop && isInstruction(node) && !(node.kind === 'ref' && (node.def.opcode === Op.JZ || node.def.opcode === Op.JNZ))) {
+      // The POP's value is never tested, so the pair does nothing; an
+      // operator that only changes the popped value goes first.
+      for (;;) {
+        const pop = lastInstruction(out);
+        const value = pop > 0 ? lastInstruction(out, pop) : -1;
+        if (value < 0 || value !== pop - 1 || opcodeOf(out[pop]) !== Op.POP) break;
+        const opcode = opcodeOf(out[value]);
+        if (DISCARDABLE.has(opcode)) out.splice(value, 2);
+        else if (COMBO_FOLDS.has(opcode) || UNARY_OPS.has(opcode)) out.splice(value, 1);
+        else break;
+        stats.dupPop++;
+      }
+    }
+    if (rules.storeLoad && node.kind === 'op' && LOAD_HANDLES.has(node.def.opcode)) {
+      // PUSH_D handle; SWAP; STORE; POP; LD var -> PUSH_D handle; SWAP; STORE
+      const pop = lastInstruction(out);
+      const tail = pop >= 4 ? out.slice(pop - 4, pop + 1) : [];
+      const handle = node.operand | LOAD_HANDLES.get(node.def.opcode)!;
+      const fits = node.def.opcode === Op.LD_G_D || node.def.opcode === Op.LD_L_D ? true
+        : (BYTE_LOADS.has(node.def.opcode) ? BYTE_RESULTS : INT16_RESULTS).has(opcodeOf(tail[0]));
+      // A 32-bit store (an inlined argument) reads back the same through a
+      // narrower load when the value fits it.
+      const stored = tail.length === 5 && opcodeOf(tail[1]) === Op.PUSH_D ? (tail[1] as { operand: number }).operand : -1;
+      if (fits && (stored === handle || stored === ((handle & ~0x70000) | 0x40000))
+        && opcodeOf(tail[2]) === Op.SWAP && opcodeOf(tail[3]) === Op.STORE && opcodeOf(tail[4]) === Op.POP) {
+        out.splice(pop, 1);
+        stats.storeLoad++;
+        continue;
+      }
+    }
+
+    out.push(node);
+    if (rules.deadCode && isTerminator(node)) {
+      // Up to the next label something jumps to; F_FLAG, FUNC and INIT stay.
+      while (i + 1 < nodes.length) {
+        const next = nodes[i + 1];
+        if (next.kind === 'label' ? !isDeadLabel(next)
+          : !(isInstruction(next) || next.kind === 'loc') || (next.kind === 'op' && next.def.mnemonic === 'F_FLAG')) break;
+        if (isInstruction(next)) stats.deadCode++;
+        i++;
+      }
+    }
+  }
+  return out;
+}
+
+// Instructions addressing the frame with their operand as the offset.
+const FRAME_OPERAND_OPS = new Set<number>([
+  Op.LD_L_B, Op.LD_L_W, Op.LD_L_D, Op.LD_L_O_B, Op.LD_L_O_W, Op.LD_L_O_D, Op.LEA_L_B, Op.LEA_L_W, Op.LEA_L_D,
+]);
+// Instructions that turn a frame offset into an absolute address (the
+// local's address escapes) or take the offset from the stack.
+const FRAME_ADDRESS_OPS = new Set<number>([Op.LEA_L_PH, Op.LEA_ABS, Op.STORE_EXT, Op.IDX]);
+// Instructions writing through a handle on the stack (STORE below a value).
+const HANDLE_WRITES = new Set<number>([Op.STORE, Op.INC_PRE, Op.DEC_PRE, Op.INC_POS, Op.DEC_POS]);
+// Syscalls taking pointers that they only read from.
+const READ_ONLY_SYSCALLS = new Set(['printf', 'TextOut', 'WriteBlock', 'strlen', 'strcmp', 'strchr', 'strstr']);
+// High 16 bits of a local byte/int/long handle.
+const LOCAL_HANDLE_KINDS = new Set<number>([0x81, 0x82, 0x84]);
+const HANDLE_BASE_EBP = 0x800000;
+// Values popped and pushed by the instructions argument code is made of;
+// the arguments of a call are found by walking back through these.
+const STACK_EFFECTS = new Map<number, [number, number]>();
+for (const op of [Op.PUSH_B, Op.PUSH_W, Op.PUSH_D, ...PLAIN_LOADS, Op.LEA_ABS, Op.LD_TEXT, Op.LD_GRAP, Op.LD_GBUF]) {
+  STACK_EFFECTS.set(op, [0, 1]);
+}
+for (const op of [
+  Op.LD_G_O_B, Op.LD_G_O_W, Op.LD_G_O_D, Op.LD_L_O_B, Op.LD_L_O_W, Op.LD_L_O_D, Op.LEA_G_B, Op.LEA_G_W, Op.LEA_G_D,
+  Op.LEA_L_B, Op.LEA_L_W, Op.LEA_L_D, Op.LEA_OFT, Op.LEA_L_PH, Op.LD_IND, Op.LD_IND_W, Op.LD_IND_D, Op.CPTR,
+  Op.L2C, Op.L2I, Op.PUSH_ADDR, ...HANDLE_WRITES, ...UNARY_OPS.keys(), ...COMBO_FOLDS.keys(),
+]) {
+  STACK_EFFECTS.set(op, [1, 1]);
+}
+for (const op of BINARY_OPS.keys()) STACK_EFFECTS.set(op, [2, 1]);
+STACK_EFFECTS.set(Op.STORE, [2, 1]);
+STACK_EFFECTS.set(Op.SWAP, [2, 2]);
+STACK_EFFECTS.set(Op.DUP, [1, 2]);
+
+interface FunctionExtent {
+  name: string;
+  /** First node of the function (its location markers, then F_FLAG). */
+  start: number;
+  /** Index of the FUNC node. */
+  func: number;
+  end: number;
+}
+
+interface InlineCandidate {
+  /** Nodes after FUNC, unreachable code left out. */
+  body: IrNode[];
+  frameSize: number;
+  argCount: number;
+  /** Per parameter, the loads that read it, or null if it is written or addressed. */
+  paramLoads: (Set<number> | null)[];
+  /** Whether the body may write memory outside its own frame. */
+  writes: boolean;
+}
+
+function findFunctions(nodes: IrNode[]): FunctionExtent[] {
+  const functions: FunctionExtent[] = [];
+  for (let i = 0; i + 2 < nodes.length; i++) {
+    const node = nodes[i];
+    const name = nodes[i + 1];
+    if (node.kind !== 'op' || node.def.mnemonic !== 'F_FLAG' || name.kind !== 'label' || nodes[i + 2].kind !== 'func') continue;
+    let start = i;
+    while (start > 0 && nodes[start - 1].kind === 'loc') start--;
+    const previous = functions[functions.length - 1];
+    if (previous) previous.end = start;
+    functions.push({ name: name.name, start, func: i + 2, end: nodes.length });
+  }
+  return functions;
+}
+
+/**
+ * `fn` as an inlining candidate: small, calling nothing (so it is not
+ * recursive, and the frames it would push stay where they were), and
+ * reaching its frame only through fixed offsets, which can be moved into the
+ * caller's frame. Functions that take a local's address, or compute offsets
+ * at run time, are left alone.
+ */
+function inlineCandidate(nodes: IrNode[], fn: FunctionExtent): InlineCandidate | null {
+  const { frameSize, argCount } = nodes[fn.func] as { frameSize: number; argCount: number };
+  if (fn.name === 'main' || frameSize - FRAME_HEADER > INLINE_MAX_FRAME_GROWTH) return null;
+  const inFrame = (offset: number) => offset >= FRAME_HEADER && offset < frameSize;
+  const paramLoads = Array.from({ length: argCount }, () => new Set<number>() as Set<number> | null);
+  // Parameter k is the 4-byte slot at FRAME_HEADER + k * 4.
+  const touch = (offset: number, load?: number) => {
+    const k = (offset - FRAME_HEADER) >> 2;
+    if (k >= argCount) return;
+    if (load !== undefined && offset === FRAME_HEADER + k * 4) paramLoads[k]?.add(load);
+    else paramLoads[k] = null;
+  };
+  const body: IrNode[] = [];
+  let writes = false;
+  let reachable = true;
+  let instructions = 0;
+  for (let i = fn.func + 1; i < fn.end; i++) {
+    const node = nodes[i];
+    if (node.kind === 'label') reachable = true;
+    if (!reachable) continue;
+    if (node.kind === 'ref' && node.def.opcode === Op.CALL) return null;
+    if (node.kind === 'op') {
+      const opcode = node.def.opcode;
+      if (FRAME_ADDRESS_OPS.has(opcode) || node.def.mnemonic === 'F_FLAG') return null;
+      if (FRAME_OPERAND_OPS.has(opcode)) {
+        if (!inFrame(node.operand)) return null;
+        touch(node.operand, PLAIN_LOADS.has(opcode) ? opcode : undefined);
+      } else if (opcode === Op.PUSH_D && LOCAL_HANDLE_KINDS.has(node.operand >>> 16)) {
+        if (!inFrame(node.operand & 0xffff)) return null;
+        touch(node.operand & 0xffff);
+      } else if ((node.operand >>> 0) < 0x1000000 && (node.operand & HANDLE_BASE_EBP)) {
+        // Part of a local handle assembled at run time (PUSH_W offset;
+        // PUSH_D 0x800000; OR): the offset is out of reach of the move.
+        return null;
+      }
+      if (HANDLE_WRITES.has(opcode)) {
+        // The code generator's own-variable forms: PUSH_D handle; SWAP; STORE and PUSH_D handle; INC.
+        const target = opcode === Op.STORE && opcodeOf(body[body.length - 1]) === Op.SWAP ? body[body.length - 2] : body[body.length - 1];
+        if (opcodeOf(target) !== Op.PUSH_D || !LOCAL_HANDLE_KINDS.has((target as { operand: number }).operand >>> 16)) writes = true;
+      } else if (isSystemOpcode(opcode)) {
+        // Only through a pointer argument; the screen and text buffers hold no variables.
+        const syscall = SYSCALL_MAP[node.def.mnemonic];
+        if (!syscall || ((syscall.isVariadic || syscall.paramTypes.includes(1)) && !READ_ONLY_SYSCALLS.has(syscall.name))) writes = true;
+      }
+    } else if (node.kind !== 'ref' && node.kind !== 'str' && node.kind !== 'label' && node.kind !== 'loc') {
+      return null;
+    }
+    body.push(node);
+    if (isInstruction(node)) instructions++;
+    if (isTerminator(node)) reachable = false;
+  }
+  const last = lastInstruction(body);
+  if (last >= 0 && opcodeOf(body[last]) === Op.RET) instructions--;
+  return instructions <= INLINE_MAX_INSTRUCTIONS ? { body, frameSize, argCount, paramLoads, writes } : null;
+}
+
+/** `value` truncated as `load` reads it back from a 32-bit slot. */
+function asLoaded(value: number, load: number): number {
+  if (load === Op.LD_L_B) return value & 0xff;
+  if (load === Op.LD_L_W) return (value << 16) >> 16;
+  return value;
+}
+
+/**
+ * Index in `out` where the code of each of the last `count` values pushed
+ * starts, or null if it cannot be told (a label, a call or a syscall on the
+ * way, or an instruction that straddles two of them).
+ */
+function argumentStarts(out: IrNode[], count: number): number[] | null {
+  const starts: number[] = [];
+  let needed = 0;
+  for (let index = out.length - 1; starts.length < count; index--) {
+    if (index < 0) return null;
+    const node = out[index];
+    if (node.kind === 'loc') continue;
+    const effect = node.kind === 'str' ? [0, 1] : STACK_EFFECTS.get(opcodeOf(node));
+    if (!effect) return null;
+    if (needed === 0) needed = 1;
+    if (effect[1] > needed) return null;
+    needed += effect[0] - effect[1];
+    if (needed === 0) starts.unshift(index);
+  }
+  return starts;
+}
+
+function writesMemory(node: IrNode): boolean {
+  return node.kind === 'op' && (HANDLE_WRITES.has(node.def.opcode) || isSystemOpcode(node.def.opcode));
+}
+
+/**
+ * Whether the argument `value` (a single instruction) can stand in for each
+ * read of its parameter: constants always can; a load of one of the caller's
+ * own variables (below `callerFrame`), or of a global, only if the body
+ * writes nothing outside its frame and every read sees the same value
+ * through its width.
+ */
+function passesDirectly(value: IrNode, loads: Set<number> | null, candidate: InlineCandidate, callerFrame: number): boolean {
+  if (!loads) return false;
+  if (pushedValue(value) !== null) return true;
+  const opcode = opcodeOf(value);
+  if (!PLAIN_LOADS.has(opcode) || candidate.writes) return false;
+  if ((opcode === Op.LD_L_B || opcode === Op.LD_L_W || opcode === Op.LD_L_D) && (value as { operand: number }).operand >= callerFrame) return false;
+  for (const load of loads) {
+    if (load === Op.LD_L_W && !INT16_RESULTS.has(opcode)) return false;
+    if (load === Op.LD_L_B && !BYTE_RESULTS.has(opcode)) return false;
+  }
+  return true;
+}
+
+/**
+ * Replaces calls to small leaf functions (see inlineCandidate) with a copy
+ * of the callee.
+ *
+ * Arguments that are a constant or a plain load are used where the body
+ * reads the parameter; the rest, which CALL/FUNC would have copied into the
+ * new frame, are stored into the caller's frame past its own variables,
+ * where the callee's frame offsets are moved. Storing takes four
+ * instructions per argument against three for CALL, FUNC and RET together,
+ * so a call is only inlined when at most INLINE_MAX_STORED_ARGS of its
+ * arguments need it.
+ *
+ * Inlining must not grow the program: a call is replaced only if the callee
+ * has no other call site (its F_FLAG, FUNC and RET go with it), or if the
+ * copy is no larger than the CALL and argument pushes it replaces. A caller's
+ * FUNC grows by the largest frame among the functions inlined into it. Each RET becomes a jump past the copy.
+ * Functions whose every call was inlined are dropped. Counts one rewrite per
+ * call eliminated.
+ */
+export function inlineCalls(nodes: IrNode[], stats: OptimizerStats): IrNode[] {
+  const functions = findFunctions(nodes);
+  const candidates = new Map<string, InlineCandidate>();
+  for (const fn of functions) {
+    const candidate = inlineCandidate(nodes, fn);
+    if (candidate) candidates.set(fn.name, candidate);
+  }
+  if (candidates.size === 0) return nodes;
+  const sites = new Map<string, number>();
+  for (const node of nodes) if (node.kind === 'ref') sites.set(node.label, (sites.get(node.label) ?? 0) + 1);
+
+  const labels = new Set<string>();
+  for (const node of nodes) if (node.kind === 'label') labels.add(node.name);
+  let labelCount = 0;
+  const freshLabel = () => {
+    let name: string;
+    do name = `L_INLINE_${labelCount++}`; while (labels.has(name));
+    return name;
+  };
+
+  let out: IrNode[] = [];
+  const inlined = new Set<string>();
+  let funcIndex = -1;
+  let frameSize = 0;
+  let growth = 0;
+  let location: IrNode | null = null;
+  const finishFunction = () => {
+    if (funcIndex < 0 || growth === 0) return;
+    const func = out[funcIndex] as { frameSize: number; argCount: number };
+    out[funcIndex] = { kind: 'func', frameSize: frameSize + growth, argCount: func.argCount };
+  };
+
+  for (const node of nodes) {
+    if (node.kind === 'func') {
+      finishFunction();
+      funcIndex = out.length;
+      frameSize = node.frameSize;
+      growth = 0;
+      location = null;
+    } else if (node.kind === 'loc') {
+      location = node;
+    }
+    const callee = node.kind === 'ref' && node.def.opcode === Op.CALL && funcIndex >= 0 ? node.label : '';
+    const candidate = candidates.get(callee);
+    if (!candidate) {
+      out.push(node);
+      continue;
+    }
+
+    // Arguments that are a single instruction and can be passed directly.
+    // A load is only moved past the code of later arguments if that writes
+    // nothing.
+    const starts = argumentStarts(out, candidate.argCount);
+    if (!starts) {
+      out.push(node);
+      continue;
+    }
+    const direct: (IrNode | undefined)[] = [];
+    const taken = new Set<number>();
+    let laterWrites = false;
+    for (let k = candidate.argCount - 1; k >= 0; k--) {
+      const codeEnd = k + 1 < candidate.argCount ? starts[k + 1] : out.length;
+      const code = out.slice(starts[k], codeEnd).filter(isInstruction);
+      const value = code[0];
+      if (code.length === 1 && passesDirectly(value, candidate.paramLoads[k], candidate, frameSize)
+        && (pushedValue(value) !== null || !laterWrites)) {
+        direct[k] = value;
+        taken.add(starts[k]);
+      }
+      laterWrites ||= code.some(writesMemory);
+    }
+    const stored = candidate.argCount - taken.size;
+    if (stored > INLINE_MAX_STORED_ARGS) {
+      out.push(node);
+      continue;
+    }
+
+    const move = (offset: number) => offset - FRAME_HEADER + frameSize;
+    const copy: IrNode[] = [];
+    // The remaining arguments, last one on top: as FUNC stores them, as 32-bit values.
+    for (let k = candidate.argCount - 1; k >= 0; k--) {
+      if (direct[k]) continue;
+      copy.push(irOp(Op.PUSH_D, move(FRAME_HEADER + k * 4) | 0x840000), irOp(Op.SWAP), irOp(Op.STORE), irOp(Op.POP));
+    }
+    const renamed = new Map<string, string>();
+    const rename = (label: string) => {
+      if (!renamed.has(label)) renamed.set(label, freshLabel());
+      return renamed.get(label)!;
+    };
+    const last = lastInstruction(candidate.body);
+    let end: string | null = null;
+    candidate.body.forEach((inner, index) => {
+      if (inner.kind === 'label') {
+        copy.push({ kind: 'label', name: rename(inner.name) });
+      } else if (inner.kind === 'ref') {
+        copy.push({ kind: 'ref', def: inner.def, label: rename(inner.label) });
+      } else if (inner.kind !== 'op') {
+        copy.push(inner);
+      } else if (inner.def.opcode === Op.RET) {
+        if (index !== last) copy.push(irRef(Op.JMP, end ??= freshLabel()));
+      } else if (FRAME_OPERAND_OPS.has(inner.def.opcode)) {
+        const value = direct[(inner.operand - FRAME_HEADER) >> 2];
+        const constant = pushedValue(value);
+        if (!value) copy.push(irOp(inner.def.opcode, move(inner.operand)));
+        else copy.push(constant === null ? value : irPush(asLoaded(constant, inner.def.opcode)));
+      } else if (inner.def.opcode === Op.PUSH_D && LOCAL_HANDLE_KINDS.has(inner.operand >>> 16)) {
+        copy.push(irOp(Op.PUSH_D, (inner.operand & ~0xffff) | move(inner.operand & 0xffff)));
+      } else {
+        copy.push(inner);
+      }
+    });
+    if (end) copy.push({ kind: 'label', name: end });
+    // Code after the copy belongs to the caller's line again.
+    if (location && candidate.body.some((inner) => inner.kind === 'loc')) copy.push(location);
+
+    let replaced = irNodeSize(node);
+    for (const index of taken) replaced += irNodeSize(out[index]);
+    if (sites.get(callee) !== 1 && copy.reduce((size, inner) => size + irNodeSize(inner), 0) > replaced) {
+      out.push(node);
+      continue;
+    }
+    if (taken.size > 0) out = out.filter((_, index) => !taken.has(index));
+    out.push(...copy);
+    growth = Math.max(growth, candidate.frameSize - FRAME_HEADER);
+    inlined.add(callee);
+    stats.inlining++;
+  }
+  finishFunction();
+
+  const called = new Set<string>();
+  for (const node of out) if (node.kind === 'ref') called.add(node.label);
+  const unused = new Set(functions.filter((fn) => inlined.has(fn.name) && !called.has(fn.name)).map((fn) => fn.name));
+  if (unused.size === 0) return out;
+  // From the F_FLAG (and the markers before it) to the next function.
+  const result: IrNode[] = [];
+  let next = 0;
+  for (const fn of findFunctions(out)) {
+    if (!unused.has(fn.name)) continue;
+    result.push(...out.slice(next, fn.start));
+    next = fn.end;
+  }
+  result.push(...out.slice(next));
+  return result;
+}
@@ -149,6 +149,7 @@ export const Device: React.FC<DeviceProps> = ({
                                 {(lifecycleState === 'paused' || lifecycleState === 'faulted') && pauseDiagnostics?.message && (
                                     <span className="text-[9px] text-neutral-400 normal-case tracking-normal font-semibold leading-relaxed">
                                         {pauseDiagnostics.message}
+                                        {pauseDiagnostics.source && ` (${pauseDiagnostics.source.file || 'source'}:${pauseDiagnostics.source.line})`}
                                     </span>
                                 )}
                             </div>
@@ -8,6 +8,7 @@ interface EditorProps {
     language?: string; // 支持 c, cpp, javascript, python 等
     gotoLine?: {line: number; col: number} | null;
     onScroll?: (e: React.UIEvent<HTMLTextAreaElement>) => void;
+    diagnostic?: string | null; // 后台编译的错误信息，显示在状态栏
 }
 
 export const CodeEditor: React.FC<EditorProps> = ({
@@ -15,6 +16,7 @@ export const CodeEditor: React.FC<EditorProps> = ({
     onChange,
     language = 'c', // 默认设为 C 语言（根据你之前的关键字推断）
     gotoLine,
+    diagnostic,
 }) => {
     const { t } = useI18n();
     const monaco = useMonaco();
@@ -95,6 +97,11 @@ export const CodeEditor: React.FC<EditorProps> = ({
                 <div>
                     {t?.('lineLabel') || 'Ln'} {cursorPosition.line}, {t?.('columnLabel') || 'Col'} {cursorPosition.column}
                 </div>
+                {diagnostic && (
+                    <div className="flex-1 mx-4 truncate text-red-400" title={diagnostic}>
+                        {diagnostic.split('\n')[0]}
+                    </div>
+                )}
                 <div>
                     {language.toUpperCase()}
                 </div>
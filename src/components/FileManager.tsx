@@ -1,7 +1,7 @@
 import React, { useState, useEffect, useRef, useCallback, useMemo } from 'react';
 import { FolderOpen, Upload, Trash2, FileText, PlayCircle, Download, FolderPlus, ChevronRight, File, Folder, SearchCode, Edit } from 'lucide-react';
 import { LavaXVM } from '../vm';
-import iconv from 'iconv-lite';
+import { decodeGbk, encodeGbk } from '../lav/gbk';
 import { useDialog } from './dialogs/DialogContext';
 import { useI18n } from '../i18n';
 
@@ -42,7 +42,7 @@ export const FileManager: React.FC<{
         return allFiles.some(f => f.path === normalized || f.path === dirPrefix || f.path.startsWith(dirPrefix));
     }, [allFiles, normalizePath]);
 
-    const moveItemInternal = useCallback((item: typeof items[number], destinationPath: string) => {
+    const moveItemInternal = useCallback(async (item: typeof items[number], destinationPath: string) => {
         const targetPath = normalizePath(destinationPath);
         if (!targetPath || targetPath === '/') return false;
 
@@ -54,18 +54,18 @@ export const FileManager: React.FC<{
             }
 
             const filesToMove = allFiles.filter(f => f.path === sourcePrefix || f.path.startsWith(sourcePrefix));
-            filesToMove.forEach(f => {
-                const data = vm.vfs.getFile(f.path);
-                if (!data) return;
+            for (const f of filesToMove) {
+                const data = await vm.vfs.readFile(f.path);
+                if (!data) continue;
                 const relativePath = f.path.slice(sourcePrefix.length);
                 const nextPath = relativePath ? `${targetPath}/${relativePath}` : `${targetPath}/`;
                 vm.vfs.addFile(nextPath, data);
                 vm.vfs.deleteFile(f.path);
-            });
+            }
             return true;
         }
 
-        const data = vm.vfs.getFile(item.fullPath);
+        const data = await vm.vfs.readFile(item.fullPath);
         if (!data) return false;
         vm.vfs.addFile(targetPath, data);
         vm.vfs.deleteFile(item.fullPath);
@@ -124,8 +124,7 @@ export const FileManager: React.FC<{
                     // Try decoding as UTF-8 with fatal: true to detect encoding
                     const text = new TextDecoder('utf-8', { fatal: true }).decode(data);
                     // Successfully decoded as UTF-8, convert to GBK for VFS storage
-                    const gbkData = iconv.encode(text, 'gbk');
-                    vm.vfs.addFile(path, new Uint8Array(gbkData));
+                    vm.vfs.addFile(path, encodeGbk(text));
                 } catch (e) {
                     // Decoding failed, assume it's already GBK (or another non-UTF-8 encoding)
                     // and store the raw bytes directly.
@@ -193,7 +192,7 @@ export const FileManager: React.FC<{
 
         if (isTextFile) {
             // For text files, convert from GBK to UTF-8
-            const text = iconv.decode(Buffer.from(data), 'gbk');
+            const text = decodeGbk(data);
             blobData = text;
             mimeType = 'text/plain;charset=utf-8';
         } else {
@@ -229,7 +228,7 @@ export const FileManager: React.FC<{
         const parentPath = currentPath === '/' ? '/' : currentPath.endsWith('/') ? currentPath : currentPath + '/';
         const newPath = `${parentPath}${newName}`;
 
-        moveItemInternal(item, newPath);
+        await moveItemInternal(item, newPath);
 
 
         refreshFiles();
@@ -257,7 +256,7 @@ export const FileManager: React.FC<{
         });
 
         if (!destination) return;
-        if (moveItemInternal(item, destination)) {
+        if (await moveItemInternal(item, destination)) {
             refreshFiles();
         }
     };
@@ -314,7 +313,7 @@ export const FileManager: React.FC<{
                         <div
                             key={item.fullPath}
                             className="flex items-center justify-between p-3 bg-white/5 hover:bg-white/10 rounded-xl group text-[11px] transition-all cursor-default border border-transparent hover:border-white/10 gap-3"
-                            onClick={() => {
+                            onClick={async () => {
                                 console.log('[FileManager] Item clicked:', item);
                                 if (item.isDir) {
                                     console.log('[FileManager] Changing directory to:', item.fullPath);
@@ -322,12 +321,12 @@ export const FileManager: React.FC<{
                                 }
                                 else if (isText) {
                                     console.log('[FileManager] Opening text file:', item.fullPath);
-                                    const d = vm.vfs.getFile(item.fullPath);
+                                    const d = await vm.vfs.readFile(item.fullPath);
                                     if (d) onOpenFile(item.fullPath, d);
                                 }
                                 else if (isLav) {
                                     console.log('[FileManager] Running LAV file:', item.fullPath);
-                                    const d = vm.vfs.getFile(item.fullPath);
+                                    const d = await vm.vfs.readFile(item.fullPath);
                                     if (d) onRunLav(item.fullPath, d);
                                 }
                             }}
@@ -346,10 +345,10 @@ export const FileManager: React.FC<{
                             <div className="flex items-center gap-1.5 flex-wrap justify-end opacity-100 md:opacity-0 md:group-hover:opacity-100 transition-opacity shrink-0">
                                 {!item.isDir && isLav && (
                                     <button
-                                        onClick={(e) => {
+                                        onClick={async (e) => {
                                             e.stopPropagation();
                                             console.log('[FileManager] Run LAV clicked:', item.fullPath);
-                                            const d = vm.vfs.getFile(item.fullPath);
+                                            const d = await vm.vfs.readFile(item.fullPath);
                                             if (d) onRunLav(item.fullPath, d);
                                             else console.error('[FileManager] Could not get file data for:', item.fullPath);
                                         }}
@@ -359,9 +358,9 @@ export const FileManager: React.FC<{
                                         <PlayCircle size={16} />
                                     </button>
                                 )}
-                                {!item.isDir && isLav && <button onClick={(e) => { e.stopPropagation(); const d = vm.vfs.getFile(item.fullPath); if (d) onDecompileLav(d); }} className="px-2 py-1.5 rounded-lg bg-white/5 hover:text-blue-400 hover:bg-white/10 transition-colors" title={t('decompile')}><SearchCode size={16} /></button>}
-                                {!item.isDir && isText && <button onClick={(e) => { e.stopPropagation(); const d = vm.vfs.getFile(item.fullPath); if (d) onOpenFile(item.fullPath, d); }} className="px-2 py-1.5 rounded-lg bg-white/5 hover:text-purple-400 hover:bg-white/10 transition-colors" title={t('openInEditor')}><FileText size={16} /></button>}
-                                {!item.isDir && <button onClick={(e) => { e.stopPropagation(); const d = vm.vfs.getFile(item.fullPath); if (d) downloadFile(item.name, d); }} className="px-2 py-1.5 rounded-lg bg-white/5 hover:text-blue-400 hover:bg-white/10 transition-colors" title={t('download')}><Download size={16} /></button>}
+                                {!item.isDir && isLav && <button onClick={async (e) => { e.stopPropagation(); const d = await vm.vfs.readFile(item.fullPath); if (d) onDecompileLav(d); }} className="px-2 py-1.5 rounded-lg bg-white/5 hover:text-blue-400 hover:bg-white/10 transition-colors" title={t('decompile')}><SearchCode size={16} /></button>}
+                                {!item.isDir && isText && <button onClick={async (e) => { e.stopPropagation(); const d = await vm.vfs.readFile(item.fullPath); if (d) onOpenFile(item.fullPath, d); }} className="px-2 py-1.5 rounded-lg bg-white/5 hover:text-purple-400 hover:bg-white/10 transition-colors" title={t('openInEditor')}><FileText size={16} /></button>}
+                                {!item.isDir && <button onClick={async (e) => { e.stopPropagation(); const d = await vm.vfs.readFile(item.fullPath); if (d) downloadFile(item.name, d); }} className="px-2 py-1.5 rounded-lg bg-white/5 hover:text-blue-400 hover:bg-white/10 transition-colors" title={t('download')}><Download size={16} /></button>}
                                 <button onClick={(e) => { e.stopPropagation(); moveItem(item); }} className="px-2 py-1.5 rounded-lg bg-white/5 hover:text-cyan-400 hover:bg-white/10 transition-colors text-[10px] font-bold" title={t('move')}>{t('move')}</button>
                                 <button onClick={(e) => { e.stopPropagation(); renameItem(item); }} className="px-2 py-1.5 rounded-lg bg-white/5 hover:text-yellow-400 hover:bg-white/10 transition-colors" title={t('rename')}><Edit size={16} /></button>
                                 <button onClick={(e) => { e.stopPropagation(); deleteItem(item); }} className="px-2 py-1.5 rounded-lg bg-white/5 hover:text-red-500 hover:bg-white/10 transition-colors" title={t('deleteAction')}><Trash2 size={16} /></button>
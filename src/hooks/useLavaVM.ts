@@ -1,9 +1,11 @@
 import { useState, useEffect, useRef, useCallback, useMemo } from 'react';
-import iconv from 'iconv-lite';
 import { LavaXVM } from '../vm';
-import { LavaXCompiler } from '../compiler';
 import { LavaXAssembler } from '../compiler/LavaXAssembler';
-import type { LavaVmWorkerEvent, LavaVmWorkerRequest, RuntimeFilePayload } from '../workers/lavaVmRuntimeProtocol';
+import { decodeGbk } from '../lav/gbk';
+import type { LavLineMap, LavSourceLine } from '../lav/lineMap';
+import { collectIncludes, LavaCompileClient, type LavaCompileOutput } from '../workers/lavaCompileClient';
+import type { LavaVmWorkerEvent, LavaVmWorkerRequest, RuntimeFilePayload, RuntimeRemoteFile } from '../workers/lavaVmRuntimeProtocol';
+import { VFS_CHUNK_SIZE } from '../vm/VFSStorageDriver';
 
 export type VmLifecycleState = 'idle' | 'running' | 'waiting' | 'paused' | 'faulted' | 'stopped';
 
@@ -15,6 +17,7 @@ export interface VmPauseDiagnostics {
     sp?: number;
     base?: number;
     opcode?: number;
+    source?: LavSourceLine;
     raw?: unknown;
 }
 
@@ -26,6 +29,7 @@ interface VmLifecycleSnapshot {
     sp?: number;
     base?: number;
     opcode?: number;
+    source?: LavSourceLine | null;
 }
 
 const ACTIVE_VM_STATES = new Set<VmLifecycleState>(['running', 'waiting', 'paused']);
@@ -72,6 +76,7 @@ const normalizeDiagnostics = (payload: unknown, fallbackReason: string): VmPause
             sp: typeof snapshot.sp === 'number' ? snapshot.sp : undefined,
             base: typeof snapshot.base === 'number' ? snapshot.base : undefined,
             opcode: typeof snapshot.opcode === 'number' ? snapshot.opcode : undefined,
+            source: isRecord(snapshot.source) && typeof snapshot.source.line === 'number' ? snapshot.source : undefined,
             raw: payload,
         };
     }
@@ -95,6 +100,8 @@ export function useLavaVM(onLog: (msg: string) => void) {
     const workerReadyRef = useRef(false);
     const workerReadyPromiseRef = useRef<Promise<void> | null>(null);
     const fontBytesRef = useRef<Uint8Array | null>(null);
+    // VFS change generation the worker's file copy matches; null until it has one.
+    const workerFilesGenerationRef = useRef<number | null>(null);
     const onLogRef = useRef(onLog);
 
     useEffect(() => {
@@ -102,8 +109,14 @@ export function useLavaVM(onLog: (msg: string) => void) {
     }, [onLog]);
 
     const vm = useMemo(() => new LavaXVM(), []);
-    const compiler = useMemo(() => new LavaXCompiler(), []);
+    // Compiles run in their own worker, created on first use.
+    const compileWorkerRef = useRef<Worker | null>(null);
+    const compileClientRef = useRef<LavaCompileClient | null>(null);
+    // Bumped per compileInWorker call; a background compile still reading includes when a newer one starts is dropped.
+    const compileRequestRef = useRef(0);
     const assembler = useMemo(() => new LavaXAssembler(), []);
+    // Line maps of binaries compiled here, passed along when one of them is run.
+    const lineMapsRef = useRef(new WeakMap<Uint8Array, LavLineMap>());
 
     const baseUrl = ((import.meta as ImportMeta & { env?: { BASE_URL?: string } }).env?.BASE_URL ?? '/');
 
@@ -160,37 +173,46 @@ export function useLavaVM(onLog: (msg: string) => void) {
         onLogRef.current(msg);
     }, [inferLifecycleFromLog]);
 
-    const snapshotRuntimeFiles = useCallback(async (sourcePath?: string) => {
+    /**
+     * Files the worker is missing: everything the first time, then the changes since the last run.
+     * Bodies still loading from storage are sent as remote files; the worker reads them on demand.
+     */
+    const collectRunFiles = useCallback(async (sourcePath?: string) => {
         await vm.vfs.ready;
-        const runtimeFiles = new Map<string, Uint8Array>();
+        const since = workerFilesGenerationRef.current;
+        const generation = vm.vfs.markChangeGeneration();
+        let paths: string[];
+        let deletedPaths: string[] = [];
+        if (since === null) {
+            paths = vm.vfs.getFiles().map(f => f.path);
+        } else {
+            const changes = vm.vfs.changesSince(since);
+            paths = changes.changed;
+            deletedPaths = changes.deleted;
+        }
 
-        for (const file of vm.vfs.getFiles()) {
-            const data = vm.vfs.getFile(file.path);
-            if (!data) continue;
-            runtimeFiles.set(file.path, new Uint8Array(data));
+        const files: RuntimeFilePayload[] = [];
+        const remoteFiles: RuntimeRemoteFile[] = [];
+        let sizes: Map<string, number> | null = null;
+        for (const path of paths) {
+            const data = vm.vfs.peekFile(path);
+            if (data) {
+                files.push({ path, data: data.buffer.slice(data.byteOffset, data.byteOffset + data.byteLength) });
+                continue;
+            }
+            sizes ??= new Map(vm.vfs.getFiles().map(f => [f.path, f.size]));
+            const size = sizes.get(path);
+            if (size !== undefined) remoteFiles.push({ path, size });
         }
+        workerFilesGenerationRef.current = generation;
 
-        let stagedCount = 0;
+        let stageLavaDataFrom: string | undefined;
         if (sourcePath && sourcePath.includes('/')) {
             const sourceDir = sourcePath.slice(0, sourcePath.lastIndexOf('/')) || '/';
-            const siblingLavaDataPrefix = `${sourceDir === '/' ? '' : sourceDir}/LavaData/`;
-            for (const [path, data] of runtimeFiles.entries()) {
-                if (!path.startsWith(siblingLavaDataPrefix)) continue;
-                const relativePath = path.slice(siblingLavaDataPrefix.length);
-                if (!relativePath) continue;
-                runtimeFiles.set(`/LavaData/${relativePath}`, new Uint8Array(data));
-                stagedCount++;
-            }
-            if (stagedCount > 0) {
-                log(`System: Staged ${stagedCount} runtime asset${stagedCount === 1 ? '' : 's'} from ${siblingLavaDataPrefix} into /LavaData.`);
-            }
+            stageLavaDataFrom = `${sourceDir === '/' ? '' : sourceDir}/LavaData/`;
         }
-
-        return Array.from(runtimeFiles.entries()).map<RuntimeFilePayload>(([path, data]) => ({
-            path,
-            data: data.buffer.slice(data.byteOffset, data.byteOffset + data.byteLength),
-        }));
-    }, [vm, log]);
+        return { files, remoteFiles, deletedPaths, resetFiles: since === null, stageLavaDataFrom };
+    }, [vm]);
 
     const handleWorkerEvent = useCallback((event: MessageEvent<LavaVmWorkerEvent>) => {
         const message = event.data;
@@ -222,14 +244,33 @@ export function useLavaVM(onLog: (msg: string) => void) {
                 setVmState('faulted', message.payload ?? message.message);
                 log(`[VM Worker Error] ${message.message}`);
                 return;
+            case 'readChunks': {
+                // A remote file the worker's VM opened; it may still be loading here.
+                const worker = event.target as Worker;
+                const { id, path, first, count } = message;
+                vm.vfs.readFile(path).then(data => {
+                    if (!data) throw new Error(`${path} no longer exists`);
+                    const chunks: ArrayBuffer[] = [];
+                    for (let i = first; i < first + count; i++) {
+                        chunks.push(data.slice(i * VFS_CHUNK_SIZE, (i + 1) * VFS_CHUNK_SIZE).buffer);
+                    }
+                    worker.postMessage({ type: 'chunks', id, chunks } satisfies LavaVmWorkerRequest, chunks);
+                }).catch((error: any) => {
+                    worker.postMessage({ type: 'chunks', id, error: error?.message ?? String(error) } satisfies LavaVmWorkerRequest);
+                });
+                return;
+            }
             case 'fileSync': {
                 // Sync VFS changes made by the VM back to the main-thread VFS
+                const workerInSync = workerFilesGenerationRef.current === vm.vfs.markChangeGeneration();
                 for (const f of message.files) {
                     vm.vfs.addFile(f.path, new Uint8Array(f.data));
                 }
                 for (const p of message.deletedPaths) {
                     vm.vfs.deleteFile(p);
                 }
+                // The worker already has these changes; only local edits made meanwhile need resending.
+                if (workerInSync) workerFilesGenerationRef.current = vm.vfs.markChangeGeneration();
                 return;
             }
         }
@@ -244,6 +285,7 @@ export function useLavaVM(onLog: (msg: string) => void) {
         }
 
         workerReadyRef.current = false;
+        workerFilesGenerationRef.current = null;
         const worker = new Worker(new URL('../workers/lavaVmWorker.ts', import.meta.url), { type: 'module' });
         worker.addEventListener('message', handleWorkerEvent);
         workerRef.current = worker;
@@ -294,79 +336,104 @@ export function useLavaVM(onLog: (msg: string) => void) {
                 workerRef.current = null;
                 workerReadyPromiseRef.current = null;
                 workerReadyRef.current = false;
+                workerFilesGenerationRef.current = null;
             }
         };
     }, [baseUrl, handleWorkerEvent, log, vm]);
 
+    useEffect(() => () => {
+        compileWorkerRef.current?.terminate();
+        compileWorkerRef.current = null;
+        compileClientRef.current = null;
+    }, []);
+
     useEffect(() => {
         if (lifecycleState !== 'paused') {
             blockedInputStateRef.current = null;
         }
     }, [lifecycleState]);
 
-    const compile = useCallback((code: string, sourceDir?: string, sourceFile?: string) => {
-        log('Compiling...');
-        // Set up #include resolver using VFS, relative to sourceDir
-        compiler.includeResolver = (filename: string) => {
-            // Try relative to sourceDir first, then root
+    /**
+     * Compiles in the worker. A `background` (diagnostics) compile resolves to null if a
+     * newer request superseded it; one the user asked for always runs.
+     * Results are cached by content, so repeating a compile of the same text is free.
+     */
+    const compileInWorker = useCallback(async (code: string, sourceDir?: string, sourceFile?: string, background = false): Promise<LavaCompileOutput | null> => {
+        if (!compileClientRef.current) {
+            const worker = new Worker(new URL('../workers/lavaCompileWorker.ts', import.meta.url), { type: 'module' });
+            compileWorkerRef.current = worker;
+            compileClientRef.current = new LavaCompileClient(worker);
+        }
+        const client = compileClientRef.current;
+        const request = ++compileRequestRef.current;
+        // #include resolves against the VFS: relative to sourceDir first, then root.
+        // The worker has no VFS, so the files are gathered here and sent along;
+        // readFile waits for bodies a lazy driver has not fetched yet.
+        const includes = await collectIncludes(code, async (filename: string) => {
             const candidates = sourceDir
                 ? [`${sourceDir}/${filename}`, filename]
                 : [filename];
             for (const path of candidates) {
-                const data = vm.vfs.getFile(path);
+                const data = await vm.vfs.readFile(path);
                 if (data) {
-                    try {
-                        return iconv.decode(Buffer.from(data), 'gbk');
-                    } catch {
-                        return new TextDecoder().decode(data);
-                    }
+                    return decodeGbk(data);
                 }
             }
             return null;
-        };
-        const asm = compiler.compile(code, sourceFile ?? '');
-        compiler.includeResolver = null;
-        if (asm.startsWith('ERROR')) {
-            log(asm);
-            return { asm, bin: null };
-        }
-        log('Assembling...');
-        try {
-            const bin = assembler.assemble(asm);
-            log(`Success! Binary size: ${bin.length} bytes`);
-            return { asm, bin };
-        } catch (e: any) {
-            log('Assembly Error: ' + e.message);
+        });
+        if (background && request !== compileRequestRef.current) return null;
+        return client.compile({ source: code, sourceFile: sourceFile ?? '', includes }, { background });
+    }, [vm]);
+
+    const compile = useCallback(async (code: string, sourceDir?: string, sourceFile?: string) => {
+        log('Compiling...');
+        const result = await compileInWorker(code, sourceDir, sourceFile);
+        if (!result) return null;
+        const asm = result.listing ?? result.error ?? '';
+        if (!result.lav) {
+            log(result.listing ? 'Assembly Error: ' + result.error!.replace(/^ERROR: /, '') : asm);
             return { asm, bin: null };
         }
-    }, [compiler, assembler, vm, log]);
+        if (result.lineMap) lineMapsRef.current.set(result.lav, result.lineMap);
+        log(`Success! Binary size: ${result.lav.length} bytes`);
+        return { asm, bin: result.lav };
+    }, [compileInWorker, log]);
+
+    /** Compiles for diagnostics only: the error message, null if it compiles, undefined if superseded. */
+    const checkSource = useCallback(async (code: string, sourceDir?: string, sourceFile?: string) => {
+        const result = await compileInWorker(code, sourceDir, sourceFile, true);
+        if (!result) return undefined;
+        return result.lav ? null : (result.error ?? '');
+    }, [compileInWorker]);
 
     const run = useCallback(async (bin: Uint8Array, sourcePath?: string) => {
         setPauseDiagnostics(null);
-        const runtimeFiles = await snapshotRuntimeFiles(sourcePath);
         const worker = workerRef.current;
         await ensureWorker();
         const activeWorker = workerRef.current ?? worker;
         if (!activeWorker) {
             throw new Error('VM worker failed to initialize');
         }
+        // After ensureWorker: a fresh worker needs every file.
+        const runFiles = await collectRunFiles(sourcePath);
 
         setScreen(null);
         setVmState('running');
 
         const programBuffer = bin.buffer.slice(bin.byteOffset, bin.byteOffset + bin.byteLength);
         const transfers: Transferable[] = [programBuffer];
-        for (const file of runtimeFiles) {
+        for (const file of runFiles.files) {
             transfers.push(file.data);
         }
 
         activeWorker.postMessage({
             type: 'run',
             program: programBuffer,
-            files: runtimeFiles,
+            ...runFiles,
             debug: vm.debug,
+            lineMap: lineMapsRef.current.get(bin),
         } satisfies LavaVmWorkerRequest, transfers);
-    }, [ensureWorker, snapshotRuntimeFiles, vm, setVmState]);
+    }, [ensureWorker, collectRunFiles, vm, setVmState]);
 
     const stop = useCallback(() => {
         workerRef.current?.postMessage({ type: 'stop' } satisfies LavaVmWorkerRequest);
@@ -416,13 +483,13 @@ export function useLavaVM(onLog: (msg: string) => void) {
         logs,
         screen,
         compile,
+        checkSource,
         run,
         stop,
         resume,
         pushKey,
         releaseKey,
         vm,
-        compiler,
         assembler,
         setLogs,
         clearLogs
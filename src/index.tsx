@@ -14,8 +14,7 @@ import { Device } from './components/Device';
 import { LavaXDecompiler } from './decompiler';
 import { DialogProvider } from './components/dialogs/DialogContext';
 import { I18nProvider, useI18n, type Language } from './i18n';
-import iconv from 'iconv-lite';
-import { Buffer } from 'buffer';
+import { decodeGbk, encodeGbk } from './lav/gbk';
 
 
 
@@ -115,6 +114,11 @@ void main() {
 
 interface Tab { id: string; name: string; content: string; asm?: string; bin?: Uint8Array; }
 
+// Quiet time after the last edit before the source is compiled for diagnostics.
+const DIAGNOSTICS_DELAY_MS = 300;
+
+const sourceDirOf = (tabName: string) => tabName.includes('/') ? tabName.slice(0, tabName.lastIndexOf('/')) : undefined;
+
 export function App() {
   const [tabs, setTabs] = useState<Tab[]>(() => {
     const saved = localStorage.getItem('lavax_tabs');
@@ -145,13 +149,13 @@ export function App() {
     logs,
     screen,
     compile,
+    checkSource,
     run,
     stop,
     resume,
     pushKey,
     releaseKey,
     vm,
-    compiler,
     assembler,
     setLogs,
     clearLogs
@@ -188,7 +192,7 @@ export function App() {
 
     let textContent = "";
     if (content instanceof Uint8Array) {
-      textContent = iconv.decode(Buffer.from(content), 'gbk');
+      textContent = decodeGbk(content);
     } else {
       textContent = content;
     }
@@ -198,7 +202,7 @@ export function App() {
     setActiveTabId(id);
   }, [tabs]);
 
-  const handleGotoLocation = useCallback((file: string, line: number, col: number) => {
+  const handleGotoLocation = useCallback(async (file: string, line: number, col: number) => {
     if (file) {
       // Try to find an already-open tab with that name
       const existing = tabs.find(t => t.name === file);
@@ -206,9 +210,9 @@ export function App() {
         setActiveTabId(existing.id);
       } else {
         // Try to open from VFS
-        const data = vm.vfs.getFile(file);
+        const data = await vm.vfs.readFile(file);
         if (data) {
-          const textContent = iconv.decode(Buffer.from(data), 'gbk');
+          const textContent = decodeGbk(data);
           const id = Math.random().toString(36).substr(2, 9);
           setTabs(prev => [...prev, { id, name: file, content: textContent }]);
           setActiveTabId(id);
@@ -221,8 +225,7 @@ export function App() {
 
   const saveToVFS = useCallback(() => {
     if (!activeTab) return;
-    const gbkData = iconv.encode(activeTab.content, 'gbk');
-    vm.vfs.addFile(activeTab.name, new Uint8Array(gbkData));
+    vm.vfs.addFile(activeTab.name, encodeGbk(activeTab.content));
     setLogs(p => [...p, `Source saved to VFS: ${activeTab.name}`]);
   }, [activeTab, vm]);
 
@@ -306,10 +309,31 @@ export function App() {
 
 
 
-  const build = useCallback(() => {
+  // Background compile of the open source file; Run reuses its result when the text is unchanged.
+  const [diagnostic, setDiagnostic] = useState<string | null>(null);
+  useEffect(() => {
+    const tabName = activeTab?.name || '';
+    if (!/\.c$/i.test(tabName)) {
+      setDiagnostic(null);
+      return;
+    }
+    let current = true;
+    const timer = setTimeout(() => {
+      checkSource(code, sourceDirOf(tabName), tabName).then(error => {
+        if (current && error !== undefined) setDiagnostic(error);
+      });
+    }, DIAGNOSTICS_DELAY_MS);
+    return () => {
+      current = false;
+      clearTimeout(timer);
+    };
+  }, [code, activeTab?.name, checkSource]);
+
+  const build = useCallback(async () => {
     const tabName = activeTab?.name || '';
-    const sourceDir = tabName.includes('/') ? tabName.slice(0, tabName.lastIndexOf('/')) : undefined;
-    const res = compile(code, sourceDir, tabName || undefined);
+    const res = await compile(code, sourceDirOf(tabName), tabName || undefined);
+    // Compiles the user asks for are never superseded (see compileInWorker).
+    if (!res) return null;
     const fileName = tabName.replace(/\.c$/, '') || 'program';
     if (res.bin) {
       setTabs(prev => prev.map(t => t.id === activeTabId ? { ...t, asm: res.asm, bin: res.bin! } : t));
@@ -338,7 +362,7 @@ export function App() {
   }, [activeTabId, activeTab?.asm, assembler]);
 
   const handleRun = async () => {
-    const bin = build();
+    const bin = await build();
     if (bin) {
       switchMobileView('emulator');
       await run(bin);
@@ -638,6 +662,7 @@ export function App() {
                 onChange={setCode}
                 onScroll={handleEditorScroll}
                 gotoLine={editorGotoLine}
+                diagnostic={diagnostic}
               />
             )}
             {viewMode === 'asm' && (
@@ -1,5 +1,5 @@
-import iconv from 'iconv-lite';
 import { Op, SystemOp } from '../types';
+import { decodeGbk } from './gbk';
 
 export const LAV_HEADER_SIZE = 16;
 export const LAV_DEFAULT_ENTRY_POINT = 0x10;
@@ -383,7 +383,7 @@ function decodeString(bytes: Uint8Array, strMask: number): string {
   for (let i = 0; i < bytes.length; i++) {
     plain[i] = strMask === 0 ? bytes[i] : (bytes[i] ^ strMask);
   }
-  return iconv.decode(Buffer.from(plain), 'gbk');
+  return decodeGbk(plain);
 }
 
 export function formatPushString(bytes: Uint8Array, strMask: number): string {
@@ -0,0 +1,226 @@
+import iconv from 'iconv-lite';
+
+/**
+ * Shared GBK codec used by the VM, compiler, assembler and UI.
+ *
+ * Both directions are served from compact typed-array tables. Each table is
+ * built once, on first use, from iconv-lite's gbk data (cp936 plus the GBK
+ * extensions) with a single bulk decode (48 KB pair table) or bulk encode
+ * (128 KB BMP table) call. After that no call touches iconv-lite or
+ * TextDecoder.
+ *
+ * VM-internal text stays as GBK bytes; these helpers are only meant for the
+ * boundaries where bytes meet JS strings (VFS paths, logs, editor buffers).
+ */
+
+const LEAD_MIN = 0x81;
+const LEAD_MAX = 0xFE;
+const TRAIL_MIN = 0x40;
+const TRAIL_MAX = 0xFE;
+const TRAIL_SPAN = TRAIL_MAX - TRAIL_MIN + 1;
+const PAIR_COUNT = (LEAD_MAX - LEAD_MIN + 1) * TRAIL_SPAN;
+
+const REPLACEMENT_CHAR = 0xFFFD;
+const DEFAULT_BYTE = 0x3F; // '?', iconv-lite's substitute for unmappable characters
+const DECODE_CHUNK = 0x2000;
+
+// (lead - 0x81) * 191 + (trail - 0x40) -> UTF-16 code unit, 0 when unmapped.
+let decodeTable: Uint16Array | null = null;
+// UTF-16 code unit -> single byte (< 0x100) or (lead << 8 | trail).
+let encodeTable: Uint16Array | null = null;
+// Byte 0x80 is a single-byte character in cp936 (euro sign).
+let byte80Char = REPLACEMENT_CHAR;
+
+let decodeScratch = new Uint16Array(256);
+let encodeScratch = new Uint8Array(256);
+
+// Bulk UTF-16 -> string conversion; falls back to String.fromCharCode chunks.
+const utf16Decoder = createDecoder('utf-16le');
+const latin1Decoder = createDecoder('latin1');
+
+function createDecoder(label: string): TextDecoder | null {
+    try {
+        return typeof TextDecoder !== 'undefined' ? new TextDecoder(label) : null;
+    } catch {
+        return null;
+    }
+}
+
+function charCodesToString(units: Uint8Array | Uint16Array, start: number, end: number): string {
+    let s = '';
+    for (let i = start; i < end; i += DECODE_CHUNK) {
+        s += String.fromCharCode.apply(null, units.subarray(i, Math.min(end, i + DECODE_CHUNK)) as unknown as number[]);
+    }
+    return s;
+}
+
+function buildDecodeTable() {
+    // Decode every lead/trail pair in one pass, NUL-separated so that an
+    // unmapped pair can never swallow its neighbour.
+    const pairs = new Uint8Array(PAIR_COUNT * 3 + 2);
+    let p = 0;
+    for (let lead = LEAD_MIN; lead <= LEAD_MAX; lead++) {
+        for (let trail = TRAIL_MIN; trail <= TRAIL_MAX; trail++) {
+            pairs[p++] = lead;
+            pairs[p++] = trail;
+            pairs[p++] = 0;
+        }
+    }
+    pairs[p++] = 0x80;
+    pairs[p++] = 0;
+
+    const decoded = iconv.decode(Buffer.from(pairs), 'gbk').split('\0');
+    const table = new Uint16Array(PAIR_COUNT);
+    for (let i = 0; i < PAIR_COUNT; i++) {
+        const s = decoded[i];
+        if (s && s.length === 1 && s.charCodeAt(0) !== REPLACEMENT_CHAR) {
+            table[i] = s.charCodeAt(0);
+        }
+    }
+    const euro = decoded[PAIR_COUNT];
+    if (euro && euro.length === 1) byte80Char = euro.charCodeAt(0);
+    return table;
+}
+
+function buildEncodeTable() {
+    // Encode every non-NUL BMP code unit in one pass, NUL-separated. Lone
+    // surrogates come back as '?' like any other unmappable unit.
+    const units = new Uint16Array(0xFFFF * 2);
+    for (let c = 1; c <= 0xFFFF; c++) units[(c - 1) * 2] = c;
+    const encoded = iconv.encode(charCodesToString(units, 0, units.length), 'gbk');
+    const table = new Uint16Array(0x10000);
+    let c = 1;
+    let start = 0;
+    for (let i = 0; i < encoded.length; i++) {
+        if (encoded[i] !== 0) continue;
+        const len = i - start;
+        table[c++] = len === 1 ? encoded[start]
+            : len === 2 ? (encoded[start] << 8) | encoded[start + 1]
+                : DEFAULT_BYTE;
+        start = i + 1;
+    }
+    return table;
+}
+
+function getDecodeTable(): Uint16Array {
+    if (!decodeTable) decodeTable = buildDecodeTable();
+    return decodeTable;
+}
+
+function getEncodeTable(): Uint16Array {
+    if (!encodeTable) encodeTable = buildEncodeTable();
+    return encodeTable;
+}
+
+function isHighSurrogate(c: number) {
+    return c >= 0xD800 && c <= 0xDBFF;
+}
+
+function isLowSurrogate(c: number) {
+    return c >= 0xDC00 && c <= 0xDFFF;
+}
+
+/** True when `b` can start a double-byte GBK character. */
+export function isGbkLeadByte(b: number): boolean {
+    return b >= LEAD_MIN && b <= LEAD_MAX;
+}
+
+/**
+ * Decodes GBK bytes in [start, end) to a JS string. Unmapped sequences become
+ * U+FFFD; an ASCII trail byte after an invalid lead is re-read as ASCII, which
+ * matches the WHATWG `gbk` decoder the VM used previously.
+ */
+export function decodeGbk(bytes: Uint8Array, start = 0, end = bytes.length): string {
+    let ascii = true;
+    for (let i = start; i < end; i++) {
+        if (bytes[i] >= 0x80) { ascii = false; break; }
+    }
+    if (ascii) {
+        return latin1Decoder ? latin1Decoder.decode(bytes.subarray(start, end)) : charCodesToString(bytes, start, end);
+    }
+
+    const table = getDecodeTable();
+    if (decodeScratch.length < end - start) {
+        decodeScratch = new Uint16Array(Math.max(end - start, decodeScratch.length * 2));
+    }
+    const out = decodeScratch;
+    let n = 0;
+    let i = start;
+    while (i < end) {
+        const b = bytes[i];
+        if (b < 0x80) {
+            out[n++] = b;
+            i++;
+        } else if (b === 0x80) {
+            out[n++] = byte80Char;
+            i++;
+        } else if (b <= LEAD_MAX && i + 1 < end) {
+            const t = bytes[i + 1];
+            const c = (t >= TRAIL_MIN && t <= TRAIL_MAX) ? table[(b - LEAD_MIN) * TRAIL_SPAN + (t - TRAIL_MIN)] : 0;
+            if (c !== 0) {
+                out[n++] = c;
+                i += 2;
+            } else {
+                out[n++] = REPLACEMENT_CHAR;
+                i += t < 0x80 ? 1 : 2;
+            }
+        } else {
+            out[n++] = REPLACEMENT_CHAR;
+            i++;
+        }
+    }
+
+    return utf16Decoder ? utf16Decoder.decode(out.subarray(0, n)) : charCodesToString(out, 0, n);
+}
+
+/**
+ * Encodes `text` as GBK into `dest` starting at `offset`. Writes at most up to
+ * `limit` (exclusive, defaults to the end of `dest`) and never splits a
+ * double-byte character. Returns the number of bytes written.
+ */
+export function encodeGbkInto(text: string, dest: Uint8Array, offset: number, limit = dest.length): number {
+    const table = getEncodeTable();
+    let o = offset;
+    for (let i = 0; i < text.length; i++) {
+        let c = text.charCodeAt(i);
+        let code: number;
+        if (c < 0x80) {
+            code = c;
+        } else if (isHighSurrogate(c) && i + 1 < text.length && isLowSurrogate(text.charCodeAt(i + 1))) {
+            code = DEFAULT_BYTE;
+            i++;
+        } else {
+            code = table[c];
+        }
+        if (code < 0x100) {
+            if (o >= limit) break;
+            dest[o++] = code;
+        } else {
+            if (o + 1 >= limit) break;
+            dest[o++] = code >> 8;
+            dest[o++] = code & 0xFF;
+        }
+    }
+    return o - offset;
+}
+
+/** Encodes `text` as GBK. Unmappable characters become '?'. */
+export function encodeGbk(text: string): Uint8Array {
+    const maxLen = text.length * 2;
+    if (encodeScratch.length < maxLen) {
+        encodeScratch = new Uint8Array(Math.max(maxLen, encodeScratch.length * 2));
+    }
+    const len = encodeGbkInto(text, encodeScratch, 0);
+    return encodeScratch.slice(0, len);
+}
+
+/**
+ * Returns `text` as it would read after a GBK encode/decode round trip.
+ * Pure-ASCII input is returned as-is.
+ */
+export function normalizeToGbk(text: string): string {
+    let i = 0;
+    while (i < text.length && text.charCodeAt(i) < 0x80) i++;
+    if (i === text.length) return text;
+    return decodeGbk(encodeGbk(text));
+}
@@ -0,0 +1,80 @@
+/**
+ * PC-to-source-line map for a compiled .lav program.
+ *
+ * One entry per run of code that comes from the same source line, sorted by
+ * address, so the line for any PC is a binary search away. Plain typed arrays
+ * keep it cheap to post to the VM worker.
+ */
+export interface LavLineMap {
+  /** Source file names; '' is the top-level source. */
+  files: string[];
+  /** Code address (absolute, header included) where each entry starts; ascending. */
+  pcs: Uint32Array;
+  /** 1-based source line of each entry. */
+  lines: Uint32Array;
+  /** Index into `files` for each entry. */
+  fileIds: Uint16Array;
+}
+
+export interface LavSourceLine {
+  file: string;
+  line: number;
+}
+
+export class LavLineMapBuilder {
+  private readonly files: string[] = [];
+  private readonly fileIndex = new Map<string, number>();
+  private readonly pcs: number[] = [];
+  private readonly lines: number[] = [];
+  private readonly fileIds: number[] = [];
+
+  /** Records that code from `file:line` starts at `pc`; calls must come in address order. */
+  add(pc: number, file: string, line: number) {
+    let fileId = this.fileIndex.get(file);
+    if (fileId === undefined) {
+      fileId = this.files.length;
+      this.files.push(file);
+      this.fileIndex.set(file, fileId);
+    }
+    const last = this.pcs.length - 1;
+    // A later mark at the same address wins: the earlier one covered no code.
+    if (last >= 0 && this.pcs[last] === pc) {
+      this.pcs.pop();
+      this.lines.pop();
+      this.fileIds.pop();
+    }
+    const prev = this.pcs.length - 1;
+    if (prev >= 0 && this.lines[prev] === line && this.fileIds[prev] === fileId) return;
+    this.pcs.push(pc);
+    this.lines.push(line);
+    this.fileIds.push(fileId);
+  }
+
+  build(): LavLineMap {
+    return {
+      files: this.files.slice(),
+      pcs: Uint32Array.from(this.pcs),
+      lines: Uint32Array.from(this.lines),
+      fileIds: Uint16Array.from(this.fileIds),
+    };
+  }
+}
+
+/** Source line of the code at `pc`, or null when it precedes every entry. */
+export function lookupLavLine(map: LavLineMap, pc: number): LavSourceLine | null {
+  const { pcs } = map;
+  let lo = 0;
+  let hi = pcs.length - 1;
+  let found = -1;
+  while (lo <= hi) {
+    const mid = (lo + hi) >>> 1;
+    if (pcs[mid] <= pc) {
+      found = mid;
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  if (found < 0) return null;
+  return { file: map.files[map.fileIds[found]], line: map.lines[found] };
+}
@@ -321,6 +321,8 @@ export enum SystemCoreOp {
   SndResume = 0x1A,
   Idle = 0x1B,
   GetVersion = 0x1C,
+  // lavax-studio extensions. Sub-ops 1-99 are taken by readdir handles.
+  Crc32 = 0x80, // System(addr, len, 0x80): CRC-32 (zlib) of a memory range
 }
 
 /**
@@ -5,9 +5,12 @@ import {
   HANDLE_TYPE_BYTE, HANDLE_TYPE_WORD, HANDLE_TYPE_DWORD, HANDLE_BASE_EBP
 } from './types';
 import { getRealLavRuntimeEntryPoint, parseLavHeader } from './lav/format';
-import { VirtualFileSystem } from './vm/VirtualFileSystem';
+import { lookupLavLine, type LavLineMap, type LavSourceLine } from './lav/lineMap';
+import { VirtualFileSystem, VirtualFileSystemOptions } from './vm/VirtualFileSystem';
 import { VFSStorageDriver } from './vm/VFSStorageDriver';
 import { GraphicsEngine } from './vm/GraphicsEngine';
+import { MemoryKernel } from './vm/MemoryKernel';
+import { VirtualClock } from './vm/VirtualClock';
 import { SyscallHandler } from './vm/SyscallHandler';
 
 type OpHandler = () => void;
@@ -31,6 +34,8 @@ export interface VMPauseSnapshot {
   readonly base2: number;
   readonly lastValue: number;
   readonly opcode: number | null;
+  /** Source line at `pc`, when the program was loaded with a line map. */
+  readonly source: LavSourceLine | null;
   readonly stackTop: readonly number[];
   readonly recentLogs: readonly string[];
 }
@@ -53,7 +58,6 @@ export class LavaXVM {
   private strBufPtr: number = STRBUF_START;
   private strMask: number = 0; // V3.0 String Mask
   private lastValue: number = 0; // GVM Result Register (RR)
-  public delayUntil: number = 0;
   public rngSeed: number = (Date.now() | 1);
 
   public memory = new Uint8Array(MEMORY_SIZE);
@@ -64,12 +68,13 @@ export class LavaXVM {
   private fd = new Uint8Array(0) as Uint8Array;
   private fdView: DataView = new DataView(new ArrayBuffer(0));
   private codeLength = 0;
+  private lineMap: LavLineMap | null = null;
 
   public running = false;
   public state: VMLifecycleState = 'idle';
   private resolveKeySignal: (() => void) | null = null;
   public debug = false;
-  public startTime = Date.now();
+  public clock = new VirtualClock();
   public keyBuffer: number[] = [];
   public heldKeys = new Uint8Array(256);
   public currentKeyDown: number = 0;
@@ -88,6 +93,7 @@ export class LavaXVM {
 
   public vfs: VirtualFileSystem;
   public graphics: GraphicsEngine;
+  public memKernel: MemoryKernel;
   public syscall: SyscallHandler;
 
   private ops: OpHandler[] = new Array(256).fill(() => {
@@ -111,9 +117,10 @@ export class LavaXVM {
     this.onLogListener = listener ?? (() => { });
   }
 
-  constructor(vfsDriver?: VFSStorageDriver) {
-    this.vfs = new VirtualFileSystem(vfsDriver);
+  constructor(vfsDriver?: VFSStorageDriver, vfsOptions?: VirtualFileSystemOptions) {
+    this.vfs = new VirtualFileSystem(vfsDriver, vfsOptions);
     this.graphics = new GraphicsEngine(this.memory, (data, w, h) => this.onUpdateScreen(data, w, h));
+    this.memKernel = new MemoryKernel(this.memory);
     this.syscall = new SyscallHandler(this);
     this.memView = new DataView(this.memory.buffer);
     this.initOps();
@@ -161,6 +168,33 @@ export class LavaXVM {
     await new Promise(resolve => setTimeout(resolve, 0));
   }
 
+  /** Suspends execution for `ms` of clock time; the run loop does the waiting. */
+  public sleep(ms: number) {
+    this.clock.sleep(ms);
+    this.setState('waiting');
+  }
+
+  private async sleepOnHost() {
+    let ms: number;
+    while ((ms = this.clock.pendingSleepMs()) > 0) {
+      if (this.state !== 'running' && this.state !== 'waiting') return;
+      this.setState('waiting');
+      // Key events, stop and pause release the wait early; a wake-up that
+      // leaves time on the clock just goes back to sleep for the remainder.
+      await new Promise<void>(resolve => {
+        const timer = setTimeout(() => {
+          this.resolveKeySignal = null;
+          resolve();
+        }, ms);
+        this.resolveKeySignal = () => {
+          clearTimeout(timer);
+          resolve();
+        };
+      });
+    }
+    if (this.state === 'waiting') this.setState('running');
+  }
+
   public requestHostYield(ms: number) {
     if (ms > this.requestedHostYieldMs) {
       this.requestedHostYieldMs = ms;
@@ -213,6 +247,7 @@ export class LavaXVM {
       base2: this.base2,
       lastValue: this.lastValue,
       opcode: this.pc < this.codeLength ? this.fd[this.pc] : null,
+      source: this.lineMap ? lookupLavLine(this.lineMap, this.pc) : null,
       stackTop,
       recentLogs,
     });
@@ -693,9 +728,11 @@ export class LavaXVM {
     this.graphics.setInternalFontData(data);
   }
 
-  load(lav: Uint8Array) {
+  /** Loads a program; `lineMap` (from the compiler) lets pause snapshots name source lines. */
+  load(lav: Uint8Array, lineMap: LavLineMap | null = null) {
     try {
       const header = parseLavHeader(lav);
+      this.lineMap = lineMap;
       this.fd = lav;
       this.fdView = new DataView(lav.buffer, lav.byteOffset, lav.byteLength);
       this.codeLength = lav.length;
@@ -726,7 +763,7 @@ export class LavaXVM {
     this.keyBuffer = [];
     this.heldKeys.fill(0);
     this.currentKeyDown = 0;
-    this.startTime = Date.now();
+    this.clock.reset();
     this.resolveKeySignal = null;
     this.lastPauseSnapshot = null;
     this.recentLogs = [];
@@ -763,6 +800,11 @@ export class LavaXVM {
 
       try {
         while (this.running && this.pc < this.codeLength) {
+          if (this.clock.isSleeping) {
+            await this.sleepOnHost();
+            if (this.getState() !== 'running') continue;
+          }
+
           const sliceStart = this.now();
           const sliceStartPc = this.pc;
           let sliceOps = 0;
@@ -800,8 +842,15 @@ export class LavaXVM {
             }
           }
 
+          this.clock.retire(sliceOps);
           const postSliceState = this.getState();
+          if (this.clock.isSleeping) {
+            // Delay: slept at the top of the next iteration, no extra host yield.
+            continue;
+          }
           if (postSliceState === 'waiting' || this.resolveKeySignal) {
+            // Blocked on input: a good moment to flush pending file writes.
+            if (this.vfs.hasUnsyncedWrites) this.vfs.syncInBackground();
             await this.waitForSignal();
             if (this.getState() === 'waiting') {
               this.setState('running');
@@ -864,6 +913,7 @@ export class LavaXVM {
           this.emitLog('System: VM Paused');
         }
         this.graphics.flushScreen();
+        this.vfs.syncInBackground();
         if (finished || settledState === 'stopped') {
           this.onFinished();
         }
@@ -877,6 +927,7 @@ export class LavaXVM {
   stop() {
     this.setState('stopped');
     this.releaseWaitSignal();
+    this.vfs.syncInBackground();
   }
 
   pause(reason: Partial<VMPauseReason> | string = 'Paused by caller') {
@@ -952,9 +1003,7 @@ export class LavaXVM {
   public getStringBytes(lp: number): Uint8Array | null {
     const addr = this.resolveAddress(lp);
     if (addr < 0 || addr >= MEMORY_SIZE) return null;
-    let end = addr;
-    while (end < MEMORY_SIZE && this.memory[end] !== 0) end++;
-    return this.memory.subarray(addr, end);
+    return this.memory.subarray(addr, addr + this.memKernel.strlen(addr));
   }
 
   public resolveAddress(lp: number): number {
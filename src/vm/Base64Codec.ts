@@ -0,0 +1,83 @@
+/**
+ * Table-driven base64 over typed arrays, for storage backends that only hold
+ * strings. Output is built in a byte buffer and turned into a string in
+ * fixed-size chunks, so encoding is linear without per-byte concatenation.
+ */
+
+const ALPHABET = 'ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/';
+const PAD = 61; // '='
+const CHUNK = 0x8000;
+
+const ENCODE = new Uint8Array(64);
+const DECODE = new Uint8Array(128).fill(0xFF);
+for (let i = 0; i < 64; i++) {
+    ENCODE[i] = ALPHABET.charCodeAt(i);
+    DECODE[ENCODE[i]] = i;
+}
+
+function asciiToString(codes: Uint8Array): string {
+    let out = '';
+    for (let i = 0; i < codes.length; i += CHUNK) {
+        out += String.fromCharCode.apply(null, codes.subarray(i, i + CHUNK) as unknown as number[]);
+    }
+    return out;
+}
+
+export function encodeBase64(bytes: Uint8Array): string {
+    const len = bytes.length;
+    const out = new Uint8Array(Math.ceil(len / 3) * 4);
+    const whole = len - (len % 3);
+    let o = 0;
+    for (let i = 0; i < whole; i += 3) {
+        const n = (bytes[i] << 16) | (bytes[i + 1] << 8) | bytes[i + 2];
+        out[o++] = ENCODE[n >>> 18];
+        out[o++] = ENCODE[(n >>> 12) & 63];
+        out[o++] = ENCODE[(n >>> 6) & 63];
+        out[o++] = ENCODE[n & 63];
+    }
+    if (len - whole === 1) {
+        const n = bytes[whole] << 16;
+        out[o++] = ENCODE[n >>> 18];
+        out[o++] = ENCODE[(n >>> 12) & 63];
+        out[o++] = PAD;
+        out[o++] = PAD;
+    } else if (len - whole === 2) {
+        const n = (bytes[whole] << 16) | (bytes[whole + 1] << 8);
+        out[o++] = ENCODE[n >>> 18];
+        out[o++] = ENCODE[(n >>> 12) & 63];
+        out[o++] = ENCODE[(n >>> 6) & 63];
+        out[o++] = PAD;
+    }
+    return asciiToString(out);
+}
+
+function sextet(text: string, i: number): number {
+    const code = text.charCodeAt(i);
+    const v = code < 128 ? DECODE[code] : 0xFF;
+    if (v === 0xFF) throw new Error(`Invalid base64 character at ${i}`);
+    return v;
+}
+
+/** Decodes standard padded base64; throws on characters outside the alphabet. */
+export function decodeBase64(text: string): Uint8Array {
+    let end = text.length;
+    while (end > 0 && text.charCodeAt(end - 1) === PAD) end--;
+    const out = new Uint8Array((end * 3) >>> 2);
+    const whole = end - (end & 3);
+    let o = 0;
+    for (let i = 0; i < whole; i += 4) {
+        const n = (sextet(text, i) << 18) | (sextet(text, i + 1) << 12) | (sextet(text, i + 2) << 6) | sextet(text, i + 3);
+        out[o++] = n >>> 16;
+        out[o++] = (n >>> 8) & 0xFF;
+        out[o++] = n & 0xFF;
+    }
+    const rest = end - whole;
+    if (rest >= 2) {
+        const n = (sextet(text, whole) << 18) | (sextet(text, whole + 1) << 12) | (rest === 3 ? sextet(text, whole + 2) << 6 : 0);
+        out[o++] = n >>> 16;
+        if (rest === 3) out[o++] = (n >>> 8) & 0xFF;
+    } else if (rest === 1) {
+        throw new Error('Truncated base64 input');
+    }
+    return out;
+}
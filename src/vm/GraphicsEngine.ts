@@ -1,6 +1,5 @@
-import iconv from 'iconv-lite';
-
 import { SCREEN_WIDTH, SCREEN_HEIGHT, VRAM_OFFSET, GBUF_OFFSET, TEXT_OFFSET, GBUF_OFFSET_LVM } from '../types';
+import { encodeGbk } from '../lav/gbk';
 
 export class GraphicsEngine {
     private fontData: Uint8Array | null = null;
@@ -255,6 +254,13 @@ export class GraphicsEngine {
 
 
     public writeString(text: string, mode: number = 1) {
+        this.writeBytes(encodeGbk(text), mode);
+    }
+
+    /**
+     * Writes raw GBK bytes to the _TEXT buffer (printf/putchar path).
+     */
+    public writeBytes(encoded: Uint8Array, mode: number = 1) {
         const size = (mode & 0x80) ? 16 : 12;
 
         if (this.currentFontSize !== size) {
@@ -262,8 +268,6 @@ export class GraphicsEngine {
             this.updateBufferCapacity();
         }
 
-        const encoded = iconv.encode(text, 'gbk'); // GBK encoded bytes
-
         for (let i = 0; i < encoded.length; i++) {
             const charCode = encoded[i];
 
@@ -0,0 +1,137 @@
+import { promises as fsp } from 'fs';
+import path from 'path';
+import { VFSManifestEntry, VFSStorageDriver, VFS_CHUNK_SIZE } from './VFSStorageDriver';
+
+export interface HostDirectoryDriverOptions {
+    /** Never touch the host directory; writes then live only in the VFS. */
+    readOnly?: boolean;
+}
+
+/**
+ * Node/Bun driver that maps the VFS root onto a host directory, for headless
+ * runs and benchmarks against real asset folders (e.g. examples/shenzhou).
+ *
+ * Startup lists the tree only; bodies are loaded on demand through the
+ * VFS's lazy loading. Under Bun a file is memory-mapped and the mapping
+ * becomes the VFS body without a copy (the VFS copies it before the first
+ * write); Node reads just the requested chunks. Writes go to disk whenever
+ * the VFS flushes (handle writes are already batched write-back there),
+ * unless `readOnly` is set, and replace the file by rename so a mapping
+ * handed out earlier keeps its old bytes.
+ */
+export class HostDirectoryDriver implements VFSStorageDriver {
+    public name = 'hostDirectory';
+    public ready: Promise<void> = Promise.resolve();
+    private readonly root: string;
+    private readonly mmap: ((file: string) => Uint8Array) | null;
+
+    constructor(root: string, private readonly options: HostDirectoryDriverOptions = {}) {
+        this.root = path.resolve(root);
+        const bun = (globalThis as any).Bun;
+        this.mmap = typeof bun?.mmap === 'function' ? (file: string) => bun.mmap(file) : null;
+    }
+
+    /** Host path for a normalized VFS path ("/a/b.dat", or "/a/" for a directory). */
+    private hostPath(vfsPath: string): string {
+        const resolved = path.join(this.root, ...vfsPath.split('/').filter(Boolean));
+        if (resolved !== this.root && !resolved.startsWith(this.root + path.sep)) {
+            throw new Error(`HostDirectoryDriver: ${vfsPath} escapes ${this.root}`);
+        }
+        return resolved;
+    }
+
+    async getManifest(): Promise<VFSManifestEntry[]> {
+        const entries: VFSManifestEntry[] = [];
+        const walk = async (dir: string, prefix: string) => {
+            for (const dirent of await fsp.readdir(dir, { withFileTypes: true })) {
+                const hostPath = path.join(dir, dirent.name);
+                const vfsPath = prefix + dirent.name;
+                if (dirent.isDirectory()) {
+                    const stat = await fsp.stat(hostPath);
+                    entries.push({ path: vfsPath + '/', size: 0, mtime: stat.mtimeMs });
+                    await walk(hostPath, vfsPath + '/');
+                } else if (dirent.isFile()) {
+                    const stat = await fsp.stat(hostPath);
+                    entries.push({ path: vfsPath, size: stat.size, mtime: stat.mtimeMs });
+                }
+            }
+        };
+        await walk(this.root, '/');
+        return entries;
+    }
+
+    mapFile(vfsPath: string): Uint8Array | null {
+        if (!this.mmap) return null;
+        try {
+            return this.mmap(this.hostPath(vfsPath));
+        } catch {
+            // Not mappable (e.g. emptied since the manifest); read chunks instead.
+            return null;
+        }
+    }
+
+    async readChunks(vfsPath: string, first: number, count: number): Promise<Uint8Array[]> {
+        const offset = first * VFS_CHUNK_SIZE;
+        const length = count * VFS_CHUNK_SIZE;
+        let bytes: Uint8Array;
+        const handle = await fsp.open(this.hostPath(vfsPath), 'r');
+        try {
+            const buffer = new Uint8Array(length);
+            const { bytesRead } = await handle.read(buffer, 0, length, offset);
+            bytes = buffer.subarray(0, bytesRead);
+        } finally {
+            await handle.close();
+        }
+
+        const chunks: Uint8Array[] = [];
+        for (let start = 0; start < bytes.length; start += VFS_CHUNK_SIZE) {
+            chunks.push(bytes.subarray(start, start + VFS_CHUNK_SIZE));
+        }
+        if (chunks.length !== count) {
+            throw new Error(`HostDirectoryDriver: ${vfsPath} is shorter than its manifest entry`);
+        }
+        return chunks;
+    }
+
+    async getAll(): Promise<Map<string, Uint8Array>> {
+        const results = new Map<string, Uint8Array>();
+        for (const entry of await this.getManifest()) {
+            results.set(entry.path, entry.path.endsWith('/')
+                ? new Uint8Array(0)
+                : new Uint8Array(await fsp.readFile(this.hostPath(entry.path))));
+        }
+        return results;
+    }
+
+    async persist(vfsPath: string, data: Uint8Array): Promise<void> {
+        if (this.options.readOnly) return;
+        const hostPath = this.hostPath(vfsPath);
+        if (vfsPath.endsWith('/')) {
+            await fsp.mkdir(hostPath, { recursive: true });
+            return;
+        }
+        await fsp.mkdir(path.dirname(hostPath), { recursive: true });
+        const temp = `${hostPath}.${process.pid}.tmp`;
+        await fsp.writeFile(temp, data);
+        await fsp.rename(temp, hostPath);
+    }
+
+    async persistMany(entries: Array<[string, Uint8Array]>): Promise<void> {
+        for (const [vfsPath, data] of entries) await this.persist(vfsPath, data);
+    }
+
+    async remove(vfsPath: string): Promise<void> {
+        if (this.options.readOnly) return;
+        const hostPath = this.hostPath(vfsPath);
+        try {
+            if (vfsPath.endsWith('/')) {
+                await fsp.rmdir(hostPath);
+            } else {
+                await fsp.unlink(hostPath);
+            }
+        } catch (e: any) {
+            // Already gone, or a directory that still has files on disk.
+            if (e?.code !== 'ENOENT' && e?.code !== 'ENOTEMPTY') throw e;
+        }
+    }
+}
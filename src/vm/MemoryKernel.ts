@@ -0,0 +1,185 @@
+/**
+ * String and bulk-memory primitives over VM memory.
+ *
+ * All addresses are already-resolved byte offsets. Every range is clamped to
+ * the end of VM memory, nothing allocates, and overlapping copies behave like
+ * memmove. NUL scans read four bytes at a time through a Uint32Array view of
+ * the same buffer once the cursor is word-aligned.
+ */
+// Slicing-by-4 tables: T[k][b] is the CRC of byte b followed by k zero bytes.
+// CRC16 is the reflected 0xA001 (CRC-16/MODBUS) used by the official Crc16;
+// CRC32 is the reflected 0xEDB88320 (zlib) polynomial.
+const CRC16_TABLES = buildCrcTables(new Uint16Array(1024), 0xA001);
+const CRC32_TABLES = buildCrcTables(new Uint32Array(1024), 0xEDB88320);
+
+function buildCrcTables<T extends Uint16Array | Uint32Array>(tables: T, poly: number): T {
+    for (let i = 0; i < 256; i++) {
+        let c = i;
+        for (let j = 0; j < 8; j++) c = (c & 1) ? (c >>> 1) ^ poly : c >>> 1;
+        tables[i] = c;
+    }
+    for (let i = 0; i < 768; i++) {
+        const prev = tables[i];
+        tables[i + 256] = (prev >>> 8) ^ tables[prev & 0xFF];
+    }
+    return tables;
+}
+
+// Below this many candidate positions a plain loop beats indexOf plus a view.
+const STRSTR_SCAN_MIN = 64;
+
+export class MemoryKernel {
+    private readonly words: Uint32Array;
+    private readonly size: number;
+
+    constructor(private readonly memory: Uint8Array) {
+        this.size = memory.length;
+        this.words = new Uint32Array(memory.buffer, memory.byteOffset, memory.length >>> 2);
+    }
+
+    /** Length of the NUL-terminated string at `addr` (stops at end of memory). */
+    public strlen(addr: number): number {
+        const mem = this.memory;
+        const end = this.size;
+        let p = addr;
+        while (p < end && (p & 3) !== 0) {
+            if (mem[p] === 0) return p - addr;
+            p++;
+        }
+
+        const words = this.words;
+        let w = p >>> 2;
+        const wordEnd = end >>> 2;
+        while (w < wordEnd) {
+            const v = words[w];
+            // Classic "has zero byte" test: true iff one of the four bytes is 0.
+            if (((v - 0x01010101) & ~v & 0x80808080) !== 0) break;
+            w++;
+        }
+
+        p = w << 2;
+        while (p < end && mem[p] !== 0) p++;
+        return p - addr;
+    }
+
+    /** Copies the string at `src` (with terminator) to `dest`. */
+    public strcpy(dest: number, src: number) {
+        this.copyString(dest, src, this.strlen(src));
+    }
+
+    /** Appends the string at `src` to the string at `dest`. */
+    public strcat(dest: number, src: number) {
+        const srcLen = this.strlen(src);
+        this.copyString(dest + this.strlen(dest), src, srcLen);
+    }
+
+    /** Byte-wise comparison; returns -1, 0 or 1. */
+    public strcmp(a: number, b: number): number {
+        const mem = this.memory;
+        const end = this.size;
+        while (a < end && b < end) {
+            const ca = mem[a++];
+            const cb = mem[b++];
+            if (ca !== cb) return ca < cb ? -1 : 1;
+            if (ca === 0) return 0;
+        }
+        // One side ran off the end of memory: treat it as terminated there.
+        const ca = a < end ? mem[a] : 0;
+        const cb = b < end ? mem[b] : 0;
+        return ca === cb ? 0 : (ca < cb ? -1 : 1);
+    }
+
+    /** Offset of the first `ch` before the terminator, or -1. */
+    public strchr(addr: number, ch: number): number {
+        const mem = this.memory;
+        const end = this.size;
+        for (let p = addr; p < end; p++) {
+            const c = mem[p];
+            if (c === ch) return p;
+            if (c === 0) break;
+        }
+        return -1;
+    }
+
+    /** Offset of the first occurrence of string `needle` in string `haystack`, or -1. */
+    public strstr(haystack: number, needle: number): number {
+        const mem = this.memory;
+        const needleLen = this.strlen(needle);
+        if (needleLen === 0) return haystack;
+        const span = this.strlen(haystack) - needleLen + 1;
+        if (span <= 0) return -1;
+
+        const first = mem[needle];
+        if (span < STRSTR_SCAN_MIN) {
+            for (let p = haystack; p < haystack + span; p++) {
+                if (mem[p] === first && this.matchesAt(p, needle, needleLen)) return p;
+            }
+            return -1;
+        }
+
+        // Long haystacks: let the native indexOf find candidates. The bounded
+        // view keeps a miss from scanning the rest of memory.
+        const window = mem.subarray(haystack, haystack + span);
+        let i = window.indexOf(first);
+        while (i !== -1) {
+            if (this.matchesAt(haystack + i, needle, needleLen)) return haystack + i;
+            i = window.indexOf(first, i + 1);
+        }
+        return -1;
+    }
+
+    /** memcpy/memmove: overlap-safe, clamped to memory. */
+    public memmove(dest: number, src: number, count: number) {
+        const n = Math.min(count, this.size - dest, this.size - src);
+        if (n <= 0 || dest === src) return;
+        this.memory.copyWithin(dest, src, src + n);
+    }
+
+    public memset(dest: number, value: number, count: number) {
+        const n = Math.min(count, this.size - dest);
+        if (n <= 0) return;
+        this.memory.fill(value & 0xFF, dest, dest + n);
+    }
+
+    /** CRC-16 (poly 0xA001 reflected, init 0xFFFF, no final xor) of a memory range. */
+    public crc16(addr: number, count: number): number {
+        return this.crc(CRC16_TABLES, 0xFFFF, addr, count);
+    }
+
+    /** CRC-32 (zlib) of a memory range, as an unsigned 32-bit value. */
+    public crc32(addr: number, count: number): number {
+        return (this.crc(CRC32_TABLES, 0xFFFFFFFF, addr, count) ^ 0xFFFFFFFF) >>> 0;
+    }
+
+    private crc(tables: Uint16Array | Uint32Array, init: number, addr: number, count: number): number {
+        const mem = this.memory;
+        const end = addr + Math.max(0, Math.min(count, this.size - addr));
+        let crc = init;
+        let p = addr;
+        const end4 = p + ((end - p) & ~3);
+        while (p < end4) {
+            const x = (crc ^ (mem[p] | (mem[p + 1] << 8) | (mem[p + 2] << 16) | (mem[p + 3] << 24))) >>> 0;
+            crc = tables[768 + (x & 0xFF)] ^ tables[512 + ((x >>> 8) & 0xFF)]
+                ^ tables[256 + ((x >>> 16) & 0xFF)] ^ tables[x >>> 24];
+            p += 4;
+        }
+        while (p < end) crc = (crc >>> 8) ^ tables[(crc ^ mem[p++]) & 0xFF];
+        return crc >>> 0;
+    }
+
+    private matchesAt(p: number, needle: number, needleLen: number): boolean {
+        const mem = this.memory;
+        for (let j = 1; j < needleLen; j++) {
+            if (mem[p + j] !== mem[needle + j]) return false;
+        }
+        return true;
+    }
+
+    private copyString(dest: number, src: number, len: number) {
+        if (dest >= this.size) return;
+        // Leave room for the terminator.
+        const n = Math.min(len, this.size - 1 - dest);
+        if (n > 0 && dest !== src) this.memory.copyWithin(dest, src, src + n);
+        this.memory[dest + Math.max(n, 0)] = 0;
+    }
+}
@@ -1,7 +1,10 @@
-import iconv from 'iconv-lite';
 import { SystemOp, MathOp, MathFrameworkOp, SystemCoreOp, GBUF_OFFSET, TEXT_OFFSET, MEMORY_SIZE, VRAM_OFFSET, GBUF_OFFSET_LVM } from '../types';
 import { GraphicsEngine } from './GraphicsEngine';
-import { VirtualFileSystem } from './VirtualFileSystem';
+import { VirtualFileSystem, VFSFileHandle } from './VirtualFileSystem';
+import { MemoryKernel } from './MemoryKernel';
+import { VirtualClock } from './VirtualClock';
+import { GbkPathDecoder } from './VFSPathCache';
+import { decodeGbk, encodeGbkInto } from '../lav/gbk';
 
 export interface ILavaXVM {
     pop(): number;
@@ -15,21 +18,25 @@ export interface ILavaXVM {
     running: boolean;
     debug: boolean;
     keyBuffer: number[];
-    startTime: number;
+    clock: VirtualClock;
     vfs: VirtualFileSystem;
     graphics: GraphicsEngine;
+    memKernel: MemoryKernel;
     stk: Int32Array;
     sp: number;
     heldKeys: Uint8Array;
     currentKeyDown: number;
-    delayUntil: number;
     rngSeed: number;
     wakeUp(): void;
+    sleep(ms: number): void;
     requestHostYield(ms: number): void;
 }
 
 const LTRUE = -1;
 const LFALSE = 0;
+// Official firmware hands out at most three FILE handles: 0x80, 0x81, 0x82.
+const FIRST_FILE_HANDLE = 0x80;
+const FILE_SLOT_COUNT = 3;
 const SIN90 = [
     0, 18, 36, 54, 71, 89, 107, 125,
     143, 160, 178, 195, 213, 230, 248, 265,
@@ -45,6 +52,39 @@ const SIN90 = [
     1023, 1024, 1024,
 ];
 
+// ctype class flags, C-locale byte semantics: the official VM takes a `char`,
+// so only the low byte counts and every byte >= 0x80 (GBK lead/trail) is unclassified.
+const CT_UPPER = 0x01;
+const CT_LOWER = 0x02;
+const CT_DIGIT = 0x04;
+const CT_XDIGIT = 0x08;
+const CT_SPACE = 0x10;
+const CT_PUNCT = 0x20;
+const CT_CNTRL = 0x40;
+const CT_BLANK = 0x80; // ' ' only, the one printable non-graph character
+const CT_ALPHA = CT_UPPER | CT_LOWER;
+const CT_ALNUM = CT_ALPHA | CT_DIGIT;
+const CT_GRAPH = CT_ALNUM | CT_PUNCT;
+const CT_PRINT = CT_GRAPH | CT_BLANK;
+
+const CTYPE = new Uint8Array(256);
+const TOLOWER = new Uint8Array(256);
+const TOUPPER = new Uint8Array(256);
+for (let c = 0; c < 256; c++) {
+    let flags = 0;
+    if (c >= 0x41 && c <= 0x5A) flags |= CT_UPPER;
+    if (c >= 0x61 && c <= 0x7A) flags |= CT_LOWER;
+    if (c >= 0x30 && c <= 0x39) flags |= CT_DIGIT | CT_XDIGIT;
+    if ((c >= 0x41 && c <= 0x46) || (c >= 0x61 && c <= 0x66)) flags |= CT_XDIGIT;
+    if ((c >= 0x09 && c <= 0x0D) || c === 0x20) flags |= CT_SPACE;
+    if (c === 0x20) flags |= CT_BLANK;
+    if (c <= 0x1F || c === 0x7F) flags |= CT_CNTRL;
+    if (c >= 0x21 && c <= 0x7E && !(flags & CT_ALNUM)) flags |= CT_PUNCT;
+    CTYPE[c] = flags;
+    TOLOWER[c] = (flags & CT_UPPER) ? c + 0x20 : c;
+    TOUPPER[c] = (flags & CT_LOWER) ? c - 0x20 : c;
+}
+
 /**
  * LavaX Syscall Handler (GVM ISA V3.0)
  * Source of truth for parameter counts and returns: src/vm/SyscallMetadata.ts
@@ -58,13 +98,21 @@ interface FileListState {
 
 export class SyscallHandler {
     private fileListState: FileListState | null = null;
-    private fileHandleSlots = new Map<number, number>();
+    // Official handles 0x80..0x82 -> VFS handle id (0 = free) and its open file.
+    private readonly fileSlotIds = new Int32Array(FILE_SLOT_COUNT);
+    private readonly fileSlots: Array<VFSFileHandle | undefined> = new Array(FILE_SLOT_COUNT).fill(undefined);
     private emptyInputPolls = 0;
+    private fmtOut = new Uint8Array(256);
+    private fmtLen = 0;
+    private readonly charByte = new Uint8Array(1);
+    // Path and mode strings repeat (assets reopened every frame); decode once.
+    private readonly pathDecoder = new GbkPathDecoder();
     constructor(private vm: ILavaXVM) { }
 
     public resetState() {
         this.fileListState = null;
-        this.fileHandleSlots.clear();
+        this.fileSlotIds.fill(0);
+        this.fileSlots.fill(undefined);
         this.emptyInputPolls = 0;
     }
 
@@ -89,17 +137,42 @@ export class SyscallHandler {
     }
 
     private allocOfficialFileHandle(internalHandle: number): number {
-        for (let slot = 0x80; slot <= 0x82; slot++) {
-            if (!this.fileHandleSlots.has(slot)) {
-                this.fileHandleSlots.set(slot, internalHandle);
-                return slot;
+        for (let slot = 0; slot < FILE_SLOT_COUNT; slot++) {
+            if (this.fileSlotIds[slot] === 0) {
+                this.fileSlotIds[slot] = internalHandle;
+                this.fileSlots[slot] = this.vm.vfs.getHandle(internalHandle);
+                return FIRST_FILE_HANDLE + slot;
             }
         }
         return 0;
     }
 
     private resolveOfficialFileHandle(handle: number): number {
-        return this.fileHandleSlots.get(handle) ?? 0;
+        const slot = handle - FIRST_FILE_HANDLE;
+        return slot >= 0 && slot < FILE_SLOT_COUNT ? this.fileSlotIds[slot] : 0;
+    }
+
+    /** The open file behind an official handle, without a VFS lookup. */
+    private officialFile(handle: number): VFSFileHandle | undefined {
+        const slot = handle - FIRST_FILE_HANDLE;
+        return slot >= 0 && slot < FILE_SLOT_COUNT ? this.fileSlots[slot] : undefined;
+    }
+
+    /**
+     * True while bytes an access needs are still loading from a lazy storage
+     * driver: the VM yields (arguments stay on the stack) and the syscall
+     * re-runs once they arrive. Writes wait for the whole file.
+     */
+    private waitForFileData(fp: number, count: number, wholeFile: boolean): boolean {
+        const h = this.officialFile(fp);
+        if (!h || !h.pending) return false;
+        const internalHandle = this.resolveOfficialFileHandle(fp);
+        const pending = wholeFile
+            ? this.vm.vfs.whenLoaded(internalHandle, 0, h.length)
+            : this.vm.vfs.whenLoaded(internalHandle, h.pos, count);
+        if (!pending) return false;
+        void pending.then(() => this.vm.wakeUp());
+        return true;
     }
 
     private nextRand(): number {
@@ -109,7 +182,11 @@ export class SyscallHandler {
     }
 
     private getMilliseconds256(): number {
-        return ((new Date().getMilliseconds() * 256) / 1000) & 0xFF;
+        return (((this.vm.clock.wallClockMs() % 1000) * 256) / 1000) & 0xFF;
+    }
+
+    private ctype(mask: number): number {
+        return (CTYPE[this.vm.pop() & 0xFF] & mask) ? LTRUE : LFALSE;
     }
 
     private sin1024(angle: number): number {
@@ -129,36 +206,11 @@ export class SyscallHandler {
         if (op === SystemOp.getchar || op === SystemOp.GetWord) {
             if (vm.keyBuffer.length === 0) return undefined;
         }
-        if (op === SystemOp.Delay) {
-            const now = Date.now();
-            if (vm.delayUntil === 0) {
-                // Peek the delay duration from stack (it's the top value)
-                const duration = vm.stk[vm.sp - 1] & 0x7fff;
-                const ticks = Math.floor((duration * 256) / 1000);
-                if (ticks <= 0) {
-                    vm.pop();
-                    return null;
-                }
-                const delayMs = Math.ceil((ticks * 1000) / 256);
-                vm.delayUntil = now + delayMs;
-                setTimeout(() => {
-                    vm.wakeUp();
-                }, delayMs);
-                return undefined; // Yield
-            } else if (now < vm.delayUntil) {
-                return undefined; // Still waiting
-            } else {
-                // Done waiting
-                vm.delayUntil = 0;
-                vm.pop(); // Actually consume the duration argument
-                return null;
-            }
-        }
 
         switch (op) {
             case SystemOp.putchar: {
-                const char = String.fromCharCode(vm.pop());
-                vm.graphics.writeString(char);
+                this.charByte[0] = vm.pop();
+                vm.graphics.writeBytes(this.charByte);
                 // UpdateLCD(0)
                 vm.graphics.repaintFromTextMemory(0);
                 vm.graphics.flushScreen();
@@ -171,9 +223,9 @@ export class SyscallHandler {
                 const fmtHandle = vm.stk[startIdx];
                 const formatBytes = vm.getStringBytes(fmtHandle);
                 if (formatBytes) {
-                    const str = this.formatVariadicString(formatBytes, count - 1, startIdx + 1);
-                    if (vm.debug) vm.onLog(str);
-                    vm.graphics.writeString(str);
+                    const bytes = this.formatVariadicBytes(formatBytes, count - 1, startIdx + 1);
+                    if (vm.debug) vm.onLog(decodeGbk(bytes));
+                    vm.graphics.writeBytes(bytes);
                     // UpdateLCD(0)
                     vm.graphics.repaintFromTextMemory(0);
                     vm.graphics.flushScreen();
@@ -195,8 +247,7 @@ export class SyscallHandler {
 
                 if (formatBytes) {
                     // count - 2 = number of format args (excluding buf and fmt)
-                    const str = this.formatVariadicString(formatBytes, count - 2, argsIdx);
-                    const bytes = iconv.encode(str, 'gbk');
+                    const bytes = this.formatVariadicBytes(formatBytes, count - 2, argsIdx);
                     vm.memory.set(bytes, destAddr);
                     vm.memory[destAddr + bytes.length] = 0;
                 }
@@ -205,20 +256,12 @@ export class SyscallHandler {
             }
 
             case SystemOp.strcpy: {
-                const srcAddr = vm.pop();
-                const destAddr = vm.resolveAddress(vm.pop());
-                const bytes = vm.getStringBytes(srcAddr);
-                if (bytes) {
-                    vm.memory.set(bytes, destAddr);
-                    vm.memory[destAddr + bytes.length] = 0;
-                }
+                const src = vm.resolveAddress(vm.pop());
+                vm.memKernel.strcpy(vm.resolveAddress(vm.pop()), src);
                 return null;
             }
 
-            case SystemOp.strlen: {
-                const bytes = vm.getStringBytes(vm.pop());
-                return bytes ? bytes.length : 0;
-            }
+            case SystemOp.strlen: return vm.memKernel.strlen(vm.resolveAddress(vm.pop()));
 
             case SystemOp.SetScreen: {
                 const mode = vm.pop();
@@ -413,108 +456,61 @@ export class SyscallHandler {
                 return hasInput ? vm.keyBuffer.shift()! : 0;
             }
 
-            case SystemOp.isalnum: return /^[a-z0-9]$/i.test(String.fromCharCode(vm.pop())) ? -1 : 0;
-            case SystemOp.isalpha: return /^[a-z]$/i.test(String.fromCharCode(vm.pop())) ? -1 : 0;
-            case SystemOp.iscntrl: {
-                const c = vm.pop();
-                return (c >= 0 && c <= 31) || c === 127 ? -1 : 0;
-            }
-            case SystemOp.isdigit: return /^[0-9]$/.test(String.fromCharCode(vm.pop())) ? -1 : 0;
-            case SystemOp.isgraph: {
-                const c = vm.pop();
-                return (c >= 33 && c <= 126) ? -1 : 0;
-            }
-            case SystemOp.islower: return /^[a-z]$/.test(String.fromCharCode(vm.pop())) ? -1 : 0;
-            case SystemOp.isprint: {
-                const c = vm.pop();
-                return (c >= 32 && c <= 126) ? -1 : 0;
-            }
-            case SystemOp.ispunct: return /^[!"#$%&'()*+,\-./:;<=>?@[\\\]^_`{|}~]$/.test(String.fromCharCode(vm.pop())) ? -1 : 0;
-            case SystemOp.isspace: return /^\s$/.test(String.fromCharCode(vm.pop())) ? -1 : 0;
-            case SystemOp.isupper: return /^[A-Z]$/.test(String.fromCharCode(vm.pop())) ? -1 : 0;
-            case SystemOp.isxdigit: return /^[a-f0-9]$/i.test(String.fromCharCode(vm.pop())) ? -1 : 0;
+            case SystemOp.isalnum: return this.ctype(CT_ALNUM);
+            case SystemOp.isalpha: return this.ctype(CT_ALPHA);
+            case SystemOp.iscntrl: return this.ctype(CT_CNTRL);
+            case SystemOp.isdigit: return this.ctype(CT_DIGIT);
+            case SystemOp.isgraph: return this.ctype(CT_GRAPH);
+            case SystemOp.islower: return this.ctype(CT_LOWER);
+            case SystemOp.isprint: return this.ctype(CT_PRINT);
+            case SystemOp.ispunct: return this.ctype(CT_PUNCT);
+            case SystemOp.isspace: return this.ctype(CT_SPACE);
+            case SystemOp.isupper: return this.ctype(CT_UPPER);
+            case SystemOp.isxdigit: return this.ctype(CT_XDIGIT);
 
-            case SystemOp.tolower: return String.fromCharCode(vm.pop()).toLowerCase().charCodeAt(0);
-            case SystemOp.toupper: return String.fromCharCode(vm.pop()).toUpperCase().charCodeAt(0);
+            case SystemOp.tolower: return TOLOWER[vm.pop() & 0xFF];
+            case SystemOp.toupper: return TOUPPER[vm.pop() & 0xFF];
 
             case SystemOp.strcmp: {
-                const s2 = vm.getStringBytes(vm.pop());
-                const s1 = vm.getStringBytes(vm.pop());
-                if (!s1 || !s2) return 0;
-                const str1 = new TextDecoder('gbk').decode(s1);
-                const str2 = new TextDecoder('gbk').decode(s2);
-                if (str1 < str2) return -1;
-                if (str1 > str2) return 1;
-                return 0;
+                const s2 = vm.resolveAddress(vm.pop());
+                return vm.memKernel.strcmp(vm.resolveAddress(vm.pop()), s2);
             }
             case SystemOp.strcat: {
-                const src = vm.getStringBytes(vm.pop());
-                const destHandle = vm.pop();
-                const destAddr = vm.resolveAddress(destHandle);
-                const destBytes = vm.getStringBytes(destHandle);
-                if (destBytes && src) {
-                    vm.memory.set(src, destAddr + destBytes.length);
-                    vm.memory[destAddr + destBytes.length + src.length] = 0;
-                }
+                const src = vm.resolveAddress(vm.pop());
+                vm.memKernel.strcat(vm.resolveAddress(vm.pop()), src);
                 return null;
             }
             case SystemOp.strchr: {
                 const char = vm.pop();
                 const strHandle = vm.pop();
-                const bytes = vm.getStringBytes(strHandle);
-                if (bytes) {
-                    const idx = bytes.indexOf(char);
-                    if (idx !== -1) return (strHandle & 0xFFFF0000) | ((vm.resolveAddress(strHandle) + idx) & 0xFFFF);
-                }
-                return 0;
+                const hit = vm.memKernel.strchr(vm.resolveAddress(strHandle), char);
+                return hit === -1 ? 0 : (strHandle & 0xFFFF0000) | (hit & 0xFFFF);
             }
             case SystemOp.strstr: {
-                const subHandle = vm.pop();
+                // Byte-level search, like the official VM: no GBK decoding needed.
+                const sub = vm.resolveAddress(vm.pop());
                 const strHandle = vm.pop();
-                const sub = vm.getStringBytes(subHandle);
-                const str = vm.getStringBytes(strHandle);
-                if (str && sub) {
-                    const strText = new TextDecoder('gbk').decode(str);
-                    const subText = new TextDecoder('gbk').decode(sub);
-                    const idx = strText.indexOf(subText);
-                    if (idx !== -1) {
-                        // We need to find the byte offset, not char offset for GBK
-                        // But since we are returning a handle, it's tricky.
-                        // Let's find byte index in 'str'
-                        let byteIdx = 0;
-                        const enc = new TextEncoder(); // This might be UTF-8, but GBK prefix match should be similar in structure for simple ASCII
-                        // Actually, let's just use the index on bytes if possible
-                        // Simple byte search for now
-                        for (let i = 0; i <= str.length - sub.length; i++) {
-                            let match = true;
-                            for (let j = 0; j < sub.length; j++) {
-                                if (str[i + j] !== sub[j]) { match = false; break; }
-                            }
-                            if (match) return (strHandle & 0xFFFF0000) | ((vm.resolveAddress(strHandle) + i) & 0xFFFF);
-                        }
-                    }
-                }
-                return 0;
+                const hit = vm.memKernel.strstr(vm.resolveAddress(strHandle), sub);
+                return hit === -1 ? 0 : (strHandle & 0xFFFF0000) | (hit & 0xFFFF);
             }
 
 
             case SystemOp.memset: {
                 const count = vm.pop(), val = vm.pop(), addr = vm.resolveAddress(vm.pop());
-                vm.memory.fill(val, addr, addr + count);
+                vm.memKernel.memset(addr, val, count);
                 return null;
             }
 
             case SystemOp.memcpy: {
                 const count = vm.pop(), src = vm.resolveAddress(vm.pop()), dest = vm.resolveAddress(vm.pop());
-                vm.memory.set(vm.memory.subarray(src, src + count), dest);
+                vm.memKernel.memmove(dest, src, count);
                 return null;
             }
 
             case SystemOp.fopen: {
                 const m = vm.getStringBytes(vm.pop()), p = vm.getStringBytes(vm.pop());
                 if (!p || !m) return 0;
-                const dec = new TextDecoder('gbk');
-                const internalHandle = vm.vfs.openFile(dec.decode(p), dec.decode(m));
+                const internalHandle = vm.vfs.openFile(this.pathDecoder.decode(p), this.pathDecoder.decode(m));
                 if (internalHandle <= 0) return 0;
                 const officialHandle = this.allocOfficialFileHandle(internalHandle);
                 if (officialHandle === 0) {
@@ -527,19 +523,23 @@ export class SyscallHandler {
                 const handle = vm.pop();
                 const internalHandle = this.resolveOfficialFileHandle(handle);
                 if (internalHandle) {
-                    vm.vfs.closeFile(internalHandle);
-                    this.fileHandleSlots.delete(handle);
+                    vm.vfs.closeFile(internalHandle)?.catch((error: any) => {
+                        vm.onLog(`[VM Warning] fclose: saving the file failed (${error?.message ?? error}); retrying`);
+                    });
+                    this.fileSlotIds[handle - FIRST_FILE_HANDLE] = 0;
+                    this.fileSlots[handle - FIRST_FILE_HANDLE] = undefined;
                 }
                 return null;
             }
             case SystemOp.fread: {
                 // Stack: [buf, size, count, fp]
+                if (this.waitForFileData(vm.stk[vm.sp - 1], vm.stk[vm.sp - 2], false)) return undefined;
                 const fp = vm.pop(), count = vm.pop(), size = vm.pop(), buf = vm.resolveAddress(vm.pop());
-                const h = vm.vfs.getHandle(this.resolveOfficialFileHandle(fp));
+                const h = this.officialFile(fp);
                 if (!h) return 0;
 
                 // LavaX spec: size is ignored, count is number of bytes
-                const toRead = Math.min(count, h.data.length - h.pos);
+                const toRead = Math.min(count, h.length - h.pos);
                 if (toRead > 0) {
                     vm.memory.set(h.data.subarray(h.pos, h.pos + toRead), buf);
                     h.pos += toRead;
@@ -549,52 +549,53 @@ export class SyscallHandler {
             }
             case SystemOp.fwrite: {
                 // Stack: [buf, size, count, fp]
+                if (this.waitForFileData(vm.stk[vm.sp - 1], 0, true)) return undefined;
                 const fp = vm.pop(), count = vm.pop(), size = vm.pop(), buf = vm.resolveAddress(vm.pop());
-                const internalHandle = this.resolveOfficialFileHandle(fp);
-                const h = vm.vfs.getHandle(internalHandle);
+                const h = this.officialFile(fp);
                 if (!h) return 0;
 
                 // LavaX spec: size is ignored, count is number of bytes
                 const data = vm.memory.subarray(buf, buf + count);
-                return vm.vfs.writeHandleData(internalHandle, data, h.pos);
+                return vm.vfs.writeHandleData(this.resolveOfficialFileHandle(fp), data, h.pos);
             }
             case SystemOp.fseek: {
                 const whence = vm.pop(), offset = vm.pop(), fp = vm.pop();
-                const h = vm.vfs.getHandle(this.resolveOfficialFileHandle(fp));
+                const h = this.officialFile(fp);
                 if (!h) return -1;
 
                 let newPos = h.pos;
                 if (whence === 0) newPos = offset;
                 else if (whence === 1) newPos += offset;
-                else if (whence === 2) newPos = h.data.length + offset;
+                else if (whence === 2) newPos = h.length + offset;
 
                 if (newPos < 0) newPos = 0;
                 h.pos = newPos;
                 return h.pos; // Return current position
             }
             case SystemOp.ftell: {
-                const h = vm.vfs.getHandle(this.resolveOfficialFileHandle(vm.pop()));
+                const h = this.officialFile(vm.pop());
                 return h ? h.pos : -1;
             }
             case SystemOp.feof: {
-                const h = vm.vfs.getHandle(this.resolveOfficialFileHandle(vm.pop()));
-                return h ? (h.pos >= h.data.length ? -1 : 0) : -1;
+                const h = this.officialFile(vm.pop());
+                return h ? (h.pos >= h.length ? -1 : 0) : -1;
             }
             case SystemOp.rewind: {
-                const h = vm.vfs.getHandle(this.resolveOfficialFileHandle(vm.pop()));
+                const h = this.officialFile(vm.pop());
                 if (h) h.pos = 0;
                 return null;
             }
             case SystemOp.getc: {
-                const h = vm.vfs.getHandle(this.resolveOfficialFileHandle(vm.pop()));
-                return (h && h.pos < h.data.length) ? h.data[h.pos++] : -1;
+                if (this.waitForFileData(vm.stk[vm.sp - 1], 1, false)) return undefined;
+                const h = this.officialFile(vm.pop());
+                return (h && h.pos < h.length) ? h.data[h.pos++] : -1;
             }
             case SystemOp.putc: {
+                if (this.waitForFileData(vm.stk[vm.sp - 1], 0, true)) return undefined;
                 const fp = vm.pop(), char = vm.pop();
-                const internalHandle = this.resolveOfficialFileHandle(fp);
-                const h = vm.vfs.getHandle(internalHandle);
+                const h = this.officialFile(fp);
                 if (h) {
-                    vm.vfs.writeHandleData(internalHandle, new Uint8Array([char]), h.pos);
+                    vm.vfs.writeHandleByte(this.resolveOfficialFileHandle(fp), h, char);
                     return char;
                 }
                 return -1;
@@ -602,16 +603,14 @@ export class SyscallHandler {
             case SystemOp.MakeDir: {
                 const path = vm.getStringBytes(vm.pop());
                 if (path) {
-                    const dec = new TextDecoder('gbk');
-                    return vm.vfs.mkdir(dec.decode(path)) ? -1 : 0;
+                    return vm.vfs.mkdir(this.pathDecoder.decode(path)) ? -1 : 0;
                 }
                 return 0;
             }
             case SystemOp.ChDir: {
                 const path = vm.getStringBytes(vm.pop());
                 if (path) {
-                    const dec = new TextDecoder('gbk');
-                    return vm.vfs.chdir(dec.decode(path)) ? -1 : 0;
+                    return vm.vfs.chdir(this.pathDecoder.decode(path)) ? -1 : 0;
                 }
                 return 0;
             }
@@ -620,35 +619,11 @@ export class SyscallHandler {
 
                 // 1. 初始化状态
                 if (!this.fileListState) {
-                    const entries = vm.vfs.getFiles();
-
-                    let currentDir = vm.vfs.cwd || '/';
-                    if (!currentDir.endsWith('/')) currentDir += '/';
-
-                    const seen = new Set<string>();
-                    const localFiles: string[] = [];
+                    const currentDir = vm.vfs.cwd || '/';
+                    const localFiles = vm.vfs.listDir(currentDir);
 
                     // 保留之前的修复：添加返回上层目录的选项
-                    if (currentDir !== '/') {
-                        localFiles.push('..');
-                        seen.add('..');
-                    }
-
-                    for (const e of entries) {
-                        if (!e.path.startsWith(currentDir)) continue;
-
-                        const rel = e.path.slice(currentDir.length);
-                        if (!rel) continue;
-
-                        // 保留之前的修复：提取当前层级的文件或文件夹名称
-                        const name = rel.split('/')[0];
-
-                        if (!name) continue;
-                        if (!seen.has(name)) {
-                            seen.add(name);
-                            localFiles.push(name);
-                        }
-                    }
+                    if (currentDir !== '/') localFiles.unshift('..');
 
                     if (localFiles.length === 0) {
                         vm.pop();
@@ -712,9 +687,8 @@ export class SyscallHandler {
                 // 判断如果按下了 ENTER 或 ESC，直接处理并退出指令
                 if (action === 1) {
                     const selected = s.files[s.fnum_i + s.fpos];
-                    const bytes = iconv.encode(selected, 'gbk');
-                    vm.memory.set(bytes, s.ptr);
-                    vm.memory[s.ptr + bytes.length] = 0; // 补充 \0 结尾
+                    const len = encodeGbkInto(selected, vm.memory, s.ptr, MEMORY_SIZE - 1);
+                    vm.memory[s.ptr + len] = 0; // 补充 \0 结尾
                     this.fileListState = null;
                     vm.pop(); // Consume argument
                     return 1;
@@ -730,8 +704,8 @@ export class SyscallHandler {
                 const fnum_show = Math.min(fnum - s.fnum_i, 5);
                 for (let i = 0; i < fnum_show; i++) {
                     const filename = s.files[s.fnum_i + i];
-                    const bytes = iconv.encode(filename, 'gbk');
-                    vm.graphics.TextOut(0, i * 16, bytes, 0xC1);
+                    const len = encodeGbkInto(filename, this.fmtOut, 0);
+                    vm.graphics.TextOut(0, i * 16, this.fmtOut.subarray(0, len), 0xC1);
                 }
 
                 // 画反色光标框
@@ -745,8 +719,7 @@ export class SyscallHandler {
             case SystemOp.opendir: {
                 const path = vm.getStringBytes(vm.pop());
                 if (path) {
-                    const dec = new TextDecoder('gbk');
-                    return vm.vfs.opendir(dec.decode(path));
+                    return vm.vfs.opendir(this.pathDecoder.decode(path));
                 }
                 return 0;
             }
@@ -770,24 +743,22 @@ export class SyscallHandler {
             }
             case SystemOp.memmove: {
                 const count = vm.pop(), src = vm.resolveAddress(vm.pop()), dest = vm.resolveAddress(vm.pop());
-                vm.memory.copyWithin(dest, src, src + count);
+                vm.memKernel.memmove(dest, src, count);
                 return null;
             }
             case SystemOp.Crc16: {
                 const count = vm.pop(), addr = vm.resolveAddress(vm.pop());
-                let crc = 0xFFFF;
-                for (let i = 0; i < count; i++) {
-                    crc ^= vm.memory[addr + i];
-                    for (let j = 0; j < 8; j++) {
-                        if (crc & 1) crc = (crc >>> 1) ^ 0xA001;
-                        else crc >>>= 1;
-                    }
-                }
-                return crc & 0xFFFF;
+                return vm.memKernel.crc16(addr, count);
+            }
+            case SystemOp.Delay: {
+                // The official VM sleeps in whole 256 Hz ticks.
+                const ticks = Math.floor(((vm.pop() & 0x7fff) * 256) / 1000);
+                if (ticks > 0) vm.sleep(Math.ceil((ticks * 1000) / 256));
+                return null;
             }
             case SystemOp.GetTime: {
                 const addr = vm.resolveAddress(vm.pop());
-                const now = new Date();
+                const now = new Date(vm.clock.wallClockMs());
                 const view = new DataView(vm.memory.buffer);
                 view.setUint16(addr, now.getFullYear(), true);
                 view.setUint8(addr + 2, (now.getMonth() + 1) & 0xFF);
@@ -829,8 +800,7 @@ export class SyscallHandler {
             case SystemOp.DeleteFile: {
                 const path = vm.getStringBytes(vm.pop());
                 if (path) {
-                    const dec = new TextDecoder('gbk');
-                    vm.vfs.deleteFile(dec.decode(path));
+                    vm.vfs.deleteFile(this.pathDecoder.decode(path));
                     return -1; // success
                 }
                 return 0; // failure
@@ -916,10 +886,9 @@ export class SyscallHandler {
                 if (sub > 0 && sub < 100) { // readdir handle range
                     const name = vm.vfs.readdir(sub);
                     if (name) {
-                        const bytes = iconv.encode(name, 'gbk');
                         const addr = 0x7500; // Use a dedicated area for readdir results
-                        vm.memory.set(bytes, addr);
-                        vm.memory[addr + bytes.length] = 0;
+                        const len = encodeGbkInto(name, vm.memory, addr, MEMORY_SIZE - 1);
+                        vm.memory[addr + len] = 0;
                         return addr;
                     }
                     // readdir returned null (end of directory or invalid handle).
@@ -937,6 +906,10 @@ export class SyscallHandler {
                     case SystemCoreOp.Idle:
                         vm.requestHostYield(1);
                         return null;
+                    case SystemCoreOp.Crc32: {
+                        const count = vm.pop(), addr = vm.resolveAddress(vm.pop());
+                        return vm.memKernel.crc32(addr, count) | 0;
+                    }
                 }
                 return 0;
             }
@@ -962,7 +935,7 @@ export class SyscallHandler {
                         case MathFrameworkOp.log: return this.floatUnary(Math.log);
                         case MathFrameworkOp.str2f: {
                             const s = vm.getStringBytes(vm.pop());
-                            const text = s ? new TextDecoder('gbk').decode(s) : "0";
+                            const text = s ? decodeGbk(s) : "0";
                             const f = parseFloat(text);
                             const b = new ArrayBuffer(4);
                             new Float32Array(b)[0] = f;
@@ -971,10 +944,8 @@ export class SyscallHandler {
                         case MathFrameworkOp.f2str: {
                             const f = vm.popFloat();
                             const addr = vm.resolveAddress(vm.pop());
-                            const str = f.toFixed(6);
-                            const bytes = iconv.encode(str, 'gbk');
-                            vm.memory.set(bytes, addr);
-                            vm.memory[addr + bytes.length] = 0;
+                            const len = encodeGbkInto(f.toFixed(6), vm.memory, addr, MEMORY_SIZE - 1);
+                            vm.memory[addr + len] = 0;
                             return addr;
                         }
                     }
@@ -1006,79 +977,116 @@ export class SyscallHandler {
         return new Int32Array(buf)[0];
     }
 
-    private formatVariadicString(formatBytes: Uint8Array, count: number, startIdx: number): string {
-        const format = new TextDecoder('gbk').decode(formatBytes);
-        let result = "";
+    private emitByte(b: number) {
+        if (this.fmtLen >= this.fmtOut.length) {
+            const grown = new Uint8Array(this.fmtOut.length * 2);
+            grown.set(this.fmtOut);
+            this.fmtOut = grown;
+        }
+        this.fmtOut[this.fmtLen++] = b;
+    }
+
+    private emitAscii(text: string) {
+        for (let i = 0; i < text.length; i++) this.emitByte(text.charCodeAt(i));
+    }
+
+    private emitPadding(b: number, count: number) {
+        for (let i = 0; i < count; i++) this.emitByte(b);
+    }
+
+    /**
+     * printf-style formatting directly on GBK bytes. The result is a view into
+     * a reusable buffer and is only valid until the next call.
+     */
+    private formatVariadicBytes(format: Uint8Array, count: number, startIdx: number): Uint8Array {
+        this.fmtLen = 0;
         let argIdx = 0;
         const fBuf = new ArrayBuffer(4);
         const fView = new Float32Array(fBuf);
         const iView = new Int32Array(fBuf);
+        const isDigit = (c: number) => c >= 0x30 && c <= 0x39;
 
         let i = 0;
         while (i < format.length) {
-            if (format[i] !== '%') {
-                result += format[i++];
+            if (format[i] !== 0x25) { // '%'
+                this.emitByte(format[i++]);
                 continue;
             }
             i++; // consume '%'
             if (i >= format.length) break;
-            if (format[i] === '%') { result += '%'; i++; continue; }
+            if (format[i] === 0x25) { this.emitByte(0x25); i++; continue; }
 
             // Parse flags: -, +, 0, space, #
             let flagLeft = false, flagPlus = false, flagZero = false, flagSpace = false;
             while (i < format.length) {
                 const f = format[i];
-                if (f === '-') { flagLeft = true; i++; }
-                else if (f === '+') { flagPlus = true; i++; }
-                else if (f === '0') { flagZero = true; i++; }
-                else if (f === ' ') { flagSpace = true; i++; }
-                else if (f === '#') { i++; } // ignore '#' flag
+                if (f === 0x2D) { flagLeft = true; i++; }
+                else if (f === 0x2B) { flagPlus = true; i++; }
+                else if (f === 0x30) { flagZero = true; i++; }
+                else if (f === 0x20) { flagSpace = true; i++; }
+                else if (f === 0x23) { i++; } // ignore '#' flag
                 else break;
             }
 
             // Parse width (may be '*' for arg)
             let width = 0;
-            if (i < format.length && format[i] === '*') {
+            if (i < format.length && format[i] === 0x2A) {
                 width = this.vm.stk[startIdx + argIdx++] | 0;
                 if (width < 0) { flagLeft = true; width = -width; }
                 i++;
             } else {
-                while (i < format.length && format[i] >= '0' && format[i] <= '9') {
-                    width = width * 10 + (format[i].charCodeAt(0) - 48);
+                while (i < format.length && isDigit(format[i])) {
+                    width = width * 10 + (format[i] - 0x30);
                     i++;
                 }
             }
 
             // Parse precision (may be '*' for arg)
             let precision = -1;
-            if (i < format.length && format[i] === '.') {
+            if (i < format.length && format[i] === 0x2E) {
                 i++;
-                if (i < format.length && format[i] === '*') {
+                if (i < format.length && format[i] === 0x2A) {
                     precision = this.vm.stk[startIdx + argIdx++] | 0;
                     if (precision < 0) precision = 0;
                     i++;
                 } else {
                     precision = 0;
-                    while (i < format.length && format[i] >= '0' && format[i] <= '9') {
-                        precision = precision * 10 + (format[i].charCodeAt(0) - 48);
+                    while (i < format.length && isDigit(format[i])) {
+                        precision = precision * 10 + (format[i] - 0x30);
                         i++;
                     }
                 }
             }
 
             // Skip length modifiers: l, h, ll, etc.
-            while (i < format.length && (format[i] === 'l' || format[i] === 'h' || format[i] === 'L')) i++;
+            while (i < format.length && (format[i] === 0x6C || format[i] === 0x68 || format[i] === 0x4C)) i++;
 
             if (i >= format.length) break;
-            const spec = format[i++];
+            const specByte = format[i++];
+            const spec = String.fromCharCode(specByte);
 
             const val = this.vm.stk[startIdx + argIdx++];
+
+            // %s and %c copy raw GBK bytes; width and precision count bytes, as in C.
+            if (spec === 's' || spec === 'c') {
+                let raw: Uint8Array;
+                if (spec === 'c') {
+                    this.charByte[0] = val;
+                    raw = this.charByte;
+                } else {
+                    raw = this.vm.getStringBytes(val) ?? this.charByte.subarray(0, 0);
+                    if (precision >= 0 && raw.length > precision) raw = raw.subarray(0, precision);
+                }
+                const pad = width - raw.length;
+                if (pad > 0 && !flagLeft) this.emitPadding(flagZero && spec === 'c' ? 0x30 : 0x20, pad);
+                for (let k = 0; k < raw.length; k++) this.emitByte(raw[k]);
+                if (pad > 0 && flagLeft) this.emitPadding(0x20, pad);
+                continue;
+            }
+
             let formatted = "";
 
             switch (spec) {
-                case 'c':
-                    formatted = String.fromCharCode(val & 0xFF);
-                    break;
                 case 'd':
                 case 'i': {
                     const n = val | 0;
@@ -1112,13 +1120,6 @@ export class SyscallHandler {
                     formatted = s;
                     break;
                 }
-                case 's': {
-                    const bytes = this.vm.getStringBytes(val);
-                    let s = bytes ? new TextDecoder('gbk').decode(bytes) : '';
-                    if (precision >= 0 && s.length > precision) s = s.substring(0, precision);
-                    formatted = s;
-                    break;
-                }
                 case 'f': {
                     iView[0] = val;
                     const prec = precision >= 0 ? precision : 6;
@@ -1148,12 +1149,14 @@ export class SyscallHandler {
                     break;
                 }
                 default:
-                    formatted = '%' + spec;
+                    this.emitByte(0x25);
+                    this.emitByte(specByte);
+                    continue;
             }
 
             // Apply width padding
             if (width > 0 && formatted.length < width) {
-                const padChar = (!flagLeft && flagZero && spec !== 's') ? '0' : ' ';
+                const padChar = (!flagLeft && flagZero) ? '0' : ' ';
                 if (flagLeft) {
                     formatted = formatted.padEnd(width, ' ');
                 } else {
@@ -1166,8 +1169,8 @@ export class SyscallHandler {
                 }
             }
 
-            result += formatted;
+            this.emitAscii(formatted);
         }
-        return result;
+        return this.fmtOut.subarray(0, this.fmtLen);
     }
 }
@@ -1,4 +1,4 @@
-import { SystemOp } from '../types';
+import { SystemOp, SystemCoreOp } from '../types';
 
 export interface SyscallInfo {
   name: string;
@@ -7,6 +7,7 @@ export interface SyscallInfo {
   paramTypes: number[]; // 0: int, 1: ptr
   hasReturn: boolean;
   isVariadic?: boolean;
+  subOp?: number; // namespace syscalls: pushed after the arguments, before op
 }
 
 export const SYSCALL_LIST: SyscallInfo[] = [
@@ -110,6 +111,7 @@ export const SYSCALL_LIST: SyscallInfo[] = [
   { name: 'SetFgColor', op: SystemOp.SetFgColor, params: 1, paramTypes: [0], hasReturn: false },
   { name: 'SetBgColor', op: SystemOp.SetBgColor, params: 1, paramTypes: [0], hasReturn: false },
   { name: 'SetPalette', op: SystemOp.SetPalette, params: 3, paramTypes: [0, 0, 1], hasReturn: false },
+  { name: 'Crc32', op: SystemOp.System, subOp: SystemCoreOp.Crc32, params: 2, paramTypes: [1, 0], hasReturn: true },
 ];
 
 export const SYSCALL_MAP: Record<string, SyscallInfo> = SYSCALL_LIST.reduce((map, info) => {
@@ -117,7 +119,8 @@ export const SYSCALL_MAP: Record<string, SyscallInfo> = SYSCALL_LIST.reduce((map
   return map;
 }, {} as Record<string, SyscallInfo>);
 
+// Namespace builtins share their opcode with a plain syscall (0xD3 is also readdir).
 export const SYSCALL_OP_MAP: Record<number, SyscallInfo> = SYSCALL_LIST.reduce((map, info) => {
-  map[info.op] = info;
+  if (info.subOp === undefined) map[info.op] = info;
   return map;
 }, {} as Record<number, SyscallInfo>);
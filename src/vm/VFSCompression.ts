@@ -0,0 +1,190 @@
+/**
+ * At-rest compression for VFS storage drivers.
+ *
+ * `deflate-raw` goes through the platform CompressionStream; `lz` is a small
+ * LZ77 block codec in plain TypeScript, used where the streams are missing.
+ * The codec is recorded per file, so a store may mix both with raw bodies.
+ */
+
+export type VFSCodec = 'deflate-raw' | 'lz';
+
+export interface VFSCompressionOptions {
+    /** Files smaller than this are stored raw (bytes, default 4 KB). */
+    minSize?: number;
+    /** Keep a compressed body only if it is at most this fraction of the original (default 0.875). */
+    maxRatio?: number;
+    /** Codec to write with; defaults to deflate-raw where CompressionStream exists, else lz. */
+    codec?: VFSCodec;
+}
+
+export interface EncodedBody {
+    /** Undefined when the body is stored raw. */
+    codec?: VFSCodec;
+    bytes: Uint8Array;
+}
+
+const DEFAULT_MIN_SIZE = 4 * 1024;
+const DEFAULT_MAX_RATIO = 0.875;
+// Large files are compressed only if this leading sample compresses well.
+const PROBE_SIZE = 16 * 1024;
+
+export function hasCompressionStreams(): boolean {
+    return typeof CompressionStream !== 'undefined' && typeof DecompressionStream !== 'undefined';
+}
+
+/** Compresses a body for storage, or returns it raw if it is small or does not shrink. */
+export async function encodeBody(data: Uint8Array, options: VFSCompressionOptions = {}): Promise<EncodedBody> {
+    const maxRatio = options.maxRatio ?? DEFAULT_MAX_RATIO;
+    if (data.length < (options.minSize ?? DEFAULT_MIN_SIZE)) return { bytes: data };
+    const codec = options.codec ?? (hasCompressionStreams() ? 'deflate-raw' : 'lz');
+    if (data.length > 2 * PROBE_SIZE) {
+        const probe = await compress(codec, data.subarray(0, PROBE_SIZE));
+        if (probe.length > PROBE_SIZE * maxRatio) return { bytes: data };
+    }
+    const bytes = await compress(codec, data);
+    return bytes.length <= data.length * maxRatio ? { codec, bytes } : { bytes: data };
+}
+
+/** Inverse of encodeBody; `size` is the original length. */
+export async function decodeBody(codec: VFSCodec | undefined, bytes: Uint8Array, size: number): Promise<Uint8Array> {
+    if (!codec) return bytes;
+    const data = codec === 'lz' ? lzDecompress(bytes, size) : await pipeThrough(new DecompressionStream(codec), bytes);
+    if (data.length !== size) throw new Error(`VFS: ${codec} body decoded to ${data.length} bytes, expected ${size}`);
+    return data;
+}
+
+function compress(codec: VFSCodec, data: Uint8Array): Promise<Uint8Array> {
+    return codec === 'lz' ? Promise.resolve(lzCompress(data)) : pipeThrough(new CompressionStream(codec), data);
+}
+
+async function pipeThrough(stream: CompressionStream | DecompressionStream, data: Uint8Array): Promise<Uint8Array> {
+    const writer = stream.writable.getWriter();
+    // Failures surface through the reader; don't leave these rejections unhandled.
+    writer.write(data as Uint8Array<ArrayBuffer>).catch(() => { });
+    writer.close().catch(() => { });
+    const parts: Uint8Array[] = [];
+    let total = 0;
+    const reader = stream.readable.getReader();
+    for (;;) {
+        const { done, value } = await reader.read();
+        if (done) break;
+        parts.push(value);
+        total += value.length;
+    }
+    if (parts.length === 1) return parts[0];
+    const out = new Uint8Array(total);
+    let offset = 0;
+    for (const part of parts) {
+        out.set(part, offset);
+        offset += part.length;
+    }
+    return out;
+}
+
+// lz: LZ4-style sequences. A token byte holds the literal count (high
+// nibble) and match length - 4 (low nibble); 15 in either continues the
+// count in following bytes (255 = keep adding). Literals follow, then a
+// 16-bit little-endian match offset. The final sequence is literals only.
+const HASH_BITS = 14;
+const MIN_MATCH = 4;
+const MAX_OFFSET = 0xFFFF;
+
+function writeCount(out: Uint8Array, op: number, count: number): number {
+    while (count >= 255) {
+        out[op++] = 255;
+        count -= 255;
+    }
+    out[op++] = count;
+    return op;
+}
+
+export function lzCompress(src: Uint8Array): Uint8Array {
+    const n = src.length;
+    const out = new Uint8Array(n + Math.ceil(n / 255) + 16);
+    const table = new Int32Array(1 << HASH_BITS).fill(-1);
+    let ip = 0;
+    let anchor = 0;
+    let op = 0;
+
+    const emit = (literals: number, offset: number, matchLength: number) => {
+        const lit = Math.min(literals, 15);
+        const match = matchLength > 0 ? Math.min(matchLength - MIN_MATCH, 15) : 0;
+        out[op++] = (lit << 4) | match;
+        if (lit === 15) op = writeCount(out, op, literals - 15);
+        out.set(src.subarray(anchor, anchor + literals), op);
+        op += literals;
+        if (matchLength === 0) return;
+        out[op++] = offset & 0xFF;
+        out[op++] = offset >>> 8;
+        if (match === 15) op = writeCount(out, op, matchLength - MIN_MATCH - 15);
+    };
+
+    while (ip + MIN_MATCH <= n) {
+        const seq = src[ip] | (src[ip + 1] << 8) | (src[ip + 2] << 16) | (src[ip + 3] << 24);
+        const h = Math.imul(seq, 0x9E3779B1) >>> (32 - HASH_BITS);
+        const ref = table[h];
+        table[h] = ip;
+        if (ref < 0 || ip - ref > MAX_OFFSET
+            || src[ref] !== src[ip] || src[ref + 1] !== src[ip + 1]
+            || src[ref + 2] !== src[ip + 2] || src[ref + 3] !== src[ip + 3]) {
+            ip++;
+            continue;
+        }
+        let length = MIN_MATCH;
+        while (ip + length < n && src[ref + length] === src[ip + length]) length++;
+        emit(ip - anchor, ip - ref, length);
+        ip += length;
+        anchor = ip;
+    }
+    emit(n - anchor, 0, 0);
+    return out.slice(0, op);
+}
+
+export function lzDecompress(src: Uint8Array, size: number): Uint8Array {
+    const out = new Uint8Array(size);
+    const end = src.length;
+    let ip = 0;
+    let op = 0;
+    const readCount = (count: number) => {
+        let b: number;
+        do {
+            if (ip >= end) throw new Error('lz: truncated input');
+            b = src[ip++];
+            count += b;
+        } while (b === 255);
+        return count;
+    };
+
+    while (ip < end) {
+        const token = src[ip++];
+        let literals = token >>> 4;
+        if (literals === 15) literals = readCount(literals);
+        if (ip + literals > end || op + literals > size) throw new Error('lz: literal run out of range');
+        if (literals > 32) {
+            out.set(src.subarray(ip, ip + literals), op);
+            ip += literals;
+            op += literals;
+        } else {
+            for (const stop = ip + literals; ip < stop;) out[op++] = src[ip++];
+        }
+        if (ip >= end) break;
+
+        if (ip + 2 > end) throw new Error('lz: truncated input');
+        const offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        let length = token & 15;
+        if (length === 15) length = readCount(length);
+        length += MIN_MATCH;
+        let from = op - offset;
+        if (offset === 0 || from < 0 || op + length > size) throw new Error('lz: match out of range');
+        // Short copies are cheaper inline than through a typed-array view.
+        if (offset >= length && length > 32) {
+            out.copyWithin(op, from, from + length);
+            op += length;
+        } else {
+            // Byte by byte: a match may overlap the bytes it produces.
+            for (const stop = op + length; op < stop;) out[op++] = out[from++];
+        }
+    }
+    return op === size ? out : out.subarray(0, op);
+}
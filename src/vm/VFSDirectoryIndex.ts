@@ -0,0 +1,145 @@
+/**
+ * Directory tree over the VFS's flat path map.
+ *
+ * Keys follow the VFS convention: "/a/b.txt" is a file, "/a/" is an explicit
+ * directory marker. Parents of an indexed path always exist as (implicit)
+ * directories, matching what a prefix scan of the flat map used to report.
+ * Each directory keeps its child names sorted, so listing costs O(children).
+ */
+interface DirNode {
+    name: string;
+    parent: DirNode | null;
+    /** Child name -> directory node, or null for a regular file. */
+    children: Map<string, DirNode | null>;
+    /** Sorted keys of `children`. */
+    names: string[];
+    /** Set when an explicit "/dir/" marker exists. */
+    hasMarker: boolean;
+}
+
+function createDirNode(name: string, parent: DirNode | null): DirNode {
+    return { name, parent, children: new Map(), names: [], hasMarker: false };
+}
+
+function splitPath(path: string): string[] {
+    return path.split('/').filter(Boolean);
+}
+
+export class VFSDirectoryIndex {
+    private root = createDirNode('', null);
+
+    constructor() {
+        this.root.hasMarker = true;
+    }
+
+    public clear() {
+        this.root = createDirNode('', null);
+        this.root.hasMarker = true;
+    }
+
+    /** Indexes a file path or "/dir/" marker; idempotent. */
+    public add(path: string) {
+        const parts = splitPath(path);
+        if (path.endsWith('/')) {
+            this.ensureDir(parts, parts.length).hasMarker = true;
+            return;
+        }
+        if (parts.length === 0) return;
+        const parent = this.ensureDir(parts, parts.length - 1);
+        const name = parts[parts.length - 1];
+        if (!parent.children.has(name)) this.insertChild(parent, name, null);
+    }
+
+    /** Removes a file path or "/dir/" marker, pruning empty implicit parents. */
+    public remove(path: string) {
+        const parts = splitPath(path);
+        if (path.endsWith('/')) {
+            const node = this.findDir(parts, parts.length);
+            if (!node || node === this.root) return;
+            node.hasMarker = false;
+            this.prune(node);
+            return;
+        }
+        if (parts.length === 0) return;
+        const parent = this.findDir(parts, parts.length - 1);
+        const name = parts[parts.length - 1];
+        // A same-named directory wins over the file entry; leave it alone.
+        if (!parent || parent.children.get(name) !== null) return;
+        this.removeChild(parent, name);
+        this.prune(parent);
+    }
+
+    public hasDir(path: string): boolean {
+        const parts = splitPath(path);
+        return this.findDir(parts, parts.length) !== undefined;
+    }
+
+    /** Sorted child names of a directory (a fresh array), or null if missing. */
+    public list(path: string): string[] | null {
+        const parts = splitPath(path);
+        const node = this.findDir(parts, parts.length);
+        return node ? node.names.slice() : null;
+    }
+
+    private findDir(parts: string[], depth: number): DirNode | undefined {
+        let node = this.root;
+        for (let i = 0; i < depth; i++) {
+            const child = node.children.get(parts[i]);
+            if (!child) return undefined;
+            node = child;
+        }
+        return node;
+    }
+
+    private ensureDir(parts: string[], depth: number): DirNode {
+        let node = this.root;
+        for (let i = 0; i < depth; i++) {
+            const name = parts[i];
+            let child = node.children.get(name);
+            if (!child) {
+                child = createDirNode(name, node);
+                if (node.children.has(name)) {
+                    node.children.set(name, child); // file entry becomes a directory
+                } else {
+                    this.insertChild(node, name, child);
+                }
+            }
+            node = child;
+        }
+        return node;
+    }
+
+    private insertChild(dir: DirNode, name: string, child: DirNode | null) {
+        const names = dir.names;
+        let lo = 0;
+        let hi = names.length;
+        while (lo < hi) {
+            const mid = (lo + hi) >>> 1;
+            if (names[mid] < name) lo = mid + 1;
+            else hi = mid;
+        }
+        names.splice(lo, 0, name);
+        dir.children.set(name, child);
+    }
+
+    private removeChild(dir: DirNode, name: string) {
+        if (!dir.children.delete(name)) return;
+        const names = dir.names;
+        let lo = 0;
+        let hi = names.length;
+        while (lo < hi) {
+            const mid = (lo + hi) >>> 1;
+            if (names[mid] < name) lo = mid + 1;
+            else hi = mid;
+        }
+        if (names[lo] === name) names.splice(lo, 1);
+    }
+
+    private prune(node: DirNode) {
+        while (node.parent && !node.hasMarker && node.children.size === 0) {
+            const parent = node.parent;
+            this.removeChild(parent, node.name);
+            node = parent;
+        }
+    }
+}
@@ -0,0 +1,95 @@
+import { decodeGbk } from '../lav/gbk';
+
+/**
+ * Small LRU caches for the fopen/getFile hot path.
+ *
+ * Both are purely lexical: they map spellings to canonical paths and never
+ * record whether a file exists, so deletes cannot make an entry stale. The
+ * resolved-path cache is keyed by cwd, which makes chdir safe without a flush.
+ */
+
+const DEFAULT_CAPACITY = 128;
+const MAX_CWD_BUCKETS = 16;
+
+/** (cwd, path) -> resolved absolute path, with interned results. */
+export class ResolvedPathCache {
+    private buckets = new Map<string, Map<string, string>>();
+    private interned = new Map<string, string>();
+
+    constructor(private readonly capacity = DEFAULT_CAPACITY) { }
+
+    public get(cwd: string, path: string): string | undefined {
+        const bucket = this.buckets.get(cwd);
+        if (!bucket) return undefined;
+        const resolved = bucket.get(path);
+        if (resolved !== undefined) {
+            // Refresh LRU position.
+            bucket.delete(path);
+            bucket.set(path, resolved);
+        }
+        return resolved;
+    }
+
+    public set(cwd: string, path: string, resolved: string): string {
+        let bucket = this.buckets.get(cwd);
+        if (!bucket) {
+            if (this.buckets.size >= MAX_CWD_BUCKETS) this.clear();
+            bucket = new Map();
+            this.buckets.set(cwd, bucket);
+        }
+        let canonical = this.interned.get(resolved);
+        if (canonical === undefined) {
+            if (this.interned.size >= this.capacity * MAX_CWD_BUCKETS) this.interned.clear();
+            this.interned.set(resolved, resolved);
+            canonical = resolved;
+        }
+        if (bucket.size >= this.capacity) bucket.delete(bucket.keys().next().value!);
+        bucket.set(path, canonical);
+        return canonical;
+    }
+
+    public clear() {
+        this.buckets.clear();
+        this.interned.clear();
+    }
+}
+
+interface DecodedEntry {
+    bytes: Uint8Array;
+    text: string;
+}
+
+/** Raw GBK path bytes -> decoded string; a hit allocates nothing. */
+export class GbkPathDecoder {
+    private entries = new Map<number, DecodedEntry>();
+
+    constructor(private readonly capacity = DEFAULT_CAPACITY) { }
+
+    public decode(bytes: Uint8Array): string {
+        // FNV-1a over the bytes, length folded in.
+        let hash = 0x811c9dc5 ^ bytes.length;
+        for (let i = 0; i < bytes.length; i++) hash = Math.imul(hash ^ bytes[i], 0x01000193);
+
+        const hit = this.entries.get(hash);
+        if (hit && hit.bytes.length === bytes.length) {
+            let same = true;
+            for (let i = 0; i < bytes.length; i++) {
+                if (hit.bytes[i] !== bytes[i]) { same = false; break; }
+            }
+            if (same) {
+                this.entries.delete(hash);
+                this.entries.set(hash, hit);
+                return hit.text;
+            }
+        }
+
+        const text = decodeGbk(bytes);
+        if (this.entries.size >= this.capacity && !hit) this.entries.delete(this.entries.keys().next().value!);
+        this.entries.set(hash, { bytes: bytes.slice(), text });
+        return text;
+    }
+
+    public clear() {
+        this.entries.clear();
+    }
+}
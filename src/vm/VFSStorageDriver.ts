@@ -1,28 +1,73 @@
+import { decodeBase64, encodeBase64 } from './Base64Codec';
+import { decodeBody, encodeBody, EncodedBody, VFSCodec, VFSCompressionOptions } from './VFSCompression';
+
+/** Bodies of drivers with lazy loading are stored and read in chunks of this size. */
+export const VFS_CHUNK_SIZE = 16 * 1024;
+
+export interface VFSManifestEntry {
+    path: string;
+    size: number;
+    /** Last persist time (ms since epoch). */
+    mtime: number;
+    /**
+     * A body the driver already holds in memory; the VFS adopts it instead of
+     * reading chunks, and copies it before the first write.
+     */
+    data?: Uint8Array;
+}
 
 export interface VFSStorageDriver {
     name: string;
     ready: Promise<void>;
     getAll(): Promise<Map<string, Uint8Array>>;
     persist(path: string, data: Uint8Array): Promise<void>;
+    /** Optional batched persist; the VFS falls back to one persist() per file. */
+    persistMany?(entries: Array<[string, Uint8Array]>): Promise<void>;
     remove(path: string): Promise<void>;
+    /**
+     * Optional lazy loading: when both are present the VFS loads only the
+     * manifest at startup and fetches file bodies chunk by chunk on demand.
+     */
+    getManifest?(): Promise<VFSManifestEntry[]>;
+    /** Reads `count` VFS_CHUNK_SIZE chunks of a file starting at chunk `first`. */
+    readChunks?(path: string, first: number, count: number): Promise<Uint8Array[]>;
+    /**
+     * Optional: a view of the whole stored file (e.g. a memory mapping), or
+     * null. The VFS adopts it as the body instead of reading chunks and
+     * copies it before the first write, so the view is never written.
+     */
+    mapFile?(path: string): Uint8Array | null;
 }
 
+/**
+ * localStorage layout: one base64 value per file under `lavax_vfs_v3:f:<path>`
+ * plus a JSON manifest of paths, so a write re-encodes only the files it
+ * touches. The manifest is rewritten only when the set of paths changes. The
+ * old single-blob `lavax_vfs_v2` layout is migrated on first load.
+ */
 export class LocalStorageDriver implements VFSStorageDriver {
     public name = 'localStorage';
     public ready: Promise<void> = Promise.resolve();
-    private storageKey = 'lavax_vfs_v2';
+    private legacyKey = 'lavax_vfs_v2';
+    private manifestKey = 'lavax_vfs_v3:manifest';
+    private filePrefix = 'lavax_vfs_v3:f:';
+    private manifest: Set<string> | null = null;
 
     async getAll(): Promise<Map<string, Uint8Array>> {
         const results = new Map<string, Uint8Array>();
         try {
             if (typeof localStorage === 'undefined') return results;
-            const saved = localStorage.getItem(this.storageKey);
-            if (saved) {
-                const obj = JSON.parse(saved);
-                for (const k in obj) {
-                    const arr = Uint8Array.from(atob(obj[k]), c => c.charCodeAt(0));
-                    results.set(k, arr);
-                }
+            let manifest: Set<string>;
+            try {
+                manifest = this.loadManifest();
+            } catch (e) {
+                // Migration did not fit; it is retried on the next load.
+                console.warn("LocalStorageDriver: Migration failed, reading the v2 store", e);
+                return this.readLegacy();
+            }
+            for (const path of manifest) {
+                const saved = localStorage.getItem(this.filePrefix + path);
+                if (saved !== null) results.set(path, decodeBase64(saved));
             }
         } catch (e) {
             console.warn("LocalStorageDriver: Error loading data", e);
@@ -31,19 +76,22 @@ export class LocalStorageDriver implements VFSStorageDriver {
     }
 
     async persist(path: string, data: Uint8Array): Promise<void> {
+        return this.persistMany([[path, data]]);
+    }
+
+    async persistMany(entries: Array<[string, Uint8Array]>): Promise<void> {
         if (typeof localStorage === 'undefined') return;
         try {
-            const all = await this.getAll();
-            all.set(path, data);
-
-            const obj: any = {};
-            all.forEach((v, k) => {
-                let binary = '';
-                const len = v.byteLength;
-                for (let i = 0; i < len; i++) binary += String.fromCharCode(v[i]);
-                obj[k] = btoa(binary);
-            });
-            localStorage.setItem(this.storageKey, JSON.stringify(obj));
+            const manifest = this.loadManifest();
+            let added = false;
+            for (const [path, data] of entries) {
+                localStorage.setItem(this.filePrefix + path, encodeBase64(data));
+                if (!manifest.has(path)) {
+                    manifest.add(path);
+                    added = true;
+                }
+            }
+            if (added) this.saveManifest(manifest);
         } catch (e) {
             console.error("LocalStorageDriver: Persist failed", e);
         }
@@ -52,31 +100,185 @@ export class LocalStorageDriver implements VFSStorageDriver {
     async remove(path: string): Promise<void> {
         if (typeof localStorage === 'undefined') return;
         try {
-            const all = await this.getAll();
-            if (all.delete(path)) {
-                const obj: any = {};
-                all.forEach((v, k) => {
-                    let binary = '';
-                    const len = v.byteLength;
-                    for (let i = 0; i < len; i++) binary += String.fromCharCode(v[i]);
-                    obj[k] = btoa(binary);
-                });
-                localStorage.setItem(this.storageKey, JSON.stringify(obj));
-            }
+            const manifest = this.loadManifest();
+            localStorage.removeItem(this.filePrefix + path);
+            if (manifest.delete(path)) this.saveManifest(manifest);
         } catch (e) {
             console.error("LocalStorageDriver: Remove failed", e);
         }
     }
+
+    /** The cached manifest; the first call migrates a v2 store (and throws if that fails). */
+    private loadManifest(): Set<string> {
+        if (this.manifest) return this.manifest;
+        const saved = localStorage.getItem(this.manifestKey);
+        this.manifest = saved ? new Set<string>(JSON.parse(saved)) : this.migrateLegacy();
+        return this.manifest;
+    }
+
+    private saveManifest(manifest: Set<string>) {
+        localStorage.setItem(this.manifestKey, JSON.stringify(Array.from(manifest)));
+    }
+
+    private readLegacy(): Map<string, Uint8Array> {
+        const results = new Map<string, Uint8Array>();
+        const legacy = localStorage.getItem(this.legacyKey);
+        if (!legacy) return results;
+        const obj = JSON.parse(legacy);
+        for (const path in obj) results.set(path, decodeBase64(obj[path]));
+        return results;
+    }
+
+    /**
+     * Splits the v2 single-blob store into per-file keys. The blob is removed
+     * first so the copies fit in the space it held; if a write still fails
+     * (quota), the keys written so far are removed, the blob is put back and
+     * the error is rethrown, leaving the store as it was.
+     */
+    private migrateLegacy(): Set<string> {
+        const manifest = new Set<string>();
+        const legacy = localStorage.getItem(this.legacyKey);
+        if (!legacy) return manifest;
+        const obj = JSON.parse(legacy);
+        localStorage.removeItem(this.legacyKey);
+        try {
+            for (const path in obj) {
+                // v2 values are already base64; store them as-is.
+                localStorage.setItem(this.filePrefix + path, obj[path]);
+                manifest.add(path);
+            }
+            this.saveManifest(manifest);
+        } catch (e) {
+            for (const path of manifest) localStorage.removeItem(this.filePrefix + path);
+            localStorage.setItem(this.legacyKey, legacy);
+            throw e;
+        }
+        return manifest;
+    }
+}
+
+/** Files an OverlayStorageDriver lists but whose bodies live elsewhere (another thread). */
+export interface OverlayRemoteFiles {
+    /** Path -> size. */
+    sizes: ReadonlyMap<string, number>;
+    readChunks(path: string, first: number, count: number): Promise<Uint8Array[]>;
+}
+
+/**
+ * Overlay over a base file map, for throwaway VMs such as worker runs. The VFS
+ * adopts the base arrays as they are (no byte copies); every persist and
+ * remove lands in the overlay and comes back as a delta from takeDelta(). The
+ * map itself is never modified. Handle writes may still update a base array in
+ * place, but such a write always marks the file dirty, so it is in the delta.
+ * Files in `remote` are listed too and read chunk by chunk on demand.
+ */
+export class OverlayStorageDriver implements VFSStorageDriver {
+    public name = 'overlay';
+    public ready: Promise<void> = Promise.resolve();
+    private written = new Map<string, Uint8Array>();
+    private deleted = new Set<string>();
+
+    constructor(private readonly base: ReadonlyMap<string, Uint8Array>, private readonly remote?: OverlayRemoteFiles) { }
+
+    /** The base files only; remote bodies are not read here. */
+    async getAll(): Promise<Map<string, Uint8Array>> {
+        return new Map(this.base);
+    }
+
+    async getManifest(): Promise<VFSManifestEntry[]> {
+        const entries: VFSManifestEntry[] = [];
+        for (const [path, data] of this.base) entries.push({ path, size: data.length, mtime: 0, data });
+        for (const [path, size] of this.remote?.sizes ?? []) {
+            if (!this.base.has(path)) entries.push({ path, size, mtime: 0 });
+        }
+        return entries;
+    }
+
+    async readChunks(path: string, first: number, count: number): Promise<Uint8Array[]> {
+        const size = this.remote?.sizes.get(path);
+        if (size === undefined) throw new Error(`OverlayStorageDriver: ${path} has no remote body`);
+        // The remote copy may have grown since it was listed; keep to the listed size.
+        const chunks = await this.remote!.readChunks(path, first, count);
+        return chunks.map((chunk, k) => chunk.subarray(0, Math.max(0, size - (first + k) * VFS_CHUNK_SIZE)));
+    }
+
+    async persist(path: string, data: Uint8Array): Promise<void> {
+        this.written.set(path, data);
+        this.deleted.delete(path);
+    }
+
+    async persistMany(entries: Array<[string, Uint8Array]>): Promise<void> {
+        for (const [path, data] of entries) await this.persist(path, data);
+    }
+
+    async remove(path: string): Promise<void> {
+        this.written.delete(path);
+        if (this.base.has(path) || this.remote?.sizes.has(path)) this.deleted.add(path);
+    }
+
+    /** Returns and clears the paths persisted or removed since the last call. */
+    public takeDelta(): { files: Array<[string, Uint8Array]>; deletedPaths: string[] } {
+        const delta = { files: Array.from(this.written), deletedPaths: Array.from(this.deleted) };
+        this.written.clear();
+        this.deleted.clear();
+        return delta;
+    }
+}
+
+interface StoredManifestEntry {
+    size: number;
+    mtime: number;
+    /** Set when the chunks hold a compressed body of `stored` bytes. */
+    codec?: VFSCodec;
+    stored?: number;
 }
 
+/** A compressed file being served chunk by chunk after one decode. */
+interface DecodedBody {
+    data: Promise<Uint8Array>;
+    /** Chunks not yet handed out; the body is dropped once this reaches 0. */
+    unserved: number;
+    served: Uint8Array;
+}
+
+export interface IndexedDBDriverOptions {
+    /**
+     * Transparent at-rest compression (see VFSCompression); off by default.
+     * A compressed file is decoded whole on its first read, so it loses the
+     * chunk-by-chunk loading raw files get; enable it when quota matters more.
+     * Small and incompressible files are still stored raw.
+     */
+    compression?: VFSCompressionOptions | false;
+}
+
+function chunkCount(size: number) {
+    return Math.ceil(size / VFS_CHUNK_SIZE);
+}
+
+/**
+ * IndexedDB layout (v2): a `manifest` store of path -> {size, mtime} and a
+ * `chunks` store keyed by [path, index] holding VFS_CHUNK_SIZE slices of each
+ * body, so startup reads only the manifest and a seek-and-read touches only
+ * the chunks it needs. A v1 `files` store (path -> whole body) is split into
+ * chunks during the upgrade.
+ *
+ * With compression enabled, a file's chunks hold the compressed body and its manifest
+ * entry records the codec. Startup still reads only the manifest; the body is
+ * read and decompressed as a whole the first time any chunk is requested.
+ */
 export class IndexedDBDriver implements VFSStorageDriver {
     public name = 'IndexedDB';
     public ready: Promise<void>;
     private db: IDBDatabase | null = null;
     private dbName = 'LavaX_VFS';
-    private storeName = 'files';
+    private legacyStoreName = 'files';
+    private manifestStoreName = 'manifest';
+    private chunkStoreName = 'chunks';
+    // Path -> codec info for compressed files, from the manifest and our writes.
+    private compressed = new Map<string, StoredManifestEntry>();
+    private decoded = new Map<string, DecodedBody>();
 
-    constructor() {
+    constructor(private readonly options: IndexedDBDriverOptions = {}) {
         this.ready = this.init();
     }
 
@@ -85,12 +287,13 @@ export class IndexedDBDriver implements VFSStorageDriver {
             if (typeof indexedDB === 'undefined') {
                 return reject(new Error("IndexedDB not supported"));
             }
-            const request = indexedDB.open(this.dbName, 1);
+            const request = indexedDB.open(this.dbName, 2);
             request.onupgradeneeded = (e: any) => {
-                const db = e.target.result;
-                if (!db.objectStoreNames.contains(this.storeName)) {
-                    db.createObjectStore(this.storeName);
-                }
+                const db: IDBDatabase = e.target.result;
+                const tx: IDBTransaction = e.target.transaction;
+                if (!db.objectStoreNames.contains(this.manifestStoreName)) db.createObjectStore(this.manifestStoreName);
+                if (!db.objectStoreNames.contains(this.chunkStoreName)) db.createObjectStore(this.chunkStoreName);
+                if (db.objectStoreNames.contains(this.legacyStoreName)) this.migrateLegacyStore(db, tx);
             };
             request.onsuccess = () => {
                 this.db = request.result;
@@ -100,45 +303,149 @@ export class IndexedDBDriver implements VFSStorageDriver {
         });
     }
 
-    async getAll(): Promise<Map<string, Uint8Array>> {
+    /** Runs inside the versionchange transaction. */
+    private migrateLegacyStore(db: IDBDatabase, tx: IDBTransaction) {
+        const manifest = tx.objectStore(this.manifestStoreName);
+        const chunks = tx.objectStore(this.chunkStoreName);
+        const cursorRequest = tx.objectStore(this.legacyStoreName).openCursor();
+        cursorRequest.onsuccess = () => {
+            const cursor = cursorRequest.result;
+            if (!cursor) {
+                db.deleteObjectStore(this.legacyStoreName);
+                return;
+            }
+            const data = cursor.value as Uint8Array;
+            this.putFile(manifest, chunks, cursor.key as string, data.length, { bytes: data }, Date.now());
+            cursor.continue();
+        };
+    }
+
+    private putFile(manifest: IDBObjectStore, chunks: IDBObjectStore, path: string, size: number, body: EncodedBody, mtime: number) {
+        const data = body.bytes;
+        chunks.delete(IDBKeyRange.bound([path, 0], [path, Infinity]));
+        for (let i = 0, offset = 0; offset < data.length; i++, offset += VFS_CHUNK_SIZE) {
+            chunks.put(data.slice(offset, offset + VFS_CHUNK_SIZE), [path, i]);
+        }
+        const entry: StoredManifestEntry = body.codec ? { size, mtime, codec: body.codec, stored: data.length } : { size, mtime };
+        manifest.put(entry, path);
+        this.decoded.delete(path);
+        if (body.codec) this.compressed.set(path, entry);
+        else this.compressed.delete(path);
+    }
+
+    /** Opens a transaction over both stores; resolves when it commits. */
+    private transact(mode: IDBTransactionMode, body: (manifest: IDBObjectStore, chunks: IDBObjectStore) => void): Promise<void> {
         return new Promise((resolve, reject) => {
-            if (!this.db) return resolve(new Map());
-            const tx = this.db.transaction(this.storeName, 'readonly');
-            const store = tx.objectStore(this.storeName);
-            const request = store.openCursor();
-            const results = new Map<string, Uint8Array>();
-            request.onsuccess = (e: any) => {
-                const cursor = e.target.result;
-                if (cursor) {
-                    results.set(cursor.key as string, cursor.value as Uint8Array);
-                    cursor.continue();
-                } else {
-                    resolve(results);
-                }
+            if (!this.db) return resolve();
+            const tx = this.db.transaction([this.manifestStoreName, this.chunkStoreName], mode);
+            body(tx.objectStore(this.manifestStoreName), tx.objectStore(this.chunkStoreName));
+            tx.oncomplete = () => resolve();
+            tx.onerror = () => reject(tx.error);
+            tx.onabort = () => reject(tx.error);
+        });
+    }
+
+    async getManifest(): Promise<VFSManifestEntry[]> {
+        const entries: VFSManifestEntry[] = [];
+        await this.transact('readonly', manifest => {
+            const request = manifest.openCursor();
+            request.onsuccess = () => {
+                const cursor = request.result;
+                if (!cursor) return;
+                const value = cursor.value as StoredManifestEntry;
+                entries.push({ path: cursor.key as string, size: value.size, mtime: value.mtime });
+                if (value.codec) this.compressed.set(cursor.key as string, value);
+                cursor.continue();
             };
-            request.onerror = () => reject(request.error);
         });
+        return entries;
+    }
+
+    async readChunks(path: string, first: number, count: number): Promise<Uint8Array[]> {
+        if (this.compressed.has(path)) return this.readDecodedChunks(path, first, count);
+        return this.readStoredChunks(path, first, count);
+    }
+
+    private async readStoredChunks(path: string, first: number, count: number): Promise<Uint8Array[]> {
+        let result: Uint8Array[] = [];
+        await this.transact('readonly', (_manifest, chunks) => {
+            const request = chunks.getAll(IDBKeyRange.bound([path, first], [path, first + count - 1]));
+            request.onsuccess = () => { result = request.result as Uint8Array[]; };
+        });
+        if (result.length !== count) throw new Error(`IndexedDBDriver: ${path} is missing chunks ${first}..${first + count - 1}`);
+        return result;
+    }
+
+    /** Reads a whole stored body (compressed bytes for compressed files). */
+    private async readStoredBody(path: string, size: number): Promise<Uint8Array> {
+        const body = new Uint8Array(size);
+        const count = chunkCount(size);
+        if (count > 0) {
+            const chunks = await this.readStoredChunks(path, 0, count);
+            chunks.forEach((chunk, i) => body.set(chunk, i * VFS_CHUNK_SIZE));
+        }
+        return body;
+    }
+
+    private async readDecodedChunks(path: string, first: number, count: number): Promise<Uint8Array[]> {
+        let body = this.decoded.get(path);
+        if (!body) {
+            const entry = this.compressed.get(path)!;
+            const chunks = chunkCount(entry.size);
+            body = {
+                data: this.readStoredBody(path, entry.stored!).then(stored => decodeBody(entry.codec, stored, entry.size)),
+                unserved: chunks,
+                served: new Uint8Array(chunks),
+            };
+            this.decoded.set(path, body);
+            body.data.catch(() => { if (this.decoded.get(path) === body) this.decoded.delete(path); });
+        }
+        const data = await body.data;
+        const result: Uint8Array[] = [];
+        for (let i = first; i < first + count; i++) {
+            result.push(data.subarray(i * VFS_CHUNK_SIZE, (i + 1) * VFS_CHUNK_SIZE));
+            if (!body.served[i]) {
+                body.served[i] = 1;
+                body.unserved--;
+            }
+        }
+        // The VFS keeps its own copy; don't hold a second one.
+        if (body.unserved === 0 && this.decoded.get(path) === body) this.decoded.delete(path);
+        return result;
+    }
+
+    async getAll(): Promise<Map<string, Uint8Array>> {
+        const results = new Map<string, Uint8Array>();
+        for (const entry of await this.getManifest()) {
+            const stored = this.compressed.get(entry.path);
+            const body = await this.readStoredBody(entry.path, stored ? stored.stored! : entry.size);
+            results.set(entry.path, stored ? await decodeBody(stored.codec, body, entry.size) : body);
+        }
+        return results;
     }
 
     async persist(path: string, data: Uint8Array): Promise<void> {
-        return new Promise((resolve, reject) => {
-            if (!this.db) return resolve();
-            const tx = this.db.transaction(this.storeName, 'readwrite');
-            const store = tx.objectStore(this.storeName);
-            const request = store.put(data, path);
-            request.onsuccess = () => resolve();
-            request.onerror = () => reject(request.error);
+        return this.persistMany([[path, data]]);
+    }
+
+    async persistMany(entries: Array<[string, Uint8Array]>): Promise<void> {
+        if (entries.length === 0) return;
+        const mtime = Date.now();
+        // Compress first: an IndexedDB transaction commits as soon as we await anything else.
+        const compression = this.options.compression;
+        const bodies = await Promise.all(entries.map(([, data]) =>
+            compression ? encodeBody(data, compression) : { bytes: data }));
+        return this.transact('readwrite', (manifest, chunks) => {
+            entries.forEach(([path, data], i) => this.putFile(manifest, chunks, path, data.length, bodies[i], mtime));
         });
     }
 
     async remove(path: string): Promise<void> {
-        return new Promise((resolve, reject) => {
-            if (!this.db) return resolve();
-            const tx = this.db.transaction(this.storeName, 'readwrite');
-            const store = tx.objectStore(this.storeName);
-            const request = store.delete(path);
-            request.onsuccess = () => resolve();
-            request.onerror = () => reject(request.error);
+        this.compressed.delete(path);
+        this.decoded.delete(path);
+        return this.transact('readwrite', (manifest, chunks) => {
+            manifest.delete(path);
+            chunks.delete(IDBKeyRange.bound([path, 0], [path, Infinity]));
         });
     }
 }
@@ -0,0 +1,115 @@
+/**
+ * Time source for the VM's timing syscalls (Delay, Getms, GetTime).
+ *
+ * - 'realtime': performance.now() for elapsed time, Date.now() for wall time.
+ * - 'virtual':  time advances with executed instructions (`opsPerMs`) and
+ *               sleeps complete instantly, so runs are deterministic and not
+ *               bound to the host's timers.
+ * - 'scaled':   real elapsed time multiplied by `scale` (2 = twice as fast).
+ *
+ * Sleeps are deadlines on this clock; the run loop asks `pendingSleepMs()` how
+ * long to wait on the host and never polls the sleeping instruction again.
+ */
+export type ClockSource = 'realtime' | 'virtual' | 'scaled';
+
+export interface ClockOptions {
+    source?: ClockSource;
+    /** Instructions per virtual millisecond ('virtual' source). */
+    opsPerMs?: number;
+    /** Rate relative to real time ('scaled' source). */
+    scale?: number;
+}
+
+const DEFAULT_OPS_PER_MS = 1000;
+
+function hostNow(): number {
+    if (typeof performance !== 'undefined' && typeof performance.now === 'function') {
+        return performance.now();
+    }
+    return Date.now();
+}
+
+export class VirtualClock {
+    public source: ClockSource = 'realtime';
+    public opsPerMs = DEFAULT_OPS_PER_MS;
+    public scale = 1;
+
+    private epochMs = 0;
+    private baseMs = 0;
+    private realStart = 0;
+    private retiredOps = 0;
+    private skippedMs = 0;
+    private sleepDeadline = 0;
+    private sleeping = false;
+
+    constructor(options?: ClockOptions) {
+        this.reset();
+        if (options) this.configure(options);
+    }
+
+    /** Restarts the clock at 0 and cancels any pending sleep. */
+    public reset() {
+        this.epochMs = Date.now();
+        this.baseMs = 0;
+        this.realStart = hostNow();
+        this.retiredOps = 0;
+        this.skippedMs = 0;
+        this.sleeping = false;
+    }
+
+    /** Switches source or rate; `now()` continues from its current value. */
+    public configure(options: ClockOptions) {
+        const current = this.now();
+        if (options.source) this.source = options.source;
+        if (options.opsPerMs && options.opsPerMs > 0) this.opsPerMs = options.opsPerMs;
+        if (options.scale && options.scale > 0) this.scale = options.scale;
+        this.baseMs = current;
+        this.realStart = hostNow();
+        this.retiredOps = 0;
+        this.skippedMs = 0;
+    }
+
+    /** Milliseconds since reset, on the configured source. */
+    public now(): number {
+        switch (this.source) {
+            case 'virtual': return this.baseMs + this.retiredOps / this.opsPerMs + this.skippedMs;
+            case 'scaled': return this.baseMs + (hostNow() - this.realStart) * this.scale;
+            default: return this.baseMs + (hostNow() - this.realStart);
+        }
+    }
+
+    /** Epoch milliseconds for calendar syscalls. */
+    public wallClockMs(): number {
+        return this.source === 'realtime' ? Date.now() : this.epochMs + Math.floor(this.now());
+    }
+
+    /** Credits executed instructions; only the 'virtual' source reads them. */
+    public retire(ops: number) {
+        this.retiredOps += ops;
+    }
+
+    public sleep(ms: number) {
+        this.sleepDeadline = this.now() + ms;
+        this.sleeping = true;
+    }
+
+    public get isSleeping(): boolean {
+        return this.sleeping;
+    }
+
+    /**
+     * Host milliseconds still to wait for the current sleep, or 0 once it is
+     * over (which also ends it). The 'virtual' source jumps to the deadline.
+     */
+    public pendingSleepMs(): number {
+        if (!this.sleeping) return 0;
+        const remaining = this.sleepDeadline - this.now();
+        if (remaining > 0) {
+            if (this.source === 'realtime') return Math.ceil(remaining);
+            if (this.source === 'scaled') return Math.ceil(remaining / this.scale);
+            this.skippedMs += remaining;
+        }
+        this.sleeping = false;
+        return 0;
+    }
+}
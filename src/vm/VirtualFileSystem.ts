@@ -1,47 +1,252 @@
-import { VFSStorageDriver, IndexedDBDriver, LocalStorageDriver } from './VFSStorageDriver';
+import { VFSStorageDriver, IndexedDBDriver, LocalStorageDriver, VFS_CHUNK_SIZE } from './VFSStorageDriver';
+import { VFSDirectoryIndex } from './VFSDirectoryIndex';
+import { ResolvedPathCache } from './VFSPathCache';
+
+/**
+ * An open file. `data` is a growable buffer whose capacity may exceed the
+ * file size; only the first `length` bytes are file content.
+ */
+export interface VFSFileHandle {
+    name: string;
+    pos: number;
+    data: Uint8Array;
+    length: number;
+    /** Set while `data` is the body of a file whose chunks are still loading. */
+    pending?: LazyFile;
+    /** Write batch this handle's last write was recorded in, see writeHandleByte(). */
+    writeBatch: number;
+}
+
+/**
+ * A stored file whose body is fetched on demand. Until first use `files`
+ * holds UNLOADED for the path; then `body` is allocated at full size, takes
+ * its place, and chunks are copied in as they arrive. A driver that can map
+ * the whole file lends that view as the body instead (see mapFile).
+ */
+interface LazyFile {
+    /** Key in the driver (the VFS path may have been normalized). */
+    source: string;
+    size: number;
+    body: Uint8Array | null;
+    /** Per-chunk flag, 1 once the chunk is in `body`. */
+    resident: Uint8Array;
+    missing: number;
+    inflight: Map<number, Promise<void>>;
+    error: unknown;
+}
 
+export interface VirtualFileSystemOptions {
+    /**
+     * With a lazy driver, read every body in the background once the
+     * manifest is loaded (see `loaded`). Defaults to true so synchronous
+     * getFile() callers find the data; on-demand reads still go first.
+     */
+    prefetch?: boolean;
+}
+
+const MIN_HANDLE_CAPACITY = 64;
+const UNLOADED = new Uint8Array(0);
+
+/**
+ * In-memory filesystem backed by a VFSStorageDriver.
+ *
+ * Loading: `ready` resolves once every path is known. With a driver that
+ * offers getManifest/readChunks that is just the manifest; file bodies are
+ * read chunk by chunk when first needed (see whenLoaded) and prefetched in
+ * the background until `loaded` resolves.
+ *
+ * Durability: addFile, deleteFile and mkdir are write-through (queued to the
+ * driver immediately). Writes made through file handles are write-back: the
+ * file is marked dirty and all dirty files reach the driver in one batch on
+ * closeFile, on sync(), when the VM stops or blocks for input, or at most
+ * `writeBackDelayMs` after the first unflushed write. A file stays dirty
+ * until the driver has accepted it: if a flush fails, its files are marked
+ * dirty again and retried after `writeBackDelayMs`, and sync() rejects.
+ * Anything not yet accepted is lost if the page dies first. All driver
+ * operations run in order, so a delete never races an older flush.
+ */
 export class VirtualFileSystem {
     private files: Map<string, Uint8Array> = new Map();
-    private fileHandles: Map<number, { name: string, pos: number, data: Uint8Array }> = new Map();
+    private tree = new VFSDirectoryIndex();
+    private pathCache = new ResolvedPathCache();
+    private fileHandles: Map<number, VFSFileHandle> = new Map();
+    // Path -> handle holding its newest content, until settled into `files`.
+    private liveHandles: Map<string, VFSFileHandle> = new Map();
+    // Path -> body still being fetched from a lazy driver.
+    private lazy: Map<string, LazyFile> = new Map();
+    // Bodies lent by the driver (manifest data, mapFile); copied before a write.
+    private borrowed = new WeakSet<Uint8Array>();
     private dirHandles: Map<number, { path: string, entries: string[], pos: number }> = new Map();
     private nextHandle = 1;
-    private nextDirHandle = 1;
     public cwd: string = "/";
     public ready: Promise<void>;
+    /** Resolves once every file body is in memory (after `ready`). */
+    public loaded: Promise<void>;
+    /** Upper bound on how long handle writes stay unflushed (ms). */
+    public writeBackDelayMs = 1000;
     private driver: VFSStorageDriver;
-
-    constructor(driver?: VFSStorageDriver) {
+    private storageQueue: Promise<void>;
+    private dirty = new Set<string>();
+    // Files handed to the driver and not yet accepted.
+    private flushing = new Set<string>();
+    // Path -> why its last flush failed (it is dirty again), until one succeeds.
+    private flushErrors = new Map<string, unknown>();
+    // Path -> generation of its last create/modify/delete, see changesSince().
+    private changeLog = new Map<string, number>();
+    private generation = 0;
+    // Bumped whenever a handle's dirty/live/change-log bookkeeping may be stale.
+    private writeBatch = 0;
+    private flushTimer: ReturnType<typeof setTimeout> | null = null;
+    private readonly byteScratch = new Uint8Array(1);
+
+    constructor(driver?: VFSStorageDriver, options: VirtualFileSystemOptions = {}) {
         // Default to IndexedDB (no quota issues); LocalStorage is a fallback for environments without IndexedDB
         this.driver = driver ?? (typeof indexedDB !== 'undefined' ? new IndexedDBDriver() : new LocalStorageDriver());
         this.ready = this.init();
+        this.storageQueue = this.ready;
+        this.loaded = options.prefetch === false ? this.ready : this.ready.then(() => this.prefetchAll());
     }
 
-    private async init() {
-        try {
-            await this.driver.ready;
-            const storedFiles = await this.driver.getAll();
-
-            const normalizedFiles = new Map<string, Uint8Array>();
-            let migratedCount = 0;
-
-            for (const [path, data] of storedFiles) {
-                let normalized = path;
-                if (!path.startsWith('/')) {
-                    normalized = '/' + path;
-                    migratedCount++;
-                    // Remove old un-normalized entry from persistent storage
-                    await this.driver.remove(path).catch(console.error);
-                }
+    /** Runs a driver operation after every previously queued one. */
+    private enqueue(op: () => Promise<void>): Promise<void> {
+        this.storageQueue = this.storageQueue.then(op).catch(console.error);
+        return this.storageQueue;
+    }
 
-                normalizedFiles.set(normalized, data);
+    private markDirty(path: string) {
+        this.recordChange(path);
+        this.dirty.add(path);
+        this.scheduleFlush();
+    }
+
+    private scheduleFlush() {
+        if (this.flushTimer === null) {
+            this.flushTimer = setTimeout(() => {
+                this.flushTimer = null;
+                this.syncInBackground();
+            }, this.writeBackDelayMs);
+        }
+    }
 
-                // If it was migrated, persist the new one immediately
-                if (normalized !== path) {
-                    await this.driver.persist(normalized, data).catch(console.error);
+    /**
+     * Flushes every dirty file to the driver in one batch. The returned promise
+     * resolves once the driver has accepted it (and everything queued before),
+     * and rejects if any file written so far could not be stored; those files
+     * stay dirty and are retried.
+     */
+    public sync(): Promise<void> {
+        if (this.flushTimer !== null) {
+            clearTimeout(this.flushTimer);
+            this.flushTimer = null;
+        }
+        if (this.dirty.size > 0) this.flushDirty();
+        return this.storageQueue.then(() => {
+            if (this.flushErrors.size > 0) throw this.flushErrors.values().next().value;
+        });
+    }
+
+    /** sync() for callers that don't wait: a failure is logged and retried. */
+    public syncInBackground() {
+        this.sync().catch(() => { /* logged by enqueue; the files stay dirty */ });
+    }
+
+    private flushDirty() {
+        const batch: Array<[string, Uint8Array]> = [];
+        for (const path of this.dirty) {
+            this.settle(path);
+            const data = this.files.get(path);
+            // Hand persistence exact-size bytes, never a view of a larger buffer.
+            if (!data) {
+                this.flushErrors.delete(path);
+                continue;
+            }
+            batch.push([path, data.byteLength === data.buffer.byteLength ? data : data.slice()]);
+            this.flushing.add(path);
+        }
+        this.dirty.clear();
+        this.writeBatch++;
+        this.enqueue(async () => {
+            try {
+                if (this.driver.persistMany) {
+                    await this.driver.persistMany(batch);
+                } else {
+                    for (const [path, data] of batch) await this.driver.persist(path, data);
                 }
+            } catch (error) {
+                // Whatever is in `files` now goes with the retry.
+                for (const [path] of batch) {
+                    this.flushErrors.set(path, error);
+                    this.dirty.add(path);
+                }
+                this.scheduleFlush();
+                throw error;
+            } finally {
+                for (const [path] of batch) this.flushing.delete(path);
             }
+            for (const [path] of batch) this.flushErrors.delete(path);
+        });
+    }
+
+    /** Publishes the trimmed content of a path's live handle into `files`. */
+    private settle(path: string) {
+        const h = this.liveHandles.get(path);
+        if (!h) return;
+        this.putFile(path, h.data.length === h.length ? h.data : h.data.subarray(0, h.length));
+    }
 
-            // migratedCount ignored (migration is transparent)
+    private recordChange(path: string) {
+        this.changeLog.set(path, ++this.generation);
+        this.writeBatch++;
+    }
+
+    /**
+     * Returns the current change generation, to pass to changesSince() later.
+     * Ends every open putc fast-path window, so bytes written after this call
+     * log a newer generation.
+     */
+    public markChangeGeneration(): number {
+        this.writeBatch++;
+        return this.generation;
+    }
+
+    /**
+     * Paths whose content changed (or that were created) and paths that were
+     * deleted after `generation`, e.g. to ship a delta to another VFS copy.
+     */
+    public changesSince(generation: number): { changed: string[]; deleted: string[] } {
+        const changed: string[] = [];
+        const deleted: string[] = [];
+        for (const [path, at] of this.changeLog) {
+            if (at <= generation) continue;
+            if (this.files.has(path)) changed.push(path);
+            else deleted.push(path);
+        }
+        return { changed, deleted };
+    }
+
+    /** Stores a path's bytes, indexing it in the directory tree if new. */
+    private putFile(path: string, data: Uint8Array) {
+        this.recordChange(path);
+        if (!this.files.has(path)) this.tree.add(path);
+        this.files.set(path, data);
+        const file = this.lazy.get(path);
+        if (file && file.body !== data) this.lazy.delete(path);
+    }
+
+    private settleAll() {
+        for (const path of this.liveHandles.keys()) this.settle(path);
+    }
+
+    public get hasUnsyncedWrites(): boolean {
+        return this.dirty.size > 0 || this.flushing.size > 0;
+    }
+
+    private async init() {
+        try {
+            await this.driver.ready;
+            const normalizedFiles = this.driver.getManifest && this.driver.readChunks
+                ? await this.loadManifest()
+                : await this.loadAll();
 
             // Migration logic: If current driver is empty and it's IndexedDB, try to migrate from localStorage
             if (normalizedFiles.size === 0 && this.driver instanceof IndexedDBDriver) {
@@ -57,13 +262,150 @@ export class VirtualFileSystem {
             }
 
             this.files = normalizedFiles;
+            this.tree.clear();
+            for (const path of normalizedFiles.keys()) this.tree.add(path);
         } catch (e) {
             console.error("VFS Initialization failed:", e);
         }
     }
 
+    private async loadAll(): Promise<Map<string, Uint8Array>> {
+        const storedFiles = await this.driver.getAll();
+        const normalizedFiles = new Map<string, Uint8Array>();
+
+        for (const [path, data] of storedFiles) {
+            let normalized = path;
+            if (!path.startsWith('/')) {
+                normalized = '/' + path;
+                // Remove old un-normalized entry from persistent storage
+                await this.driver.remove(path).catch(console.error);
+            }
+
+            normalizedFiles.set(normalized, data);
+
+            // If it was migrated, persist the new one immediately
+            if (normalized !== path) {
+                await this.driver.persist(normalized, data).catch(console.error);
+            }
+        }
+        return normalizedFiles;
+    }
+
+    /** Registers every stored path; bodies stay unread until needed. */
+    private async loadManifest(): Promise<Map<string, Uint8Array>> {
+        const normalizedFiles = new Map<string, Uint8Array>();
+        this.lazy.clear();
+        for (const entry of await this.driver.getManifest!()) {
+            const path = entry.path.startsWith('/') ? entry.path : '/' + entry.path;
+            if (entry.data || entry.size === 0) {
+                if (entry.data) this.borrowed.add(entry.data);
+                normalizedFiles.set(path, entry.data ?? new Uint8Array(0));
+                continue;
+            }
+            normalizedFiles.set(path, UNLOADED);
+            const chunks = Math.ceil(entry.size / VFS_CHUNK_SIZE);
+            this.lazy.set(path, {
+                source: entry.path,
+                size: entry.size,
+                body: null,
+                resident: new Uint8Array(chunks),
+                missing: chunks,
+                inflight: new Map(),
+                error: null,
+            });
+        }
+        return normalizedFiles;
+    }
+
+    private async prefetchAll() {
+        for (const [path, file] of Array.from(this.lazy)) {
+            // Skip files deleted or overwritten since the manifest loaded.
+            if (this.lazy.get(path) === file) await this.fetchChunks(path, file, 0, file.resident.length);
+        }
+    }
+
+    /**
+     * Starts reads for the missing chunks in [first, end) of a lazy file,
+     * coalescing runs into one driver call and reusing reads in flight.
+     * Returns null when the range is already resident. Never rejects: a
+     * failed read is recorded in `file.error`.
+     */
+    private fetchChunks(path: string, file: LazyFile, first: number, end: number): Promise<void> | null {
+        if (!file.body && this.adoptMapping(path, file)) return null;
+        const waits: Promise<void>[] = [];
+        let runStart = -1;
+        for (let i = first; i <= end; i++) {
+            const needed = i < end && !file.resident[i];
+            const inflight = needed ? file.inflight.get(i) : undefined;
+            if (inflight) waits.push(inflight);
+            if (needed && !inflight) {
+                if (runStart < 0) runStart = i;
+                continue;
+            }
+            if (runStart >= 0) {
+                waits.push(this.readRun(path, file, runStart, i - runStart));
+                runStart = -1;
+            }
+        }
+        return waits.length > 0 ? Promise.all(waits).then(() => undefined) : null;
+    }
+
+    /**
+     * Takes the driver's whole-file view (see VFSStorageDriver.mapFile) as a
+     * lazy file's body, making it resident at once. False if there is none.
+     */
+    private adoptMapping(path: string, file: LazyFile): boolean {
+        const view = this.driver.mapFile?.(file.source);
+        if (!view || view.length !== file.size) return false;
+        this.borrowed.add(view);
+        file.body = view;
+        file.resident.fill(1);
+        file.missing = 0;
+        if (this.lazy.get(path) === file) {
+            this.files.set(path, view);
+            this.lazy.delete(path);
+        }
+        return true;
+    }
+
+    /** Allocates a lazy file's body on first use and publishes it in `files`. */
+    private lazyBody(path: string, file: LazyFile): Uint8Array {
+        if (!file.body && !this.adoptMapping(path, file)) {
+            file.body = new Uint8Array(file.size);
+            if (this.lazy.get(path) === file) this.files.set(path, file.body);
+        }
+        return file.body;
+    }
+
+    private readRun(path: string, file: LazyFile, first: number, count: number): Promise<void> {
+        const read = this.driver.readChunks!(file.source, first, count).then(chunks => {
+            const body = this.lazyBody(path, file);
+            for (let k = 0; k < chunks.length; k++) {
+                const i = first + k;
+                if (file.resident[i]) continue;
+                body.set(chunks[k], i * VFS_CHUNK_SIZE);
+                file.resident[i] = 1;
+                file.missing--;
+            }
+            if (file.missing === 0 && this.lazy.get(path) === file) this.lazy.delete(path);
+        }, error => {
+            console.error(`VFS: reading ${path} failed`, error);
+            file.error = error;
+        }).finally(() => {
+            for (let i = first; i < first + count; i++) file.inflight.delete(i);
+        });
+        for (let i = first; i < first + count; i++) file.inflight.set(i, read);
+        return read;
+    }
+
     private resolvePath(path: string): string {
-        const original = path;
+        const cwd = this.cwd;
+        const cached = this.pathCache.get(cwd, path);
+        if (cached !== undefined) return cached;
+        return this.pathCache.set(cwd, path, this.normalizePath(path));
+    }
+
+    private normalizePath(path: string): string {
         const endsWithSlash = path.endsWith('/');
         if (!path.startsWith('/')) {
             path = this.cwd + (this.cwd.endsWith('/') ? '' : '/') + path;
@@ -95,29 +437,61 @@ export class VirtualFileSystem {
             current += "/" + parts[i];
             const dirMarker = current + "/";
             if (!this.files.has(dirMarker)) {
-                this.files.set(dirMarker, new Uint8Array(0));
-                this.driver.persist(dirMarker, new Uint8Array(0)).catch(console.error);
+                this.putFile(dirMarker, new Uint8Array(0));
+                this.enqueue(() => this.driver.persist(dirMarker, new Uint8Array(0)));
             }
         }
 
-        this.files.set(resolved, data);
-        this.ready.then(() => {
-            this.driver.persist(resolved, data).catch(console.error);
-        });
+        this.putFile(resolved, data);
+        this.liveHandles.delete(resolved);
+        this.dirty.delete(resolved);
+        this.flushErrors.delete(resolved);
+        this.enqueue(() => this.driver.persist(resolved, data));
     }
 
+    /**
+     * Returns a file's bytes. A body still being fetched from a lazy driver
+     * reads as undefined (and is fetched first); use readFile to wait for it.
+     */
     public getFile(path: string) {
         const resolved = this.resolvePath(path);
-        const data = this.files.get(resolved);
-        return data;
+        const file = this.lazy.get(resolved);
+        if (file) {
+            void this.fetchChunks(resolved, file, 0, file.resident.length);
+            // Still loading, unless the driver lent a mapping of the whole file.
+            if (this.lazy.has(resolved)) return undefined;
+        }
+        this.settle(resolved);
+        return this.files.get(resolved);
+    }
+
+    /** A file's bytes if they are all in memory; unlike getFile, never starts a read. */
+    public peekFile(path: string): Uint8Array | undefined {
+        const resolved = this.resolvePath(path);
+        if (this.lazy.has(resolved)) return undefined;
+        this.settle(resolved);
+        return this.files.get(resolved);
+    }
+
+    public async readFile(path: string): Promise<Uint8Array | undefined> {
+        const resolved = this.resolvePath(path);
+        const file = this.lazy.get(resolved);
+        if (file) {
+            await this.fetchChunks(resolved, file, 0, file.resident.length);
+            if (file.error) throw file.error;
+        }
+        return this.getFile(resolved);
     }
 
     public deleteFile(path: string) {
         const resolved = this.resolvePath(path);
-        this.files.delete(resolved);
-        this.ready.then(() => {
-            this.driver.remove(resolved).catch(console.error);
-        });
+        if (this.files.delete(resolved)) this.tree.remove(resolved);
+        this.recordChange(resolved);
+        this.lazy.delete(resolved);
+        this.liveHandles.delete(resolved);
+        this.dirty.delete(resolved);
+        this.flushErrors.delete(resolved);
+        this.enqueue(() => this.driver.remove(resolved));
     }
 
     public mkdir(path: string): boolean {
@@ -126,53 +500,39 @@ export class VirtualFileSystem {
         if (this.files.has(dirPath)) return true;
 
         // Add explicit directory marker (empty Uint8Array)
-        this.files.set(dirPath, new Uint8Array(0));
-        this.ready.then(() => {
-            this.driver.persist(dirPath, new Uint8Array(0)).catch(console.error);
-        });
+        this.putFile(dirPath, new Uint8Array(0));
+        this.enqueue(() => this.driver.persist(dirPath, new Uint8Array(0)));
         return true;
     }
 
     public chdir(path: string): boolean {
         const resolved = this.resolvePath(path);
-        if (resolved === '/') {
-            this.cwd = '/';
-            return true;
-        }
-        const dirPath = resolved.endsWith('/') ? resolved : resolved + '/';
-        if (this.files.has(dirPath)) {
-            this.cwd = resolved;
-            return true;
-        }
-        return false;
+        if (!this.tree.hasDir(resolved)) return false;
+        this.cwd = resolved.length > 1 && resolved.endsWith('/') ? resolved.slice(0, -1) : resolved;
+        return true;
     }
 
     public opendir(path: string): number {
         const resolved = this.resolvePath(path);
-        const prefix = resolved.endsWith('/') ? resolved : resolved + '/';
-        const entries = new Set<string>();
-
-        for (const fullPath of this.files.keys()) {
-            if (fullPath.startsWith(prefix) && fullPath !== prefix) {
-                const relative = fullPath.slice(prefix.length);
-                const firstPart = relative.split('/')[0];
-                if (firstPart) {
-                    // If it's a directory (ends with /), don't include the slash in the name
-                    // But readdir should return names, and usually they don't have trailing slashes
-                    entries.add(firstPart);
-                }
-            }
-        }
-
-        const handle = this.nextDirHandle++;
+        // Reuse the lowest free id: System (0xD3) only treats 1..99 as readdir handles.
+        let handle = 1;
+        while (this.dirHandles.has(handle)) handle++;
         this.dirHandles.set(handle, {
             path: resolved,
-            entries: Array.from(entries),
+            entries: this.tree.list(resolved) ?? [],
             pos: 0
         });
         return handle;
     }
 
+    /**
+     * Sorted names of the entries directly inside a directory (files and
+     * subdirectories, without trailing slashes); empty if it does not exist.
+     */
+    public listDir(path: string): string[] {
+        return this.tree.list(this.resolvePath(path)) ?? [];
+    }
+
     public readdir(handle: number): string | null {
         const h = this.dirHandles.get(handle);
         if (!h || h.pos >= h.entries.length) return null;
@@ -189,19 +549,25 @@ export class VirtualFileSystem {
     }
 
     public getFiles() {
-        return Array.from(this.files.entries()).map(([p, d]) => ({ path: p, size: d.length }));
+        this.settleAll();
+        return Array.from(this.files.entries()).map(([p, d]) => ({ path: p, size: this.lazy.get(p)?.size ?? d.length }));
     }
 
     public clearHandles() {
+        this.settleAll();
         this.fileHandles.clear();
+        this.liveHandles.clear();
         this.dirHandles.clear();
         this.nextHandle = 1;
-        this.nextDirHandle = 1;
         this.cwd = "/";
     }
 
     public openFile(path: string, mode: string): number {
         const resolved = this.resolvePath(path);
+        this.settle(resolved);
+        const lazyFile = this.lazy.get(resolved);
+        // Truncating opens never need the stored body.
+        if (lazyFile && !mode.includes('w')) this.lazyBody(resolved, lazyFile);
         let fileData = this.files.get(resolved);
 
         // Standard C-like mode handling
@@ -215,40 +581,54 @@ export class VirtualFileSystem {
                 return 0; // NULL
             }
             if (isWrite || isAppend || isPlus) {
-                // Create new file and persist immediately
+                // Create new file; persisted with the next flush
                 fileData = new Uint8Array(0);
-                this.files.set(resolved, fileData);
-                this.ready.then(() => {
-                    this.driver.persist(resolved, new Uint8Array(0)).catch(console.error);
-                });
+                this.putFile(resolved, fileData);
+                this.liveHandles.delete(resolved);
+                this.markDirty(resolved);
             } else {
                 return 0;
             }
         } else {
             if (isWrite) {
-                // Truncate and persist the truncated (empty) file
+                // Truncate; persisted with the next flush
                 fileData = new Uint8Array(0);
-                this.files.set(resolved, fileData);
-                this.ready.then(() => {
-                    this.driver.persist(resolved, new Uint8Array(0)).catch(console.error);
-                });
+                this.putFile(resolved, fileData);
+                this.liveHandles.delete(resolved);
+                this.markDirty(resolved);
             }
         }
 
         const handle = this.nextHandle++;
         const pos = isAppend ? fileData.length : 0;
+        const pending = this.lazy.get(resolved);
 
         this.fileHandles.set(handle, {
             name: resolved,
             pos: pos,
-            data: fileData
+            data: fileData,
+            length: fileData.length,
+            pending: pending?.body === fileData ? pending : undefined,
+            writeBatch: -1,
         });
 
         return handle;
     }
 
-    public closeFile(handle: number) {
+    /** Closes a handle; returns the flush of its writes (see sync()), or null if it has none. */
+    public closeFile(handle: number): Promise<void> | null {
+        const h = this.fileHandles.get(handle);
         this.fileHandles.delete(handle);
+        if (!h) return null;
+        if (this.liveHandles.get(h.name) === h) {
+            // Drop spare capacity once nobody appends through this handle.
+            this.putFile(h.name, h.data.length === h.length ? h.data : h.data.slice(0, h.length));
+            this.liveHandles.delete(h.name);
+        }
+        if (!this.dirty.has(h.name)) return null;
+        const flushed = this.sync();
+        flushed.catch(() => { /* logged by enqueue; the file stays dirty */ });
+        return flushed;
     }
 
     public getHandle(handle: number) {
@@ -256,30 +636,70 @@ export class VirtualFileSystem {
     }
 
     /**
-     * Writes data to a file handle and ensures persistence.
+     * For a handle on a file still loading from a lazy driver: returns a
+     * promise that settles once bytes [pos, pos + count) are in memory, or
+     * null if they already are. Throws if reading the file failed.
+     */
+    public whenLoaded(handle: number, pos: number, count: number): Promise<void> | null {
+        const h = this.fileHandles.get(handle);
+        const file = h?.pending;
+        if (!file) return null;
+        if (file.error) throw new Error(`VFS: ${h.name} could not be read`);
+        if (file.missing === 0) {
+            h.pending = undefined;
+            return null;
+        }
+        const end = Math.min(h.length, pos + count);
+        if (end <= pos) return null;
+        return this.fetchChunks(h.name, file, Math.floor(pos / VFS_CHUNK_SIZE), Math.ceil(end / VFS_CHUNK_SIZE));
+    }
+
+    /**
+     * Writes data to a file handle. The file is flushed write-back, see sync().
      */
     public writeHandleData(handle: number, data: Uint8Array, pos: number): number {
         const h = this.fileHandles.get(handle);
         if (!h) return 0;
-
-        // Ensure data buffer is large enough
-        if (pos + data.length > h.data.length) {
-            const newData = new Uint8Array(pos + data.length);
-            newData.set(h.data);
-            h.data = newData;
+        if (h.pending && h.pending.missing > 0) throw new Error(`VFS: write to ${h.name} before it finished loading`);
+
+        const end = pos + data.length;
+        if (end > h.data.length || this.borrowed.has(h.data)) {
+            // Amortised growth: double the capacity, copy only the live bytes.
+            // A body lent by the driver is copied before its first write.
+            let capacity = end > h.data.length ? Math.max(MIN_HANDLE_CAPACITY, h.data.length * 2) : h.data.length;
+            while (capacity < end) capacity *= 2;
+            const grown = new Uint8Array(capacity);
+            grown.set(h.data.subarray(0, h.length));
+            h.data = grown;
         }
 
         h.data.set(data, pos);
-        h.pos = pos + data.length;
-
-        // Sync to VFS memory map
-        this.files.set(h.name, h.data);
+        h.pos = end;
+        if (end > h.length) h.length = end;
 
-        // Persistent sync (Async)
-        this.ready.then(() => {
-            this.driver.persist(h.name, h.data).catch(console.error);
-        });
+        this.liveHandles.set(h.name, h);
+        this.markDirty(h.name);
+        h.writeBatch = this.writeBatch;
 
         return data.length;
     }
+
+    /**
+     * Writes one byte at the handle's position (putc). While nothing has
+     * happened since this handle's last write that could make its
+     * bookkeeping stale (flush, settle, another writer, markChangeGeneration),
+     * the byte goes straight into the buffer; otherwise it takes the
+     * writeHandleData() path.
+     */
+    public writeHandleByte(handle: number, h: VFSFileHandle, value: number) {
+        const pos = h.pos;
+        if (h.writeBatch === this.writeBatch && pos < h.data.length) {
+            h.data[pos] = value;
+            h.pos = pos + 1;
+            if (h.pos > h.length) h.length = h.pos;
+            return;
+        }
+        this.byteScratch[0] = value;
+        this.writeHandleData(handle, this.byteScratch, pos);
+    }
 }
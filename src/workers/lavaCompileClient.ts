@@ -0,0 +1,162 @@
+import type { LavLineMap } from '../lav/lineMap';
+import type { LavaCompileWorkerEvent, LavaCompileWorkerRequest } from './lavaCompileProtocol';
+
+export interface LavaCompileInput {
+  source: string;
+  sourceFile: string;
+  /** Files the source may #include, by included name; see collectIncludes(). */
+  includes: Record<string, string>;
+}
+
+export interface LavaCompileOutput {
+  /** Null when compilation failed; `error` says why. */
+  lav: Uint8Array | null;
+  listing?: string;
+  lineMap?: LavLineMap;
+  error?: string;
+}
+
+/** The subset of Worker the client talks through. */
+export interface LavaCompilePort {
+  postMessage(message: LavaCompileWorkerRequest, transfer: Transferable[]): void;
+  addEventListener(type: 'message', listener: (event: { data: LavaCompileWorkerEvent }) => void): void;
+}
+
+export interface LavaCompileOptions {
+  /** A diagnostics compile: a newer request may drop it (it then resolves to null). */
+  background?: boolean;
+}
+
+interface Waiting {
+  key: string;
+  identity: string;
+  resolve: (output: LavaCompileOutput | null) => void;
+  /** A later request of the same input that must not be dropped; answers this one if it is. */
+  successor?: Promise<LavaCompileOutput | null>;
+}
+
+const DEFAULT_CACHE_SIZE = 8;
+const INCLUDE_DIRECTIVE = /^[ \t]*#[ \t]*include[ \t]*"([^"]+)"/gm;
+
+/**
+ * Every file reachable through `#include "..."` from `source`, read with
+ * `resolve` (which gets the name exactly as the compiler's include resolver
+ * would). `resolve` may be async, so lazily loaded files can be awaited.
+ * Directives inside inactive #if blocks are followed too; an extra file does
+ * no harm.
+ */
+export async function collectIncludes(
+  source: string,
+  resolve: (filename: string) => Promise<string | null> | string | null,
+): Promise<Record<string, string>> {
+  const includes: Record<string, string> = {};
+  const seen = new Set<string>();
+  const queue = [source];
+  while (queue.length > 0) {
+    const text = queue.pop()!;
+    for (const match of text.matchAll(INCLUDE_DIRECTIVE)) {
+      const filename = match[1];
+      if (seen.has(filename)) continue;
+      seen.add(filename);
+      const content = await resolve(filename);
+      if (content === null) continue;
+      includes[filename] = content;
+      queue.push(content);
+    }
+  }
+  return includes;
+}
+
+// cyrb53: 53-bit string hash, plenty to key a handful of cache entries.
+function hashString(text: string): number {
+  let h1 = 0xdeadbeef;
+  let h2 = 0x41c6ce57;
+  for (let i = 0; i < text.length; i++) {
+    const ch = text.charCodeAt(i);
+    h1 = Math.imul(h1 ^ ch, 2654435761);
+    h2 = Math.imul(h2 ^ ch, 1597334677);
+  }
+  h1 = Math.imul(h1 ^ (h1 >>> 16), 2246822507) ^ Math.imul(h2 ^ (h2 >>> 13), 3266489909);
+  h2 = Math.imul(h2 ^ (h2 >>> 16), 2246822507) ^ Math.imul(h1 ^ (h1 >>> 13), 3266489909);
+  return 4294967296 * (2097151 & h2) + (h1 >>> 0);
+}
+
+function inputIdentity({ source, sourceFile, includes }: LavaCompileInput): string {
+  const parts = [sourceFile];
+  for (const name of Object.keys(includes).sort()) parts.push(name, includes[name]);
+  parts.push(source);
+  return parts.join('\0');
+}
+
+/**
+ * Main-thread side of the compile worker.
+ *
+ * Results are cached by a hash of everything the compile depends on (source,
+ * file name, included files), so a Run right after the diagnostics compile
+ * of the same text gets its bytecode without compiling again; a request
+ * identical to one still in flight shares its promise. compile() resolves to
+ * null when the worker dropped a background request for a newer one; an
+ * explicit compile of the same input as an in-flight background one is sent
+ * anyway, and answers it if that one is dropped.
+ */
+export class LavaCompileClient {
+  private nextToken = 1;
+  private readonly waiting = new Map<number, Waiting>();
+  // key -> the latest request in flight for it
+  private readonly inFlight = new Map<string, { identity: string; token: number; background: boolean; promise: Promise<LavaCompileOutput | null> }>();
+  // key -> result, least recently used first
+  private readonly cache = new Map<string, { identity: string; output: LavaCompileOutput }>();
+
+  constructor(private readonly port: LavaCompilePort, private readonly cacheSize = DEFAULT_CACHE_SIZE) {
+    port.addEventListener('message', (event) => this.onEvent(event.data));
+  }
+
+  compile(input: LavaCompileInput, { background = false }: LavaCompileOptions = {}): Promise<LavaCompileOutput | null> {
+    const identity = inputIdentity(input);
+    const key = String(hashString(identity));
+    const cached = this.cache.get(key);
+    if (cached && cached.identity === identity) {
+      this.cache.delete(key);
+      this.cache.set(key, cached);
+      return Promise.resolve(cached.output);
+    }
+    const running = this.inFlight.get(key);
+    const sameInput = running && running.identity === identity ? running : null;
+    if (sameInput && (background || !sameInput.background)) return sameInput.promise;
+
+    const token = this.nextToken++;
+    const promise = new Promise<LavaCompileOutput | null>((resolve) => {
+      this.waiting.set(token, { key, identity, resolve });
+    });
+    if (sameInput) {
+      const earlier = this.waiting.get(sameInput.token);
+      if (earlier) earlier.successor = promise;
+    }
+    this.inFlight.set(key, { identity, token, background, promise });
+    this.port.postMessage({ type: 'compile', token, ...input, background }, []);
+    return promise;
+  }
+
+  private onEvent(event: LavaCompileWorkerEvent) {
+    const waiting = this.waiting.get(event.token);
+    if (!waiting) return;
+    this.waiting.delete(event.token);
+    const { key, identity } = waiting;
+    if (this.inFlight.get(key)?.token === event.token) this.inFlight.delete(key);
+
+    if (event.type === 'superseded') {
+      if (waiting.successor) waiting.successor.then(waiting.resolve);
+      else waiting.resolve(null);
+      return;
+    }
+    const output: LavaCompileOutput = {
+      lav: event.program ? new Uint8Array(event.program) : null,
+      listing: event.listing,
+      lineMap: event.lineMap,
+      error: event.error,
+    };
+    this.cache.set(key, { identity, output });
+    while (this.cache.size > this.cacheSize) this.cache.delete(this.cache.keys().next().value!);
+    waiting.resolve(output);
+  }
+}
@@ -0,0 +1,14 @@
+import type { LavLineMap } from '../lav/lineMap';
+
+// Requests are numbered by the client in increasing `token` order; a newer
+// compile supersedes an older `background` one still queued (diagnostics),
+// never one the user asked for. `includes` holds every file the source may
+// #include, by the name it is included as.
+export type LavaCompileWorkerRequest =
+  | { type: 'compile'; token: number; source: string; sourceFile: string; includes: Record<string, string>; background: boolean };
+
+export type LavaCompileWorkerEvent =
+  // `program` is set on success; `error` is the compiler's message otherwise.
+  | { type: 'result'; token: number; program?: ArrayBuffer; listing?: string; lineMap?: LavLineMap; error?: string }
+  // The request was dropped unrun.
+  | { type: 'superseded'; token: number };
@@ -0,0 +1,61 @@
+import { LavaXCompiler } from '../compiler';
+import type { LavaCompileWorkerEvent, LavaCompileWorkerRequest } from './lavaCompileProtocol';
+
+/**
+ * The compile worker's message handling, kept free of worker globals so it can
+ * also be driven directly.
+ *
+ * A newer request replaces a queued background one (which is answered
+ * `superseded`), so a burst of keystrokes costs one compile, not one per key.
+ * Compiles the user asked for stay queued and run in order. The queue is
+ * drained from a zero-delay timer so messages that are already waiting get to
+ * supersede before it starts. A compile that has
+ * started runs to completion (the compiler is synchronous); its result is
+ * still posted, and callers that moved on ignore it.
+ */
+export class LavaCompileService {
+  // Incremental: successive edits of the same buffer reuse unchanged functions.
+  private readonly compiler = new LavaXCompiler();
+  private pending: LavaCompileWorkerRequest[] = [];
+  private scheduled = false;
+
+  constructor(private readonly post: (event: LavaCompileWorkerEvent, transfer: Transferable[]) => void) {
+    this.compiler.incremental = true;
+  }
+
+  handle(message: LavaCompileWorkerRequest) {
+    for (const queued of this.pending) {
+      if (queued.background) this.post({ type: 'superseded', token: queued.token }, []);
+    }
+    this.pending = this.pending.filter(queued => !queued.background);
+    this.pending.push(message);
+    if (!this.scheduled) {
+      this.scheduled = true;
+      setTimeout(() => this.drain(), 0);
+    }
+  }
+
+  private drain() {
+    this.scheduled = false;
+    const queue = this.pending;
+    this.pending = [];
+    for (const request of queue) this.run(request);
+  }
+
+  private run({ token, source, sourceFile, includes }: LavaCompileWorkerRequest) {
+    this.compiler.includeResolver = (filename) => includes[filename] ?? null;
+    const result = this.compiler.compileToLav(source, sourceFile, { listing: true, lineMap: true });
+    this.compiler.includeResolver = null;
+
+    const transfer: Transferable[] = [];
+    let program: ArrayBuffer | undefined;
+    if (result.lav) {
+      program = result.lav.buffer as ArrayBuffer;
+      transfer.push(program);
+    }
+    if (result.lineMap) {
+      transfer.push(result.lineMap.pcs.buffer, result.lineMap.lines.buffer, result.lineMap.fileIds.buffer);
+    }
+    this.post({ type: 'result', token, program, listing: result.listing, lineMap: result.lineMap, error: result.error }, transfer);
+  }
+}
@@ -0,0 +1,12 @@
+import { LavaCompileService } from './lavaCompileService';
+import type { LavaCompileWorkerEvent, LavaCompileWorkerRequest } from './lavaCompileProtocol';
+
+const workerScope = self as unknown as Worker;
+
+const service = new LavaCompileService((event: LavaCompileWorkerEvent, transfer: Transferable[]) => {
+  workerScope.postMessage(event, transfer);
+});
+
+workerScope.onmessage = (event: MessageEvent<LavaCompileWorkerRequest>) => {
+  service.handle(event.data);
+};
@@ -1,3 +1,5 @@
+import type { LavLineMap } from '../lav/lineMap';
+
 export type VmLifecycleState = 'idle' | 'running' | 'waiting' | 'paused' | 'faulted' | 'stopped';
 
 export interface RuntimeFilePayload {
@@ -5,9 +7,20 @@ export interface RuntimeFilePayload {
   data: ArrayBuffer;
 }
 
+/** A file whose body is still being loaded on the main thread; the worker reads it with readChunks. */
+export interface RuntimeRemoteFile {
+  path: string;
+  size: number;
+}
+
 export type LavaVmWorkerRequest =
   | { type: 'init'; fontData?: ArrayBuffer | null }
-  | { type: 'run'; program: ArrayBuffer; files: RuntimeFilePayload[]; debug?: boolean }
+  // `files`/`remoteFiles`/`deletedPaths` are the changes since the previous run (everything when `resetFiles`);
+  // `stageLavaDataFrom` names a `<dir>/LavaData/` prefix to mirror into /LavaData for this run.
+  // `lineMap` is the compiler's PC-to-source-line map, when the program was built from source.
+  | { type: 'run'; program: ArrayBuffer; files: RuntimeFilePayload[]; remoteFiles: RuntimeRemoteFile[]; deletedPaths: string[]; resetFiles: boolean; stageLavaDataFrom?: string; debug?: boolean; lineMap?: LavLineMap }
+  // Answer to a `readChunks` event: the chunks, or why they could not be read.
+  | { type: 'chunks'; id: number; chunks?: ArrayBuffer[]; error?: string }
   | { type: 'stop' }
   | { type: 'resume' }
   | { type: 'pushKey'; code: number }
@@ -20,4 +33,7 @@ export type LavaVmWorkerEvent =
   | { type: 'lifecycle'; state: VmLifecycleState; payload?: unknown }
   | { type: 'finished' }
   | { type: 'error'; message: string; payload?: unknown }
-  | { type: 'fileSync'; files: RuntimeFilePayload[]; deletedPaths: string[] };
+  // Only the paths the run wrote or deleted.
+  | { type: 'fileSync'; files: RuntimeFilePayload[]; deletedPaths: string[] }
+  // VFS_CHUNK_SIZE chunks [first, first + count) of a remote file, answered by a `chunks` request.
+  | { type: 'readChunks'; id: number; path: string; first: number; count: number };
@@ -1,10 +1,32 @@
 import { LavaXVM } from '../vm';
+import { OverlayStorageDriver, type OverlayRemoteFiles } from '../vm/VFSStorageDriver';
 import type { LavaVmWorkerEvent, LavaVmWorkerRequest, RuntimeFilePayload } from './lavaVmRuntimeProtocol';
 
 const workerScope = self as unknown as Worker;
 
 let currentVm: LavaXVM | null = null;
 let fontData: Uint8Array | null = null;
+// Runs execute one at a time; a run message stops the current one and waits for it.
+let runGeneration = 0;
+let lastRun: Promise<void> = Promise.resolve();
+// The files as of the end of the last run. Each run message carries only the
+// main thread's changes since then; each run sends back only its own.
+const baseFiles = new Map<string, Uint8Array>();
+// Files the main thread had not loaded yet: path -> size. Read on demand.
+const remoteSizes = new Map<string, number>();
+let nextChunkRequest = 1;
+const chunkRequests = new Map<number, { resolve: (chunks: Uint8Array[]) => void; reject: (error: Error) => void }>();
+
+const remoteFiles: OverlayRemoteFiles = {
+  sizes: remoteSizes,
+  readChunks(path, first, count) {
+    return new Promise((resolve, reject) => {
+      const id = nextChunkRequest++;
+      chunkRequests.set(id, { resolve, reject });
+      postEvent({ type: 'readChunks', id, path, first, count });
+    });
+  },
+};
 
 function postEvent(event: LavaVmWorkerEvent, transfer?: Transferable[]) {
   workerScope.postMessage(event, transfer ?? []);
@@ -19,24 +41,70 @@ function cloneLifecyclePayload(payload: unknown) {
   }
 }
 
-async function applyRuntimeFiles(vm: LavaXVM, files: RuntimeFilePayload[]) {
-  await vm.vfs.ready;
-  for (const file of files) {
-    vm.vfs.addFile(file.path, new Uint8Array(file.data));
+function applyRunFiles(message: Extract<LavaVmWorkerRequest, { type: 'run' }>) {
+  if (message.resetFiles) {
+    baseFiles.clear();
+    remoteSizes.clear();
+  }
+  for (const path of message.deletedPaths) {
+    baseFiles.delete(path);
+    remoteSizes.delete(path);
+  }
+  for (const file of message.files) {
+    baseFiles.set(file.path, new Uint8Array(file.data));
+    remoteSizes.delete(file.path);
+  }
+  for (const file of message.remoteFiles) {
+    baseFiles.delete(file.path);
+    remoteSizes.set(file.path, file.size);
+  }
+}
+
+function answerChunks(message: Extract<LavaVmWorkerRequest, { type: 'chunks' }>) {
+  const waiting = chunkRequests.get(message.id);
+  if (!waiting) return;
+  chunkRequests.delete(message.id);
+  if (message.chunks) waiting.resolve(message.chunks.map(chunk => new Uint8Array(chunk)));
+  else waiting.reject(new Error(message.error ?? 'readChunks failed'));
+}
+
+async function stageSiblingLavaData(vm: LavaXVM, prefix: string) {
+  let stagedCount = 0;
+  for (const { path } of vm.vfs.getFiles()) {
+    if (!path.startsWith(prefix)) continue;
+    const relativePath = path.slice(prefix.length);
+    if (!relativePath) continue;
+    const data = await vm.vfs.readFile(path);
+    if (!data) continue;
+    stagedCount++;
+    // Unchanged copies from an earlier run stay out of this run's delta.
+    const target = `/LavaData/${relativePath}`;
+    const existing = await vm.vfs.readFile(target);
+    if (existing && existing.length === data.length && existing.every((b, i) => b === data[i])) continue;
+    vm.vfs.addFile(target, data);
+  }
+  if (stagedCount > 0) {
+    postEvent({ type: 'log', message: `System: Staged ${stagedCount} runtime asset${stagedCount === 1 ? '' : 's'} from ${prefix} into /LavaData.` });
   }
 }
 
-function collectFilesFromVfs(vm: LavaXVM): { files: RuntimeFilePayload[]; transfers: ArrayBuffer[] } {
+/** Folds a finished run's delta into the base and ships it to the main thread. */
+function postRunDelta(driver: OverlayStorageDriver) {
+  const delta = driver.takeDelta();
   const files: RuntimeFilePayload[] = [];
   const transfers: ArrayBuffer[] = [];
-  for (const entry of vm.vfs.getFiles()) {
-    const data = vm.vfs.getFile(entry.path);
-    if (data === undefined) continue;
+  for (const [path, data] of delta.files) {
+    baseFiles.set(path, data);
+    remoteSizes.delete(path);
     const buf = data.buffer.slice(data.byteOffset, data.byteOffset + data.byteLength);
-    files.push({ path: entry.path, data: buf });
+    files.push({ path, data: buf });
     transfers.push(buf);
   }
-  return { files, transfers };
+  for (const path of delta.deletedPaths) {
+    baseFiles.delete(path);
+    remoteSizes.delete(path);
+  }
+  postEvent({ type: 'fileSync', files, deletedPaths: delta.deletedPaths }, transfers);
 }
 
 function wireVm(vm: LavaXVM) {
@@ -61,8 +129,9 @@ function wireVm(vm: LavaXVM) {
   };
 }
 
-async function createVm(debug = false) {
-  const vm = new LavaXVM();
+async function createVm(driver: OverlayStorageDriver, debug = false) {
+  // Remote bodies are read when the program opens them, not prefetched.
+  const vm = new LavaXVM(driver, { prefetch: false });
   vm.debug = debug;
   if (fontData) {
     vm.setInternalFontData(fontData);
@@ -73,34 +142,52 @@ async function createVm(debug = false) {
 }
 
 async function handleRun(message: Extract<LavaVmWorkerRequest, { type: 'run' }>) {
+  const generation = ++runGeneration;
   if (currentVm) {
     currentVm.stop();
     currentVm = null;
   }
 
-  const vm = await createVm(!!message.debug);
-  await applyRuntimeFiles(vm, message.files);
+  // The stopped run still syncs and folds its delta into baseFiles; the new
+  // run must not see the base until that is done.
+  const previous = lastRun;
+  const run = previous.then(() => runProgram(message, generation));
+  lastRun = run.catch(() => {});
+  await run;
+}
 
-  // Track initial file set so we can detect deletions after run
-  const initialPaths = new Set(vm.vfs.getFiles().map(f => f.path));
+async function runProgram(message: Extract<LavaVmWorkerRequest, { type: 'run' }>, generation: number) {
+  applyRunFiles(message);
+  // A newer run arrived while this one waited: its message only carries the
+  // changes since this one, so the files above still had to be applied.
+  if (generation !== runGeneration) return;
 
-  vm.load(new Uint8Array(message.program));
+  const driver = new OverlayStorageDriver(baseFiles, remoteFiles);
+  const vm = await createVm(driver, !!message.debug);
+  await vm.vfs.ready;
+  if (message.stageLavaDataFrom) await stageSiblingLavaData(vm, message.stageLavaDataFrom);
+
+  if (generation === runGeneration) {
+    vm.load(new Uint8Array(message.program), message.lineMap ?? null);
+
+    try {
+      await vm.run();
+    } catch (error: any) {
+      postEvent({
+        type: 'error',
+        message: error?.message ?? String(error),
+        payload: cloneLifecyclePayload(vm.getPauseSnapshot?.()),
+      });
+    }
+  }
 
+  // Sync VFS changes back to main thread after run ends (finished, stopped, or paused)
   try {
-    await vm.run();
+    await vm.vfs.sync();
   } catch (error: any) {
-    postEvent({
-      type: 'error',
-      message: error?.message ?? String(error),
-      payload: cloneLifecyclePayload(vm.getPauseSnapshot?.()),
-    });
+    postEvent({ type: 'log', message: `[VM Warning] Saving files failed: ${error?.message ?? String(error)}` });
   }
-
-  // Sync VFS back to main thread after run ends (finished, stopped, or paused)
-  const { files, transfers } = collectFilesFromVfs(vm);
-  const currentPaths = new Set(files.map(f => f.path));
-  const deletedPaths = Array.from(initialPaths).filter(p => !currentPaths.has(p));
-  postEvent({ type: 'fileSync', files, deletedPaths }, transfers);
+  postRunDelta(driver);
 }
 
 workerScope.onmessage = async (event: MessageEvent<LavaVmWorkerRequest>) => {
@@ -121,6 +208,9 @@ workerScope.onmessage = async (event: MessageEvent<LavaVmWorkerRequest>) => {
     case 'resume':
       await currentVm?.resume?.();
       return;
+    case 'chunks':
+      answerChunks(message);
+      return;
     case 'pushKey':
       currentVm?.pushKey(message.code);
       return;
@@ -0,0 +1,59 @@
+import fs from 'fs';
+import path from 'path';
+import { LavaXCompiler } from '../../src/compiler';
+import { LavaXAssembler } from '../../src/compiler/LavaXAssembler';
+import { bench } from './bench_utils';
+
+// End-to-end compile of the largest bundled sources.
+const SOURCES = ['examples/xpw.c', 'examples/boshi.c'];
+
+async function main() {
+  for (const file of SOURCES) {
+    const source = fs.readFileSync(path.join(process.cwd(), file));
+    let asm = '';
+    await bench(`compile ${path.basename(file)} (${(source.length / 1024).toFixed(0)} KB)`, () => {
+      asm = new LavaXCompiler().compile(source);
+    }, 20, 3);
+    if (asm.startsWith('ERROR')) throw new Error(asm);
+    await bench(`assemble ${path.basename(file)}`, () => new LavaXAssembler().assemble(asm), 10, 2);
+    await bench(`compileToLav ${path.basename(file)}`, () => {
+      const result = new LavaXCompiler().compileToLav(source);
+      if (!result.lav) throw new Error(result.error);
+    }, 20, 3);
+    await bench(`compileToLav ${path.basename(file)} + line map`, () => {
+      const result = new LavaXCompiler().compileToLav(source, file, { lineMap: true });
+      if (!result.lineMap) throw new Error(result.error);
+    }, 20, 3);
+
+    // Editor keystroke: one function body changes between compiles, and the
+    // compiler instance is reused as the IDE does.
+    const text = source.toString('utf8');
+    const edit = text.lastIndexOf('}', text.lastIndexOf('}') - 1);
+    const variants = [text, text.slice(0, edit) + ';' + text.slice(edit)];
+    let keystroke = 0;
+    await bench(`keystroke -> diagnostics ${path.basename(file)} (full)`, () => {
+      new LavaXCompiler().compile(variants[keystroke++ & 1]);
+    }, 20, 3);
+    const editor = new LavaXCompiler();
+    editor.incremental = true;
+    await bench(`keystroke -> diagnostics ${path.basename(file)} (incremental)`, () => {
+      const out = editor.compile(variants[keystroke++ & 1]);
+      if (out.startsWith('ERROR')) throw new Error(out);
+    }, 20, 3);
+    console.log(`  reused ${editor.lastCompileStats.reused}/${editor.lastCompileStats.functions} functions`);
+  }
+
+  // Editor keystroke in a file that includes a large header: the header's
+  // preprocessed lines are reused while it and the macros before it are unchanged.
+  const header = fs.readFileSync(path.join(process.cwd(), 'examples/shenzhou/ime2gb.h'), 'utf8');
+  const withHeader = new LavaXCompiler();
+  withHeader.incremental = true;
+  withHeader.includeResolver = (name) => (name === 'ime2gb.h' ? header : null);
+  let edits = 0;
+  await bench(`keystroke -> diagnostics with ime2gb.h (${(header.length / 1024).toFixed(0)} KB)`, () => {
+    const out = withHeader.compile(`#include "ime2gb.h"\nvoid main() {\n  int k;\n  k = ${edits++ & 1};\n}\n`);
+    if (out.startsWith('ERROR')) throw new Error(out);
+  }, 20, 3);
+}
+
+main();
@@ -0,0 +1,21 @@
+import { SystemOp } from '../../src/types';
+import { bench, callSyscall, createBenchVm } from './bench_utils';
+
+// Per-character classification as done by IME/dictionary parsers (e.g. examples/shenzhou).
+const CTYPE_OPS = [
+  SystemOp.isalnum, SystemOp.isalpha, SystemOp.isdigit, SystemOp.islower, SystemOp.isupper,
+  SystemOp.isspace, SystemOp.ispunct, SystemOp.isxdigit, SystemOp.tolower, SystemOp.toupper,
+];
+
+async function main() {
+  const vm = createBenchVm();
+  await vm.vfs.ready;
+
+  for (const op of CTYPE_OPS) {
+    await bench(`syscall: 256k x ${SystemOp[op]}`, () => {
+      for (let i = 0; i < 256 * 1024; i++) callSyscall(vm, op, [i & 0xff]);
+    }, 10);
+  }
+}
+
+main();
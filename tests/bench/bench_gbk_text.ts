@@ -0,0 +1,65 @@
+import iconv from 'iconv-lite';
+import fs from 'fs';
+import path from 'path';
+import { SystemOp } from '../../src/types';
+import { bench, callSyscall, compileProgram, createBenchVm, runProgram, writeCString } from './bench_utils';
+
+// Text-heavy LavaX workload: GBK sprintf/strcmp/strstr in a loop plus printf output.
+const TEXT_PROGRAM = `
+char buf[96];
+char name[16];
+void main() {
+  int i;
+  int n;
+  n = 0;
+  strcpy(name, "中文玩家");
+  for (i = 0; i < 4000; i++) {
+    sprintf(buf, "%s 第%d关 得分:%05d 状态%c", name, i, i * 7, 'A' + (i & 7));
+    if (strcmp(buf, name) > 0) n++;
+    if (strstr(buf, "得分")) n++;
+    if ((i & 255) == 0) printf("%s\\n", buf);
+  }
+  printf("%d\\n", n);
+}
+`;
+
+async function main() {
+  const program = compileProgram(TEXT_PROGRAM);
+  const vm = createBenchVm();
+  await vm.vfs.ready;
+  await bench('vm: sprintf/strcmp/strstr GBK loop', () => runProgram(vm, program), 8);
+
+  // Same work at the syscall level, without run-loop scheduling noise.
+  const fmt = writeCString(vm, 0x3000, iconv.encode('%s 第%d关 得分:%05d 状态%c', 'gbk'));
+  const name = writeCString(vm, 0x3100, iconv.encode('中文玩家', 'gbk'));
+  const needle = writeCString(vm, 0x3200, iconv.encode('得分', 'gbk'));
+  const buf = 0x3300;
+  await bench('syscall: 10k x (sprintf + strcmp + strstr)', () => {
+    for (let i = 0; i < 10000; i++) {
+      callSyscall(vm, SystemOp.sprintf, [buf, fmt, name, i, i * 7, 65 + (i & 7), 6]);
+      callSyscall(vm, SystemOp.strcmp, [buf, name]);
+      callSyscall(vm, SystemOp.strstr, [buf, needle]);
+    }
+  }, 10);
+  const filePath = writeCString(vm, 0x3400, iconv.encode('/LavaData/存档.dat', 'gbk'));
+  const mode = writeCString(vm, 0x3480, iconv.encode('rb', 'gbk'));
+  await bench('syscall: 10k x fopen (missing GBK path)', () => {
+    for (let i = 0; i < 10000; i++) callSyscall(vm, SystemOp.fopen, [filePath, mode]);
+  }, 10);
+
+  const source = fs.readFileSync(path.join(process.cwd(), 'examples', 'xpw.c'));
+  const text = iconv.decode(source, 'gbk');
+  await bench('iconv-lite: decode xpw.c', () => iconv.decode(source, 'gbk'), 30);
+  await bench('iconv-lite: encode xpw.c', () => iconv.encode(text, 'gbk'), 30);
+  await bench('TextDecoder(gbk): decode xpw.c', () => new TextDecoder('gbk').decode(source), 30);
+
+  // The shared codec only exists after the GBK pipeline change; skip it when benchmarking older trees.
+  const gbk = await import('../../src/lav/gbk').catch(() => null);
+  if (gbk) {
+    await bench('lav/gbk: decode xpw.c', () => gbk.decodeGbk(source), 30);
+    await bench('lav/gbk: encode xpw.c', () => gbk.encodeGbk(text), 30);
+    await bench('lav/gbk: normalize xpw.c', () => gbk.normalizeToGbk(text), 30);
+  }
+}
+
+main();
@@ -0,0 +1,82 @@
+import fs from 'fs';
+import path from 'path';
+import { LavaXCompiler } from '../../src/compiler';
+import { OPTIMIZER_RULES, type OptimizerRule } from '../../src/compiler/LavaXOptimizer';
+import { Op } from '../../src/types';
+import type { LavaXVM } from '../../src/vm';
+import { createBenchVm } from './bench_utils';
+
+// Code size, instruction count, and instructions and calls executed for the large
+// examples with the optimizer off, with each rule switched off in turn, and
+// with everything on. examples/boshi.lav is the official compiler's build of
+// boshi.c, for reference.
+const SOURCES = ['examples/boshi.c', 'examples/xpw.c'];
+// Syscalls to run through, answering key waits from KEYS in turn. (xpw.c
+// stops after a few without its data files, so only its size is telling.)
+const EVENTS = 2000;
+const KEYS = [13, 23, 22, 20, 21, 27, 25, 13, 27, 13, 23, 23, 21, 21, 13, 27];
+
+type Variant = { name: string; rules: OptimizerRule[] };
+
+function build(source: Buffer, rules: OptimizerRule[]) {
+  const compiler = new LavaXCompiler();
+  for (const rule of OPTIMIZER_RULES) compiler.optimizations[rule] = rules.includes(rule);
+  const result = compiler.compileToLav(source, '', { listing: true });
+  if (!result.lav) throw new Error(result.error);
+  const instructions = result.listing!.split('\n').filter((line) => line && !line.endsWith(':')).length;
+  return { lav: result.lav, instructions, stats: compiler.lastOptimizerStats };
+}
+
+// Instructions and CALLs executed until the EVENTS-th syscall (or the program ends).
+function executed(vm: LavaXVM, program: Uint8Array): { steps: number; calls: number } {
+  const internals = vm as unknown as { pc: number; fd: Uint8Array; stepSync(): void; resolveKeySignal: (() => void) | null };
+  vm.load(program);
+  vm.running = true;
+  let steps = 0;
+  let calls = 0;
+  let events = 0;
+  let keys = 0;
+  while (vm.running && internals.pc < program.length && events < EVENTS) {
+    const opcode = internals.fd[internals.pc];
+    if (opcode >= 0x80) events++;
+    else if (opcode === Op.CALL) calls++;
+    internals.stepSync();
+    steps++;
+    if (internals.resolveKeySignal) {
+      vm.keyBuffer.push(KEYS[keys++ % KEYS.length]);
+      internals.resolveKeySignal();
+      internals.resolveKeySignal = null;
+    }
+  }
+  return { steps, calls };
+}
+
+async function main() {
+  const vm = createBenchVm();
+  await vm.vfs.ready;
+  const font = fs.readFileSync(path.join(process.cwd(), 'public/fonts.dat'));
+  vm.setInternalFontData(new Uint8Array(font.buffer, font.byteOffset, font.byteLength));
+  const official = fs.readFileSync(path.join(process.cwd(), 'examples/boshi.lav'));
+  const reference = executed(vm, new Uint8Array(official));
+  console.log(`official boshi.lav: ${official.length} bytes, ${reference.steps} instructions and ${reference.calls} calls executed`);
+
+  const variants: Variant[] = [
+    { name: 'optimizer off', rules: [] },
+    { name: 'expression rules only', rules: ['immediates', 'foldConstants', 'shortPush'] },
+    ...OPTIMIZER_RULES.map((off) => ({ name: `without ${off}`, rules: OPTIMIZER_RULES.filter((rule) => rule !== off) })),
+    { name: 'all rules', rules: [...OPTIMIZER_RULES] },
+  ];
+  for (const file of SOURCES) {
+    const source = fs.readFileSync(path.join(process.cwd(), file));
+    console.log(`\n${path.basename(file)}`);
+    for (const { name, rules } of variants) {
+      const { lav, instructions } = build(source, rules);
+      const { steps, calls } = executed(vm, lav);
+      console.log(`  ${name.padEnd(26)} ${String(lav.length).padStart(6)} bytes ${String(instructions).padStart(6)} instructions ${String(steps).padStart(8)} executed ${String(calls).padStart(6)} calls`);
+    }
+    const { stats } = build(source, [...OPTIMIZER_RULES]);
+    console.log(`  rewrites: ${OPTIMIZER_RULES.map((rule) => `${rule} ${stats[rule]}`).join(', ')}`);
+  }
+}
+
+main();
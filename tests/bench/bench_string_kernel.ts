@@ -0,0 +1,63 @@
+import fs from 'fs';
+import { SystemCoreOp, SystemOp } from '../../src/types';
+import { bench, callSyscall, createBenchVm, writeCString } from './bench_utils';
+
+const ascii = (text: string) => Array.from(text, ch => ch.charCodeAt(0));
+
+// Shapes taken from the examples: short menu labels, dictionary lines and
+// 1.6 KB screen-buffer copies (160x80 / 8).
+const SHORT = ascii('Save');
+const LINE = ascii('zhong1 guo2 ren2 min2 gong4 he2 guo2 - dictionary entry used by the IME table');
+const LONG = ascii('x'.repeat(900) + 'needle' + 'y'.repeat(90));
+
+async function main() {
+  const vm = createBenchVm();
+  await vm.vfs.ready;
+
+  writeCString(vm, 0x2001, SHORT); // deliberately unaligned
+  writeCString(vm, 0x2100, LINE);
+  writeCString(vm, 0x2200, LINE);
+  writeCString(vm, 0x3000, LONG);
+  writeCString(vm, 0x2080, ascii('needle'));
+  writeCString(vm, 0x2090, ascii('IME'));
+
+  const N = 100_000;
+  await bench(`syscall: ${N / 1000}k x strlen (4 / 77 / 996 bytes)`, () => {
+    for (let i = 0; i < N; i++) {
+      callSyscall(vm, SystemOp.strlen, [0x2001]);
+      callSyscall(vm, SystemOp.strlen, [0x2100]);
+      callSyscall(vm, SystemOp.strlen, [0x3000]);
+    }
+  });
+  await bench(`syscall: ${N / 1000}k x strcpy + strcat (label + line)`, () => {
+    for (let i = 0; i < N; i++) {
+      callSyscall(vm, SystemOp.strcpy, [0x5000, 0x2001]);
+      callSyscall(vm, SystemOp.strcat, [0x5000, 0x2100]);
+    }
+  });
+  await bench(`syscall: ${N / 1000}k x strcmp (equal 77-byte lines)`, () => {
+    for (let i = 0; i < N; i++) callSyscall(vm, SystemOp.strcmp, [0x2100, 0x2200]);
+  });
+  await bench(`syscall: ${N / 1000}k x strchr + strstr`, () => {
+    for (let i = 0; i < N; i++) {
+      callSyscall(vm, SystemOp.strchr, [0x2100, 0x2d]);
+      callSyscall(vm, SystemOp.strstr, [0x2100, 0x2090]);
+      callSyscall(vm, SystemOp.strstr, [0x3000, 0x2080]);
+    }
+  });
+  await bench(`syscall: ${N / 1000}k x memset + memcpy + memmove (1600 bytes)`, () => {
+    for (let i = 0; i < N; i++) {
+      callSyscall(vm, SystemOp.memset, [0x6000, 0, 1600]);
+      callSyscall(vm, SystemOp.memcpy, [0x7000, 0x6000, 1600]);
+      callSyscall(vm, SystemOp.memmove, [0x7010, 0x7000, 1600]);
+    }
+  });
+
+  // Save-game integrity check over the 200 KB shenzhou data file.
+  const data = fs.readFileSync('examples/shenzhou/LavaData/GameSource.dat');
+  vm.memory.set(data, 0x8000);
+  await bench(`syscall: Crc16 over ${data.length} bytes`, () => callSyscall(vm, SystemOp.Crc16, [0x8000, data.length]), 20);
+  await bench(`syscall: System Crc32 over ${data.length} bytes`, () => callSyscall(vm, SystemOp.System, [0x8000, data.length, SystemCoreOp.Crc32]), 20);
+}
+
+main();
@@ -0,0 +1,73 @@
+import { LavaXCompiler } from '../../src/compiler';
+import type { LavaXVM } from '../../src/vm';
+import { bench, createBenchVm } from './bench_utils';
+
+// A 50-state dispatcher driven round-robin through every state, like a menu
+// or game-state loop: each iteration enters the switch once.
+const STATES = 50;
+const STATE_MACHINE = `
+long total;
+void main() {
+  long i;
+  int state = 0;
+  for (i = 0; i < 100000; i++) {
+    switch (state) {
+${Array.from({ length: STATES }, (_, s) => `      case ${s * 2}: total = total + ${s}; state = ${((s * 7 + 3) % STATES) * 2}; break;`).join('\n')}
+      default: state = 0;
+    }
+  }
+}
+`;
+
+// The three-case switch from tests/test_switch*.ts, in a loop.
+const SMALL_SWITCH = `
+long total;
+void main() {
+  long i;
+  for (i = 0; i < 100000; i++) {
+    switch (i & 3) {
+      case 1: total = total + 1; break;
+      case 2: total = total + 2; break;
+      case 3: total = total + 3; break;
+      default: total = total - 1;
+    }
+  }
+}
+`;
+
+function compileWith(source: string, switchTrees: boolean): Uint8Array {
+  const compiler = new LavaXCompiler();
+  compiler.switchTrees = switchTrees;
+  const result = compiler.compileToLav(source);
+  if (!result.lav) throw new Error(result.error);
+  return result.lav;
+}
+
+// Steps the program to completion without the run loop's host yields, so
+// only dispatch is measured. Returns the number of instructions executed.
+function execute(vm: LavaXVM, program: Uint8Array): number {
+  vm.load(program);
+  vm.running = true;
+  const internals = vm as unknown as { pc: number; stepSync(): void };
+  let steps = 0;
+  while (vm.running && internals.pc < program.length) {
+    internals.stepSync();
+    steps++;
+  }
+  return steps;
+}
+
+async function main() {
+  const vm = createBenchVm();
+  await vm.vfs.ready;
+  for (const [name, source] of [[`${STATES}-case state machine`, STATE_MACHINE], ['3-case switch (test_switch)', SMALL_SWITCH]]) {
+    for (const switchTrees of [false, true]) {
+      const program = compileWith(source, switchTrees);
+      const label = `100k x ${name}, ${switchTrees ? 'binary search' : 'linear'}`;
+      await bench(label, () => execute(vm, program), 10, 2);
+      console.log(`  ${execute(vm, program)} instructions, ${program.length} bytes`);
+    }
+  }
+}
+
+main();
@@ -0,0 +1,78 @@
+import { LavaXVM } from '../../src/vm';
+import { LavaXCompiler } from '../../src/compiler';
+import { LavaXAssembler } from '../../src/compiler/LavaXAssembler';
+import type { VirtualFileSystemOptions } from '../../src/vm/VirtualFileSystem';
+
+export class MockStorageDriver {
+  name = 'mock';
+  ready = Promise.resolve();
+  async getAll() { return new Map<string, Uint8Array>(); }
+  async persist() { }
+  async remove() { }
+}
+
+export interface BenchResult {
+  name: string;
+  iterations: number;
+  medianMs: number;
+  minMs: number;
+}
+
+function now() {
+  return typeof performance !== 'undefined' ? performance.now() : Date.now();
+}
+
+/**
+ * Runs `fn` `iterations` times after `warmup` untimed runs and reports the
+ * median and minimum wall time of a single run.
+ */
+export async function bench(name: string, fn: () => unknown | Promise<unknown>, iterations = 10, warmup = 2): Promise<BenchResult> {
+  for (let i = 0; i < warmup; i++) await fn();
+  const samples: number[] = [];
+  for (let i = 0; i < iterations; i++) {
+    const start = now();
+    await fn();
+    samples.push(now() - start);
+  }
+  samples.sort((a, b) => a - b);
+  const result = {
+    name,
+    iterations,
+    medianMs: samples[Math.floor(samples.length / 2)],
+    minMs: samples[0],
+  };
+  console.log(`${name.padEnd(48)} median ${result.medianMs.toFixed(3).padStart(10)} ms   min ${result.minMs.toFixed(3).padStart(10)} ms   (n=${iterations})`);
+  return result;
+}
+
+export function compileProgram(source: string): Uint8Array {
+  const asm = new LavaXCompiler().compile(source);
+  if (asm.startsWith('ERROR')) throw new Error(asm);
+  return new Uint8Array(new LavaXAssembler().assemble(asm));
+}
+
+export function createBenchVm(driver: unknown = new MockStorageDriver(), vfsOptions?: VirtualFileSystemOptions) {
+  const vm = new LavaXVM(driver as any, vfsOptions);
+  vm.onLog = () => { };
+  return vm;
+}
+
+export async function runProgram(vm: LavaXVM, program: Uint8Array) {
+  vm.load(program);
+  await vm.run();
+}
+
+/**
+ * Invokes a syscall directly through the handler, bypassing the run loop and
+ * its host yields, so the measurement only covers the syscall itself.
+ */
+export function callSyscall(vm: LavaXVM, op: number, args: number[]) {
+  for (const arg of args) vm.push(arg);
+  return vm.syscall.handleSync(op);
+}
+
+export function writeCString(vm: LavaXVM, addr: number, bytes: ArrayLike<number>) {
+  vm.memory.set(bytes, addr);
+  vm.memory[addr + bytes.length] = 0;
+  return addr;
+}
@@ -0,0 +1,57 @@
+import fs from 'fs';
+import path from 'path';
+import { SystemOp } from '../../src/types';
+import { bench, callSyscall, createBenchVm, writeCString } from './bench_utils';
+
+const ascii = (text: string) => Array.from(text, ch => ch.charCodeAt(0));
+
+// Byte-loop readers (py2gb.ime lookups scan the table with getc) against a
+// single fread of the same bytes, and putc output of the same size.
+async function main() {
+  const vm = createBenchVm();
+  await vm.vfs.ready;
+  const ime = new Uint8Array(fs.readFileSync(path.join(process.cwd(), 'examples', 'shenzhou', 'LavaData', 'py2gb.ime')));
+  vm.vfs.addFile('/LavaData/py2gb.ime', ime);
+  writeCString(vm, 0x2000, ascii('/LavaData/py2gb.ime'));
+  writeCString(vm, 0x2100, ascii('rb'));
+  writeCString(vm, 0x2200, ascii('/LavaData/out.bin'));
+  writeCString(vm, 0x2300, ascii('w+'));
+  const passes = 50;
+  const total = ime.length * passes;
+
+  const fp = callSyscall(vm, SystemOp.fopen, [0x2000, 0x2100]) as number;
+  await bench(`getc ${ime.length} B x${passes}`, () => {
+    let sum = 0;
+    for (let p = 0; p < passes; p++) {
+      vm.push(fp);
+      vm.syscall.handleSync(SystemOp.rewind);
+      for (;;) {
+        vm.push(fp);
+        const ch = vm.syscall.handleSync(SystemOp.getc) as number;
+        if (ch === -1) break;
+        sum += ch;
+      }
+    }
+    if (sum === 0) throw new Error('read nothing');
+  });
+  await bench(`fread ${ime.length} B x${passes}`, () => {
+    for (let p = 0; p < passes; p++) {
+      callSyscall(vm, SystemOp.rewind, [fp]);
+      callSyscall(vm, SystemOp.fread, [0x8000, 1, ime.length, fp]);
+    }
+  });
+  callSyscall(vm, SystemOp.fclose, [fp]);
+
+  await bench(`putc ${total} B`, () => {
+    const out = callSyscall(vm, SystemOp.fopen, [0x2200, 0x2300]) as number;
+    for (let i = 0; i < total; i++) {
+      vm.push(i & 0xff);
+      vm.push(out);
+      vm.syscall.handleSync(SystemOp.putc);
+    }
+    callSyscall(vm, SystemOp.fclose, [out]);
+  }, 5, 1);
+  await vm.vfs.sync();
+}
+
+main();
@@ -0,0 +1,41 @@
+import fs from 'fs';
+import path from 'path';
+import { decodeBody, encodeBody, VFSCodec } from '../../src/vm/VFSCompression';
+import { bench } from './bench_utils';
+
+// The bundled corpus as IndexedDB would store it with compression enabled
+// (IndexedDBDriverOptions.compression, off by default). Encode time is the CPU cost
+// paid on persist; decode time is what the first open of a file adds to its
+// load latency (startup itself reads only the manifest).
+const CORPUS = [
+  'public/fonts.dat',
+  'examples/shenzhou/LavaData/GameSource.dat',
+  'examples/shenzhou/LavaData/py2gb.ime',
+  'examples/shenzhou/神州.lav',
+  'examples/pala.lav',
+  'examples/boshi.lav',
+  'examples/xpw.lav',
+];
+
+async function main() {
+  const files = CORPUS.map(file => ({ file, data: new Uint8Array(fs.readFileSync(path.join(process.cwd(), file))) }));
+  const rawTotal = files.reduce((sum, { data }) => sum + data.length, 0);
+  console.log(`corpus: ${files.length} files, ${rawTotal} bytes raw`);
+
+  for (const codec of ['deflate-raw', 'lz'] as VFSCodec[]) {
+    let storedTotal = 0;
+    for (const { file, data } of files) {
+      const encoded = await encodeBody(data, { codec });
+      storedTotal += encoded.bytes.length;
+      const ratio = (encoded.bytes.length / data.length * 100).toFixed(1);
+      console.log(`  ${codec.padEnd(12)} ${path.basename(file).padEnd(16)} ${String(data.length).padStart(7)} -> ${String(encoded.bytes.length).padStart(7)} (${ratio}%)${encoded.codec ? '' : ' raw'}`);
+      await bench(`${codec} encode ${path.basename(file)}`, () => encodeBody(data, { codec }), 5, 1);
+      if (encoded.codec) {
+        await bench(`${codec} decode ${path.basename(file)}`, () => decodeBody(encoded.codec, encoded.bytes, data.length), 10, 2);
+      }
+    }
+    console.log(`  ${codec} stored total: ${storedTotal} bytes (${(storedTotal / rawTotal * 100).toFixed(1)}%)`);
+  }
+}
+
+main();
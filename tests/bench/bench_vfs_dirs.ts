@@ -0,0 +1,57 @@
+import { SystemOp } from '../../src/types';
+import { bench, callSyscall, createBenchVm, writeCString } from './bench_utils';
+
+const ascii = (text: string) => Array.from(text, ch => ch.charCodeAt(0));
+
+// A large imported asset collection next to a small game directory.
+const ASSET_DIRS = 50;
+const FILES_PER_DIR = 200;
+
+async function main() {
+  const vm = createBenchVm();
+  await vm.vfs.ready;
+  const empty = new Uint8Array(16);
+  for (let d = 0; d < ASSET_DIRS; d++) {
+    for (let f = 0; f < FILES_PER_DIR; f++) vm.vfs.addFile(`/assets/pack${d}/tile${f}.bin`, empty);
+  }
+  for (let f = 0; f < 8; f++) vm.vfs.addFile(`/LavaData/save${f}.dat`, empty);
+  writeCString(vm, 0x2000, ascii('/LavaData'));
+  writeCString(vm, 0x2100, ascii('/assets/pack7'));
+
+  const total = ASSET_DIRS * FILES_PER_DIR;
+  await bench(`opendir+readdir /LavaData (8 of ${total})`, () => {
+    for (let i = 0; i < 1000; i++) {
+      const dir = callSyscall(vm, SystemOp.opendir, [0x2000]) as number;
+      while (callSyscall(vm, SystemOp.System, [dir]) !== 0) { /* drain */ }
+      callSyscall(vm, SystemOp.closedir, [dir]);
+    }
+  });
+  await bench(`opendir+readdir /assets/pack7 (${FILES_PER_DIR})`, () => {
+    for (let i = 0; i < 1000; i++) {
+      const dir = callSyscall(vm, SystemOp.opendir, [0x2100]) as number;
+      while (callSyscall(vm, SystemOp.System, [dir]) !== 0) { /* drain */ }
+      callSyscall(vm, SystemOp.closedir, [dir]);
+    }
+  });
+  // Game loops that reopen the same asset each frame (relative to cwd).
+  writeCString(vm, 0x2200, ascii('save3.dat'));
+  writeCString(vm, 0x2300, ascii('rb'));
+  vm.vfs.chdir('/LavaData');
+  await bench('fopen+fclose same relative asset x10k', () => {
+    for (let i = 0; i < 10000; i++) {
+      const fp = callSyscall(vm, SystemOp.fopen, [0x2200, 0x2300]) as number;
+      if (!fp) throw new Error('fopen failed');
+      callSyscall(vm, SystemOp.fclose, [fp]);
+    }
+  });
+  vm.vfs.chdir('/');
+
+  await bench('chdir /LavaData and back x1000', () => {
+    for (let i = 0; i < 1000; i++) {
+      vm.vfs.chdir('/LavaData');
+      vm.vfs.chdir('/');
+    }
+  });
+}
+
+main();
@@ -0,0 +1,27 @@
+import { SystemOp } from '../../src/types';
+import { bench, callSyscall, createBenchVm, writeCString } from './bench_utils';
+
+const ascii = (text: string) => Array.from(text, ch => ch.charCodeAt(0));
+
+// Sequential byte-at-a-time output, the worst case for exact-size reallocation.
+async function main() {
+  const vm = createBenchVm();
+  await vm.vfs.ready;
+  writeCString(vm, 0x2000, ascii('/LavaData/big.bin'));
+  writeCString(vm, 0x2100, ascii('w+'));
+
+  for (const size of [64 * 1024, 1024 * 1024]) {
+    await bench(`syscall: ${size / 1024} KB via putc`, () => {
+      const fp = callSyscall(vm, SystemOp.fopen, [0x2000, 0x2100]) as number;
+      for (let i = 0; i < size; i++) callSyscall(vm, SystemOp.putc, [i & 0xff, fp]);
+      callSyscall(vm, SystemOp.rewind, [fp]);
+      let read = 0;
+      while (callSyscall(vm, SystemOp.getc, [fp]) !== -1) read++;
+      if (read !== size) throw new Error(`read back ${read} of ${size} bytes`);
+      callSyscall(vm, SystemOp.fclose, [fp]);
+    }, 3, 1);
+  }
+  await vm.vfs.sync();
+}
+
+main();
@@ -0,0 +1,63 @@
+import { VFS_CHUNK_SIZE } from '../../src/vm/VFSStorageDriver';
+import { bench, compileProgram, createBenchVm, runProgram } from './bench_utils';
+
+// A large imported library plus the 200 KB GameSource.dat a game seeks into.
+const LIBRARY_FILES = 200;
+const LIBRARY_FILE_BYTES = 100 * 1024;
+const GAME_SOURCE_BYTES = 200 * 1024;
+
+function buildStore() {
+  const stored = new Map<string, Uint8Array>();
+  for (let i = 0; i < LIBRARY_FILES; i++) stored.set(`/library/pack${i}.lav`, new Uint8Array(LIBRARY_FILE_BYTES).fill(i));
+  stored.set('/GameSource.dat', Uint8Array.from({ length: GAME_SOURCE_BYTES }, (_, i) => i & 0xff));
+  return stored;
+}
+
+/** Whole-store driver: bodies are copied out like a structured clone would. */
+class EagerDriver {
+  name = 'eager';
+  ready = Promise.resolve();
+  chunksRead = 0;
+  constructor(protected stored: Map<string, Uint8Array>) { }
+  async getAll() {
+    return new Map(Array.from(this.stored, ([path, data]) => [path, data.slice()] as [string, Uint8Array]));
+  }
+  async persist() { }
+  async remove() { }
+}
+
+/** Same store behind the manifest + chunk interface. */
+class LazyDriver extends EagerDriver {
+  name = 'lazy';
+  async getManifest() {
+    return Array.from(this.stored, ([path, data]) => ({ path, size: data.length, mtime: 0 }));
+  }
+  async readChunks(path: string, first: number, count: number) {
+    const data = this.stored.get(path)!;
+    this.chunksRead += count;
+    return Array.from({ length: count }, (_, k) => data.slice((first + k) * VFS_CHUNK_SIZE, (first + k + 1) * VFS_CHUNK_SIZE));
+  }
+}
+
+const SEEK_AND_READ = compileProgram(`char buf[100];
+  int main() { int fp; fp = fopen("/GameSource.dat", "rb"); fseek(fp, 150000, 0); fread(buf, 1, 100, fp); fclose(fp); }`);
+
+async function main() {
+  const stored = buildStore();
+  const totalMb = (LIBRARY_FILES * LIBRARY_FILE_BYTES + GAME_SOURCE_BYTES) / (1024 * 1024);
+  for (const Driver of [EagerDriver, LazyDriver]) {
+    const name = new Driver(stored).name;
+    await bench(`${name}: time to VM ready (${totalMb.toFixed(1)} MB store)`, async () => {
+      await createBenchVm(new Driver(stored)).vfs.ready;
+    }, 5, 1);
+    let chunks = 0;
+    await bench(`${name}: ready + fseek/fread 100 B, no prefetch`, async () => {
+      const driver = new Driver(stored);
+      await runProgram(createBenchVm(driver, { prefetch: false }), SEEK_AND_READ);
+      chunks = driver.chunksRead;
+    }, 5, 1);
+    console.log(`  chunks read: ${chunks}`);
+  }
+}
+
+main();
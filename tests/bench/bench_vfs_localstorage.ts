@@ -0,0 +1,45 @@
+import { LocalStorageDriver } from '../../src/vm/VFSStorageDriver';
+import { bench } from './bench_utils';
+
+/** Map-backed localStorage so the driver can run outside the browser. */
+class MemoryLocalStorage {
+  items = new Map<string, string>();
+  get length() { return this.items.size; }
+  key(index: number) { return Array.from(this.items.keys())[index] ?? null; }
+  getItem(key: string) { return this.items.get(key) ?? null; }
+  setItem(key: string, value: string) { this.items.set(key, String(value)); }
+  removeItem(key: string) { this.items.delete(key); }
+  clear() { this.items.clear(); }
+}
+
+// 100 files totalling 2 MB, roughly an imported game folder plus saves.
+const FILE_COUNT = 100;
+const TOTAL_BYTES = 2 * 1024 * 1024;
+
+async function main() {
+  (globalThis as any).localStorage = new MemoryLocalStorage();
+  const driver = new LocalStorageDriver();
+  const entries: Array<[string, Uint8Array]> = [];
+  for (let i = 0; i < FILE_COUNT; i++) {
+    const data = new Uint8Array(TOTAL_BYTES / FILE_COUNT);
+    for (let j = 0; j < data.length; j++) data[j] = (j * 31 + i) & 0xff;
+    entries.push([`/LavaData/file${i}.dat`, data]);
+  }
+  await driver.persistMany(entries);
+
+  const save = new Uint8Array(64);
+  await bench('persist one 64 B save (store 2 MB / 100 files)', async () => {
+    save[0]++;
+    await driver.persist('/LavaData/file7.dat', save);
+  });
+  await bench('persist a new 64 B file, then remove it', async () => {
+    await driver.persist('/LavaData/new.dat', save);
+    await driver.remove('/LavaData/new.dat');
+  });
+  await bench('getAll (load 2 MB / 100 files)', async () => {
+    const all = await new LocalStorageDriver().getAll();
+    if (all.size !== FILE_COUNT) throw new Error(`loaded ${all.size} files`);
+  }, 5, 1);
+}
+
+main();
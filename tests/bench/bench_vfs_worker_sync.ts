@@ -0,0 +1,107 @@
+import { LavaXVM } from '../../src/vm';
+import { OverlayStorageDriver } from '../../src/vm/VFSStorageDriver';
+import { VirtualFileSystem } from '../../src/vm/VirtualFileSystem';
+import { compileProgram, createBenchVm, MockStorageDriver, runProgram } from './bench_utils';
+
+// Main-thread side of a worker run, without the Worker itself: postMessage
+// transfers are free, so the cost is the copies and VFS work on each side.
+const FILE_COUNT = 50;
+const FILE_BYTES = 100 * 1024; // 5 MB in total
+
+const SAVE_GAME = compileProgram(`char mem[2000];
+  int main() { int fp; fp = fopen("/LavaData/save.dat", "w"); fwrite(mem, 1, 2000, fp); fclose(fp); }`);
+
+function now() {
+  return performance.now();
+}
+
+async function createMainVfs() {
+  const vfs = new VirtualFileSystem(new MockStorageDriver() as any);
+  await vfs.ready;
+  for (let i = 0; i < FILE_COUNT; i++) vfs.addFile(`/games/pack${i}.dat`, new Uint8Array(FILE_BYTES).fill(i));
+  return vfs;
+}
+
+/** The previous flow: ship every file both ways on every run. */
+async function fullSnapshotRun(main: VirtualFileSystem) {
+  const t0 = now();
+  const payload = main.getFiles().map(({ path }) => {
+    const data = new Uint8Array(main.getFile(path)!);
+    return { path, data: data.buffer.slice(0) };
+  });
+  const vm = createBenchVm();
+  await vm.vfs.ready;
+  for (const file of payload) vm.vfs.addFile(file.path, new Uint8Array(file.data));
+  const t1 = now();
+
+  await runProgram(vm, SAVE_GAME);
+
+  const t2 = now();
+  const back = vm.vfs.getFiles().map(({ path }) => {
+    const data = vm.vfs.getFile(path)!;
+    return { path, data: data.buffer.slice(data.byteOffset, data.byteOffset + data.byteLength) };
+  });
+  for (const file of back) main.addFile(file.path, new Uint8Array(file.data));
+  return { start: t1 - t0, end: now() - t2, sent: payload.length, returned: back.length };
+}
+
+/** The overlay flow in steady state: the worker keeps its base between runs. */
+async function overlayRun(main: VirtualFileSystem, base: Map<string, Uint8Array>, since: number) {
+  const t0 = now();
+  const changes = main.changesSince(since);
+  const payload = changes.changed.map(path => {
+    const data = main.getFile(path)!;
+    return { path, data: data.buffer.slice(data.byteOffset, data.byteOffset + data.byteLength) };
+  });
+  for (const path of changes.deleted) base.delete(path);
+  for (const file of payload) base.set(file.path, new Uint8Array(file.data));
+  const driver = new OverlayStorageDriver(base);
+  const vm = new LavaXVM(driver);
+  vm.onLog = () => { };
+  await vm.vfs.ready;
+  const t1 = now();
+
+  await runProgram(vm, SAVE_GAME);
+
+  const t2 = now();
+  await vm.vfs.sync();
+  const delta = driver.takeDelta();
+  const back = delta.files.map(([path, data]) => {
+    base.set(path, data);
+    return { path, data: data.buffer.slice(data.byteOffset, data.byteOffset + data.byteLength) };
+  });
+  for (const path of delta.deletedPaths) base.delete(path);
+  for (const file of back) main.addFile(file.path, new Uint8Array(file.data));
+  for (const path of delta.deletedPaths) main.deleteFile(path);
+  return { start: t1 - t0, end: now() - t2, sent: payload.length, returned: back.length };
+}
+
+function report(name: string, runs: Array<{ start: number, end: number, sent: number, returned: number }>) {
+  const median = (values: number[]) => values.sort((a, b) => a - b)[Math.floor(values.length / 2)];
+  const last = runs[runs.length - 1];
+  console.log(`${name.padEnd(36)} run start ${median(runs.map(r => r.start)).toFixed(2).padStart(8)} ms   run end ${median(runs.map(r => r.end)).toFixed(2).padStart(8)} ms   files sent ${last.sent} / returned ${last.returned}`);
+}
+
+async function main() {
+  const RUNS = 10;
+  {
+    const main = await createMainVfs();
+    const runs = [];
+    for (let i = 0; i < RUNS; i++) runs.push(await fullSnapshotRun(main));
+    report('full snapshot (5 MB VFS)', runs);
+  }
+  {
+    const main = await createMainVfs();
+    const base = new Map<string, Uint8Array>();
+    let since = -1;
+    const runs = [];
+    for (let i = 0; i < RUNS; i++) {
+      runs.push(await overlayRun(main, base, since));
+      since = main.markChangeGeneration();
+    }
+    console.log(`overlay first run (ships the base)   run start ${runs[0].start.toFixed(2).padStart(8)} ms   files sent ${runs[0].sent}`);
+    report('overlay delta (5 MB VFS)', runs.slice(1));
+  }
+}
+
+main();
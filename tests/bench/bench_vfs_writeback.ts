@@ -0,0 +1,68 @@
+import fs from 'fs';
+import { compileProgram, createBenchVm, runProgram } from './bench_utils';
+
+/** Counts driver round-trips and bytes handed to persistence. */
+class CountingStorageDriver {
+  name = 'counting';
+  ready = Promise.resolve();
+  calls = 0;
+  bytes = 0;
+  async getAll() { return new Map<string, Uint8Array>(); }
+  async persist(_path: string, data: Uint8Array) {
+    this.calls++;
+    this.bytes += data.length;
+  }
+  async persistMany(entries: Array<[string, Uint8Array]>) {
+    this.calls++;
+    for (const [, data] of entries) this.bytes += data.length;
+  }
+  async remove() { }
+}
+
+// Save paths from the bundled games.
+const SCENARIOS: Array<{ name: string, preload?: [string, string], source: string }> = [
+  {
+    // examples/shenzhou/神州.c SaveMagic(): one slot of a 4000-byte save file.
+    name: 'shenzhou save slot (fseek + fwrite 2000 B)',
+    preload: ['/LavaData/Magic_Save.dat', 'examples/shenzhou/LavaData/Magic_Save.dat'],
+    source: `char mem[2000];
+      int main() { int fp; fp = fopen("/LavaData/Magic_Save.dat", "rb+"); fseek(fp, 2000, 0); fwrite(mem, 1, 2000, fp); fclose(fp); }`,
+  },
+  {
+    // examples/docs_vm_stress.c: report lines written as fwrite + putc('\\n').
+    name: 'docs_vm_stress report (40 x fwrite + putc)',
+    source: `char line[40];
+      int main() { int fp; int i; strcpy(line, "check passed: syscall round trip ok");
+        fp = fopen("/LavaData/vm_report.txt", "w+");
+        for (i = 0; i < 40; i++) { fwrite(line, 1, strlen(line), fp); putc(10, fp); }
+        fclose(fp); }`,
+  },
+  {
+    name: 'byte-at-a-time save (4000 x putc)',
+    source: `int main() { int fp; int i; fp = fopen("/LavaData/Magic_Save.dat", "w");
+        for (i = 0; i < 4000; i++) putc(i, fp);
+        fclose(fp); }`,
+  },
+];
+
+async function main() {
+  for (const scenario of SCENARIOS) {
+    const driver = new CountingStorageDriver();
+    const vm = createBenchVm(driver);
+    await vm.vfs.ready;
+    if (scenario.preload) {
+      vm.vfs.addFile(scenario.preload[0], new Uint8Array(fs.readFileSync(scenario.preload[1])));
+      await vm.vfs.sync();
+      driver.calls = 0;
+      driver.bytes = 0;
+    }
+
+    const start = performance.now();
+    await runProgram(vm, compileProgram(scenario.source));
+    await vm.vfs.sync();
+    const elapsed = performance.now() - start;
+    console.log(`${scenario.name.padEnd(48)} persist calls ${String(driver.calls).padStart(6)}   bytes ${String(driver.bytes).padStart(10)}   ${elapsed.toFixed(1)} ms`);
+  }
+}
+
+main();
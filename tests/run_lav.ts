@@ -3,9 +3,15 @@
  *
  * Example:
  *   bun tests/run_lav.ts examples/shenzhou/神州.lav --timeout-ms=2000 --json
+ *   bun tests/run_lav.ts game.lav --clock=virtual   (Delay completes instantly)
+ *   bun tests/run_lav.ts game.lav --clock=scaled:4  (4x real time)
+ *   bun tests/run_lav.ts examples/shenzhou/神州.lav --vfs-root=examples/shenzhou
+ *     (VFS root is the host directory, read lazily; add --vfs-write to let saves reach disk)
  */
 import path from 'path';
 
+import type { ClockOptions, ClockSource } from '../src/vm/VirtualClock';
+
 import {
   createDiagnosticVm,
   formatSummary,
@@ -16,6 +22,9 @@ interface CliOptions {
   lavPath: string;
   timeoutMs: number;
   autoKeyDelayMs: number;
+  clock: ClockOptions;
+  vfsRoot?: string;
+  vfsWritable: boolean;
   json: boolean;
 }
 
@@ -24,6 +33,8 @@ function parseArgs(argv: string[]): CliOptions {
     lavPath: 'docs/ref_prjs/编译器/资料/通过/1.lav',
     timeoutMs: 2500,
     autoKeyDelayMs: 120,
+    clock: { source: 'realtime' },
+    vfsWritable: false,
     json: false,
   };
 
@@ -40,6 +51,19 @@ function parseArgs(argv: string[]): CliOptions {
       opts.autoKeyDelayMs = Number(arg.slice('--auto-key-delay-ms='.length)) || opts.autoKeyDelayMs;
       continue;
     }
+    if (arg.startsWith('--vfs-root=')) {
+      opts.vfsRoot = arg.slice('--vfs-root='.length);
+      continue;
+    }
+    if (arg === '--vfs-write') {
+      opts.vfsWritable = true;
+      continue;
+    }
+    if (arg.startsWith('--clock=')) {
+      const [source, rate] = arg.slice('--clock='.length).split(':');
+      opts.clock = { source: source as ClockSource, scale: Number(rate) || 1, opsPerMs: Number(rate) || undefined };
+      continue;
+    }
     if (!arg.startsWith('--')) {
       opts.lavPath = arg;
     }
@@ -50,7 +74,8 @@ function parseArgs(argv: string[]): CliOptions {
 
 async function main() {
   const options = parseArgs(process.argv.slice(2));
-  const vm = createDiagnosticVm();
+  const vm = createDiagnosticVm({ vfsRoot: options.vfsRoot, vfsWritable: options.vfsWritable });
+  vm.clock.configure(options.clock);
 
   const result = await runVmBounded(vm, {
     lavPath: options.lavPath,
@@ -58,6 +83,7 @@ async function main() {
     autoKeyDelayMs: options.autoKeyDelayMs,
     maxLogs: 120,
     maxEvents: 80,
+    preloadLavaData: !options.vfsRoot,
   });
 
   const summary = formatSummary(result);
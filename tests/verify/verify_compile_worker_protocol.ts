@@ -0,0 +1,125 @@
+import { LavaXCompiler } from '../../src/compiler';
+import { LavaCompileService } from '../../src/workers/lavaCompileService';
+import { collectIncludes, LavaCompileClient, type LavaCompilePort } from '../../src/workers/lavaCompileClient';
+import type { LavaCompileWorkerEvent, LavaCompileWorkerRequest } from '../../src/workers/lavaCompileProtocol';
+
+function assert(condition: unknown, message: string): asserts condition {
+  if (!condition) {
+    throw new Error(message);
+  }
+}
+
+/** Client and service joined like a worker would join them: asynchronously, one message per task. */
+function connect() {
+  const requests: LavaCompileWorkerRequest[] = [];
+  const events: LavaCompileWorkerEvent[] = [];
+  let listener: ((event: { data: LavaCompileWorkerEvent }) => void) | null = null;
+  const service = new LavaCompileService((event) => {
+    events.push(event);
+    setTimeout(() => listener?.({ data: event }), 0);
+  });
+  const port: LavaCompilePort = {
+    postMessage(message) {
+      requests.push(message);
+      setTimeout(() => service.handle(message), 0);
+    },
+    addEventListener(_type, callback) {
+      listener = callback;
+    },
+  };
+  return { client: new LavaCompileClient(port), requests, events };
+}
+
+const MAIN = `#include "util.h"
+void main() {
+  printf("%d\\n", twice(21));
+}
+`;
+const UTIL = `int twice(int x) {
+  return x * 2;
+}
+`;
+
+async function verifyResultMatchesDirectCompile() {
+  const { client } = connect();
+  const includes = await collectIncludes(MAIN, (name) => (name === 'util.h' ? UTIL : null));
+  assert(Object.keys(includes).join() === 'util.h', 'collectIncludes must find util.h');
+  const awaited = await collectIncludes(MAIN, async (name) => (name === 'util.h' ? UTIL : null));
+  assert(awaited['util.h'] === UTIL, 'collectIncludes must await an async resolver');
+
+  const result = await client.compile({ source: MAIN, sourceFile: 'main.c', includes });
+  assert(result && result.lav && !result.error, `worker compile failed: ${result?.error}`);
+
+  const compiler = new LavaXCompiler();
+  compiler.includeResolver = (name) => includes[name] ?? null;
+  const direct = compiler.compileToLav(MAIN, 'main.c', { listing: true, lineMap: true });
+  assert(direct.lav && direct.lav.length === result.lav.length && direct.lav.every((b, i) => b === result.lav![i]), 'worker bytecode must match a direct compile');
+  assert(result.listing === direct.listing, 'worker listing must match a direct compile');
+  assert(result.lineMap && result.lineMap.files.includes('util.h'), 'line map must come back with the result');
+
+  const failed = await client.compile({ source: 'void main() { undefined_fn(); }', sourceFile: 'bad.c', includes: {} });
+  assert(failed && failed.lav === null && failed.error, 'a failing compile must report its error');
+}
+
+async function verifySupersessionAndCache() {
+  const { client, requests, events } = connect();
+  const input = (n: number) => ({ source: `void main() { printf("%d", ${n}); }`, sourceFile: 'main.c', includes: {} });
+
+  // Three keystrokes in a row: only the last is compiled.
+  const background = { background: true };
+  const burst = [client.compile(input(1), background), client.compile(input(2), background), client.compile(input(3), background)];
+  const [first, second, third] = await Promise.all(burst);
+  assert(first === null && second === null, 'queued compiles must be superseded by newer ones');
+  assert(third && third.lav, 'the newest compile must run');
+  assert(events.filter(e => e.type === 'result').length === 1, 'superseded compiles must not run');
+
+  // Run after the diagnostics compile of the same text: served from the cache.
+  const sent = requests.length;
+  const again = await client.compile(input(3));
+  assert(again === third, 'an unchanged source must reuse the cached result');
+  assert(requests.length === sent, 'a cached result must not reach the worker');
+
+  // Identical requests in flight share one compile.
+  const [a, b] = await Promise.all([client.compile(input(4)), client.compile(input(4))]);
+  assert(a && a === b, 'identical requests in flight must share a result');
+  assert(requests.length === sent + 1, 'identical requests in flight must compile once');
+
+  // The cache is keyed by the included files too.
+  const withInclude = { ...input(3), source: `#include "x.h"\n${input(3).source}`, includes: { 'x.h': 'int x;' } };
+  const first1 = await client.compile(withInclude);
+  const changed = await client.compile({ ...withInclude, includes: { 'x.h': 'int x; int y;' } });
+  assert(first1 && changed && first1 !== changed, 'changing an included file must invalidate the cache');
+}
+
+async function verifyDiagnosticsNeverCancelRun() {
+  const { client, requests, events } = connect();
+  const input = (n: number) => ({ source: `void main() { printf("%d", ${n}); }`, sourceFile: 'main.c', includes: {} });
+
+  // The diagnostics timer fires while Run's compile is still queued.
+  const run = client.compile(input(1));
+  const diagnostics = client.compile(input(2), { background: true });
+  const [ran, checked] = await Promise.all([run, diagnostics]);
+  assert(ran && ran.lav, 'a background compile must not supersede an explicit one');
+  assert(checked && checked.lav, 'the background compile queued behind it must still run');
+
+  // Run of the text a queued diagnostics compile is checking, then newer diagnostics.
+  const stale = client.compile(input(3), { background: true });
+  const run2 = client.compile(input(3));
+  const newer = client.compile(input(4), { background: true });
+  const [staleResult, ran2, newerResult] = await Promise.all([stale, run2, newer]);
+  assert(ran2 && ran2.lav, 'Run must not share the fate of a background compile of the same text');
+  assert(staleResult === ran2, 'a dropped background compile must be answered by the explicit one of the same input');
+  assert(newerResult && newerResult.lav, 'the newest background compile must run');
+  const superseded = new Set(events.filter(e => e.type === 'superseded').map(e => e.token));
+  assert(requests.every(r => r.background || !superseded.has(r.token)), 'explicit compiles must never be superseded');
+  assert(superseded.size === 1, 'only the stale background compile must be dropped');
+}
+
+async function main() {
+  await verifyResultMatchesDirectCompile();
+  await verifySupersessionAndCache();
+  await verifyDiagnosticsNeverCancelRun();
+  console.log('PASS: compile worker protocol verified.');
+}
+
+main();
@@ -1,4 +1,9 @@
 import { LavaXCompiler } from '../../src/compiler';
+import { LavaXAssembler } from '../../src/compiler/LavaXAssembler';
+import { LavaXTokenStream, TokenKind } from '../../src/compiler/LavaXLexer';
+import { evalConstExpr } from '../../src/compiler/LavaXConstExpr';
+import { lookupLavLine } from '../../src/lav/lineMap';
+import { LavaXVM } from '../../src/vm';
 import iconv from 'iconv-lite';
 
 function assert(condition: unknown, message: string): asserts condition {
@@ -38,13 +43,14 @@ function verifyIntArrayStride() {
   const asm = compile(`
     void main() {
       int a[2];
+      int i;
       int x;
-      a[1] = 7;
-      x = a[1];
+      a[i] = 7;
+      x = a[i];
     }
   `);
 
-  const strideCount = countMatches(asm, /(PUSH_B 2\nMUL|MUL_C 2)/g);
+  const strideCount = countMatches(asm, /(PUSH_B 2\nMUL|MUL_C 2|SHL_C 1)/g);
   assert(strideCount >= 2, `expected int array accesses to use 2-byte stride, got ${strideCount}`);
 }
 
@@ -71,10 +77,415 @@ function verifyGlobalChineseMenuStrings() {
   assert(!asm.includes('INIT 8192 3 0 0 0'), 'global Chinese menu strings regressed to zero-initialization');
 }
 
-function main() {
+function verifyTokenStream() {
+  const src = `a <<= b->c; /* x */ s = "q\\"t"; // tail\nk+=1`;
+  const stream = new LavaXTokenStream(src);
+  const texts: string[] = [];
+  for (let pos = 0, t = stream.at(0); stream.kinds[t] !== TokenKind.End; pos = stream.ends[t], t = stream.at(pos)) {
+    texts.push(stream.texts[t]);
+  }
+  assert(texts.join(' ') === 'a <<= b -> c ; s = "q\\"t" ; k += 1', `unexpected tokens: ${texts.join(' ')}`);
+  assert(stream.kinds[stream.at(src.indexOf('"'))] === TokenKind.String, 'string literal kind');
+  // Offsets inside a token (after raw character scans) lex the remainder.
+  assert(stream.texts[stream.at(src.indexOf('<<=') + 1)] === '<=', 'mid-token offsets must lex from there');
+  assert(stream.texts[stream.at(1)] === stream.texts[stream.at(2)], 'leading whitespace resolves to the same token');
+}
+
+function verifyDirectEncodingMatchesAssembler() {
+  const source = `
+char msg[] = "hi\\n";
+int table[3] = {1, 300, -2};
+long big = 0x12345678;
+int twice(int x) { return x * 2; }
+void main() {
+  int i;
+  for (i = 0; i < 3; i++) {
+    if (table[i] > 100) printf(msg);
+    switch (i) { case 1: i = twice(i); break; default: break; }
+  }
+  done:
+  big = big + 70000;
+}`;
+  const asm = compile(source);
+  const result = new LavaXCompiler().compileToLav(source, '', { listing: true });
+  assert(result.lav && !result.error, `direct encoding failed: ${result.error}`);
+  assert(result.listing === asm, 'listing must match compile() output');
+  const assembled = new LavaXAssembler().assemble(asm);
+  assert(assembled.length === result.lav.length && assembled.every((byte, i) => byte === result.lav![i]),
+    'direct encoding must match assembling the listing');
+  assert(new LavaXCompiler().compileToLav(source).listing === undefined, 'listing is opt-in');
+
+  const missing = new LavaXCompiler().compileToLav('void later();\nvoid main() { later(); }');
+  assert(missing.error?.startsWith('ERROR: Unknown label: later'), `unexpected error: ${missing.error}`);
+}
+
+function verifyLineMap() {
+  const compiler = new LavaXCompiler();
+  compiler.includeResolver = name => name === 'util.h' ? 'int twice(int x) {\n  return x * 2;\n}\n' : null;
+  const source = '#include "util.h"\nvoid main() {\n  int a;\n  a = twice(3);\n\n  a = a + 1;\n}\n';
+  const result = compiler.compileToLav(source, 'main.c', { lineMap: true });
+  assert(result.lav && result.lineMap, `compile failed: ${result.error}`);
+  const map = result.lineMap;
+  const entries = Array.from(map.pcs, (pc, i) => ({ pc, where: `${map.files[map.fileIds[i]]}:${map.lines[i]}` }));
+  const wheres = entries.map(entry => entry.where);
+  assert(wheres.includes('util.h:2') && wheres.includes('main.c:4') && wheres.includes('main.c:6'),
+    `line map must cover statements in both files: ${wheres.join(' ')}`);
+  assert(entries.every((entry, i) => i === 0 || entry.pc > entries[i - 1].pc), 'line map addresses must ascend');
+  const assignment = entries.find(entry => entry.where === 'main.c:6')!;
+  assert(lookupLavLine(map, assignment.pc)?.line === 6 && lookupLavLine(map, assignment.pc + 1)?.line === 6, 'lookup inside an entry');
+  assert(lookupLavLine(map, 0) === null, 'code before the first statement has no line');
+
+  const error = new LavaXCompiler().compile('void main() {\n  int a;\n  a = ;\n}\n', 'bad.c');
+  assert(error.startsWith('ERROR:') && error.includes('bad.c:3:'), `diagnostic must point at line 3: ${error.split('\n')[0]}`);
+}
+
+function verifyIncrementalCompile() {
+  const base = [
+    'int g;',
+    'int first(int x) {\n  return x + 1;\n}',
+    'int second(int x) {\n  if (x > 2) return 1;\n  while (x) x--;\n  return 0;\n}',
+    'void main() {\n  g = first(1) + second(3);\n}',
+  ];
+  const editor = new LavaXCompiler();
+  editor.incremental = true;
+  const check = (parts: string[], expectedReused: number, label: string) => {
+    const source = parts.join('\n');
+    const result = editor.compileToLav(source, 'inc.c', { listing: true, lineMap: true });
+    const full = new LavaXCompiler().compileToLav(source, 'inc.c', { listing: true, lineMap: true });
+    assert(result.listing === full.listing, `${label}: incremental listing must match a full compile`);
+    assert(Array.from(result.lineMap!.lines).join() === Array.from(full.lineMap!.lines).join()
+      && Array.from(result.lineMap!.pcs).join() === Array.from(full.lineMap!.pcs).join(), `${label}: line maps must match`);
+    assert(editor.lastCompileStats.reused === expectedReused,
+      `${label}: expected ${expectedReused} reused functions, got ${editor.lastCompileStats.reused}`);
+  };
+
+  check(base, 0, 'cold');
+  check(base, 3, 'unchanged');
+  // New labels in an earlier function shift the generated labels of later ones.
+  const edited = [base[0], 'int first(int x) {\n  if (x) x = 2;\n  return x + 1;\n}', base[2], base[3]];
+  check(edited, 2, 'edited body');
+  // Moving code down shifts source offsets but not the generated code.
+  check(['// moved', ...edited], 3, 'shifted');
+  // A changed global invalidates every function.
+  check(['long g;', ...edited.slice(1)], 0, 'symbols changed');
+}
+
+function verifyConstantExpressions() {
+  const cases: Array<[string, number]> = [
+    ['2 + 3 * 4', 14], ['(2 + 3) * 4', 20], ['7 / 2', 3], ['-7 / 2', -3], ['7 % 3', 1], ['1 << 4 | 1', 17],
+    ['0x1F & ~1', 30], ['010', 8], ['10L', 10], ["'A'", 65], ["'\\n'", 10], ["'\\x41'", 65],
+    ['3 > 2 && 2 > 1', 1], ['1 ? 5 : 6', 5], ['!0 + !5', 1], ['1 /* one */ + 2 // two', 3],
+  ];
+  for (const [text, expected] of cases) {
+    assert(evalConstExpr(text) === expected, `${text} should be ${expected}, got ${evalConstExpr(text)}`);
+  }
+  for (const text of ['1 / 0', 'foo + 1', '"str"', '1 +', '(1']) {
+    assert(Number.isNaN(evalConstExpr(text)), `${text} is not a constant expression`);
+  }
+  assert(evalConstExpr('UNDEFINED + 1', true) === 1, '#if treats undefined names as 0');
+
+  const asm = compile([
+    '#define N 2 + 3',
+    '#if !MISSING && N * 2 == 8',
+    'char table[N * 2];',
+    '#endif',
+    "char initial = 'A';",
+    'void main() {',
+    '  int k;',
+    "  switch (k) { case 'a': k = 1; break; case 7 / 2: k = 2; }",
+    '}',
+  ].join('\n'));
+  assert(/^INIT \d+ 1 65$/m.test(asm), 'a character initializer must be stored');
+  assert(asm.includes('EQ_C 97') && asm.includes('EQ_C 3'), 'case labels must be integer constants');
+}
+
+function verifyIncludeCache() {
+  const files: Record<string, string> = {
+    'outer.h': '#include "inner.h"\n#ifdef WIDE\nlong width;\n#else\nint width;\n#endif\n#define OUTER 1\n',
+    'inner.h': 'int inner;\n',
+  };
+  const resolver = (name: string) => files[name] ?? null;
+  const editor = new LavaXCompiler();
+  editor.incremental = true;
+  editor.includeResolver = resolver;
+  const check = (source: string, label: string) => {
+    const result = editor.compileToLav(source, 'main.c', { listing: true, lineMap: true });
+    const fresh = new LavaXCompiler();
+    fresh.includeResolver = resolver;
+    const full = fresh.compileToLav(source, 'main.c', { listing: true, lineMap: true });
+    assert(result.lav && result.listing === full.listing, `${label}: cached preprocessing must match a fresh compile: ${result.error}`);
+    assert(Array.from(result.lineMap!.lines).join() === Array.from(full.lineMap!.lines).join()
+      && result.lineMap!.files.join() === full.lineMap!.files.join(), `${label}: line maps must match`);
+  };
+  const main = '#include "outer.h"\nvoid main() {\n  width = OUTER;\n  inner = 2;\n}\n';
+  check(main, 'cold');
+  check(main, 'cached');
+  check(`#define WIDE\n${main}`, 'different macros on entry');
+  files['inner.h'] = 'int pad;\nint inner;\n';
+  check(main, 'nested include changed');
+}
+
+// Runs `source` and returns its first global, a long array of `count` results.
+async function runForResults(source: string, count: number, configure: (compiler: LavaXCompiler) => void): Promise<number[]> {
+  const compiler = new LavaXCompiler();
+  configure(compiler);
+  const result = compiler.compileToLav(source, 'fold.c');
+  assert(result.lav, result.error ?? 'compile failed');
+  const vm = new LavaXVM();
+  vm.load(result.lav);
+  await vm.run();
+  const view = new DataView(vm.memory.buffer, vm.memory.byteOffset);
+  return Array.from({ length: count }, (_, i) => view.getInt32(0x2000 + i * 4, true));
+}
+
+async function verifyConstantFolding() {
+  const asm = compile(`
+    int g;
+    void main() {
+      char c;
+      g = g * 8 + 3 * 4;
+      g = 3 < g;
+      g = !(g == 4);
+      g = g * 1 + 0 - 0;
+      g = c / 4 + g / 4;
+      g = g + 1 + 2 - 5;
+    }
+  `);
+  assert(asm.includes('SHL_C 3\nADD_C 12') && !asm.includes('MUL'), 'x * 8 must shift and 3 * 4 must fold');
+  assert(asm.includes('GT_C 3'), 'a constant left operand must become an immediate');
+  assert(asm.includes('NEQ_C 4') && !asm.includes('L_NOT'), 'a negated comparison must become the opposite comparison');
+  assert(!/ADD_C 0|SUB_C 0|MUL_C 1\b/.test(asm), 'identities must be dropped');
+  assert(asm.includes('SHR_C 2') && asm.includes('DIV_C 4'), 'only unsigned bytes may divide by shifting');
+  assert(asm.includes('ADD_C -2'), 'ADD_C/SUB_C chains must merge');
+
+  // Folded constants must compute exactly what the VM computes.
+  const expressions = [
+    '7 / 0', '7 % 0', '-7 / 2', '-7 % 2', '0x7fffffff + 1', '65536 * 65536', '-1 >> 28', '1 << 33', '1 << -1',
+    '3 > 2', '(3 == 3) + 1', '!5', '~5', '-(-2147483647 - 1)', '5 && 0', '0 || 9', 'x * 65536', 'x * -1', '2 - x',
+    '(x + 40000) - 40000', 'x - 1 + 1', 'c / 2', 'c * 4 / 4', '!(x < 3)', '6 >= x',
+  ];
+  const source = `long r[${expressions.length}];
+  void main() {
+    long x = -5;
+    char c = 200;
+    ${expressions.map((e, i) => `r[${i}] = ${e};`).join('\n    ')}
+  }`;
+  const folded = await runForResults(source, expressions.length, () => {});
+  const unfolded = await runForResults(source, expressions.length, (c) => { c.optimizations.foldConstants = false; });
+  assert(folded.join() === unfolded.join(), `folding changed results:\n${unfolded}\n${folded}`);
+}
+
+async function verifySwitchSearchTree() {
+  // Gaps, negatives, values past int16 and int32 hex literals (0xFFFFFFFF is
+  // -1 as a long), fall-through and no default.
+  const cases = [-40000, -3, 0, 1, 2, 3, 4, 9, 10, 11, 100, 255, 256, 70000, '0x80000000', '0xFFFFFFFF'];
+  const probes = [-40001, -40000, -4, -3, -1, 0, 1, 2, 3, 4, 5, 8, 9, 10, 11, 12, 99, 100, 255, 256, 69999, 70000, 70001,
+    '0x80000000', '0x80000001', '0x7FFFFFFF', '0xFFFFFFFE'];
+  const switchOn = (withDefault: boolean) => `switch (v) {
+      ${cases.map((c, i) => `case ${c}: r = ${i + 1};${i % 4 === 3 ? '' : ' break;'}`).join('\n      ')}
+      ${withDefault ? 'default: r = -1;' : ''}
+    }`;
+  const source = `long out[${probes.length * 2}];
+  long probes[${probes.length}] = { ${probes.join(', ')} };
+  long classify(long v, int withDefault) {
+    long r = -2;
+    if (withDefault) { ${switchOn(true)} } else { ${switchOn(false)} }
+    return r;
+  }
+  void main() {
+    int i;
+    for (i = 0; i < ${probes.length}; i++) {
+      out[i * 2] = classify(probes[i], 1);
+      out[i * 2 + 1] = classify(probes[i], 0);
+    }
+  }`;
+  const asm = compile(source);
+  assert(asm.includes('L_SWLT_'), 'a switch with many cases must bisect');
+  const tree = await runForResults(source, probes.length * 2, () => {});
+  const linear = await runForResults(source, probes.length * 2, (c) => { c.switchTrees = false; });
+  assert(tree.join() === linear.join(), `binary search dispatch changed results:\n${linear}\n${tree}`);
+  assert(tree[probes.indexOf(70000) * 2] === 14 && tree[probes.indexOf(5) * 2 + 1] === -2, `unexpected dispatch results: ${tree}`);
+  assert(tree[probes.indexOf(-1) * 2 + 1] === 16 && tree[probes.indexOf('0x80000000') * 2] === 15, `int32 hex cases must match as longs: ${tree}`);
+}
+
+async function verifyControlFlowOptimizer() {
+  const source = `long out[8];
+  int g;
+  int pick(int v) {
+    if (v > 3) {
+      return v * 2;
+    } else {
+      return v - 1;
+    }
+    return 0;
+  }
+  void main() {
+    long a;
+    long b;
+    int i;
+    int n = 0;
+    while (1) {
+      if (n >= 5) break;
+      n++;
+      if (n & 1) { g = g + n; } else { g = g - 1; }
+    }
+    a = pick(n) + 1000;
+    b = a;
+    out[0] = b;
+    out[1] = g;
+    g;
+    for (i = 0; i < 3; i++) {
+      if (i == 1) continue;
+      out[2] = out[2] + i;
+    }
+    out[3] = pick(2);
+    out[4] = n;
+  }`;
+  const compiler = new LavaXCompiler();
+  const asm = compiler.compile(source);
+  assert(!asm.startsWith('ERROR:'), asm);
+  const stats = compiler.lastOptimizerStats;
+  for (const rule of ['jumpThreading', 'branchToNext', 'deadCode', 'dupPop', 'storeLoad'] as const) {
+    assert(stats[rule] > 0, `${rule} must fire on the sample: ${JSON.stringify(stats)}`);
+  }
+
+  const lines = asm.split('\n');
+  const labels = new Map(lines.map((line, i) => [line.slice(0, -1), i] as const).filter(([, i]) => lines[i].endsWith(':')));
+  const firstInstruction = (i: number) => {
+    while (lines[i]?.endsWith(':')) i++;
+    return lines[i] ?? '';
+  };
+  lines.forEach((line, i) => {
+    const [op, target] = line.split(' ');
+    if (op === 'JMP' || op === 'RET' || op === 'EXIT') {
+      const next = lines[i + 1];
+      assert(next === undefined || next.endsWith(':') || next === 'F_FLAG', `dead code after ${line}: ${next}`);
+    }
+    if (op === 'JMP' || op === 'JZ' || op === 'JNZ') {
+      assert(!firstInstruction(labels.get(target)! + 1).startsWith('JMP '), `${line} must be threaded`);
+      assert(labels.get(target) !== i + 1, `${line} jumps to the next instruction`);
+    }
+  });
+  assert(!/PUSH_B 1\nPOP\nJZ/.test(asm), 'while (1) must not test its condition');
+  assert(!/STORE\nPOP\nLD_L_D/.test(asm), 'b = a must reuse the stored value');
+
+  const off = await runForResults(source, 5, (c) => {
+    for (const rule of Object.keys(c.optimizations) as Array<keyof typeof c.optimizations>) c.optimizations[rule] = false;
+  });
+  const on = await runForResults(source, 5, () => {});
+  assert(on.join() === off.join() && on.join() === '1010,7,2,1,5', `optimized code computed ${on}, unoptimized ${off}`);
+}
+
+async function verifyInlining() {
+  const source = `long out[8];
+  int g = 7;
+  int count;
+  int clamp(int v, int lo, int hi) {
+    if (v < lo) return lo;
+    if (v > hi) return hi;
+    return v;
+  }
+  int get() { return g; }
+  void add(int x) { count = count + x; }
+  int diff(int a, int b) { return a - b; }
+  int low(char c) { return c; }
+  int fact(int n) {
+    if (n <= 1) return 1;
+    return n * fact(n - 1);
+  }
+  void main() {
+    int i;
+    int n = 4;
+    long s = 0;
+    for (i = 0; i < 5; i++) s = s + clamp(i * 3, 2, 9);
+    out[0] = s;
+    out[1] = get() * get();
+    add(5);
+    add(6);
+    out[2] = count;
+    out[3] = fact(5);
+    out[4] = clamp(get(), 0, 5);
+    out[5] = diff(n, n++);
+    out[6] = low(300);
+  }`;
+  const compiler = new LavaXCompiler();
+  const asm = compiler.compile(source);
+  assert(!asm.startsWith('ERROR:'), asm);
+  assert(compiler.lastOptimizerStats.inlining === 4, `every call of get and low must be inlined: ${JSON.stringify(compiler.lastOptimizerStats)}`);
+  // get's copy is smaller than a CALL; low has a single call site.
+  for (const name of ['get', 'low']) {
+    assert(!asm.includes(`CALL ${name}\n`) && !asm.includes(`${name}:`), `${name} must be inlined and dropped`);
+  }
+  // Copying these into each of their two call sites would grow the program.
+  assert(asm.includes('CALL clamp\n') && asm.includes('CALL add\n'), 'a call must not be inlined where its copy is larger');
+  assert(asm.includes('CALL fact\n'), 'a recursive function must not be inlined');
+  // n must be read before n++: both arguments would need storing.
+  assert(asm.includes('CALL diff\n'), 'a call with more than one stored argument must not be inlined');
+  // main's frame: header, i, n, s, then low's parameter.
+  assert(/main:\nFUNC 17 0\n/.test(asm), `main's frame must grow by low's: ${asm.split('\n').find(line => line.startsWith('FUNC'))}`);
+  const calls = new LavaXCompiler();
+  calls.optimizations.inlining = false;
+  const inlinedSize = compiler.compileToLav(source, 'inline.c').lav!.length;
+  assert(inlinedSize < calls.compileToLav(source, 'inline.c').lav!.length, 'inlining must not grow the program');
+
+  const off = await runForResults(source, 7, (c) => { c.optimizations.inlining = false; });
+  const on = await runForResults(source, 7, () => {});
+  assert(on.join() === off.join() && on.join() === '29,49,11,120,5,0,44', `inlined code computed ${on}, with calls ${off}`);
+}
+
+async function verifyInliningRuntimeFrameAddresses() {
+  // Without folding, these handles are built at run time from an offset
+  // the inliner cannot move (PUSH_W off; PUSH_D 0x800000; OR).
+  const source = `long out[5];
+  long cell = 42;
+  long deref(long v) { long *p = v; return *p; }
+  int second(int v) { int a[2]; a[1] = v; return a[1] + 1; }
+  void main() {
+    long a = 1;
+    long b = 2;
+    long c = 3;
+    out[0] = deref(&cell);
+    out[1] = second(20);
+    out[2] = a; out[3] = b; out[4] = c;
+  }`;
+  const calls = await runForResults(source, 5, (c) => { c.optimizations.foldConstants = false; c.optimizations.inlining = false; });
+  const inlined = await runForResults(source, 5, (c) => { c.optimizations.foldConstants = false; });
+  assert(calls.join() === '42,21,1,2,3', `unexpected results with calls: ${calls}`);
+  assert(inlined.join() === calls.join(), `inlining a runtime frame address changed results: ${inlined}`);
+}
+
+async function verifyCrc32Builtin() {
+  const source = `
+    long crc;
+    long empty;
+    char check[] = "123456789";
+    void main() {
+      crc = Crc32(check, strlen(check));
+      empty = Crc32(check, 0);
+    }
+  `;
+  assert(compile(source).includes('PUSH_B 128\nreaddir'), 'Crc32 must push its System sub-op before 0xD3');
+  const [crc, empty] = await runForResults(source, 2, () => {});
+  assert(crc === (0xcbf43926 | 0), `Crc32 must match zlib crc32, got ${(crc >>> 0).toString(16)}`);
+  assert(empty === 0, 'Crc32 of an empty buffer must be 0');
+}
+
+async function main() {
+  verifyTokenStream();
+  verifyConstantExpressions();
+  verifyIncludeCache();
+  verifyDirectEncodingMatchesAssembler();
+  verifyLineMap();
+  verifyIncrementalCompile();
   verifyLocalCharArrayStringInit();
   verifyIntArrayStride();
   verifyGlobalChineseMenuStrings();
+  await verifyConstantFolding();
+  await verifySwitchSearchTree();
+  await verifyControlFlowOptimizer();
+  await verifyInlining();
+  await verifyInliningRuntimeFrameAddresses();
+  await verifyCrc32Builtin();
   console.log('compiler regression checks passed');
 }
 
@@ -0,0 +1,102 @@
+import iconv from 'iconv-lite';
+import { decodeGbk, encodeGbk, encodeGbkInto, normalizeToGbk } from '../../src/lav/gbk';
+
+function assert(condition: unknown, message: string): asserts condition {
+  if (!condition) {
+    throw new Error(message);
+  }
+}
+
+const hex = (bytes: ArrayLike<number>) => Array.from(bytes, b => b.toString(16).padStart(2, '0')).join(' ');
+const units = (text: string) => Array.from(text, ch => 'U+' + ch.charCodeAt(0).toString(16).toUpperCase()).join(' ');
+
+function verifyDecodeMatchesIconv() {
+  // Every lead byte with every possible second byte, against the table the codec is built from.
+  for (let lead = 0x80; lead <= 0xFF; lead++) {
+    for (let trail = 0; trail <= 0xFF; trail++) {
+      const bytes = new Uint8Array([lead, trail]);
+      const actual = decodeGbk(bytes);
+      // A lead byte followed by 0xFF is one invalid pair (WHATWG), iconv-lite re-reads the 0xFF.
+      const expected = lead >= 0x81 && lead <= 0xFE && trail === 0xFF ? '\uFFFD' : iconv.decode(Buffer.from(bytes), 'gbk');
+      assert(actual === expected, `decode ${hex(bytes)}: ${units(actual)} vs iconv ${units(expected)}`);
+
+      // GBK is a superset of cp936: every pair cp936 maps must decode the same.
+      const cp936 = iconv.decode(Buffer.from(bytes), 'cp936');
+      if (cp936.length === 1 && cp936 !== '\uFFFD') {
+        assert(actual === cp936, `decode ${hex(bytes)}: ${units(actual)} vs cp936 ${units(cp936)}`);
+      }
+    }
+  }
+
+  for (let b = 0; b <= 0xFF; b++) {
+    const actual = decodeGbk(new Uint8Array([b]));
+    const expected = iconv.decode(Buffer.from([b]), 'gbk');
+    assert(actual === expected, `decode single ${hex([b])}: ${units(actual)} vs iconv ${units(expected)}`);
+  }
+  assert(decodeGbk(new Uint8Array([0x80])) === '€', 'byte 0x80 must decode to the euro sign');
+  assert(decodeGbk(new Uint8Array([0x41, 0x81])) === 'A\uFFFD', 'a lead byte at the end must decode to U+FFFD');
+  assert(decodeGbk(new Uint8Array([0x81, 0x30, 0x41])) === '\uFFFD0A', 'an ASCII byte after an invalid lead must be re-read');
+
+  // A long mixed buffer exercises the growing scratch and the bulk string conversion.
+  const mixed: number[] = [];
+  for (let i = 0; i < 40000; i++) {
+    if (i % 3 === 0) mixed.push(0x20 + (i % 0x5F));
+    else mixed.push(0xB0 + (i % 0x40), 0xA1 + (i % 0x5E));
+  }
+  const mixedBytes = new Uint8Array(mixed);
+  assert(decodeGbk(mixedBytes) === iconv.decode(Buffer.from(mixedBytes), 'gbk'), 'decode of a long mixed buffer must match iconv');
+  assert(decodeGbk(mixedBytes, 3, 9) === iconv.decode(Buffer.from(mixedBytes.subarray(3, 9)), 'gbk'), 'decode must honour [start, end)');
+}
+
+function verifyEncodeMatchesIconv() {
+  for (let c = 1; c <= 0xFFFF; c++) {
+    if (c >= 0xD800 && c <= 0xDFFF) continue;
+    const text = String.fromCharCode(c);
+    const actual = encodeGbk(text);
+    // iconv-lite emits the four-byte GB18030 form for U+E7C7; GBK has none.
+    const expected = c === 0xE7C7 ? new Uint8Array([0x3F]) : iconv.encode(text, 'gbk');
+    assert(hex(actual) === hex(expected), `encode U+${c.toString(16).toUpperCase()}: ${hex(actual)} vs iconv ${hex(expected)}`);
+
+    const cp936 = iconv.encode(text, 'cp936');
+    if (cp936.length !== 1 || cp936[0] !== 0x3F || c === 0x3F) {
+      assert(hex(actual) === hex(cp936), `encode U+${c.toString(16).toUpperCase()}: ${hex(actual)} vs cp936 ${hex(cp936)}`);
+    }
+  }
+
+  assert(hex(encodeGbk('€')) === '80', 'the euro sign must encode to byte 0x80');
+  assert(hex(encodeGbk('\u{1F600}')) === '3f', 'a surrogate pair must encode to a single ?');
+  assert(hex(encodeGbk('a\uD800b\uDC00')) === '61 3f 62 3f', 'lone surrogates must encode to ?');
+}
+
+// Pairs that share their character with a canonical encoding (iconv-lite encodes the same way).
+const DUPLICATE_PAIRS = new Map([['a2 e3', '80'], ['a3 a0', 'a1 a1']]);
+
+function verifyRoundTrip() {
+  let pairs = 0;
+  for (let lead = 0x81; lead <= 0xFE; lead++) {
+    for (let trail = 0x40; trail <= 0xFE; trail++) {
+      const bytes = new Uint8Array([lead, trail]);
+      const text = decodeGbk(bytes);
+      if (text === '\uFFFD' || text.length !== 1) continue;
+      const expected = DUPLICATE_PAIRS.get(hex(bytes)) ?? hex(bytes);
+      assert(hex(encodeGbk(text)) === expected, `${hex(bytes)} -> ${units(text)} must encode back to ${expected}`);
+      assert(normalizeToGbk(text) === text, `${units(text)} must survive normalizeToGbk`);
+      pairs++;
+    }
+  }
+  assert(pairs > 21000, `expected every GBK character to round-trip, only ${pairs} pairs mapped`);
+
+  // encodeGbkInto never splits a double-byte character at the limit.
+  const dest = new Uint8Array(8).fill(0xEE);
+  const written = encodeGbkInto('a中文', dest, 1, 5);
+  assert(written === 3 && hex(dest.subarray(0, 5)) === 'ee 61 d6 d0 ee', `encodeGbkInto must stop before a split character, wrote ${hex(dest)}`);
+}
+
+function main() {
+  verifyDecodeMatchesIconv();
+  verifyEncodeMatchesIconv();
+  verifyRoundTrip();
+  console.log('PASS: GBK codec matches iconv-lite for every pair, single byte and BMP code unit.');
+}
+
+main();
@@ -1,4 +1,12 @@
+import fs from 'fs';
+import os from 'os';
+import path from 'path';
 import { VirtualFileSystem } from '../../src/vm/VirtualFileSystem';
+import { HostDirectoryDriver } from '../../src/vm/HostDirectoryDriver';
+import { GbkPathDecoder } from '../../src/vm/VFSPathCache';
+import { LocalStorageDriver, OverlayStorageDriver, VFS_CHUNK_SIZE, VFSManifestEntry } from '../../src/vm/VFSStorageDriver';
+import { decodeBase64, encodeBase64 } from '../../src/vm/Base64Codec';
+import { decodeBody, encodeBody, lzCompress, lzDecompress } from '../../src/vm/VFSCompression';
 
 class MockStorageDriver {
   name = 'mock';
@@ -8,12 +16,78 @@ class MockStorageDriver {
   async remove() {}
 }
 
+class CountingStorageDriver extends MockStorageDriver {
+  stored = new Map<string, Uint8Array>();
+  persistCalls = 0;
+  async persist(path: string, data: Uint8Array) {
+    this.persistCalls++;
+    this.stored.set(path, data.slice());
+  }
+  async persistMany(entries: Array<[string, Uint8Array]>) {
+    this.persistCalls++;
+    for (const [path, data] of entries) {
+      assert(data.byteLength === data.buffer.byteLength, `persisted ${path} must not be a view of a larger buffer`);
+      this.stored.set(path, data.slice());
+    }
+  }
+  async remove(path: string) {
+    this.stored.delete(path);
+  }
+}
+
 function assert(condition: unknown, message: string): asserts condition {
   if (!condition) {
     throw new Error(message);
   }
 }
 
+/** Lazy driver over in-memory files; counts how many chunks were read. */
+class ChunkedStorageDriver extends MockStorageDriver {
+  chunksRead = 0;
+  constructor(private stored: Map<string, Uint8Array>) {
+    super();
+  }
+  async getAll(): Promise<Map<string, Uint8Array>> {
+    throw new Error('lazy VFS must not load every body at startup');
+  }
+  async getManifest(): Promise<VFSManifestEntry[]> {
+    return Array.from(this.stored, ([path, data]) => ({ path, size: data.length, mtime: 0 }));
+  }
+  async readChunks(path: string, first: number, count: number) {
+    const data = this.stored.get(path)!;
+    const chunks: Uint8Array[] = [];
+    for (let i = first; i < first + count; i++) chunks.push(data.slice(i * VFS_CHUNK_SIZE, (i + 1) * VFS_CHUNK_SIZE));
+    this.chunksRead += count;
+    return chunks;
+  }
+}
+
+/** Map-backed stand-in for the browser's localStorage that counts writes and can run out of space. */
+class MemoryLocalStorage {
+  items = new Map<string, string>();
+  writtenChars = 0;
+  /** Total characters of keys and values that fit. */
+  quota = Infinity;
+  get length() { return this.items.size; }
+  key(index: number) { return Array.from(this.items.keys())[index] ?? null; }
+  getItem(key: string) { return this.items.get(key) ?? null; }
+  used() {
+    let chars = 0;
+    for (const [key, value] of this.items) chars += key.length + value.length;
+    return chars;
+  }
+  setItem(key: string, value: string) {
+    const replaced = this.items.has(key) ? key.length + this.items.get(key)!.length : 0;
+    if (this.used() - replaced + key.length + value.length > this.quota) {
+      throw Object.assign(new Error('quota exceeded'), { name: 'QuotaExceededError' });
+    }
+    this.writtenChars += value.length;
+    this.items.set(key, String(value));
+  }
+  removeItem(key: string) { this.items.delete(key); }
+  clear() { this.items.clear(); }
+}
+
 async function createVfs() {
   const vfs = new VirtualFileSystem(new MockStorageDriver() as any);
   await vfs.ready;
@@ -91,11 +165,449 @@ async function verifyChdirAndMissingReadOpen() {
   assert(vfs.openFile('/does-not-exist.bin', 'rb') === 0, 'rb should fail for missing file');
 }
 
+async function verifyWriteBackFlushing() {
+  const driver = new CountingStorageDriver();
+  const vfs = new VirtualFileSystem(driver as any);
+  await vfs.ready;
+
+  // Byte-at-a-time writes stay in memory until the handle is closed.
+  const handle = vfs.openFile('/save.dat', 'w');
+  for (let i = 0; i < 4000; i++) vfs.writeHandleData(handle, new Uint8Array([i & 0xff]), i);
+  await new Promise(resolve => setTimeout(resolve, 0));
+  assert(driver.persistCalls === 0, `handle writes must not persist before a flush, got ${driver.persistCalls}`);
+  vfs.closeFile(handle);
+  await vfs.sync();
+  assert(driver.persistCalls === 1, `fclose must flush dirty files in one batch, got ${driver.persistCalls}`);
+  assert(driver.stored.get('/save.dat')?.length === 4000, 'flushed file must carry every written byte');
+
+  // Unclosed handles are flushed by the write-back timer.
+  vfs.writeBackDelayMs = 5;
+  const log = vfs.openFile('/log.txt', 'w');
+  vfs.writeHandleData(log, new Uint8Array([1, 2]), 0);
+  await new Promise(resolve => setTimeout(resolve, 30));
+  assert(driver.stored.get('/log.txt')?.length === 2, 'write-back timer must flush unclosed handles');
+
+  // A delete after a pending write must win.
+  vfs.writeHandleData(log, new Uint8Array([3]), 2);
+  vfs.deleteFile('/log.txt');
+  await vfs.sync();
+  assert(!driver.stored.has('/log.txt'), 'deleteFile must drop pending writes for the path');
+}
+
+class FlakyStorageDriver extends CountingStorageDriver {
+  failures = 1;
+  async persistMany(entries: Array<[string, Uint8Array]>) {
+    if (this.failures > 0) {
+      this.failures--;
+      throw new Error('quota exceeded');
+    }
+    await super.persistMany(entries);
+  }
+}
+
+async function verifyFailedFlushIsRetried() {
+  const driver = new FlakyStorageDriver();
+  const vfs = new VirtualFileSystem(driver as any);
+  await vfs.ready;
+
+  // A rejected batch keeps its files dirty and surfaces through fclose and sync().
+  const handle = vfs.openFile('/save.dat', 'w');
+  vfs.writeHandleData(handle, new Uint8Array([1, 2, 3]), 0);
+  let closeError: unknown = null;
+  await vfs.closeFile(handle)?.catch(error => { closeError = error; });
+  assert(closeError instanceof Error, 'fclose must see the failed flush');
+  assert(vfs.hasUnsyncedWrites, 'a failed flush must leave its files dirty');
+  let syncError: unknown = null;
+  await vfs.sync().catch(error => { syncError = error; });
+  assert(syncError === null, `the retry must succeed once the driver recovers, got ${syncError}`);
+  assert(driver.stored.get('/save.dat')?.length === 3, 'the retried flush must persist the file');
+  assert(!vfs.hasUnsyncedWrites, 'an accepted flush must clear the dirty state');
+
+  // The write-back timer retries on its own, and sync() rejects while the driver keeps failing.
+  vfs.writeBackDelayMs = 5;
+  driver.failures = 1;
+  const log = vfs.openFile('/log.txt', 'w');
+  vfs.writeHandleData(log, new Uint8Array([4, 5]), 0);
+  await new Promise(resolve => setTimeout(resolve, 40));
+  assert(driver.stored.get('/log.txt')?.length === 2, 'the write-back timer must retry a failed flush');
+
+  driver.failures = 2;
+  vfs.writeHandleData(log, new Uint8Array([6]), 2);
+  let rejected = false;
+  await vfs.sync().catch(() => { rejected = true; });
+  assert(rejected, 'sync() must reject when the driver refuses the batch');
+  await vfs.sync().catch(() => {});
+  await vfs.sync();
+  assert(driver.stored.get('/log.txt')?.length === 3, 'the latest content must persist after recovery');
+}
+
+async function verifyGrowableHandleBuffers() {
+  const driver = new CountingStorageDriver();
+  const vfs = new VirtualFileSystem(driver as any);
+  await vfs.ready;
+
+  const handle = vfs.openFile('/grow.bin', 'w+');
+  for (let i = 0; i < 100; i++) vfs.writeHandleData(handle, new Uint8Array([i]), i);
+  const h = vfs.getHandle(handle)!;
+  assert(h.length === 100 && h.data.length >= 100, 'handle must track logical length separately from capacity');
+  const capacity = h.data.length;
+  vfs.writeHandleData(handle, new Uint8Array([1]), 100);
+  assert(h.data.length === capacity || h.data.length === capacity * 2, 'growth must double the capacity');
+
+  const snapshot = vfs.getFile('/grow.bin');
+  assert(snapshot?.length === 101 && snapshot[99] === 99, 'getFile must return the trimmed contents of an open file');
+  assert(vfs.getFiles().find(f => f.path === '/grow.bin')?.size === 101, 'getFiles must report the logical size');
+
+  // A second handle sees the written bytes and nothing past them.
+  const reader = vfs.openFile('/grow.bin', 'rb');
+  assert(vfs.getHandle(reader)?.length === 101, 'reopening must see the logical length');
+
+  vfs.closeFile(handle);
+  await vfs.sync();
+  assert(driver.stored.get('/grow.bin')?.length === 101, 'persisted file must be trimmed to its logical length');
+}
+
+async function verifyDirectoryTreeIndex() {
+  const vfs = await createVfs();
+  vfs.addFile('/games/zeta.lav', new Uint8Array([1]));
+  vfs.addFile('/games/alpha.lav', new Uint8Array([2]));
+  vfs.addFile('/games/saves/slot1.dat', new Uint8Array([3]));
+  vfs.mkdir('/games/empty');
+
+  const listing = vfs.listDir('/games');
+  assert(listing.join(',') === 'alpha.lav,empty,saves,zeta.lav', `listDir must return sorted direct children, got ${listing}`);
+  assert(vfs.listDir('/missing').length === 0, 'listDir of a missing directory must be empty');
+
+  // Files created through handles appear in their directory immediately.
+  const handle = vfs.openFile('/games/saves/slot2.dat', 'w');
+  vfs.closeFile(handle);
+  assert(vfs.listDir('/games/saves').join(',') === 'slot1.dat,slot2.dat', 'openFile must index newly created files');
+
+  vfs.deleteFile('/games/zeta.lav');
+  vfs.deleteFile('/games/empty/');
+  assert(vfs.listDir('/games').join(',') === 'alpha.lav,saves', 'deleteFile must unindex files and directory markers');
+  assert(!vfs.chdir('/games/empty'), 'chdir must fail once the directory is deleted');
+  assert(vfs.chdir('/games/saves') && vfs.cwd === '/games/saves', 'chdir must enter indexed directories');
+}
+
+async function verifyPathCacheFollowsCwdAndDeletes() {
+  const vfs = await createVfs();
+  vfs.addFile('/a/data.bin', new Uint8Array([1]));
+  vfs.addFile('/b/data.bin', new Uint8Array([2]));
+
+  vfs.chdir('/a');
+  assert(vfs.getFile('data.bin')?.[0] === 1, 'relative path must resolve against /a');
+  vfs.chdir('/b');
+  assert(vfs.getFile('data.bin')?.[0] === 2, 'cached resolution must not leak across chdir');
+  vfs.chdir('/a');
+  assert(vfs.getFile('data.bin')?.[0] === 1, 'returning to a directory must resolve against it again');
+
+  vfs.deleteFile('data.bin');
+  assert(vfs.getFile('data.bin') === undefined, 'deleted file must not be reachable through a cached path');
+  assert(vfs.openFile('data.bin', 'rb') === 0, 'fopen of a deleted file must fail');
+  vfs.addFile('data.bin', new Uint8Array([3]));
+  assert(vfs.getFile('/a/data.bin')?.[0] === 3, 'recreated file must be found under the cached path');
+
+  const decoder = new GbkPathDecoder(2);
+  const gbkName = new Uint8Array([0x2f, 0xc9, 0xf1, 0xd6, 0xdd, 0x2e, 0x6c, 0x61, 0x76]); // "/神州.lav"
+  assert(decoder.decode(gbkName) === '/神州.lav' && decoder.decode(gbkName) === '/神州.lav', 'GBK path decode cache must be stable');
+  gbkName[1] = 0x41;
+  assert(decoder.decode(gbkName).startsWith('/A'), 'decode cache must key on the bytes, not the buffer');
+}
+
+async function verifyLocalStoragePerFileLayout() {
+  for (let len = 0; len < 70; len++) {
+    const bytes = Uint8Array.from({ length: len }, (_, i) => (i * 73 + len) & 0xff);
+    const encoded = encodeBase64(bytes);
+    assert(encoded === Buffer.from(bytes).toString('base64'), `base64 encoding of ${len} bytes must match the standard alphabet`);
+    assert(Buffer.from(decodeBase64(encoded)).equals(Buffer.from(bytes)), `base64 round trip of ${len} bytes must be lossless`);
+  }
+
+  const storage = new MemoryLocalStorage();
+  const previous = (globalThis as any).localStorage;
+  (globalThis as any).localStorage = storage;
+  try {
+    // A v2 single-blob store is split into per-file keys on first load.
+    storage.setItem('lavax_vfs_v2', JSON.stringify({ '/old.dat': encodeBase64(new Uint8Array([7, 8, 9])) }));
+    const driver = new LocalStorageDriver();
+    const loaded = await driver.getAll();
+    assert(loaded.get('/old.dat')?.join(',') === '7,8,9', 'legacy v2 files must survive migration');
+    assert(storage.getItem('lavax_vfs_v2') === null, 'legacy blob must be dropped after migration');
+
+    const big = new Uint8Array(20000).fill(0x41);
+    await driver.persistMany([['/big.bin', big], ['/small.bin', new Uint8Array([1])]]);
+    storage.writtenChars = 0;
+    await driver.persist('/small.bin', new Uint8Array([2, 3]));
+    assert(storage.writtenChars === 4, `rewriting an existing small file must touch only its key (wrote ${storage.writtenChars} chars)`);
+
+    await driver.remove('/old.dat');
+    const reloaded = await new LocalStorageDriver().getAll();
+    assert(reloaded.size === 2 && !reloaded.has('/old.dat'), 'manifest must track adds and removes');
+    assert(reloaded.get('/small.bin')?.join(',') === '2,3' && reloaded.get('/big.bin')?.length === big.length, 'per-file values must round trip');
+  } finally {
+    (globalThis as any).localStorage = previous;
+  }
+}
+
+async function verifyLocalStorageMigrationOverQuota() {
+  const storage = new MemoryLocalStorage();
+  const previous = (globalThis as any).localStorage;
+  (globalThis as any).localStorage = storage;
+  try {
+    const files: Record<string, string> = {};
+    for (let i = 0; i < 8; i++) files[`/f${i}.dat`] = encodeBase64(new Uint8Array(3000).fill(i));
+    const blob = JSON.stringify(files);
+    storage.setItem('lavax_vfs_v2', blob);
+
+    // Room for the blob but not for the blob plus per-file keys, nor (with
+    // per-key overhead) for every per-file key: migration fails midway.
+    storage.quota = storage.used() + 20;
+    const driver = new LocalStorageDriver();
+    const loaded = await driver.getAll();
+    assert(loaded.size === 8 && loaded.get('/f5.dat')?.[0] === 5, 'a failed migration must keep serving the v2 store');
+    assert(storage.getItem('lavax_vfs_v2') === blob, 'a failed migration must leave the v2 blob in place');
+    assert(storage.items.size === 1, `a failed migration must roll back its keys, left ${Array.from(storage.items.keys())}`);
+
+    // Writes after the failure must not save a partial manifest over the blob.
+    await driver.persist('/new.dat', new Uint8Array([1]));
+    assert(storage.getItem('lavax_vfs_v3:manifest') === null, 'no manifest may be saved while migration has not succeeded');
+
+    // With room, the next load migrates everything.
+    storage.quota = Infinity;
+    const migrated = await new LocalStorageDriver().getAll();
+    assert(migrated.size === 8 && migrated.get('/f7.dat')?.[2999] === 7, 'migration must be retried and complete once there is room');
+    assert(storage.getItem('lavax_vfs_v2') === null, 'legacy blob must be dropped after migration');
+  } finally {
+    (globalThis as any).localStorage = previous;
+  }
+}
+
+async function verifyLazyChunkedLoading() {
+  const source = Uint8Array.from({ length: 200 * 1024 }, (_, i) => (i * 7 + (i >> 10)) & 0xff);
+  const driver = new ChunkedStorageDriver(new Map([
+    ['/GameSource.dat', source],
+    ['/LavaData/', new Uint8Array(0)],
+  ]));
+  const vfs = new VirtualFileSystem(driver as any, { prefetch: false });
+  await vfs.ready;
+  assert(driver.chunksRead === 0, 'startup must read only the manifest');
+  assert(vfs.getFiles().some(f => f.path === '/GameSource.dat' && f.size === source.length), 'manifest sizes must be listed before bodies load');
+  assert(vfs.listDir('/').join(',') === 'GameSource.dat,LavaData', 'manifest paths must be indexed as directories and files');
+
+  const handle = vfs.openFile('/GameSource.dat', 'rb');
+  const h = vfs.getHandle(handle)!;
+  h.pos = 100000;
+  const pending = vfs.whenLoaded(handle, h.pos, 100);
+  assert(pending !== null, 'reading an unloaded chunk must wait');
+  await pending;
+  assert(driver.chunksRead === 1, `fseek+fread must read only the chunk it touches, read ${driver.chunksRead}`);
+  assert(vfs.whenLoaded(handle, h.pos, 100) === null, 'a resident range must not wait');
+  assert(h.data.subarray(100000, 100100).every((b, i) => b === source[100000 + i]), 'loaded chunk must hold the stored bytes');
+
+  assert(vfs.getFile('/GameSource.dat') === undefined, 'getFile must not expose a partially loaded body');
+  const whole = await vfs.readFile('/GameSource.dat');
+  assert(whole !== undefined && whole.every((b, i) => b === source[i]), 'readFile must return the full stored body');
+  assert(driver.chunksRead === Math.ceil(source.length / VFS_CHUNK_SIZE), `each chunk must be read once, read ${driver.chunksRead}`);
+  assert(vfs.getFile('/GameSource.dat') === whole, 'a fully loaded file must be served synchronously');
+
+  const writer = vfs.openFile('/GameSource.dat', 'rb+');
+  assert(vfs.whenLoaded(writer, 0, source.length) === null, 'handles on resident files must not wait');
+  vfs.writeHandleData(writer, new Uint8Array([1, 2]), 0);
+  vfs.closeFile(writer);
+  assert(vfs.getFile('/GameSource.dat')?.[1] === 2, 'writes after loading must land in the file');
+
+  const prefetching = new VirtualFileSystem(new ChunkedStorageDriver(new Map([['/a.bin', source]])) as any);
+  await prefetching.loaded;
+  assert(prefetching.getFile('/a.bin')?.[12345] === source[12345], 'background prefetch must make bodies available synchronously');
+}
+
+async function verifyOverlayDeltaAndChangeLog() {
+  const base = new Map<string, Uint8Array>([
+    ['/LavaData/', new Uint8Array(0)],
+    ['/LavaData/save.dat', new Uint8Array([1, 2, 3])],
+    ['/LavaData/old.dat', new Uint8Array([4])],
+    ['/game.lav', new Uint8Array(1000)],
+  ]);
+  const driver = new OverlayStorageDriver(base);
+  const vfs = new VirtualFileSystem(driver);
+  await vfs.ready;
+  assert(vfs.getFile('/game.lav') === base.get('/game.lav'), 'overlay must hand the base bodies to the VFS without copying');
+
+  const start = vfs.markChangeGeneration();
+  const fp = vfs.openFile('/LavaData/save.dat', 'rb+');
+  vfs.writeHandleData(fp, new Uint8Array([9]), 0);
+  vfs.closeFile(fp);
+  vfs.deleteFile('/LavaData/old.dat');
+  vfs.addFile('/LavaData/new.dat', new Uint8Array([7]));
+  await vfs.sync();
+
+  const delta = driver.takeDelta();
+  const written = delta.files.map(([path]) => path).sort().join(',');
+  assert(written === '/LavaData/new.dat,/LavaData/save.dat', `delta must hold only written paths, got ${written}`);
+  assert(delta.deletedPaths.join(',') === '/LavaData/old.dat', 'delta must list deleted base paths');
+  assert(base.size === 4 && base.has('/LavaData/old.dat'), 'the base map must not change');
+  assert(driver.takeDelta().files.length === 0, 'takeDelta must clear the delta');
+
+  const changes = vfs.changesSince(start);
+  assert(changes.changed.sort().join(',') === '/LavaData/new.dat,/LavaData/save.dat', `change log must list modified paths, got ${changes.changed}`);
+  assert(changes.deleted.join(',') === '/LavaData/old.dat', 'change log must list deleted paths');
+  assert(vfs.changesSince(vfs.markChangeGeneration()).changed.length === 0, 'no changes after the current generation');
+}
+
+async function verifyOverlayRemoteFiles() {
+  // A worker run's view: one body already shipped, one still on the main thread.
+  const remoteBody = Uint8Array.from({ length: VFS_CHUNK_SIZE + 10 }, (_, i) => i & 0xff);
+  const reads: string[] = [];
+  const base = new Map<string, Uint8Array>([['/game.lav', new Uint8Array([1, 2])]]);
+  const driver = new OverlayStorageDriver(base, {
+    sizes: new Map([['/LavaData/big.dat', remoteBody.length], ['/LavaData/gone.dat', 4]]),
+    async readChunks(path, first, count) {
+      reads.push(`${path}:${first}+${count}`);
+      // The main thread's copy has grown by now.
+      const grown = new Uint8Array(remoteBody.length + 100);
+      grown.set(remoteBody);
+      return Array.from({ length: count }, (_, k) => grown.slice((first + k) * VFS_CHUNK_SIZE, (first + k + 1) * VFS_CHUNK_SIZE));
+    },
+  });
+  const vfs = new VirtualFileSystem(driver, { prefetch: false });
+  await vfs.ready;
+  assert(reads.length === 0, 'listing remote files must not read them');
+  assert(vfs.getFile('/game.lav') === base.get('/game.lav'), 'base bodies must still be adopted without copying');
+  assert(vfs.peekFile('/LavaData/big.dat') === undefined && reads.length === 0, 'peekFile must not start a read');
+  assert(vfs.getFiles().find(f => f.path === '/LavaData/big.dat')?.size === remoteBody.length, 'remote files must be listed with their size');
+
+  const fp = vfs.openFile('/LavaData/big.dat', 'rb');
+  await vfs.whenLoaded(fp, VFS_CHUNK_SIZE, 4);
+  assert(reads.join() === '/LavaData/big.dat:1+1', `only the chunk read must be fetched, got ${reads}`);
+  vfs.closeFile(fp);
+  const data = await vfs.readFile('/LavaData/big.dat');
+  assert(data && data.length === remoteBody.length && data.every((b, i) => b === remoteBody[i]), 'remote body must read back at its listed size');
+
+  vfs.deleteFile('/LavaData/gone.dat');
+  await vfs.sync();
+  assert(driver.takeDelta().deletedPaths.join() === '/LavaData/gone.dat', 'deleting a remote file must reach the delta');
+}
+
+async function verifyHostDirectoryDriver() {
+  const root = fs.mkdtempSync(path.join(os.tmpdir(), 'lavax-vfs-'));
+  try {
+    const source = Uint8Array.from({ length: 50000 }, (_, i) => (i * 13) & 0xff);
+    fs.mkdirSync(path.join(root, 'LavaData'));
+    fs.writeFileSync(path.join(root, 'LavaData', 'GameSource.dat'), source);
+
+    const readOnly = new VirtualFileSystem(new HostDirectoryDriver(root, { readOnly: true }), { prefetch: false });
+    await readOnly.ready;
+    assert(readOnly.listDir('/LavaData').join(',') === 'GameSource.dat', 'host directory must be listed at startup');
+    const fp = readOnly.openFile('/LavaData/GameSource.dat', 'rb');
+    await readOnly.whenLoaded(fp, 40000, 16);
+    assert(readOnly.getHandle(fp)!.data[40001] === source[40001], 'chunk reads must come from the host file');
+    readOnly.addFile('/LavaData/save.dat', new Uint8Array([1]));
+    await readOnly.sync();
+    assert(!fs.existsSync(path.join(root, 'LavaData', 'save.dat')), 'a read-only mount must not write to disk');
+
+    const writable = new VirtualFileSystem(new HostDirectoryDriver(root), { prefetch: false });
+    await writable.ready;
+    const out = writable.openFile('/LavaData/new/save.dat', 'w');
+    writable.writeHandleData(out, new Uint8Array([5, 6, 7]), 0);
+    writable.closeFile(out);
+    await writable.sync();
+    assert(fs.readFileSync(path.join(root, 'LavaData', 'new', 'save.dat')).join(',') === '5,6,7', 'flushed writes must reach the host file');
+    writable.deleteFile('/LavaData/new/save.dat');
+    await writable.sync();
+    assert(!fs.existsSync(path.join(root, 'LavaData', 'new', 'save.dat')), 'deletes must reach the host directory');
+    assert((await writable.readFile('/LavaData/GameSource.dat'))?.every((b, i) => b === source[i]), 'readFile must return the whole host file');
+  } finally {
+    fs.rmSync(root, { recursive: true, force: true });
+  }
+}
+
+async function verifyMappedBodiesAreCopiedOnWrite() {
+  const root = fs.mkdtempSync(path.join(os.tmpdir(), 'lavax-vfs-'));
+  const bun = (globalThis as any).Bun;
+  const mapped: Uint8Array[] = [];
+  // Stand-in for Bun.mmap: a view the VFS must read in place and never write.
+  (globalThis as any).Bun = { mmap: (file: string) => { const view = new Uint8Array(fs.readFileSync(file)); mapped.push(view); return view; } };
+  try {
+    const source = Uint8Array.from({ length: 50000 }, (_, i) => (i * 7) & 0xff);
+    fs.writeFileSync(path.join(root, 'map.dat'), source);
+    const vfs = new VirtualFileSystem(new HostDirectoryDriver(root), { prefetch: false });
+    await vfs.ready;
+    const body = vfs.getFile('/map.dat');
+    assert(mapped.length === 1 && body === mapped[0], 'getFile must return the mapping itself, not a copy');
+
+    const fp = vfs.openFile('/map.dat', 'r+');
+    assert(vfs.whenLoaded(fp, 0, 50000) === null, 'a mapped file must be resident at once');
+    vfs.writeHandleData(fp, new Uint8Array([1, 2]), 100);
+    assert(mapped[0][100] === source[100], 'a write must not reach the mapping');
+    const reader = vfs.openFile('/map.dat', 'rb');
+    assert(vfs.getHandle(reader)!.data[100] === 1, 'the copy must carry the write');
+    vfs.closeFile(fp);
+    await vfs.sync();
+    assert(fs.readFileSync(path.join(root, 'map.dat'))[101] === 2, 'the copy must reach the host file');
+    assert(fs.readdirSync(root).join(',') === 'map.dat', 'a rewrite must not leave temporary files');
+
+    // Manifest bodies (the worker's base files) are lent the same way.
+    const base = new Map([['/base.dat', new Uint8Array([9, 9, 9])]]);
+    const overlay = new VirtualFileSystem(new OverlayStorageDriver(base), { prefetch: false });
+    await overlay.ready;
+    const bp = overlay.openFile('/base.dat', 'r+');
+    overlay.writeHandleData(bp, new Uint8Array([1]), 0);
+    assert(base.get('/base.dat')![0] === 9, 'a write must not change the overlay base in place');
+  } finally {
+    (globalThis as any).Bun = bun;
+    fs.rmSync(root, { recursive: true, force: true });
+  }
+}
+
+async function verifyCompressionCodecs() {
+  const text = new TextEncoder().encode('int main() { printf("hello %d\\n", 42); }\n'.repeat(400));
+  let seed = 0x2545F491;
+  const noise = Uint8Array.from({ length: 64 * 1024 }, () => {
+    seed ^= seed << 13; seed ^= seed >>> 17; seed ^= seed << 5;
+    return seed & 0xff;
+  });
+  const runs = new Uint8Array(70000).fill(0x55);
+  for (const sample of [new Uint8Array(0), new Uint8Array([1, 2, 3]), text, noise, runs, noise.subarray(0, 20000)]) {
+    const packed = lzCompress(sample);
+    assert(Buffer.from(lzDecompress(packed, sample.length)).equals(Buffer.from(sample)), `lz round trip of ${sample.length} bytes must be lossless`);
+  }
+  assert(lzCompress(runs).length < 400, 'lz must encode long runs as overlapping matches');
+
+  for (const codec of ['lz', 'deflate-raw'] as const) {
+    const encoded = await encodeBody(text, { codec });
+    assert(encoded.codec === codec && encoded.bytes.length < text.length / 4, `${codec} must compress repetitive source`);
+    assert(Buffer.from(await decodeBody(encoded.codec, encoded.bytes, text.length)).equals(Buffer.from(text)), `${codec} body must decode`);
+    assert((await encodeBody(noise, { codec })).codec === undefined, `${codec}: incompressible bodies must be stored raw`);
+  }
+  assert((await encodeBody(text.subarray(0, 1000))).codec === undefined, 'bodies under minSize must be stored raw');
+
+  let rejected = false;
+  try {
+    await decodeBody('lz', lzCompress(text), text.length + 1);
+  } catch {
+    rejected = true;
+  }
+  assert(rejected, 'a body decoding to the wrong size must be rejected');
+}
+
 async function main() {
   await verifyPathNormalization();
   await verifyDirectoryMarkersAndEnumeration();
   await verifyOpenWriteAppendAndTruncate();
   await verifyChdirAndMissingReadOpen();
+  await verifyWriteBackFlushing();
+  await verifyFailedFlushIsRetried();
+  await verifyGrowableHandleBuffers();
+  await verifyDirectoryTreeIndex();
+  await verifyPathCacheFollowsCwdAndDeletes();
+  await verifyLocalStoragePerFileLayout();
+  await verifyLocalStorageMigrationOverQuota();
+  await verifyLazyChunkedLoading();
+  await verifyOverlayDeltaAndChangeLog();
+  await verifyOverlayRemoteFiles();
+  await verifyHostDirectoryDriver();
+  await verifyMappedBodiesAreCopiedOnWrite();
+  await verifyCompressionCodecs();
   console.log('PASS: VFS path, directory, and file lifecycle behaviour verified.');
 }
 
@@ -1,5 +1,6 @@
 import { LavaXVM } from '../../src/vm';
-import { Op, SystemOp } from '../../src/types';
+import { MEMORY_SIZE, Op, SystemCoreOp, SystemOp } from '../../src/types';
+import { VFS_CHUNK_SIZE } from '../../src/vm/VFSStorageDriver';
 
 function assert(condition: boolean, message: string) {
   if (!condition) {
@@ -121,6 +122,19 @@ function testDelayTickRounding() {
   assert(vm.sp === 0, `Delay(1) should consume its argument when it does not actually wait, sp=${vm.sp}`);
 }
 
+function testDelaySleepsOnVirtualClock() {
+  const vm = new LavaXVM();
+  vm.clock.configure({ source: 'virtual' });
+  const start = vm.clock.now();
+  vm.push(50);
+  const result = vm.syscall.handleSync(SystemOp.Delay);
+  assert(result === null && vm.sp === 0, 'Delay must consume its argument and complete as a scheduler sleep');
+  assert(vm.clock.isSleeping, 'Delay(50) must leave a pending sleep for the run loop');
+  assert(vm.clock.pendingSleepMs() === 0 && !vm.clock.isSleeping, 'virtual clock must finish sleeps without host waits');
+  const expected = Math.ceil((12 * 1000) / 256); // 50 ms -> 12 ticks at 256 Hz
+  assert(Math.abs(vm.clock.now() - start - expected) < 1e-9, `virtual clock must advance by whole ticks, got ${vm.clock.now() - start}`);
+}
+
 function testOfficialFileHandleRange() {
   const vm = new LavaXVM();
   vm.memory.set([0x2f, 0x74, 0x6d, 0x70, 0, 0x77, 0x2b, 0, 0], 0x2000); // "/tmp", "w+"
@@ -141,6 +155,71 @@ function testOfficialFileHandleRange() {
   assert(fp3 === 0x82, `third fopen handle must be 0x82, got ${fp3}`);
 }
 
+function testPutcGetcThroughHandleSlots() {
+  const vm = new LavaXVM();
+  vm.memory.set([0x2f, 0x6f, 0x75, 0x74, 0, 0x77, 0x2b, 0], 0x2000); // "/out", "w+"
+  const open = () => { vm.push(0x2000); vm.push(0x2005); return vm.syscall.handleSync(SystemOp.fopen) as number; };
+  const putc = (ch: number, fp: number) => { vm.push(ch); vm.push(fp); return vm.syscall.handleSync(SystemOp.putc); };
+  const getc = (fp: number) => { vm.push(fp); return vm.syscall.handleSync(SystemOp.getc); };
+
+  const fp = open();
+  assert(putc(0x141, fp) === 0x141, 'putc must return its argument');
+  for (let i = 1; i < 200; i++) putc(i, fp);
+  const generation = vm.vfs.markChangeGeneration();
+  putc(7, fp);
+  assert(vm.vfs.changesSince(generation).changed.includes('/out'), 'a putc after markChangeGeneration must be logged');
+  vm.push(fp);
+  vm.syscall.handleSync(SystemOp.rewind);
+  assert(getc(fp) === 0x41, 'putc must store the low byte');
+  for (let i = 1; i < 200; i++) assert(getc(fp) === i, `getc must read back byte ${i}`);
+  assert(getc(fp) === 7 && getc(fp) === -1, 'getc must stop at end of file');
+  assert(vm.vfs.getFile('/out')?.length === 201, 'putc must extend the file');
+
+  open();
+  open();
+  assert(open() === 0, 'a fourth fopen must fail while 0x80..0x82 are open');
+  vm.push(0x81);
+  vm.syscall.handleSync(SystemOp.fclose);
+  assert(getc(0x81) === -1 && putc(1, 0x81) === -1, 'a closed handle must not read or write');
+  assert(getc(0x7f) === -1 && getc(0x83) === -1, 'handles outside 0x80..0x82 must not resolve');
+  assert(open() === 0x81, 'fclose must free its slot for the next fopen');
+}
+
+async function testFileReadsWaitForLazyChunks() {
+  const body = Uint8Array.from({ length: 64 * 1024 }, (_, i) => i & 0xff);
+  let reads = 0;
+  const vm = new LavaXVM({
+    name: 'lazy',
+    ready: Promise.resolve(),
+    getAll: async () => new Map(),
+    persist: async () => { },
+    remove: async () => { },
+    getManifest: async () => [{ path: '/big.dat', size: body.length, mtime: 0 }],
+    readChunks: async (_path: string, first: number, count: number) => {
+      reads++;
+      return Array.from({ length: count }, (_, k) => body.slice((first + k) * VFS_CHUNK_SIZE, (first + k + 1) * VFS_CHUNK_SIZE));
+    },
+  });
+  await vm.vfs.ready;
+  let woken = 0;
+  vm.wakeUp = () => { woken++; };
+  vm.memory.set([0x2f, 0x62, 0x69, 0x67, 0x2e, 0x64, 0x61, 0x74, 0, 0x72, 0x62, 0], 0x2000); // "/big.dat", "rb"
+  vm.push(0x2000); vm.push(0x2009);
+  const fp = vm.syscall.handleSync(SystemOp.fopen) as number;
+  vm.push(fp); vm.push(40000); vm.push(0);
+  vm.syscall.handleSync(SystemOp.fseek);
+  vm.sp = 0;
+
+  vm.push(0x3000); vm.push(1); vm.push(8); vm.push(fp);
+  assert(vm.syscall.handleSync(SystemOp.fread) === undefined, 'fread of an unloaded chunk must yield');
+  assert(vm.sp === 4, `a yielding fread must leave its arguments on the stack, sp=${vm.sp}`);
+  await vm.vfs.whenLoaded(1, 40000, 8);
+  await Promise.resolve();
+  assert(woken === 1 && reads === 1, `chunk arrival must wake the VM after one read (woken=${woken}, reads=${reads})`);
+  assert(vm.syscall.handleSync(SystemOp.fread) === 8, 'fread must complete once its chunk is loaded');
+  assert(vm.memory.subarray(0x3000, 0x3008).every((b, i) => b === ((40000 + i) & 0xff)), 'fread must copy the stored bytes');
+}
+
 function testPaletteOrderAndColorMasking() {
   const vm = new LavaXVM();
   vm.graphics.graphMode = 8;
@@ -172,6 +251,94 @@ function testTrigLookupTable() {
   assert(vm.syscall.handleSync(SystemOp.Cos) === -1024, 'Cos(180) must equal -1024');
 }
 
+function testCtypeByteSemantics() {
+  const vm = new LavaXVM();
+  const call = (op: SystemOp, c: number) => {
+    vm.push(c);
+    return vm.syscall.handleSync(op);
+  };
+
+  assert(call(SystemOp.isalpha, 0x41) === -1 && call(SystemOp.isalpha, 0x7a) === -1, 'isalpha must accept ASCII letters');
+  assert(call(SystemOp.isxdigit, 0x46) === -1 && call(SystemOp.isxdigit, 0x47) === 0, 'isxdigit must accept only 0-9a-fA-F');
+  assert(call(SystemOp.isspace, 0x0b) === -1 && call(SystemOp.isspace, 0xa0) === 0, 'isspace must follow C-locale whitespace');
+  assert(call(SystemOp.ispunct, 0x7e) === -1 && call(SystemOp.ispunct, 0x20) === 0, 'ispunct must cover ASCII punctuation only');
+  assert(call(SystemOp.isalnum, 0x141) === -1, 'ctype syscalls must classify the low byte of their char argument');
+
+  // GBK lead/trail bytes are never classified or case-mapped.
+  for (let c = 0x80; c <= 0xff; c++) {
+    for (const op of [SystemOp.isalnum, SystemOp.isalpha, SystemOp.isprint, SystemOp.ispunct, SystemOp.isspace, SystemOp.iscntrl]) {
+      assert(call(op, c) === 0, `${SystemOp[op]}(0x${c.toString(16)}) must be false for high bytes`);
+    }
+    assert(call(SystemOp.tolower, c) === c && call(SystemOp.toupper, c) === c, `case mapping must leave 0x${c.toString(16)} unchanged`);
+  }
+  assert(call(SystemOp.tolower, 0x41) === 0x61 && call(SystemOp.toupper, 0x7a) === 0x5a, 'ASCII case mapping drifted');
+  assert(vm.sp === 0, `ctype syscalls must consume exactly one argument, sp=${vm.sp}`);
+}
+
+function testStringKernelBounds() {
+  const vm = new LavaXVM();
+  const call = (op: SystemOp, ...args: number[]) => {
+    for (const a of args) vm.push(a);
+    return vm.syscall.handleSync(op);
+  };
+  const put = (addr: number, text: string) => {
+    for (let i = 0; i < text.length; i++) vm.memory[addr + i] = text.charCodeAt(i);
+    vm.memory[addr + text.length] = 0;
+  };
+
+  // Word-at-a-time NUL scan must agree with a byte scan at every alignment.
+  for (let offset = 0; offset < 8; offset++) {
+    for (let len = 0; len < 12; len++) {
+      vm.memory.fill(0x41, 0x2000, 0x2040);
+      vm.memory[0x2000 + offset + len] = 0;
+      assert(call(SystemOp.strlen, 0x2000 + offset) === len, `strlen drifted at offset ${offset}, len ${len}`);
+    }
+  }
+
+  put(0x3000, 'hello');
+  put(0x3100, ', world');
+  call(SystemOp.strcat, 0x3000, 0x3100);
+  call(SystemOp.strcpy, 0x3200, 0x3000);
+  assert(call(SystemOp.strcmp, 0x3200, 0x3000) === 0 && call(SystemOp.strlen, 0x3200) === 12, 'strcat/strcpy must produce a terminated copy');
+  assert(call(SystemOp.strchr, 0x3000, 0x77) === 0x3007 && call(SystemOp.strchr, 0x3000, 0x7a) === 0, 'strchr must stop at the terminator');
+  assert(call(SystemOp.strstr, 0x3000, 0x3100) === 0x3005, 'strstr must return the match address');
+
+  // Overlapping copies behave like memmove; counts past the end of memory are clamped.
+  put(0x4000, 'abcdef');
+  call(SystemOp.memcpy, 0x4002, 0x4000, 4);
+  assert(String.fromCharCode(...vm.memory.subarray(0x4000, 0x4006)) === 'ababcd', 'memcpy must be overlap-safe');
+  call(SystemOp.memset, 0x4000, 0x17a, 2);
+  assert(vm.memory[0x4000] === 0x7a && vm.memory[0x4001] === 0x7a, 'memset must store the low byte');
+  call(SystemOp.memset, 0xfff0, 0x55, 0x7fffffff);
+  assert(vm.memory[MEMORY_SIZE - 1] === 0x55, 'memset must clamp to the end of memory');
+  call(SystemOp.memmove, 0x8000, 0xfff0, MEMORY_SIZE);
+  assert(vm.sp === 0, `string syscalls must consume their arguments, sp=${vm.sp}`);
+}
+
+function testChecksums() {
+  const vm = new LavaXVM();
+  const check = '123456789';
+  for (let i = 0; i < check.length; i++) vm.memory[0x3001 + i] = check.charCodeAt(i);
+
+  vm.push(0x3001); vm.push(check.length);
+  assert(vm.syscall.handleSync(SystemOp.Crc16) === 0x4b37, 'Crc16 must be CRC-16/MODBUS (0xA001 reflected, init 0xFFFF)');
+  vm.push(0x3001); vm.push(check.length); vm.push(SystemCoreOp.Crc32);
+  assert(vm.syscall.handleSync(SystemOp.System) === (0xcbf43926 | 0), 'System Crc32 must match zlib crc32');
+
+  // Table-driven result must match the bitwise reference on odd lengths and offsets.
+  for (let i = 0; i < 64; i++) vm.memory[0x4000 + i] = (i * 37 + 11) & 0xff;
+  for (let len = 0; len < 13; len++) {
+    let crc = 0xffff;
+    for (let i = 0; i < len; i++) {
+      crc ^= vm.memory[0x4003 + i];
+      for (let j = 0; j < 8; j++) crc = (crc & 1) ? (crc >>> 1) ^ 0xa001 : crc >>> 1;
+    }
+    vm.push(0x4003); vm.push(len);
+    assert(vm.syscall.handleSync(SystemOp.Crc16) === crc, `Crc16 drifted for length ${len}`);
+  }
+  assert(vm.sp === 0, `checksum syscalls must consume their arguments, sp=${vm.sp}`);
+}
+
 async function main() {
   await testShiftSemantics();
   testRandSeed();
@@ -179,9 +346,15 @@ async function main() {
   testCheckKeyAndReleaseKey();
   testHeldKeyDedupAndGetWord();
   testDelayTickRounding();
+  testDelaySleepsOnVirtualClock();
   testOfficialFileHandleRange();
+  testPutcGetcThroughHandleSlots();
+  await testFileReadsWaitForLazyChunks();
   testPaletteOrderAndColorMasking();
   testTrigLookupTable();
+  testCtypeByteSemantics();
+  testStringKernelBounds();
+  testChecksums();
   console.log('PASS: VM official-C compatibility regressions verified.');
 }
 
@@ -1,9 +1,11 @@
+import { LavaXCompiler } from '../../src/compiler';
 import { Op, SystemOp } from '../../src/types';
 import {
   assert,
   createDiagnosticVm,
   makeProgram,
   runVmBounded,
+  sleep,
 } from './vm_diagnostic_utils';
 
 function requireContract(vm: ReturnType<typeof createDiagnosticVm>) {
@@ -45,6 +47,24 @@ async function verifyWatchdogPause() {
   assert(immutableCopy.reason !== 'mutated-by-test', 'pause snapshot returned to diagnostics must be immutable/copy-safe');
 }
 
+async function verifyPauseSnapshotNamesSourceLine() {
+  const vm = createDiagnosticVm();
+  const source = 'void main() {\n  int i;\n  i = 0;\n  while (1) {\n    i++;\n  }\n}\n';
+  const compiled = new LavaXCompiler().compileToLav(source, 'spin.c', { lineMap: true });
+  assert(compiled.lav && compiled.lineMap, `compile failed: ${compiled.error}`);
+
+  await vm.vfs.ready;
+  vm.load(compiled.lav, compiled.lineMap);
+  const running = vm.run();
+  await sleep(30);
+  const snapshot = vm.pause('line map check');
+  vm.stop();
+  await running;
+
+  assert(snapshot?.source?.file === 'spin.c', `pause snapshot must name the source file, got ${JSON.stringify(snapshot?.source)}`);
+  assert(snapshot.source.line >= 4 && snapshot.source.line <= 5, `paused inside the loop, got line ${snapshot.source.line}`);
+}
+
 async function verifyBusySlicesYieldViaAnimationFrameWhenAvailable() {
   const vm = createDiagnosticVm();
   requireContract(vm);
@@ -126,6 +146,7 @@ async function verifyEmptyInkeyPollingRequestsHostYield() {
 }
 
 async function main() {
+  await verifyPauseSnapshotNamesSourceLine();
   await verifyWatchdogPause();
   await verifyBusySlicesYieldViaAnimationFrameWhenAvailable();
   await verifyWaitingDoesNotFalsePause();
@@ -3,6 +3,7 @@ import path from 'path';
 
 import { LavaXVM } from '../../src/vm';
 import { LocalStorageDriver } from '../../src/vm/VFSStorageDriver';
+import { HostDirectoryDriver } from '../../src/vm/HostDirectoryDriver';
 import { SystemOp } from '../../src/types';
 
 export function assert(condition: unknown, message: string): asserts condition {
@@ -72,8 +73,17 @@ function tryReadFont(vm: LavaXVM) {
   }
 }
 
-export function createDiagnosticVm() {
-  const vm = new LavaXVM(new LocalStorageDriver());
+export interface DiagnosticVmOptions {
+  /** Mount this host directory as the VFS root instead of an empty store. */
+  vfsRoot?: string;
+  /** Let the program write into `vfsRoot` (read-only by default). */
+  vfsWritable?: boolean;
+}
+
+export function createDiagnosticVm(options: DiagnosticVmOptions = {}) {
+  const vm = options.vfsRoot
+    ? new LavaXVM(new HostDirectoryDriver(options.vfsRoot, { readOnly: !options.vfsWritable }), { prefetch: false })
+    : new LavaXVM(new LocalStorageDriver());
   tryReadFont(vm);
   return vm;
 }
@@ -254,6 +264,8 @@ export interface BoundedRunOptions {
   autoKeyDelayMs?: number;
   maxLogs?: number;
   maxEvents?: number;
+  /** Copy the .lav's sibling LavaData/ into /LavaData first (default true). */
+  preloadLavaData?: boolean;
 }
 
 export async function runVmBounded(vm: LavaXVM, options: BoundedRunOptions): Promise<BoundedRunResult> {
@@ -272,7 +284,11 @@ export async function runVmBounded(vm: LavaXVM, options: BoundedRunOptions): Pro
     }
     assert(program, 'runVmBounded requires either a program or lavPath');
 
-    await preloadSiblingLavaData(vm, options.lavPath);
+    if (options.preloadLavaData !== false) {
+      await preloadSiblingLavaData(vm, options.lavPath);
+    } else {
+      await vm.vfs.ready;
+    }
 
     vm.load(program);
 